@@ -238,6 +238,17 @@ public:
 		iter.owner=this;
 		return iter;
 	}
+	// Finds by an object of a different type that stands for a key, for example, a view of a bitmap.
+	// It saves making a temporary key object only for look up.  ysHash <QueryType> must give the same
+	// code as ysHash <KeyType> for equal keys, and query==key must be defined.
+	template <class QueryType>
+	iterator find_as(const QueryType &query) const
+	{
+		ysHash <QueryType> queryFunc;
+		auto iter=find_base<QueryType,decltype(table),iterator>(query,table,end(),queryFunc(query));
+		iter.owner=this;
+		return iter;
+	}
 
 	iterator begin(void) const
 	{
@@ -378,6 +389,17 @@ public:
 		iter.owner=this;
 		return iter;
 	}
+	// Finds by an object of a different type that stands for a key, for example, a view of a bitmap.
+	// It saves making a temporary key object only for look up.  ysHash <QueryType> must give the same
+	// code as ysHash <KeyType> for equal keys, and query==key must be defined.
+	template <class QueryType>
+	iterator find_as(const QueryType &query) const
+	{
+		ysHash <QueryType> queryFunc;
+		auto iter=find_base<QueryType,decltype(table),iterator>(query,table,end(),queryFunc(query));
+		iter.owner=this;
+		return iter;
+	}
 
 	iterator begin(void) const
 	{
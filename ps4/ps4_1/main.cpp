@@ -34,8 +34,14 @@ int main(int argc, char* argv[])
 		{
 			FILE* f;
 
-			// Create cropped instance of input image called "cut_img"
-			auto cut_img = bmp.CutOut(i, j, dim, dim);
+			// View of the tile.  No copy unless the tile sticks out of the image and needs padding.
+			SimpleBitmap edge_img;
+			auto cut_img = bmp.GetView(i, j, dim, dim);
+			if (cut_img.GetWidth() != dim || cut_img.GetHeight() != dim)
+			{
+				edge_img = bmp.CutOut(i, j, dim, dim);
+				cut_img = edge_img.GetView();
+			}
 
 			// Convert counter value to string type and append ".png" to create the name of image to be saved
 			std::string file_name = std::to_string(count) + ".png";
@@ -46,9 +52,15 @@ int main(int argc, char* argv[])
 			// Open for writing in binary mode. If the file exists, its contents are overwritten. 
 			// If the file does not exist, it will be created
 			f = fopen(name, "wb");
+			if (f == nullptr)
+			{
+				printf("\nError: Failed to open %s for writing.\n", name);
+				return 0;
+			}
 
 			// Save Image
 			cut_img.SavePng(f);
+			fclose(f);
 
 			// Increment counter for next cut out
 			count++;
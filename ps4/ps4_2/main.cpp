@@ -14,25 +14,40 @@ static int w = 1200;
 
 // Referencing from "test_hashtable.cpp"
 template<>
-struct ysHash<SimpleBitmap>
+struct ysHash<SimpleBitmapView>
 {
 	// std::size_t is by default a 64-bit unsigned integer.
-	std::size_t operator() (const SimpleBitmap& key) const
+	std::size_t operator() (const SimpleBitmapView& key) const
 	{
 		static unsigned int prime[7] = { 3,5,7,11,13,17,19};
 		std::size_t sum = 0;
 		int ctr = 0;
-		int nElement = key.GetTotalNumComponent();
-		auto itr = key.GetBitmapPointer();
-		for (int p = 0; p < nElement; p++)
+		int nElement = key.GetNumComponentPerLine();
+		// Bottom line first, which gives the code of the tile flipped upside down for glDrawPixels.
+		// The tiles are drawn in the order of the code.
+		for (int y = key.GetHeight() - 1; 0 <= y; y--)
 		{
-			sum += (itr[p] * prime[ctr % 7]); // as mentioned in PS4, it cannot be cyclic multiples of 4, hence 7 was selected
-			++ctr;
+			auto itr = key.GetPixelPointer(0, y);
+			for (int p = 0; p < nElement; p++)
+			{
+				sum += (itr[p] * prime[ctr % 7]); // as mentioned in PS4, it cannot be cyclic multiples of 4, hence 7 was selected
+				++ctr;
+			}
 		}
 		return sum;
 	}
 };
 
+// Same code as the view so that a tile can be looked up by a view without copying it.
+template<>
+struct ysHash<SimpleBitmap>
+{
+	std::size_t operator() (const SimpleBitmap& key) const
+	{
+		return ysHash<SimpleBitmapView>()(key.GetView());
+	}
+};
+
 int main(int argc, char* argv[])
 {
 	SimpleBitmap bmp;
@@ -57,19 +72,23 @@ int main(int argc, char* argv[])
 	{
 		for (int j = 0; j < bmp.GetWidth(); j += 40)
 		{
-			auto cut_img = bmp.CutOut(i, j, dim, dim);
-			
-			cut_img.Invert(); // alternatively bmp.Invert() can be done but outside nested loop
-
-			auto bmp = cut_img.GetBitmapPointer();
+			// Look up by a view.  A tile is copied only when it is new.
+			SimpleBitmap edge_img;
+			auto tile = bmp.GetView(i, j, dim, dim);
+			if (tile.GetWidth() != dim || tile.GetHeight() != dim)
+			{
+				// The tile sticks out of the image.  Make a copy padded with zero.
+				edge_img = bmp.CutOut(i, j, dim, dim);
+				tile = edge_img.GetView();
+			}
 
-			if (hash_table.find(cut_img) == hash_table.end())
+			auto ID_hash = hash_table.find_as(tile);
+			if (ID_hash == hash_table.end())
 			{
-				hash_table.insert(cut_img, count);
+				hash_table.insert(tile.CutOut(), count);
 				count++;
+				ID_hash = hash_table.find_as(tile);
 			}
-
-			auto ID_hash = hash_table.find(cut_img);
 			printf("\%c", ' ' + ID_hash->value);
 		}
 	}
@@ -87,7 +106,9 @@ int main(int argc, char* argv[])
 		int x_fin = x % x_new;
 
 		glRasterPos2i(x_fin * 40, y_fin * 40 + 20 - 1);
-		glDrawPixels(dim, dim, GL_RGBA, GL_UNSIGNED_BYTE, iterator->key.GetBitmapPointer());
+		SimpleBitmap tile_img = iterator->key;
+		tile_img.Invert(); // glDrawPixels draws bottom to top.
+		glDrawPixels(dim, dim, GL_RGBA, GL_UNSIGNED_BYTE, tile_img.GetBitmapPointer());
 
 		FsSwapBuffers();
 
@@ -1,9 +1,53 @@
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "simplebitmap.h"
+#include "simplebitmaprawfile.h"
 #include "yspng.h"
 #include "yspngenc.h"
 
 
 
+/* Decodes into a bitmap made by Create, so that a loaded bitmap is aligned to BUFFER_ALIGNMENT
+   like any other, instead of taking over the rgba that YsRawPngDecoder allocates by new []. */
+class SimpleBitmapPngDecoder : public YsRawPngDecoder
+{
+public:
+	SimpleBitmap bmp;
+
+	virtual int PrepareOutput(void)
+	{
+		// Same rows as YsRawPngDecoder::PrepareOutput.  Too large an image is left to it to reject.
+		const int height=(int)hdr.height;
+		int y0=(rowY0<0 ? 0 : rowY0);
+		int y1=(rowY1<0 || height<rowY1 ? height : rowY1);
+		y0=(y1<y0 ? y1 : y0);
+		bmp.CleanUp();
+		if(0<hdr.width && hdr.height<=0x7fffffff/4/hdr.width && 0<y1-y0 && true==bmp.Create((int)hdr.width,y1-y0))
+		{
+			SetOutputBuffer(bmp.GetEditableBitmapPointer(),bmp.GetWidth(),bmp.GetHeight(),bmp.GetPitchInBytes());
+		}
+		else
+		{
+			SetOutputBuffer(nullptr,0,0,0);
+		}
+		return YsRawPngDecoder::PrepareOutput();
+	}
+
+	/*! Moves the decoded image to the bitmap. */
+	void MoveTo(SimpleBitmap &to)
+	{
+		if(nullptr!=rgba)
+		{
+			to.MoveFrom(*this);
+		}
+		else
+		{
+			to.MoveFrom(bmp);
+		}
+	}
+};
+
 SimpleBitmap::SimpleBitmap(const SimpleBitmap &incoming)
 {
 	CopyFrom(incoming);
@@ -24,24 +68,142 @@ SimpleBitmap &SimpleBitmap::operator=(SimpleBitmap &&incoming)
 }
 bool SimpleBitmap::LoadPng(const char fn[])
 {
-	YsRawPngDecoder decoder;
+	SimpleBitmapPngDecoder decoder;
 	if(YSOK==decoder.Decode(fn))
 	{
-		MoveFrom(decoder);
+		decoder.MoveTo(*this);
 		return true;
 	}
 	return false;
 }
 bool SimpleBitmap::LoadPng(FILE *fp)
 {
-	YsRawPngDecoder decoder;
+	SimpleBitmapPngDecoder decoder;
 	if(YSOK==decoder.Decode(fp))
 	{
-		MoveFrom(decoder);
+		decoder.MoveTo(*this);
+		return true;
+	}
+	return false;
+}
+bool SimpleBitmap::LoadPng(const char fn[],int y0,int y1,bool bottomUp)
+{
+	SimpleBitmapPngDecoder decoder;
+	decoder.SetRowRange(y0,y1);
+	decoder.SetBottomUp(bottomUp);
+	if(YSOK==decoder.Decode(fn))
+	{
+		decoder.MoveTo(*this);
 		return true;
 	}
 	return false;
 }
+bool SimpleBitmap::LoadPngInPlace(const char fn[],int y0,int y1,bool bottomUp)
+{
+	unsigned char *buf=GetEditableBitmapPointer();
+	if(nullptr==buf)  // The decoder would allocate its own buffer.
+	{
+		return false;
+	}
+	YsRawPngDecoder decoder;
+	decoder.SetRowRange(y0,y1);
+	decoder.SetBottomUp(bottomUp);
+	decoder.SetOutputBuffer(buf,GetWidth(),GetHeight(),GetPitchInBytes());
+	return YSOK==decoder.Decode(fn);
+}
+/* Shared by the threads of LoadPngBatch.  The files are taken one at a time from nextFile,
+   so that a thread that got small files takes more of them. */
+class SimpleBitmapBatchLoader
+{
+public:
+	const std::vector <std::string> *fn;
+	std::atomic <int> nextFile,nLoaded;
+
+	std::vector <SimpleBitmapLoadResult> *result;   // For the ordered version.  Otherwise nullptr.
+	void (*callback)(void *context,SimpleBitmapLoadResult &result);
+	void *context;
+	std::mutex callbackLock;
+
+	SimpleBitmapBatchLoader() : fn(nullptr),nextFile(0),nLoaded(0),result(nullptr),callback(nullptr),context(nullptr){}
+
+	int Run(int nThread);
+	static void RunThread(SimpleBitmapBatchLoader *loader);
+};
+
+int SimpleBitmapBatchLoader::Run(int nThread)
+{
+	if(nThread<=0)
+	{
+		nThread=(int)std::thread::hardware_concurrency();
+	}
+	nThread=((int)fn->size()<nThread ? (int)fn->size() : nThread);
+
+	std::vector <std::thread> threads;
+	for(int i=1; i<nThread; ++i)
+	{
+		threads.push_back(std::thread(RunThread,this));
+	}
+	RunThread(this);
+	for(auto &t : threads)
+	{
+		t.join();
+	}
+	return nLoaded;
+}
+
+void SimpleBitmapBatchLoader::RunThread(SimpleBitmapBatchLoader *loader)
+{
+	SimpleBitmapPngDecoder decoder;
+	for(;;)
+	{
+		const int index=loader->nextFile++;
+		if((int)loader->fn->size()<=index)
+		{
+			break;
+		}
+
+		SimpleBitmapLoadResult local;
+		SimpleBitmapLoadResult &res=(nullptr!=loader->result ? (*loader->result)[index] : local);
+		res.index=index;
+		res.loaded=(YSOK==decoder.Decode((*loader->fn)[index].c_str()));
+		if(true==res.loaded)
+		{
+			decoder.MoveTo(res.bmp);
+			++loader->nLoaded;
+		}
+
+		if(nullptr!=loader->callback)
+		{
+			std::lock_guard <std::mutex> lock(loader->callbackLock);
+			(*loader->callback)(loader->context,res);
+		}
+	}
+}
+
+int SimpleBitmap::LoadPngBatch(std::vector <SimpleBitmapLoadResult> &result,const std::vector <std::string> &fn,int nThread)
+{
+	result.clear();
+	result.resize(fn.size());
+
+	SimpleBitmapBatchLoader loader;
+	loader.fn=&fn;
+	loader.result=&result;
+	return loader.Run(nThread);
+}
+
+int SimpleBitmap::LoadPngBatch(const std::vector <std::string> &fn,void (*callback)(void *context,SimpleBitmapLoadResult &result),void *context,int nThread)
+{
+	SimpleBitmapBatchLoader loader;
+	loader.fn=&fn;
+	loader.callback=callback;
+	loader.context=context;
+	return loader.Run(nThread);
+}
+
+bool SimpleBitmap::LoadRaw(const char fn[])
+{
+	return SimpleBitmapRawFile::Load(*this,fn);
+}
 SimpleBitmap &SimpleBitmap::operator=(class YsRawPngDecoder &&pngDecoder)
 {
 	return MoveFrom(pngDecoder);
@@ -63,63 +225,94 @@ SimpleBitmap SimpleBitmap::CutOut(int x0,int y0,int wid,int hei) const
 }
 void SimpleBitmap::Clear(unsigned char r,unsigned char g,unsigned char b,unsigned char a)
 {
-	auto rgba=GetEditableBitmapPointer();
-	auto numPix=GetWidth()*GetHeight();
-	for(int i=0; i<numPix; ++i)
-	{
-		rgba[i*4  ]=r;
-		rgba[i*4+1]=g;
-		rgba[i*4+2]=b;
-		rgba[i*4+3]=a;
-	}
+	const unsigned char rgba[4]={r,g,b,a};
+	FillPixel(0,0,GetWidth(),GetHeight(),rgba);
 }
 bool SimpleBitmap::SavePng(FILE *fp) const
 {
-	YsRawPngEncoder encoder;
-	if(YSOK==encoder.EncodeToFile(fp,GetWidth(),GetHeight(),8,6,GetBitmapPointer()))
-	{
-		return true;
-	}
-	return false;
+	return GetView().SavePng(fp);
+}
+bool SimpleBitmap::SaveRaw(FILE *fp) const
+{
+	return GetView().SaveRaw(fp);
+}
+SimpleBitmapView SimpleBitmap::GetView(void) const
+{
+	return SimpleBitmapView(*this);
+}
+SimpleBitmapView SimpleBitmap::GetView(int x0,int y0,int wid,int hei) const
+{
+	return SimpleBitmapTemplate <unsigned char,4>::GetView(x0,y0,wid,hei);
 }
 
 bool SimpleBitmap::operator==(const SimpleBitmap &bitmapB) const
 {
-	// Fill this function as a part of the assignment.
-	if (this->GetWidth() != bitmapB.GetWidth() || this->GetHeight() != bitmapB.GetHeight())
-	{
-		return false;
-	}
-	auto nElements = (GetWidth() * GetHeight() * 4);
-	auto BMrgba = GetBitmapPointer();
-	auto refBMrgba = bitmapB.GetBitmapPointer();
-	for (int i = 0; i < nElements; ++i)
-	{
-		if (BMrgba[i] != refBMrgba[i])
-		{
-			return false;
-		}
-	}
-	return true;
+	return GetView()==bitmapB.GetView();
 }
 
 bool SimpleBitmap::operator!=(const SimpleBitmap &bitmapB) const
 {
-	// Fill this function as a part of the assignment.
-	if (this->GetWidth() != bitmapB.GetWidth() || this->GetHeight() != bitmapB.GetHeight())
+	return !(*this == bitmapB);
+}
+
+bool SimpleBitmap::operator==(const SimpleBitmapView &viewB) const
+{
+	return GetView()==viewB;
+}
+
+bool SimpleBitmap::operator!=(const SimpleBitmapView &viewB) const
+{
+	return !(*this == viewB);
+}
+
+////////////////////////////////////////////////////////////
+
+SimpleBitmapView::SimpleBitmapView(const unsigned char *rgba,int wid,int hei,int pitch) :
+	SimpleBitmapViewTemplate <unsigned char,4>(rgba,wid,hei,pitch)
+{
+}
+SimpleBitmapView::SimpleBitmapView(const SimpleBitmapViewTemplate <unsigned char,4> &incoming) :
+	SimpleBitmapViewTemplate <unsigned char,4>(incoming)
+{
+}
+SimpleBitmapView::SimpleBitmapView(const SimpleBitmap &bmp) :
+	SimpleBitmapViewTemplate <unsigned char,4>(bmp.GetBitmapPointer(),bmp.GetWidth(),bmp.GetHeight(),bmp.GetPitch())
+{
+}
+SimpleBitmapView SimpleBitmapView::GetView(int x0,int y0,int wid,int hei) const
+{
+	return SimpleBitmapViewTemplate <unsigned char,4>::GetView(x0,y0,wid,hei);
+}
+SimpleBitmap SimpleBitmapView::CutOut(int x0,int y0,int wid,int hei) const
+{
+	SimpleBitmap cut;
+	cut.CutOutFrom(*this,x0,y0,wid,hei,0);
+	return cut;
+}
+SimpleBitmap SimpleBitmapView::CutOut(void) const
+{
+	SimpleBitmap cut;
+	cut.CopyFrom(*this);
+	return cut;
+}
+bool SimpleBitmapView::SavePng(FILE *fp) const
+{
+	YsRawPngEncoder encoder;
+	if(YSOK==encoder.EncodeToFile(fp,GetWidth(),GetHeight(),8,6,GetPixelPointer(0,0),GetPitchInBytes()))
 	{
 		return true;
 	}
-	auto nElements = (GetWidth() * GetHeight() * 4); // 4 RGBA components per pixel
-	auto BMrgba = GetBitmapPointer();
-	auto refBMrgba = bitmapB.GetBitmapPointer();
-	for (int i = 0; i < nElements; ++i)
-	{
-		if (BMrgba[i] != refBMrgba[i])
-		{
-			return true;
-		}
-	}
 	return false;
 }
-
+bool SimpleBitmapView::SaveRaw(FILE *fp) const
+{
+	return SimpleBitmapRawFile::Save(fp,*this);
+}
+bool SimpleBitmapView::operator==(const SimpleBitmap &bitmapB) const
+{
+	return *this==bitmapB.GetView();
+}
+bool SimpleBitmapView::operator!=(const SimpleBitmap &bitmapB) const
+{
+	return !(*this==bitmapB);
+}
@@ -3,8 +3,13 @@
 /* { */
 
 #include <stdio.h>
+#include <vector>
+#include <string>
 #include "simplebitmaptemplate.h"
 
+class SimpleBitmapView;
+class SimpleBitmapLoadResult;
+
 class SimpleBitmap : public SimpleBitmapTemplate <unsigned char,4>
 {
 public:
@@ -23,10 +28,11 @@ public:
 	SimpleBitmap(){}
 	~SimpleBitmap(){}
 
-	/*! Default copy constructor. */
+	/*! Copy constructor.  Takes constant time, because the copy shares the pixels with incoming
+	    until either of them is edited.  See SimpleBitmapTemplate::CopyFrom. */
 	SimpleBitmap(const SimpleBitmap &incoming);
 
-	/*! Default copy operator. */
+	/*! Copy operator.  Shares the pixels in the same way as the copy constructor. */
 	SimpleBitmap &operator=(const SimpleBitmap &from);
 
 	/*! Move-assignment constructor. */
@@ -41,6 +47,30 @@ public:
 	/*! fp must be opened with "rb". */
 	bool LoadPng(FILE *fp);
 
+	/*! Loads rows y0 to y1-1 of a PNG image.  y1<0 means the bottom of the image.  Unless the image is interlaced,
+	    decoding stops after row y1-1, so that a strip at the top of a tall image is quick to take out.
+	    If bottomUp is true, the rows are stored upside down, same as after Invert(). */
+	bool LoadPng(const char fn[],int y0,int y1,bool bottomUp);
+
+	/*! Same as LoadPng(fn,y0,y1,bottomUp), but the pixels are written to the buffer this bitmap already has,
+	    from the top-left corner.  Nothing is allocated.  The pixels outside of the decoded area are not touched.
+	    Fails if the image is wider than this bitmap, or has more rows to decode than this bitmap. */
+	bool LoadPngInPlace(const char fn[],int y0,int y1,bool bottomUp);
+
+	/*! Loads PNG files in nThread threads.  result[i] is for fn[i].  Each thread takes the next file
+	    when it is done with one, and uses one decoder for all the files it takes.  If nThread is zero
+	    or negative, the number of hardware threads is used.  Returns the number of files loaded. */
+	static int LoadPngBatch(std::vector <SimpleBitmapLoadResult> &result,const std::vector <std::string> &fn,int nThread=0);
+
+	/*! Same as above, but each result is given to callback as soon as the file is loaded, in the order of
+	    completion, not in the order of fn.  callback is called from the worker threads, but one at a time.
+	    It can take the bitmap by moving it from result.bmp. */
+	static int LoadPngBatch(const std::vector <std::string> &fn,void (*callback)(void *context,SimpleBitmapLoadResult &result),void *context,int nThread=0);
+
+	/*! Maps a raw bitmap file made by SaveRaw, and uses its pixels without decoding or copying.
+	    An edit does not go back to the file.  See SimpleBitmapRawFile. */
+	bool LoadRaw(const char fn[]);
+
 	/*! Move-assignment operator from a YsRawPngDecoder object. */
 	SimpleBitmap &operator=(class YsRawPngDecoder &&pngDecoder);
 
@@ -50,6 +80,13 @@ public:
 	/*! Cut out a rectangular part of the bitmap, (x0,y0)-(x0+wid-1,y0+hei-1) and returns it. */
 	SimpleBitmap CutOut(int x0,int y0,int wid,int hei) const;
 
+	/*! Returns a view of the whole bitmap. */
+	SimpleBitmapView GetView(void) const;
+
+	/*! Returns a view of (x0,y0)-(x0+wid-1,y0+hei-1) without copying the pixels.
+	    The part outside of the bitmap is cut off. */
+	SimpleBitmapView GetView(int x0,int y0,int wid,int hei) const;
+
 public:
 	/*! Clears the bitmap with the given RGBA values. */
 	void Clear(unsigned char r,unsigned char g,unsigned char b,unsigned char a);
@@ -61,11 +98,72 @@ public:
 	    Common mistake is ending up with opening "w" mode.  This is good in Unix systems, but breaks in Windows. */
 	bool SavePng(FILE *fp) const;
 
+	/*! Saves the bitmap in the uncompressed raw bitmap format, which LoadRaw can map without decoding.
+	    The file must be opened in "wb" mode. */
+	bool SaveRaw(FILE *fp) const;
+
 	/*! Returns true if bitmapB is exactly same as this bitmap. */
 	bool operator==(const SimpleBitmap &bitmapB) const;
 
 	/*! Returns true if bitmapB is not same as this bitmap. */
 	bool operator!=(const SimpleBitmap &bitmapB) const;
+
+	/*! Returns true if the pixels referenced by viewB are exactly same as this bitmap. */
+	bool operator==(const SimpleBitmapView &viewB) const;
+
+	/*! Returns true if the pixels referenced by viewB are not same as this bitmap. */
+	bool operator!=(const SimpleBitmapView &viewB) const;
+};
+
+
+/*! Result of loading one file by SimpleBitmap::LoadPngBatch. */
+class SimpleBitmapLoadResult
+{
+public:
+	int index;      // Index to the file name.
+	bool loaded;    // false if the file could not be opened, or was not a PNG image that can be decoded.
+	SimpleBitmap bmp;
+
+	SimpleBitmapLoadResult() : index(-1),loaded(false){}
+};
+
+
+/*! Non-owning view of a rectangle of a SimpleBitmap.
+    Use it to hash, compare, or save a part of a bitmap without copying it.
+    Make a SimpleBitmap from it by CutOut only when the pixels need to be kept. */
+class SimpleBitmapView : public SimpleBitmapViewTemplate <unsigned char,4>
+{
+public:
+	using SimpleBitmapViewTemplate <unsigned char,4>::operator==;
+	using SimpleBitmapViewTemplate <unsigned char,4>::operator!=;
+
+	SimpleBitmapView(){}
+	SimpleBitmapView(const unsigned char *rgba,int wid,int hei,int pitch);
+	SimpleBitmapView(const SimpleBitmapViewTemplate <unsigned char,4> &incoming);
+
+	/*! A SimpleBitmap can be used wherever a view is expected. */
+	SimpleBitmapView(const SimpleBitmap &bmp);
+
+	/*! Returns a view of (x0,y0)-(x0+wid-1,y0+hei-1) of this view.  The part outside of this view is cut off. */
+	SimpleBitmapView GetView(int x0,int y0,int wid,int hei) const;
+
+	/*! Copies (x0,y0)-(x0+wid-1,y0+hei-1) of this view to a new bitmap.  Pixels outside of the view are zero. */
+	SimpleBitmap CutOut(int x0,int y0,int wid,int hei) const;
+
+	/*! Copies the pixels to a new bitmap. */
+	SimpleBitmap CutOut(void) const;
+
+	/*! Saves the pixels in .PNG format.  Same as SimpleBitmap::SavePng. */
+	bool SavePng(FILE *fp) const;
+
+	/*! Saves the pixels in the raw bitmap format.  Same as SimpleBitmap::SaveRaw. */
+	bool SaveRaw(FILE *fp) const;
+
+	/*! Returns true if the pixels are exactly same as bitmapB. */
+	bool operator==(const SimpleBitmap &bitmapB) const;
+
+	/*! Returns true if the pixels are not same as bitmapB. */
+	bool operator!=(const SimpleBitmap &bitmapB) const;
 };
 
 
@@ -0,0 +1,411 @@
+#include <string.h>
+#include <vector>
+#include <thread>
+#include "simplebitmapconvert.h"
+
+#if defined(__SSE2__) || (defined(_MSC_VER) && defined(_M_X64))
+	#define SIMPLEBITMAPCONVERT_SSE2
+	#include <emmintrin.h>
+#endif
+
+
+/* Runs func(dstLine,srcLine,wid) for every line.  Bands of lines go to threads if the image is large.
+   Pitches are in the number of components. */
+template <class DstComponentType,class SrcComponentType,class LineFunc>
+static void SimpleBitmapConvert_ForEachLine(
+    DstComponentType *dst,int dstPitch,const SrcComponentType *src,int srcPitch,int wid,int hei,int nThread,LineFunc func)
+{
+	if(nThread<=0)
+	{
+		nThread=(int)std::thread::hardware_concurrency();
+	}
+	// A thread is not worth it for less than 256K pixels.
+	while(1<nThread && (long long int)wid*hei<262144LL*nThread)
+	{
+		--nThread;
+	}
+
+	auto band=[=](int y0,int y1)
+	{
+		for(int y=y0; y<y1; ++y)
+		{
+			func(dst+(size_t)y*dstPitch,src+(size_t)y*srcPitch,wid);
+		}
+	};
+	std::vector <std::thread> threads;
+	for(int i=1; i<nThread; ++i)
+	{
+		threads.push_back(std::thread(band,hei*i/nThread,hei*(i+1)/nThread));
+	}
+	band(0,(1<nThread ? hei/nThread : hei));
+	for(auto &t : threads)
+	{
+		t.join();
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/* Line kernels.  The kernels that make smaller pixels can run in place (dst==src),
+   because every pixel is read before it is overwritten. */
+
+static inline unsigned char SimpleBitmapConvert_Luma(unsigned int r,unsigned int g,unsigned int b)
+{
+	return (unsigned char)((77*r+150*g+29*b+128)>>8);
+}
+
+static void SimpleBitmapConvert_RGBA8ToRGB8(unsigned char *dst,const unsigned char *src,int n)
+{
+	for(int i=0; i<n; ++i)
+	{
+		dst[i*3  ]=src[i*4  ];
+		dst[i*3+1]=src[i*4+1];
+		dst[i*3+2]=src[i*4+2];
+	}
+}
+
+static void SimpleBitmapConvert_RGBA8ToGray8(unsigned char *dst,const unsigned char *src,int n)
+{
+	int i=0;
+#ifdef SIMPLEBITMAPCONVERT_SSE2
+	// Eight pixels at a time.  _mm_madd_epi16 gives 77R+150G and 29B+0A of each pixel, and the two
+	// are added by shifting one onto the other.
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i weight=_mm_setr_epi16(77,150,29,0,77,150,29,0);
+	const __m128i round=_mm_set1_epi32(128);
+	auto luma4=[&](__m128i pix) -> __m128i
+	{
+		__m128i m0=_mm_madd_epi16(_mm_unpacklo_epi8(pix,zero),weight);
+		__m128i m1=_mm_madd_epi16(_mm_unpackhi_epi8(pix,zero),weight);
+		m0=_mm_add_epi32(m0,_mm_srli_epi64(m0,32));
+		m1=_mm_add_epi32(m1,_mm_srli_epi64(m1,32));
+		__m128i y=_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0),_mm_castsi128_ps(m1),_MM_SHUFFLE(2,0,2,0)));
+		return _mm_srli_epi32(_mm_add_epi32(y,round),8);
+	};
+	for(; i+8<=n; i+=8)
+	{
+		const __m128i p0=_mm_loadu_si128((const __m128i *)(src+i*4));
+		const __m128i p1=_mm_loadu_si128((const __m128i *)(src+i*4+16));
+		const __m128i y16=_mm_packs_epi32(luma4(p0),luma4(p1));
+		_mm_storel_epi64((__m128i *)(dst+i),_mm_packus_epi16(y16,y16));
+	}
+#endif
+	for(; i<n; ++i)
+	{
+		dst[i]=SimpleBitmapConvert_Luma(src[i*4],src[i*4+1],src[i*4+2]);
+	}
+}
+
+static void SimpleBitmapConvert_RGB8ToGray8(unsigned char *dst,const unsigned char *src,int n)
+{
+	for(int i=0; i<n; ++i)
+	{
+		dst[i]=SimpleBitmapConvert_Luma(src[i*3],src[i*3+1],src[i*3+2]);
+	}
+}
+
+static void SimpleBitmapConvert_RGB8ToRGBA8(unsigned char *dst,const unsigned char *src,int n)
+{
+	for(int i=0; i<n; ++i)
+	{
+		dst[i*4  ]=src[i*3  ];
+		dst[i*4+1]=src[i*3+1];
+		dst[i*4+2]=src[i*3+2];
+		dst[i*4+3]=255;
+	}
+}
+
+static void SimpleBitmapConvert_Gray8ToRGBA8(unsigned char *dst,const unsigned char *src,int n)
+{
+	int i=0;
+#ifdef SIMPLEBITMAPCONVERT_SSE2
+	// g0 g0 g1 g1 ... and g0 ff g1 ff ... interleaved by 16 bits make g0 g0 g0 ff g1 g1 g1 ff ...
+	const __m128i opaque=_mm_set1_epi8((char)0xff);
+	for(; i+16<=n; i+=16)
+	{
+		const __m128i g=_mm_loadu_si128((const __m128i *)(src+i));
+		const __m128i gg0=_mm_unpacklo_epi8(g,g),ga0=_mm_unpacklo_epi8(g,opaque);
+		const __m128i gg1=_mm_unpackhi_epi8(g,g),ga1=_mm_unpackhi_epi8(g,opaque);
+		_mm_storeu_si128((__m128i *)(dst+i*4   ),_mm_unpacklo_epi16(gg0,ga0));
+		_mm_storeu_si128((__m128i *)(dst+i*4+16),_mm_unpackhi_epi16(gg0,ga0));
+		_mm_storeu_si128((__m128i *)(dst+i*4+32),_mm_unpacklo_epi16(gg1,ga1));
+		_mm_storeu_si128((__m128i *)(dst+i*4+48),_mm_unpackhi_epi16(gg1,ga1));
+	}
+#endif
+	for(; i<n; ++i)
+	{
+		dst[i*4  ]=src[i];
+		dst[i*4+1]=src[i];
+		dst[i*4+2]=src[i];
+		dst[i*4+3]=255;
+	}
+}
+
+static void SimpleBitmapConvert_Gray8ToRGB8(unsigned char *dst,const unsigned char *src,int n)
+{
+	for(int i=0; i<n; ++i)
+	{
+		dst[i*3  ]=src[i];
+		dst[i*3+1]=src[i];
+		dst[i*3+2]=src[i];
+	}
+}
+
+static void SimpleBitmapConvert_RGBA8ToRGBAF(float *dst,const unsigned char *src,int n)
+{
+	const float scale=1.0f/255.0f;
+	int i=0;
+#ifdef SIMPLEBITMAPCONVERT_SSE2
+	const __m128i zero=_mm_setzero_si128();
+	const __m128 scale4=_mm_set1_ps(scale);
+	for(; i+4<=n; i+=4)
+	{
+		const __m128i p=_mm_loadu_si128((const __m128i *)(src+i*4));
+		const __m128i lo=_mm_unpacklo_epi8(p,zero),hi=_mm_unpackhi_epi8(p,zero);
+		_mm_storeu_ps(dst+i*4   ,_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo,zero)),scale4));
+		_mm_storeu_ps(dst+i*4+ 4,_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo,zero)),scale4));
+		_mm_storeu_ps(dst+i*4+ 8,_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi,zero)),scale4));
+		_mm_storeu_ps(dst+i*4+12,_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi,zero)),scale4));
+	}
+#endif
+	for(i*=4; i<n*4; ++i)
+	{
+		dst[i]=(float)src[i]*scale;
+	}
+}
+
+static void SimpleBitmapConvert_RGBAFToRGBA8(unsigned char *dst,const float *src,int n)
+{
+	int i=0;
+#ifdef SIMPLEBITMAPCONVERT_SSE2
+	// _mm_max_ps returns the second operand for NaN, therefore NaN becomes 0.
+	const __m128 scale=_mm_set1_ps(255.0f),half=_mm_set1_ps(0.5f);
+	const __m128 minValue=_mm_setzero_ps(),maxValue=_mm_set1_ps(255.0f);
+	auto toInt=[&](const float *ptr) -> __m128i
+	{
+		__m128 v=_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ptr),scale),half);
+		v=_mm_min_ps(_mm_max_ps(v,minValue),maxValue);
+		return _mm_cvttps_epi32(v);
+	};
+	for(; i+4<=n; i+=4)
+	{
+		const __m128i lo=_mm_packs_epi32(toInt(src+i*4),toInt(src+i*4+4));
+		const __m128i hi=_mm_packs_epi32(toInt(src+i*4+8),toInt(src+i*4+12));
+		_mm_storeu_si128((__m128i *)(dst+i*4),_mm_packus_epi16(lo,hi));
+	}
+#endif
+	for(i*=4; i<n*4; ++i)
+	{
+		float v=src[i]*255.0f+0.5f;
+		if(!(0.0f<v))
+		{
+			v=0.0f;
+		}
+		if(255.0f<v)
+		{
+			v=255.0f;
+		}
+		dst[i]=(unsigned char)v;
+	}
+}
+
+/* c*a/255 rounded to the nearest, without a division. */
+static inline unsigned char SimpleBitmapConvert_MulDiv255(unsigned int c,unsigned int a)
+{
+	const unsigned int t=c*a+128;
+	return (unsigned char)((t+(t>>8))>>8);
+}
+
+static void SimpleBitmapConvert_Premultiply(unsigned char *dst,const unsigned char *src,int n)
+{
+	int i=0;
+#ifdef SIMPLEBITMAPCONVERT_SSE2
+	// Same as SimpleBitmapConvert_MulDiv255 in 16-bit lanes.  The multiplier of A itself is 255,
+	// which keeps A as is.
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i alphaMultiplier=_mm_setr_epi16(0,0,0,255,0,0,0,255);
+	const __m128i round=_mm_set1_epi16(128);
+	auto premultiply2=[&](__m128i pix) -> __m128i
+	{
+		__m128i a=_mm_shufflehi_epi16(_mm_shufflelo_epi16(pix,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+		a=_mm_or_si128(_mm_and_si128(a,_mm_setr_epi16(-1,-1,-1,0,-1,-1,-1,0)),alphaMultiplier);
+		__m128i t=_mm_add_epi16(_mm_mullo_epi16(pix,a),round);
+		return _mm_srli_epi16(_mm_add_epi16(t,_mm_srli_epi16(t,8)),8);
+	};
+	for(; i+4<=n; i+=4)
+	{
+		const __m128i p=_mm_loadu_si128((const __m128i *)(src+i*4));
+		const __m128i lo=premultiply2(_mm_unpacklo_epi8(p,zero));
+		const __m128i hi=premultiply2(_mm_unpackhi_epi8(p,zero));
+		_mm_storeu_si128((__m128i *)(dst+i*4),_mm_packus_epi16(lo,hi));
+	}
+#endif
+	for(; i<n; ++i)
+	{
+		const unsigned int a=src[i*4+3];
+		dst[i*4  ]=SimpleBitmapConvert_MulDiv255(src[i*4  ],a);
+		dst[i*4+1]=SimpleBitmapConvert_MulDiv255(src[i*4+1],a);
+		dst[i*4+2]=SimpleBitmapConvert_MulDiv255(src[i*4+2],a);
+		dst[i*4+3]=(unsigned char)a;
+	}
+}
+
+static void SimpleBitmapConvert_Unpremultiply(unsigned char *dst,const unsigned char *src,int n)
+{
+	// reciprocal[a] is 255/a in 16.16 fixed point.
+	static const struct Reciprocal
+	{
+		unsigned int value[256];
+		Reciprocal()
+		{
+			value[0]=0;
+			for(unsigned int a=1; a<256; ++a)
+			{
+				value[a]=((255u<<16)+a/2)/a;
+			}
+		}
+	} reciprocal;
+
+	for(int i=0; i<n; ++i)
+	{
+		const unsigned int a=src[i*4+3];
+		const unsigned int r=reciprocal.value[a];
+		for(int c=0; c<3; ++c)
+		{
+			const unsigned int v=(src[i*4+c]*r+32768)>>16;
+			dst[i*4+c]=(unsigned char)(255<v ? 255 : v);
+		}
+		dst[i*4+3]=(unsigned char)a;
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/* static */ void SimpleBitmapConvert::Convert(RGB8 &dst,const RGBA8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_RGBA8ToRGB8);
+}
+/* static */ void SimpleBitmapConvert::Convert(Gray8 &dst,const RGBA8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_RGBA8ToGray8);
+}
+/* static */ void SimpleBitmapConvert::Convert(RGBAF &dst,const RGBA8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_RGBA8ToRGBAF);
+}
+/* static */ void SimpleBitmapConvert::Convert(RGBA8 &dst,const RGB8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_RGB8ToRGBA8);
+}
+/* static */ void SimpleBitmapConvert::Convert(Gray8 &dst,const RGB8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_RGB8ToGray8);
+}
+/* static */ void SimpleBitmapConvert::Convert(RGBA8 &dst,const Gray8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_Gray8ToRGBA8);
+}
+/* static */ void SimpleBitmapConvert::Convert(RGB8 &dst,const Gray8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_Gray8ToRGB8);
+}
+/* static */ void SimpleBitmapConvert::Convert(RGBA8 &dst,const RGBAFView &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_RGBAFToRGBA8);
+}
+
+/* static */ void SimpleBitmapConvert::Premultiply(RGBA8 &dst,const RGBA8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_Premultiply);
+}
+/* static */ void SimpleBitmapConvert::Unpremultiply(RGBA8 &dst,const RGBA8View &src,int nThread)
+{
+	dst.Create(src.GetWidth(),src.GetHeight());
+	SimpleBitmapConvert_ForEachLine(dst.GetEditableBitmapPointer(),dst.GetPitch(),src.GetPixelPointer(0,0),src.GetPitch(),src.GetWidth(),src.GetHeight(),nThread,SimpleBitmapConvert_Unpremultiply);
+}
+/* static */ void SimpleBitmapConvert::Premultiply(RGBA8 &bmp,int nThread)
+{
+	auto ptr=bmp.GetEditableBitmapPointer();
+	SimpleBitmapConvert_ForEachLine(ptr,bmp.GetPitch(),ptr,bmp.GetPitch(),bmp.GetWidth(),bmp.GetHeight(),nThread,SimpleBitmapConvert_Premultiply);
+}
+/* static */ void SimpleBitmapConvert::Unpremultiply(RGBA8 &bmp,int nThread)
+{
+	auto ptr=bmp.GetEditableBitmapPointer();
+	SimpleBitmapConvert_ForEachLine(ptr,bmp.GetPitch(),ptr,bmp.GetPitch(),bmp.GetWidth(),bmp.GetHeight(),nThread,SimpleBitmapConvert_Unpremultiply);
+}
+
+/* static */ void SimpleBitmapConvert::ConvertInPlace(RGB8 &dst,RGBA8 &src,int nThread)
+{
+	const int wid=src.GetWidth(),hei=src.GetHeight(),pitch=src.GetPitch();
+	auto ptr=src.GetEditableBitmapPointer();
+	SimpleBitmapConvert_ForEachLine(ptr,pitch,ptr,pitch,wid,hei,nThread,SimpleBitmapConvert_RGBA8ToRGB8);
+	dst.TakeBufferFrom(src,wid,hei,pitch);
+}
+/* static */ void SimpleBitmapConvert::ConvertInPlace(Gray8 &dst,RGBA8 &src,int nThread)
+{
+	const int wid=src.GetWidth(),hei=src.GetHeight(),pitch=src.GetPitch();
+	auto ptr=src.GetEditableBitmapPointer();
+	SimpleBitmapConvert_ForEachLine(ptr,pitch,ptr,pitch,wid,hei,nThread,SimpleBitmapConvert_RGBA8ToGray8);
+	dst.TakeBufferFrom(src,wid,hei,pitch);
+}
+/* static */ void SimpleBitmapConvert::ConvertInPlace(Gray8 &dst,RGB8 &src,int nThread)
+{
+	const int wid=src.GetWidth(),hei=src.GetHeight(),pitch=src.GetPitch();
+	auto ptr=src.GetEditableBitmapPointer();
+	SimpleBitmapConvert_ForEachLine(ptr,pitch,ptr,pitch,wid,hei,nThread,SimpleBitmapConvert_RGB8ToGray8);
+	dst.TakeBufferFrom(src,wid,hei,pitch);
+}
+
+/* static */ bool SimpleBitmapConvert::IsOpaque(const RGBA8View &src)
+{
+	for(int y=0; y<src.GetHeight(); ++y)
+	{
+		auto ptr=src.GetPixelPointer(0,y);
+		int x=0;
+#ifdef SIMPLEBITMAPCONVERT_SSE2
+		// R, G, and B are set to 255 so that only A can make a difference.
+		const __m128i colorMask=_mm_set1_epi32(0x00ffffff),allOne=_mm_set1_epi8((char)0xff);
+		for(; x+4<=src.GetWidth(); x+=4)
+		{
+			const __m128i p=_mm_loadu_si128((const __m128i *)(ptr+x*4));
+			if(0xffff!=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(p,colorMask),allOne)))
+			{
+				return false;
+			}
+		}
+#endif
+		for(; x<src.GetWidth(); ++x)
+		{
+			if(255!=ptr[x*4+3])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/* static */ bool SimpleBitmapConvert::IsGray(const RGBA8View &src)
+{
+	for(int y=0; y<src.GetHeight(); ++y)
+	{
+		auto ptr=src.GetPixelPointer(0,y);
+		for(int x=0; x<src.GetWidth(); ++x)
+		{
+			if(ptr[x*4]!=ptr[x*4+1] || ptr[x*4]!=ptr[x*4+2] || 255!=ptr[x*4+3])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,69 @@
+#ifndef SIMPLEBITMAPCONVERT_24783_IS_INCLUDED
+#define SIMPLEBITMAPCONVERT_24783_IS_INCLUDED
+/* { */
+
+#include "simplebitmaptemplate.h"
+
+/*! Conversions between the pixel formats.
+
+        RGBA8    SimpleBitmapTemplate <unsigned char,4>, and SimpleBitmap
+        RGB8     SimpleBitmapTemplate <unsigned char,3>
+        Gray8    SimpleBitmapTemplate <unsigned char,1>
+        RGBAF    SimpleBitmapTemplate <float,4>, 0.0 to 1.0
+        Premultiplied RGBA8, in which R, G, and B are already multiplied by A/255.
+
+    Gray is the Rec. 601 luma, (77R+150G+29B)/256.  Alpha is dropped when going to RGB8 or Gray8,
+    and is 255 when coming from them.  The source is given as a view, for example, bmp.GetView().
+
+    The lines are split over nThread threads for a large image.  If nThread is zero or negative,
+    the number of hardware threads is used.  SSE2 is used where available.
+
+    The in-place versions convert to a format with fewer bytes per pixel in the buffer of the source.
+    They save allocating and touching a second buffer, but the buffer keeps the original size,
+    and the lines keep the original pitch in bytes.  To cut memory, use the versions that make a copy.
+*/
+class SimpleBitmapConvert
+{
+public:
+	typedef SimpleBitmapTemplate <unsigned char,4> RGBA8;
+	typedef SimpleBitmapTemplate <unsigned char,3> RGB8;
+	typedef SimpleBitmapTemplate <unsigned char,1> Gray8;
+	typedef SimpleBitmapTemplate <float,4> RGBAF;
+	typedef SimpleBitmapViewTemplate <unsigned char,4> RGBA8View;
+	typedef SimpleBitmapViewTemplate <unsigned char,3> RGB8View;
+	typedef SimpleBitmapViewTemplate <unsigned char,1> Gray8View;
+	typedef SimpleBitmapViewTemplate <float,4> RGBAFView;
+
+	static void Convert(RGB8 &dst,const RGBA8View &src,int nThread=0);
+	static void Convert(Gray8 &dst,const RGBA8View &src,int nThread=0);
+	static void Convert(RGBAF &dst,const RGBA8View &src,int nThread=0);
+	static void Convert(RGBA8 &dst,const RGB8View &src,int nThread=0);
+	static void Convert(Gray8 &dst,const RGB8View &src,int nThread=0);
+	static void Convert(RGBA8 &dst,const Gray8View &src,int nThread=0);
+	static void Convert(RGB8 &dst,const Gray8View &src,int nThread=0);
+
+	/*! Components are clamped to 0.0 to 1.0, and rounded to the nearest. */
+	static void Convert(RGBA8 &dst,const RGBAFView &src,int nThread=0);
+
+	/*! Multiplies R, G, and B by A/255, rounded to the nearest. */
+	static void Premultiply(RGBA8 &dst,const RGBA8View &src,int nThread=0);
+	/*! Divides R, G, and B by A/255.  The pixels of A=0 become all zero.
+	    The precision lost by Premultiply does not come back. */
+	static void Unpremultiply(RGBA8 &dst,const RGBA8View &src,int nThread=0);
+
+	static void Premultiply(RGBA8 &bmp,int nThread=0);
+	static void Unpremultiply(RGBA8 &bmp,int nThread=0);
+
+	/*! In-place conversions.  src becomes empty, and dst takes its buffer. */
+	static void ConvertInPlace(RGB8 &dst,RGBA8 &src,int nThread=0);
+	static void ConvertInPlace(Gray8 &dst,RGBA8 &src,int nThread=0);
+	static void ConvertInPlace(Gray8 &dst,RGB8 &src,int nThread=0);
+
+	/*! Returns true if A of all pixels is 255, that is, the bitmap can be stored as RGB8 without a loss. */
+	static bool IsOpaque(const RGBA8View &src);
+	/*! Returns true if R=G=B and A=255 for all pixels, that is, the bitmap can be stored as Gray8 without a loss. */
+	static bool IsGray(const RGBA8View &src);
+};
+
+/* } */
+#endif
@@ -0,0 +1,497 @@
+#ifndef SIMPLEBITMAPFILTERPIPELINE_24783_IS_INCLUDED
+#define SIMPLEBITMAPFILTERPIPELINE_24783_IS_INCLUDED
+/* { */
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include "simplebitmaptemplate.h"
+
+/*! Chain of neighborhood filters that runs in one pass over tiles.
+
+    Each tile is read from the source with enough margin (halo) for all the stages, and then the
+    stages are applied one after another on small tile buffers.  Therefore, no full-size
+    intermediate image is made, and the working set stays in the cache.  The tiles are
+    distributed over threads by SimpleBitmapResample_RunBands, so that this header does not
+    include <thread>.
+
+    The pixels outside of the image are the nearest pixels on the edge, for the source and for
+    every intermediate result.  Therefore, the result is the same as applying the stages one by one
+    on the whole image, except that the intermediate values are kept in float and not rounded.
+
+    All components are filtered in the same way, including alpha.
+
+        SimpleBitmapFilterPipeline <unsigned char,4> pipeline;
+        pipeline.AddBoxBlur(2);
+        pipeline.AddSobel();
+        pipeline.Apply(edge,bmp.GetView());
+*/
+template <class ComponentType,int NumComponentPerPixel>
+class SimpleBitmapFilterPipeline
+{
+public:
+	enum
+	{
+		DEFAULT_TILE_SIZE=128
+	};
+
+private:
+	enum
+	{
+		STAGE_CONVOLUTION,
+		STAGE_BOXBLUR,
+		STAGE_SOBEL,
+		STAGE_SHARPEN
+	};
+	class Stage
+	{
+	public:
+		int type;
+		int halo;
+		std::vector <float> hKernel,vKernel;
+		float amount;
+	};
+
+	/* Float pixels of (x0,y0)-(x0+wid-1,y0+hei-1) in the image coordinate. */
+	class TileBuffer
+	{
+	public:
+		int x0,y0,wid,hei;
+		std::vector <float> value;
+
+		void Resize(int x0,int y0,int wid,int hei)
+		{
+			this->x0=x0;
+			this->y0=y0;
+			this->wid=wid;
+			this->hei=hei;
+			value.resize((size_t)wid*hei*NumComponentPerPixel);
+		}
+		float *Line(int y)
+		{
+			return value.data()+(size_t)(y-y0)*wid*NumComponentPerPixel;
+		}
+		const float *Line(int y) const
+		{
+			return value.data()+(size_t)(y-y0)*wid*NumComponentPerPixel;
+		}
+		float *Pixel(int x,int y)
+		{
+			return Line(y)+(x-x0)*NumComponentPerPixel;
+		}
+		const float *Pixel(int x,int y) const
+		{
+			return Line(y)+(x-x0)*NumComponentPerPixel;
+		}
+	};
+
+	std::vector <Stage> stages;
+	int tileSize;
+
+public:
+	SimpleBitmapFilterPipeline()
+	{
+		tileSize=DEFAULT_TILE_SIZE;
+	}
+
+	/*! Removes all the stages. */
+	void Clear(void)
+	{
+		stages.clear();
+	}
+
+	/*! Returns the number of stages. */
+	int GetNumStage(void) const
+	{
+		return (int)stages.size();
+	}
+
+	/*! Returns the margin around a tile that needs to be read from the source. */
+	int GetHalo(void) const
+	{
+		int halo=0;
+		for(auto &s : stages)
+		{
+			halo+=s.halo;
+		}
+		return halo;
+	}
+
+	/*! Sets the width and height of a tile.  Too small a tile wastes time on the halo. */
+	void SetTileSize(int tileSize)
+	{
+		this->tileSize=(16<tileSize ? tileSize : 16);
+	}
+
+	/*! Adds a separable convolution.  The kernel is the outer product of vKernel and hKernel.
+	    Both must have an odd number of taps, and the center tap is at the middle.
+	    Returns false if the kernels are not acceptable. */
+	bool AddConvolution(const std::vector <float> &hKernel,const std::vector <float> &vKernel)
+	{
+		if(0==hKernel.size()%2 || 0==vKernel.size()%2)
+		{
+			return false;
+		}
+		Stage s;
+		s.type=STAGE_CONVOLUTION;
+		s.hKernel=hKernel;
+		s.vKernel=vKernel;
+		s.halo=(int)std::max(hKernel.size(),vKernel.size())/2;
+		s.amount=0.0f;
+		stages.push_back(s);
+		return true;
+	}
+
+	/*! Adds a Gaussian blur of the given standard deviation, as a separable convolution. */
+	bool AddGaussianBlur(float sigma)
+	{
+		if(sigma<=0.0f)
+		{
+			return false;
+		}
+		const int radius=(int)ceil(sigma*3.0f);
+		std::vector <float> kernel(radius*2+1);
+		float sum=0.0f;
+		for(int i=-radius; i<=radius; ++i)
+		{
+			kernel[i+radius]=exp(-(float)(i*i)/(2.0f*sigma*sigma));
+			sum+=kernel[i+radius];
+		}
+		for(auto &k : kernel)
+		{
+			k/=sum;
+		}
+		return AddConvolution(kernel,kernel);
+	}
+
+	/*! Adds an average over (2*radius+1)x(2*radius+1) pixels.  It is computed from the integral image
+	    of the tile, and therefore the cost per pixel does not depend on the radius. */
+	bool AddBoxBlur(int radius)
+	{
+		if(radius<=0)
+		{
+			return false;
+		}
+		Stage s;
+		s.type=STAGE_BOXBLUR;
+		s.halo=radius;
+		s.amount=0.0f;
+		stages.push_back(s);
+		return true;
+	}
+
+	/*! Adds the magnitude of the Sobel gradient, sqrt(Gx*Gx+Gy*Gy). */
+	void AddSobel(void)
+	{
+		Stage s;
+		s.type=STAGE_SOBEL;
+		s.halo=1;
+		s.amount=0.0f;
+		stages.push_back(s);
+	}
+
+	/*! Adds unsharp masking by a 3x3 binomial blur, in+amount*(in-blur). */
+	void AddSharpen(float amount)
+	{
+		Stage s;
+		s.type=STAGE_SHARPEN;
+		s.halo=1;
+		s.amount=amount;
+		stages.push_back(s);
+	}
+
+	/*! Makes dst the result of the stages applied to src.  src must not be a view of dst.
+	    If nThread is zero or negative, the number of hardware threads is used.
+	    Returns false if src is empty. */
+	bool Apply(SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &dst,const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &src,int nThread=0) const
+	{
+		if(src.GetWidth()<=0 || src.GetHeight()<=0)
+		{
+			return false;
+		}
+		dst.Create(src.GetWidth(),src.GetHeight());
+
+		const int nTileX=(src.GetWidth()+tileSize-1)/tileSize;
+		const int nTileY=(src.GetHeight()+tileSize-1)/tileSize;
+		const int nTile=nTileX*nTileY;
+
+		if(nThread<=0)
+		{
+			nThread=SimpleBitmapResample_GetNumHardwareThread();
+		}
+		if(nTile<nThread)
+		{
+			nThread=nTile;
+		}
+
+		Band band;
+		band.pipeline=this;
+		band.dst=&dst;
+		band.src=&src;
+		band.nTileX=nTileX;
+		band.nTile=nTile;
+		band.nBand=(1<nThread ? nThread : 1);
+		SimpleBitmapResample_RunBands(band.nBand,RunBand,&band);
+		return true;
+	}
+
+private:
+	class Band
+	{
+	public:
+		const SimpleBitmapFilterPipeline *pipeline;
+		SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> *dst;
+		const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> *src;
+		int nTileX,nTile,nBand;
+	};
+
+	/* Band b takes tiles b, b+nBand, b+2*nBand, ..., so that every band gets tiles from all over the image. */
+	static void RunBand(void *context,int b)
+	{
+		const Band &band=*(const Band *)context;
+		const int tileSize=band.pipeline->tileSize;
+		const int srcWid=band.src->GetWidth(),srcHei=band.src->GetHeight();
+		TileBuffer buf[3];
+		std::vector <double> integral;
+		for(int tile=b; tile<band.nTile; tile+=band.nBand)
+		{
+			const int x0=(tile%band.nTileX)*tileSize,y0=(tile/band.nTileX)*tileSize;
+			const int wid=std::min(tileSize,srcWid-x0),hei=std::min(tileSize,srcHei-y0);
+			band.pipeline->RunTile(*band.dst,*band.src,x0,y0,wid,hei,buf,integral);
+		}
+	}
+
+	void RunTile(
+	    SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &dst,const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &src,
+	    int x0,int y0,int wid,int hei,TileBuffer buf[],std::vector <double> &integral) const
+	{
+		int halo=GetHalo();
+		Load(buf[0],src,x0-halo,y0-halo,wid+halo*2,hei+halo*2);
+
+		int cur=0;
+		for(auto &s : stages)
+		{
+			halo-=s.halo;
+			auto &in=buf[cur];
+			auto &out=buf[1-cur];
+			out.Resize(x0-halo,y0-halo,wid+halo*2,hei+halo*2);
+			switch(s.type)
+			{
+			case STAGE_CONVOLUTION:
+				Convolve(out,in,s.hKernel,s.vKernel,buf[2]);
+				break;
+			case STAGE_BOXBLUR:
+				BoxBlur(out,in,s.halo,integral);
+				break;
+			case STAGE_SOBEL:
+				Sobel(out,in);
+				break;
+			case STAGE_SHARPEN:
+				Sharpen(out,in,s.amount);
+				break;
+			}
+			if(0<halo)
+			{
+				ReplicateEdge(out,src.GetWidth(),src.GetHeight());
+			}
+			cur=1-cur;
+		}
+		Store(dst,buf[cur]);
+	}
+
+	static void Load(TileBuffer &buf,const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &src,int x0,int y0,int wid,int hei)
+	{
+		buf.Resize(x0,y0,wid,hei);
+		const int inX0=std::max(x0,0),inX1=std::min(x0+wid,src.GetWidth());
+		for(int y=std::max(y0,0); y<std::min(y0+hei,src.GetHeight()); ++y)
+		{
+			auto srcPtr=src.GetPixelPointer(inX0,y);
+			auto dstPtr=buf.Pixel(inX0,y);
+			for(int i=0; i<(inX1-inX0)*NumComponentPerPixel; ++i)
+			{
+				dstPtr[i]=(float)srcPtr[i];
+			}
+		}
+		ReplicateEdge(buf,src.GetWidth(),src.GetHeight());
+	}
+
+	/* Overwrites the pixels outside of the image by the nearest pixels inside. */
+	static void ReplicateEdge(TileBuffer &buf,int imageWid,int imageHei)
+	{
+		const int inX0=std::max(buf.x0,0),inX1=std::min(buf.x0+buf.wid,imageWid);
+		const int inY0=std::max(buf.y0,0),inY1=std::min(buf.y0+buf.hei,imageHei);
+		for(int y=inY0; y<inY1; ++y)
+		{
+			for(int x=buf.x0; x<inX0; ++x)
+			{
+				std::copy(buf.Pixel(inX0,y),buf.Pixel(inX0,y)+NumComponentPerPixel,buf.Pixel(x,y));
+			}
+			for(int x=inX1; x<buf.x0+buf.wid; ++x)
+			{
+				std::copy(buf.Pixel(inX1-1,y),buf.Pixel(inX1-1,y)+NumComponentPerPixel,buf.Pixel(x,y));
+			}
+		}
+		const size_t lineLength=(size_t)buf.wid*NumComponentPerPixel;
+		for(int y=buf.y0; y<inY0; ++y)
+		{
+			std::copy(buf.Line(inY0),buf.Line(inY0)+lineLength,buf.Line(y));
+		}
+		for(int y=inY1; y<buf.y0+buf.hei; ++y)
+		{
+			std::copy(buf.Line(inY1-1),buf.Line(inY1-1)+lineLength,buf.Line(y));
+		}
+	}
+
+	static void Store(SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &dst,const TileBuffer &buf)
+	{
+		const int n=buf.wid*NumComponentPerPixel;
+		for(int y=buf.y0; y<buf.y0+buf.hei; ++y)
+		{
+			auto srcPtr=buf.Line(y);
+			auto dstPtr=dst.GetEditablePixelPointer(buf.x0,y);
+			for(int i=0; i<n; ++i)
+			{
+				dstPtr[i]=ToComponent(srcPtr[i],std::is_floating_point <ComponentType>());
+			}
+		}
+	}
+	static ComponentType ToComponent(float v,std::true_type)
+	{
+		return (ComponentType)v;
+	}
+	static ComponentType ToComponent(float v,std::false_type)
+	{
+		const float minValue=(float)std::numeric_limits <ComponentType>::min();
+		const float maxValue=(float)std::numeric_limits <ComponentType>::max();
+		v=(v<minValue ? minValue : (maxValue<v ? maxValue : v));
+		return (ComponentType)(0.0f<=v ? v+0.5f : v-0.5f);
+	}
+
+	/* Horizontal pass over the lines that the vertical pass needs, and then the vertical pass.
+	   Both inner loops run over contiguous floats. */
+	static void Convolve(TileBuffer &out,const TileBuffer &in,const std::vector <float> &hKernel,const std::vector <float> &vKernel,TileBuffer &tmp)
+	{
+		const int hr=(int)hKernel.size()/2,vr=(int)vKernel.size()/2;
+		const int n=out.wid*NumComponentPerPixel;
+
+		tmp.Resize(out.x0,out.y0-vr,out.wid,out.hei+vr*2);
+		for(int y=tmp.y0; y<tmp.y0+tmp.hei; ++y)
+		{
+			auto tmpPtr=tmp.Line(y);
+			for(int i=0; i<n; ++i)
+			{
+				tmpPtr[i]=0.0f;
+			}
+			for(int k=0; k<(int)hKernel.size(); ++k)
+			{
+				const float w=hKernel[k];
+				auto inPtr=in.Pixel(out.x0-hr+k,y);
+				for(int i=0; i<n; ++i)
+				{
+					tmpPtr[i]+=w*inPtr[i];
+				}
+			}
+		}
+		for(int y=out.y0; y<out.y0+out.hei; ++y)
+		{
+			auto outPtr=out.Line(y);
+			for(int i=0; i<n; ++i)
+			{
+				outPtr[i]=0.0f;
+			}
+			for(int k=0; k<(int)vKernel.size(); ++k)
+			{
+				const float w=vKernel[k];
+				auto tmpPtr=tmp.Line(y-vr+k);
+				for(int i=0; i<n; ++i)
+				{
+					outPtr[i]+=w*tmpPtr[i];
+				}
+			}
+		}
+	}
+
+	static void BoxBlur(TileBuffer &out,const TileBuffer &in,int radius,std::vector <double> &integral)
+	{
+		// integral[(y*(in.wid+1)+x)*N+c] is the sum of in over (in.x0,in.y0)-(in.x0+x-1,in.y0+y-1).
+		const int integralWid=in.wid+1;
+		integral.assign((size_t)integralWid*(in.hei+1)*NumComponentPerPixel,0.0);
+		for(int y=0; y<in.hei; ++y)
+		{
+			double rowSum[NumComponentPerPixel];
+			for(auto &r : rowSum)
+			{
+				r=0.0;
+			}
+			auto inPtr=in.Line(in.y0+y);
+			auto upPtr=integral.data()+(size_t)y*integralWid*NumComponentPerPixel;
+			auto curPtr=upPtr+integralWid*NumComponentPerPixel;
+			for(int x=0; x<in.wid; ++x)
+			{
+				for(int c=0; c<NumComponentPerPixel; ++c)
+				{
+					rowSum[c]+=inPtr[x*NumComponentPerPixel+c];
+					curPtr[(x+1)*NumComponentPerPixel+c]=upPtr[(x+1)*NumComponentPerPixel+c]+rowSum[c];
+				}
+			}
+		}
+
+		const int diameter=radius*2+1;
+		const double scale=1.0/(double)(diameter*diameter);
+		for(int y=out.y0; y<out.y0+out.hei; ++y)
+		{
+			const int iy=y-radius-in.y0;
+			auto topPtr=integral.data()+(size_t)iy*integralWid*NumComponentPerPixel;
+			auto bottomPtr=topPtr+(size_t)diameter*integralWid*NumComponentPerPixel;
+			auto outPtr=out.Line(y);
+			for(int x=0; x<out.wid; ++x)
+			{
+				const int ix0=(out.x0+x-radius-in.x0)*NumComponentPerPixel;
+				const int ix1=ix0+diameter*NumComponentPerPixel;
+				for(int c=0; c<NumComponentPerPixel; ++c)
+				{
+					const double sum=bottomPtr[ix1+c]-bottomPtr[ix0+c]-topPtr[ix1+c]+topPtr[ix0+c];
+					*outPtr++=(float)(sum*scale);
+				}
+			}
+		}
+	}
+
+	static void Sobel(TileBuffer &out,const TileBuffer &in)
+	{
+		const int n=out.wid*NumComponentPerPixel;
+		for(int y=out.y0; y<out.y0+out.hei; ++y)
+		{
+			auto up=in.Pixel(out.x0,y-1),mid=in.Pixel(out.x0,y),down=in.Pixel(out.x0,y+1);
+			auto outPtr=out.Line(y);
+			for(int i=0; i<n; ++i)
+			{
+				const int l=i-NumComponentPerPixel,r=i+NumComponentPerPixel;
+				const float gx=(up[r]-up[l])+2.0f*(mid[r]-mid[l])+(down[r]-down[l]);
+				const float gy=(down[l]-up[l])+2.0f*(down[i]-up[i])+(down[r]-up[r]);
+				outPtr[i]=sqrt(gx*gx+gy*gy);
+			}
+		}
+	}
+
+	static void Sharpen(TileBuffer &out,const TileBuffer &in,float amount)
+	{
+		const int n=out.wid*NumComponentPerPixel;
+		for(int y=out.y0; y<out.y0+out.hei; ++y)
+		{
+			auto up=in.Pixel(out.x0,y-1),mid=in.Pixel(out.x0,y),down=in.Pixel(out.x0,y+1);
+			auto outPtr=out.Line(y);
+			for(int i=0; i<n; ++i)
+			{
+				const int l=i-NumComponentPerPixel,r=i+NumComponentPerPixel;
+				const float blur=((up[l]+2.0f*up[i]+up[r])+2.0f*(mid[l]+2.0f*mid[i]+mid[r])+(down[l]+2.0f*down[i]+down[r]))/16.0f;
+				outPtr[i]=mid[i]+amount*(mid[i]-blur);
+			}
+		}
+	}
+};
+
+/* } */
+#endif
@@ -0,0 +1,342 @@
+#include <string.h>
+#include <vector>
+#include <thread>
+#include "simplebitmaporient.h"
+
+#if defined(__SSE2__) || (defined(_MSC_VER) && defined(_M_X64))
+	#define SIMPLEBITMAPORIENT_SSE2
+	#include <emmintrin.h>
+#endif
+
+
+/* Runs func(i0,i1) over bands of 0 to nItem-1.  Bands go to threads if the image is large.
+   Band boundaries are multiples of align, so that the threads do not write the same cache line
+   of the destination unless a line is shorter than a cache line. */
+template <class BandFunc>
+static void SimpleBitmapOrient_ForEachBand(int nItem,int align,long long int nPixel,int nThread,BandFunc func)
+{
+	if(nThread<=0)
+	{
+		nThread=(int)std::thread::hardware_concurrency();
+	}
+	// Moving pixels is memory bound.  A thread is not worth it for less than 256K pixels.
+	while(1<nThread && (nPixel<262144LL*nThread || nItem<align*nThread))
+	{
+		--nThread;
+	}
+
+	auto bandTop=[&](int i) -> int
+	{
+		return (i<nThread ? (int)((long long int)nItem*i/nThread/align*align) : nItem);
+	};
+	std::vector <std::thread> threads;
+	for(int i=1; i<nThread; ++i)
+	{
+		threads.push_back(std::thread(func,bandTop(i),bandTop(i+1)));
+	}
+	func(0,bandTop(1));
+	for(auto &t : threads)
+	{
+		t.join();
+	}
+}
+
+/* Expands call(PixelByte) with PixelByte fixed at compile time for the common pixel sizes,
+   so that memcpy of a pixel becomes a single move.  PixelByte=0 takes the size at run time. */
+#define SIMPLEBITMAPORIENT_DISPATCH(pixelByte,call) \
+	switch(pixelByte) \
+	{ \
+	case 1:  call(1);  break; \
+	case 2:  call(2);  break; \
+	case 3:  call(3);  break; \
+	case 4:  call(4);  break; \
+	case 6:  call(6);  break; \
+	case 8:  call(8);  break; \
+	case 12: call(12); break; \
+	case 16: call(16); break; \
+	default: call(0);  break; \
+	}
+
+template <size_t PixelByte>
+static inline void SimpleBitmapOrient_SwapPixel(unsigned char *a,unsigned char *b,size_t pixelByte)
+{
+	const size_t pb=(0<PixelByte ? PixelByte : pixelByte);
+	for(size_t k=0; k<pb; ++k)
+	{
+		unsigned char c=a[k];
+		a[k]=b[k];
+		b[k]=c;
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/* Transposes (x0,y0)-(x1-1,y1-1) of src. */
+template <size_t PixelByte>
+static void SimpleBitmapOrient_TransposeTile(
+    unsigned char *dst,ptrdiff_t dstPitch,const unsigned char *src,ptrdiff_t srcPitch,int x0,int y0,int x1,int y1,size_t pixelByte)
+{
+	const size_t pb=(0<PixelByte ? PixelByte : pixelByte);
+	for(int x=x0; x<x1; ++x)
+	{
+		auto dstPtr=dst+dstPitch*x+pb*y0;
+		auto srcPtr=src+srcPitch*y0+pb*x;
+		for(int y=y0; y<y1; ++y)
+		{
+			memcpy(dstPtr,srcPtr,pb);
+			dstPtr+=pb;
+			srcPtr+=srcPitch;
+		}
+	}
+}
+
+#ifdef SIMPLEBITMAPORIENT_SSE2
+/* 4x4 blocks of 4-byte pixels are transposed in registers.  Four lines of the source are read
+   and four lines of the destination are written 16 bytes at a time. */
+static void SimpleBitmapOrient_TransposeTile4SSE2(
+    unsigned char *dst,ptrdiff_t dstPitch,const unsigned char *src,ptrdiff_t srcPitch,int x0,int y0,int x1,int y1)
+{
+	const int x4=x0+(x1-x0)/4*4;
+	int y=y0;
+	for(; y+4<=y1; y+=4)
+	{
+		auto s0=src+srcPitch*y;
+		auto s1=s0+srcPitch;
+		auto s2=s1+srcPitch;
+		auto s3=s2+srcPitch;
+		for(int x=x0; x<x4; x+=4)
+		{
+			__m128i r0=_mm_loadu_si128((const __m128i *)(s0+4*x));  // a0 a1 a2 a3
+			__m128i r1=_mm_loadu_si128((const __m128i *)(s1+4*x));  // b0 b1 b2 b3
+			__m128i r2=_mm_loadu_si128((const __m128i *)(s2+4*x));  // c0 c1 c2 c3
+			__m128i r3=_mm_loadu_si128((const __m128i *)(s3+4*x));  // d0 d1 d2 d3
+			__m128i t0=_mm_unpacklo_epi32(r0,r1);                  // a0 b0 a1 b1
+			__m128i t1=_mm_unpacklo_epi32(r2,r3);                  // c0 d0 c1 d1
+			__m128i t2=_mm_unpackhi_epi32(r0,r1);                  // a2 b2 a3 b3
+			__m128i t3=_mm_unpackhi_epi32(r2,r3);                  // c2 d2 c3 d3
+			auto d=dst+dstPitch*x+4*y;
+			_mm_storeu_si128((__m128i *)d,_mm_unpacklo_epi64(t0,t1));
+			_mm_storeu_si128((__m128i *)(d+dstPitch),_mm_unpackhi_epi64(t0,t1));
+			_mm_storeu_si128((__m128i *)(d+2*dstPitch),_mm_unpacklo_epi64(t2,t3));
+			_mm_storeu_si128((__m128i *)(d+3*dstPitch),_mm_unpackhi_epi64(t2,t3));
+		}
+	}
+	// Right and bottom edges that do not make a 4x4 block.
+	SimpleBitmapOrient_TransposeTile <4> (dst,dstPitch,src,srcPitch,x4,y0,x1,y,4);
+	SimpleBitmapOrient_TransposeTile <4> (dst,dstPitch,src,srcPitch,x0,y,x1,y1,4);
+}
+#endif
+
+class SimpleBitmapOrient_Transposer
+{
+public:
+	unsigned char *dst;
+	ptrdiff_t dstPitch;
+	const unsigned char *src;
+	ptrdiff_t srcPitch;
+	int srcWid;
+	size_t pixelByte;
+
+	/* Transposes source lines y0 to y1-1, which become destination columns y0 to y1-1. */
+	template <size_t PixelByte>
+	void Run(int y0,int y1) const
+	{
+		for(int ty=y0; ty<y1; ty+=SimpleBitmapOrient::TILE_SIZE)
+		{
+			const int ty1=(ty+SimpleBitmapOrient::TILE_SIZE<y1 ? ty+SimpleBitmapOrient::TILE_SIZE : y1);
+			for(int tx=0; tx<srcWid; tx+=SimpleBitmapOrient::TILE_SIZE)
+			{
+				const int tx1=(tx+SimpleBitmapOrient::TILE_SIZE<srcWid ? tx+SimpleBitmapOrient::TILE_SIZE : srcWid);
+#ifdef SIMPLEBITMAPORIENT_SSE2
+				if(4==PixelByte)
+				{
+					SimpleBitmapOrient_TransposeTile4SSE2(dst,dstPitch,src,srcPitch,tx,ty,tx1,ty1);
+					continue;
+				}
+#endif
+				SimpleBitmapOrient_TransposeTile <PixelByte> (dst,dstPitch,src,srcPitch,tx,ty,tx1,ty1,pixelByte);
+			}
+		}
+	}
+};
+
+/* static */ void SimpleBitmapOrient::Transpose(
+    void *dst,ptrdiff_t dstPitchInBytes,
+    const void *src,ptrdiff_t srcPitchInBytes,int srcWid,int srcHei,size_t pixelByte,int nThread)
+{
+	SimpleBitmapOrient_Transposer transposer;
+	transposer.dst=(unsigned char *)dst;
+	transposer.dstPitch=dstPitchInBytes;
+	transposer.src=(const unsigned char *)src;
+	transposer.srcPitch=srcPitchInBytes;
+	transposer.srcWid=srcWid;
+	transposer.pixelByte=pixelByte;
+
+	// Bands of the source lines are bands of the destination columns.  Cut at tile boundaries.
+	SimpleBitmapOrient_ForEachBand(srcHei,TILE_SIZE,(long long int)srcWid*srcHei,nThread,[&](int y0,int y1)
+	{
+#define SIMPLEBITMAPORIENT_CALL(n) transposer.Run <n> (y0,y1)
+		SIMPLEBITMAPORIENT_DISPATCH(pixelByte,SIMPLEBITMAPORIENT_CALL);
+#undef SIMPLEBITMAPORIENT_CALL
+	});
+}
+
+////////////////////////////////////////////////////////////
+
+/* dst[i]=src[wid-1-i].  If dst==src, the line is reversed in place. */
+template <size_t PixelByte>
+static void SimpleBitmapOrient_ReverseLine(unsigned char *dst,const unsigned char *src,int wid,size_t pixelByte)
+{
+	const size_t pb=(0<PixelByte ? PixelByte : pixelByte);
+	if(dst==src)
+	{
+		for(int i=0,j=wid-1; i<j; ++i,--j)
+		{
+			SimpleBitmapOrient_SwapPixel <PixelByte> (dst+pb*i,dst+pb*j,pb);
+		}
+	}
+	else
+	{
+		for(int i=0; i<wid; ++i)
+		{
+			memcpy(dst+pb*i,src+pb*(wid-1-i),pb);
+		}
+	}
+}
+
+/* a[i] is swapped with b[wid-1-i] for all i.  a and b must be different lines. */
+template <size_t PixelByte>
+static void SimpleBitmapOrient_SwapReverseLine(unsigned char *a,unsigned char *b,int wid,size_t pixelByte)
+{
+	const size_t pb=(0<PixelByte ? PixelByte : pixelByte);
+	for(int i=0; i<wid; ++i)
+	{
+		SimpleBitmapOrient_SwapPixel <PixelByte> (a+pb*i,b+pb*(wid-1-i),pb);
+	}
+}
+
+#ifdef SIMPLEBITMAPORIENT_SSE2
+static inline __m128i SimpleBitmapOrient_Reverse4(__m128i v)
+{
+	return _mm_shuffle_epi32(v,_MM_SHUFFLE(0,1,2,3));
+}
+
+/* The in-place version takes four pixels from each end, and stops where the two ends would meet. */
+static void SimpleBitmapOrient_ReverseLine4SSE2(unsigned char *dst,const unsigned char *src,int wid)
+{
+	int i=0;
+	if(dst==src)
+	{
+		for(; i+4<=wid/2; i+=4)
+		{
+			__m128i left=_mm_loadu_si128((const __m128i *)(dst+4*i));
+			__m128i right=_mm_loadu_si128((const __m128i *)(dst+4*(wid-4-i)));
+			_mm_storeu_si128((__m128i *)(dst+4*i),SimpleBitmapOrient_Reverse4(right));
+			_mm_storeu_si128((__m128i *)(dst+4*(wid-4-i)),SimpleBitmapOrient_Reverse4(left));
+		}
+		for(int j=wid-1-i; i<j; ++i,--j)
+		{
+			SimpleBitmapOrient_SwapPixel <4> (dst+4*i,dst+4*j,4);
+		}
+	}
+	else
+	{
+		for(; i+4<=wid; i+=4)
+		{
+			__m128i v=_mm_loadu_si128((const __m128i *)(src+4*(wid-4-i)));
+			_mm_storeu_si128((__m128i *)(dst+4*i),SimpleBitmapOrient_Reverse4(v));
+		}
+		for(; i<wid; ++i)
+		{
+			memcpy(dst+4*i,src+4*(wid-1-i),4);
+		}
+	}
+}
+
+static void SimpleBitmapOrient_SwapReverseLine4SSE2(unsigned char *a,unsigned char *b,int wid)
+{
+	int i=0;
+	for(; i+4<=wid; i+=4)
+	{
+		__m128i va=_mm_loadu_si128((const __m128i *)(a+4*i));
+		__m128i vb=_mm_loadu_si128((const __m128i *)(b+4*(wid-4-i)));
+		_mm_storeu_si128((__m128i *)(a+4*i),SimpleBitmapOrient_Reverse4(vb));
+		_mm_storeu_si128((__m128i *)(b+4*(wid-4-i)),SimpleBitmapOrient_Reverse4(va));
+	}
+	for(; i<wid; ++i)
+	{
+		SimpleBitmapOrient_SwapPixel <4> (a+4*i,b+4*(wid-1-i),4);
+	}
+}
+#endif
+
+template <size_t PixelByte>
+static void SimpleBitmapOrient_ReverseLineDispatch(unsigned char *dst,const unsigned char *src,int wid,size_t pixelByte)
+{
+#ifdef SIMPLEBITMAPORIENT_SSE2
+	if(4==PixelByte)
+	{
+		SimpleBitmapOrient_ReverseLine4SSE2(dst,src,wid);
+		return;
+	}
+#endif
+	SimpleBitmapOrient_ReverseLine <PixelByte> (dst,src,wid,pixelByte);
+}
+
+template <size_t PixelByte>
+static void SimpleBitmapOrient_SwapReverseLineDispatch(unsigned char *a,unsigned char *b,int wid,size_t pixelByte)
+{
+#ifdef SIMPLEBITMAPORIENT_SSE2
+	if(4==PixelByte)
+	{
+		SimpleBitmapOrient_SwapReverseLine4SSE2(a,b,wid);
+		return;
+	}
+#endif
+	SimpleBitmapOrient_SwapReverseLine <PixelByte> (a,b,wid,pixelByte);
+}
+
+/* static */ void SimpleBitmapOrient::ReverseLines(
+    void *dst,ptrdiff_t dstPitchInBytes,
+    const void *src,ptrdiff_t srcPitchInBytes,int wid,int hei,size_t pixelByte,int nThread)
+{
+	auto dstPtr=(unsigned char *)dst;
+	auto srcPtr=(const unsigned char *)src;
+	SimpleBitmapOrient_ForEachBand(hei,1,(long long int)wid*hei,nThread,[&](int y0,int y1)
+	{
+		for(int y=y0; y<y1; ++y)
+		{
+#define SIMPLEBITMAPORIENT_CALL(n) SimpleBitmapOrient_ReverseLineDispatch <n> (dstPtr+dstPitchInBytes*y,srcPtr+srcPitchInBytes*y,wid,pixelByte)
+			SIMPLEBITMAPORIENT_DISPATCH(pixelByte,SIMPLEBITMAPORIENT_CALL);
+#undef SIMPLEBITMAPORIENT_CALL
+		}
+	});
+}
+
+/* static */ void SimpleBitmapOrient::Rotate180InPlace(void *ptr,ptrdiff_t pitchInBytes,int wid,int hei,size_t pixelByte,int nThread)
+{
+	// Line y and line hei-1-y are swapped and reversed together.  The middle line of an odd height
+	// is reversed by itself.
+	auto top=(unsigned char *)ptr;
+	const int nPair=(hei+1)/2;
+	SimpleBitmapOrient_ForEachBand(nPair,1,(long long int)wid*hei,nThread,[&](int y0,int y1)
+	{
+		for(int y=y0; y<y1; ++y)
+		{
+			auto a=top+pitchInBytes*y;
+			auto b=top+pitchInBytes*(hei-1-y);
+			if(a==b)
+			{
+#define SIMPLEBITMAPORIENT_CALL(n) SimpleBitmapOrient_ReverseLineDispatch <n> (a,a,wid,pixelByte)
+				SIMPLEBITMAPORIENT_DISPATCH(pixelByte,SIMPLEBITMAPORIENT_CALL);
+#undef SIMPLEBITMAPORIENT_CALL
+			}
+			else
+			{
+#define SIMPLEBITMAPORIENT_CALL(n) SimpleBitmapOrient_SwapReverseLineDispatch <n> (a,b,wid,pixelByte)
+				SIMPLEBITMAPORIENT_DISPATCH(pixelByte,SIMPLEBITMAPORIENT_CALL);
+#undef SIMPLEBITMAPORIENT_CALL
+			}
+		}
+	});
+}
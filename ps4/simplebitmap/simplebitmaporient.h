@@ -0,0 +1,44 @@
+#ifndef SIMPLEBITMAPORIENT_24783_IS_INCLUDED
+#define SIMPLEBITMAPORIENT_24783_IS_INCLUDED
+/* { */
+
+#include <stddef.h>
+
+/*! Kernels for SimpleBitmapTemplate::Transpose, Rotate90, Rotate180, Rotate270, and FlipHorizontal.
+
+    Pixels are moved as blocks of pixelByte bytes, therefore one set of kernels serves every
+    component type and number of components.  Pitches are in bytes and can be negative, which reads
+    or writes the lines bottom-up.  A rotation by 90 or 270 degrees is a transpose with one side
+    upside down.
+
+    The lines are split over nThread threads for a large image.  If nThread is zero or negative,
+    the number of hardware threads is used.
+*/
+class SimpleBitmapOrient
+{
+public:
+	/*! Pixels on a side of a tile of Transpose.  A tile of the source and a tile of the destination
+	    of 4-byte pixels fit in L1 cache together. */
+	enum
+	{
+		TILE_SIZE=64
+	};
+
+	/*! Writes the pixel at (x,y) of src to (y,x) of dst.  dst is srcHei x srcWid pixels.
+	    The image is transposed tile by tile, so that neither side is walked column by column across
+	    the whole image.  4-byte pixels are transposed 4x4 in SSE2 registers where available. */
+	static void Transpose(
+	    void *dst,ptrdiff_t dstPitchInBytes,
+	    const void *src,ptrdiff_t srcPitchInBytes,int srcWid,int srcHei,size_t pixelByte,int nThread=0);
+
+	/*! Writes every line of src to dst in the reverse order of the pixels.  dst may be src. */
+	static void ReverseLines(
+	    void *dst,ptrdiff_t dstPitchInBytes,
+	    const void *src,ptrdiff_t srcPitchInBytes,int wid,int hei,size_t pixelByte,int nThread=0);
+
+	/*! Rotates the image by 180 degrees in place. */
+	static void Rotate180InPlace(void *ptr,ptrdiff_t pitchInBytes,int wid,int hei,size_t pixelByte,int nThread=0);
+};
+
+/* } */
+#endif
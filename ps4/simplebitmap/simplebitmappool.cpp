@@ -0,0 +1,480 @@
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "simplebitmappool.h"
+
+
+static std::atomic <SimpleBitmapAllocator::AllocateFunc> SimpleBitmapAllocator_AllocateFunc(SimpleBitmapAllocator::DefaultAllocate);
+static std::atomic <SimpleBitmapAllocator::FreeFunc> SimpleBitmapAllocator_FreeFunc(SimpleBitmapAllocator::DefaultFree);
+
+/* static */ void SimpleBitmapAllocator::SetHook(AllocateFunc allocFunc,FreeFunc freeFunc)
+{
+	if(nullptr==allocFunc || nullptr==freeFunc)
+	{
+		allocFunc=DefaultAllocate;
+		freeFunc=DefaultFree;
+	}
+	SimpleBitmapAllocator_AllocateFunc.store(allocFunc);
+	SimpleBitmapAllocator_FreeFunc.store(freeFunc);
+}
+
+/* static */ SimpleBitmapAllocator::AllocateFunc SimpleBitmapAllocator::GetAllocateFunc(void)
+{
+	return SimpleBitmapAllocator_AllocateFunc.load(std::memory_order_relaxed);
+}
+
+/* static */ SimpleBitmapAllocator::FreeFunc SimpleBitmapAllocator::GetFreeFunc(void)
+{
+	return SimpleBitmapAllocator_FreeFunc.load(std::memory_order_relaxed);
+}
+
+/* static */ void *SimpleBitmapAllocator::DefaultAllocate(size_t nByte)
+{
+	// The pointer returned by new [] is kept right before the aligned buffer.
+	auto rawPtr=new unsigned char [nByte+ALIGNMENT+sizeof(void *)];
+	auto alignedAddr=((uintptr_t)rawPtr+sizeof(void *)+ALIGNMENT-1)&~(uintptr_t)(ALIGNMENT-1);
+	((unsigned char **)alignedAddr)[-1]=rawPtr;
+	return (void *)alignedAddr;
+}
+
+/* static */ void SimpleBitmapAllocator::DefaultFree(void *ptr)
+{
+	if(nullptr!=ptr)
+	{
+		delete [] ((unsigned char **)ptr)[-1];
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/* A pooled buffer has this header right before the aligned buffer. */
+class SimpleBitmapPool_BlockHeader
+{
+public:
+	unsigned char *rawPtr;
+	int sizeClass;   // -1 if not pooled.
+};
+
+/* Size classes from MIN_POOLED_SIZE to MAX_POOLED_SIZE, four per power of two. */
+class SimpleBitmapPool_SizeClassTable
+{
+public:
+	std::vector <size_t> classSize;
+
+	SimpleBitmapPool_SizeClassTable()
+	{
+		for(size_t base=SimpleBitmapPool::MIN_POOLED_SIZE; base<SimpleBitmapPool::MAX_POOLED_SIZE; base*=2)
+		{
+			for(size_t step=0; step<4; ++step)
+			{
+				classSize.push_back(base+base*step/4);
+			}
+		}
+		classSize.push_back(SimpleBitmapPool::MAX_POOLED_SIZE);
+	}
+	int GetNumClass(void) const
+	{
+		return (int)classSize.size();
+	}
+	/* Returns the smallest class that can hold nByte, or -1 if it is too large to pool. */
+	int Find(size_t nByte) const
+	{
+		auto found=std::lower_bound(classSize.begin(),classSize.end(),nByte);
+		return (found!=classSize.end() ? (int)(found-classSize.begin()) : -1);
+	}
+};
+
+static const SimpleBitmapPool_SizeClassTable &SimpleBitmapPool_GetSizeClassTable(void)
+{
+	// Never deleted for the same reason as SimpleBitmapPool_Shared below.
+	static const SimpleBitmapPool_SizeClassTable *table=new SimpleBitmapPool_SizeClassTable;
+	return *table;
+}
+
+static void *SimpleBitmapPool_SystemAllocate(size_t nByte,int sizeClass)
+{
+	const size_t headerRoom=SimpleBitmapAllocator::ALIGNMENT;  // Enough for the header, and keeps the alignment.
+	auto rawPtr=new unsigned char [nByte+headerRoom+SimpleBitmapAllocator::ALIGNMENT];
+	auto alignedAddr=((uintptr_t)rawPtr+headerRoom+SimpleBitmapAllocator::ALIGNMENT-1)&~(uintptr_t)(SimpleBitmapAllocator::ALIGNMENT-1);
+	auto header=(SimpleBitmapPool_BlockHeader *)alignedAddr-1;
+	header->rawPtr=rawPtr;
+	header->sizeClass=sizeClass;
+	return (void *)alignedAddr;
+}
+
+static SimpleBitmapPool_BlockHeader *SimpleBitmapPool_GetHeader(void *ptr)
+{
+	return (SimpleBitmapPool_BlockHeader *)ptr-1;
+}
+
+static void SimpleBitmapPool_SystemFree(void *ptr)
+{
+	delete [] SimpleBitmapPool_GetHeader(ptr)->rawPtr;
+}
+
+////////////////////////////////////////////////////////////
+
+/* Counters.  Each thread counts in its cache, and adds to these every so often,
+   so that the threads do not fight over the cache line of the counters. */
+class SimpleBitmapPool_Counter
+{
+public:
+	unsigned long long int nAllocate,nThreadCacheHit,nSharedPoolHit,nSystemAllocate,nFree;
+
+	SimpleBitmapPool_Counter()
+	{
+		Clear();
+	}
+	void Clear(void)
+	{
+		nAllocate=0;
+		nThreadCacheHit=0;
+		nSharedPoolHit=0;
+		nSystemAllocate=0;
+		nFree=0;
+	}
+};
+
+class SimpleBitmapPool_GlobalCounter
+{
+public:
+	std::atomic <unsigned long long int> nAllocate,nThreadCacheHit,nSharedPoolHit,nSystemAllocate,nFree;
+
+	SimpleBitmapPool_GlobalCounter() : nAllocate(0),nThreadCacheHit(0),nSharedPoolHit(0),nSystemAllocate(0),nFree(0)
+	{
+	}
+	void Add(SimpleBitmapPool_Counter &counter)
+	{
+		nAllocate.fetch_add(counter.nAllocate,std::memory_order_relaxed);
+		nThreadCacheHit.fetch_add(counter.nThreadCacheHit,std::memory_order_relaxed);
+		nSharedPoolHit.fetch_add(counter.nSharedPoolHit,std::memory_order_relaxed);
+		nSystemAllocate.fetch_add(counter.nSystemAllocate,std::memory_order_relaxed);
+		nFree.fetch_add(counter.nFree,std::memory_order_relaxed);
+		counter.Clear();
+	}
+};
+
+/* The shared pool and the counters are never deleted, because bitmaps in static variables
+   may be freed after the static variables of this file are gone. */
+class SimpleBitmapPool_Shared
+{
+public:
+	std::mutex lock;
+	std::vector <std::vector <void *> > freeList;
+	size_t nByte,limit;
+	SimpleBitmapPool_GlobalCounter counter;
+
+	SimpleBitmapPool_Shared() : nByte(0),limit(256*1024*1024)
+	{
+		freeList.resize(SimpleBitmapPool_GetSizeClassTable().GetNumClass());
+	}
+
+	/* Takes the ownership of ptr.  Returns it to the system if the pool is full. */
+	void Put(void *ptr,int sizeClass)
+	{
+		const size_t size=SimpleBitmapPool_GetSizeClassTable().classSize[sizeClass];
+		{
+			std::lock_guard <std::mutex> guard(lock);
+			if(nByte+size<=limit)
+			{
+				freeList[sizeClass].push_back(ptr);
+				nByte+=size;
+				return;
+			}
+		}
+		SimpleBitmapPool_SystemFree(ptr);
+	}
+	void *Take(int sizeClass)
+	{
+		std::lock_guard <std::mutex> guard(lock);
+		auto &list=freeList[sizeClass];
+		if(true!=list.empty())
+		{
+			auto ptr=list.back();
+			list.pop_back();
+			nByte-=SimpleBitmapPool_GetSizeClassTable().classSize[sizeClass];
+			return ptr;
+		}
+		return nullptr;
+	}
+	void Trim(void)
+	{
+		std::vector <void *> toFree;
+		{
+			std::lock_guard <std::mutex> guard(lock);
+			for(auto &list : freeList)
+			{
+				toFree.insert(toFree.end(),list.begin(),list.end());
+				list.clear();
+			}
+			nByte=0;
+		}
+		for(auto ptr : toFree)
+		{
+			SimpleBitmapPool_SystemFree(ptr);
+		}
+	}
+};
+
+static SimpleBitmapPool_Shared &SimpleBitmapPool_GetShared(void)
+{
+	static SimpleBitmapPool_Shared *shared=new SimpleBitmapPool_Shared;
+	return *shared;
+}
+
+class SimpleBitmapPool_ThreadCache
+{
+public:
+	enum
+	{
+		MAX_BYTE=16*1024*1024,   // Bytes kept by one thread.  Larger buffers go to the shared pool.
+		COUNTER_FLUSH_INTERVAL=256
+	};
+
+	std::vector <std::vector <void *> > freeList;
+	size_t nByte;
+	SimpleBitmapPool_Counter counter;
+
+	SimpleBitmapPool_ThreadCache() : nByte(0)
+	{
+		freeList.resize(SimpleBitmapPool_GetSizeClassTable().GetNumClass());
+		for(auto &list : freeList)
+		{
+			list.reserve(SimpleBitmapPool::THREAD_CACHE_PER_CLASS);
+		}
+	}
+	~SimpleBitmapPool_ThreadCache()
+	{
+		FlushToShared();
+		SimpleBitmapPool_GetShared().counter.Add(counter);
+	}
+	void FlushToShared(void)
+	{
+		for(int sizeClass=0; sizeClass<(int)freeList.size(); ++sizeClass)
+		{
+			for(auto ptr : freeList[sizeClass])
+			{
+				SimpleBitmapPool_GetShared().Put(ptr,sizeClass);
+			}
+			freeList[sizeClass].clear();
+		}
+		nByte=0;
+	}
+	void Trim(void)
+	{
+		for(auto &list : freeList)
+		{
+			for(auto ptr : list)
+			{
+				SimpleBitmapPool_SystemFree(ptr);
+			}
+			list.clear();
+		}
+		nByte=0;
+	}
+	void Count(void)
+	{
+		if(COUNTER_FLUSH_INTERVAL<=counter.nAllocate+counter.nFree)
+		{
+			SimpleBitmapPool_GetShared().counter.Add(counter);
+		}
+	}
+};
+
+/* Returns nullptr after the thread's cache is destroyed at the exit of the thread.
+   A bitmap freed after that goes to the shared pool. */
+static SimpleBitmapPool_ThreadCache *SimpleBitmapPool_GetThreadCache(void)
+{
+	class Holder
+	{
+	public:
+		SimpleBitmapPool_ThreadCache cache;
+		bool *destroyedFlag;
+		Holder(bool *destroyedFlag) : destroyedFlag(destroyedFlag)
+		{
+		}
+		~Holder()
+		{
+			*destroyedFlag=true;
+		}
+	};
+	static thread_local bool destroyed=false;
+	if(true==destroyed)
+	{
+		return nullptr;
+	}
+	static thread_local Holder holder(&destroyed);
+	return &holder.cache;
+}
+
+////////////////////////////////////////////////////////////
+
+SimpleBitmapPool::Statistics::Statistics()
+{
+	nAllocate=0;
+	nThreadCacheHit=0;
+	nSharedPoolHit=0;
+	nSystemAllocate=0;
+	nFree=0;
+	sharedPoolBytes=0;
+}
+
+double SimpleBitmapPool::Statistics::GetHitRate(void) const
+{
+	return (0<nAllocate ? (double)(nThreadCacheHit+nSharedPoolHit)/(double)nAllocate : 0.0);
+}
+
+/* static */ void SimpleBitmapPool::Install(void)
+{
+	SimpleBitmapAllocator::SetHook(Allocate,Free);
+}
+
+/* static */ void SimpleBitmapPool::Uninstall(void)
+{
+	SimpleBitmapAllocator::SetHook(nullptr,nullptr);
+}
+
+/* static */ void *SimpleBitmapPool::Allocate(size_t nByte)
+{
+	const auto &table=SimpleBitmapPool_GetSizeClassTable();
+	const int sizeClass=table.Find(nByte);
+	auto cache=SimpleBitmapPool_GetThreadCache();
+	SimpleBitmapPool_Counter localCounter;
+	auto &counter=(nullptr!=cache ? cache->counter : localCounter);
+
+	++counter.nAllocate;
+	void *ptr=nullptr;
+	if(0<=sizeClass)
+	{
+		if(nullptr!=cache && true!=cache->freeList[sizeClass].empty())
+		{
+			ptr=cache->freeList[sizeClass].back();
+			cache->freeList[sizeClass].pop_back();
+			cache->nByte-=table.classSize[sizeClass];
+			++counter.nThreadCacheHit;
+		}
+		else if(nullptr!=(ptr=SimpleBitmapPool_GetShared().Take(sizeClass)))
+		{
+			++counter.nSharedPoolHit;
+		}
+	}
+	if(nullptr==ptr)
+	{
+		ptr=SimpleBitmapPool_SystemAllocate(0<=sizeClass ? table.classSize[sizeClass] : nByte,sizeClass);
+		++counter.nSystemAllocate;
+	}
+
+	if(nullptr!=cache)
+	{
+		cache->Count();
+	}
+	else
+	{
+		SimpleBitmapPool_GetShared().counter.Add(localCounter);
+	}
+	return ptr;
+}
+
+/* static */ void SimpleBitmapPool::Free(void *ptr)
+{
+	if(nullptr==ptr)
+	{
+		return;
+	}
+
+	const int sizeClass=SimpleBitmapPool_GetHeader(ptr)->sizeClass;
+	auto cache=SimpleBitmapPool_GetThreadCache();
+	if(nullptr==cache)
+	{
+		SimpleBitmapPool_Counter localCounter;
+		localCounter.nFree=1;
+		SimpleBitmapPool_GetShared().counter.Add(localCounter);
+		if(0<=sizeClass)
+		{
+			SimpleBitmapPool_GetShared().Put(ptr,sizeClass);
+		}
+		else
+		{
+			SimpleBitmapPool_SystemFree(ptr);
+		}
+		return;
+	}
+
+	++cache->counter.nFree;
+	if(0<=sizeClass)
+	{
+		const size_t size=SimpleBitmapPool_GetSizeClassTable().classSize[sizeClass];
+		auto &list=cache->freeList[sizeClass];
+		if(list.size()<THREAD_CACHE_PER_CLASS && cache->nByte+size<=SimpleBitmapPool_ThreadCache::MAX_BYTE)
+		{
+			list.push_back(ptr);
+			cache->nByte+=size;
+		}
+		else
+		{
+			SimpleBitmapPool_GetShared().Put(ptr,sizeClass);
+		}
+	}
+	else
+	{
+		SimpleBitmapPool_SystemFree(ptr);
+	}
+	cache->Count();
+}
+
+/* static */ void SimpleBitmapPool::Trim(void)
+{
+	auto cache=SimpleBitmapPool_GetThreadCache();
+	if(nullptr!=cache)
+	{
+		cache->Trim();
+	}
+	SimpleBitmapPool_GetShared().Trim();
+}
+
+/* static */ void SimpleBitmapPool::SetSharedPoolLimit(size_t nByte)
+{
+	auto &shared=SimpleBitmapPool_GetShared();
+	std::lock_guard <std::mutex> guard(shared.lock);
+	shared.limit=nByte;
+}
+
+/* static */ SimpleBitmapPool::Statistics SimpleBitmapPool::GetStatistics(void)
+{
+	auto &shared=SimpleBitmapPool_GetShared();
+	auto cache=SimpleBitmapPool_GetThreadCache();
+	if(nullptr!=cache)
+	{
+		// Other threads' counts may be behind by up to COUNTER_FLUSH_INTERVAL each.
+		shared.counter.Add(cache->counter);
+	}
+
+	Statistics stat;
+	stat.nAllocate=shared.counter.nAllocate.load(std::memory_order_relaxed);
+	stat.nThreadCacheHit=shared.counter.nThreadCacheHit.load(std::memory_order_relaxed);
+	stat.nSharedPoolHit=shared.counter.nSharedPoolHit.load(std::memory_order_relaxed);
+	stat.nSystemAllocate=shared.counter.nSystemAllocate.load(std::memory_order_relaxed);
+	stat.nFree=shared.counter.nFree.load(std::memory_order_relaxed);
+	{
+		std::lock_guard <std::mutex> guard(shared.lock);
+		stat.sharedPoolBytes=shared.nByte;
+	}
+	return stat;
+}
+
+/* static */ void SimpleBitmapPool::ResetStatistics(void)
+{
+	auto &shared=SimpleBitmapPool_GetShared();
+	auto cache=SimpleBitmapPool_GetThreadCache();
+	if(nullptr!=cache)
+	{
+		cache->counter.Clear();
+	}
+	shared.counter.nAllocate.store(0);
+	shared.counter.nThreadCacheHit.store(0);
+	shared.counter.nSharedPoolHit.store(0);
+	shared.counter.nSystemAllocate.store(0);
+	shared.counter.nFree.store(0);
+}
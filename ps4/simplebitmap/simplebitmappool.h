@@ -0,0 +1,93 @@
+#ifndef SIMPLEBITMAPPOOL_24783_IS_INCLUDED
+#define SIMPLEBITMAPPOOL_24783_IS_INCLUDED
+/* { */
+
+#include <stddef.h>
+
+/*! Allocator of the pixel buffers of SimpleBitmapTemplate.  By default, the buffers come from new [].
+    SetHook replaces the functions, for example, with SimpleBitmapPool::Allocate and SimpleBitmapPool::Free.
+    A buffer is always given back to the Free function that was set when it was allocated,
+    therefore the hook can be changed while bitmaps are alive.  It must not be changed while other
+    threads are making bitmaps. */
+class SimpleBitmapAllocator
+{
+public:
+	/*! Alignment of the buffers returned by the allocate function. */
+	enum
+	{
+		ALIGNMENT=64
+	};
+
+	/*! Must return a buffer of at least nByte bytes aligned to ALIGNMENT, or nullptr. */
+	typedef void *(*AllocateFunc)(size_t nByte);
+	typedef void (*FreeFunc)(void *ptr);
+
+	/*! Sets the allocator.  If either is nullptr, the default allocator is used. */
+	static void SetHook(AllocateFunc allocFunc,FreeFunc freeFunc);
+	static AllocateFunc GetAllocateFunc(void);
+	static FreeFunc GetFreeFunc(void);
+
+	/*! Default allocator.  Over-allocates by new [] and aligns. */
+	static void *DefaultAllocate(size_t nByte);
+	static void DefaultFree(void *ptr);
+};
+
+/*! Pool of buffers for bitmaps that are made and deleted over and over, such as tiles.
+
+    The sizes are rounded up to size classes, four per power of two, so that a buffer of a class
+    can be used for any size in the class.  A freed buffer is first kept by the thread that freed it,
+    and taken again without a lock.  When the thread's cache of a class is full, or the thread exits,
+    buffers go to the shared pool, which any thread can take from under a lock.  Buffers larger than
+    MAX_POOLED_SIZE are not pooled.
+
+    Use by:
+        SimpleBitmapPool::Install();
+    which sets SimpleBitmapPool::Allocate and SimpleBitmapPool::Free to SimpleBitmapAllocator.
+*/
+class SimpleBitmapPool
+{
+public:
+	enum
+	{
+		MIN_POOLED_SIZE=256,
+		MAX_POOLED_SIZE=64*1024*1024,
+		THREAD_CACHE_PER_CLASS=4           // Buffers of one class kept by one thread.
+	};
+
+	class Statistics
+	{
+	public:
+		unsigned long long int nAllocate;          // Calls to Allocate.
+		unsigned long long int nThreadCacheHit;    // Taken from the thread's cache.
+		unsigned long long int nSharedPoolHit;     // Taken from the shared pool.
+		unsigned long long int nSystemAllocate;    // Allocated by new [], including the ones too large to pool.
+		unsigned long long int nFree;
+		unsigned long long int sharedPoolBytes;    // Bytes kept in the shared pool now.
+
+		Statistics();
+		/*! Returns the ratio of the allocations served from the pool. */
+		double GetHitRate(void) const;
+	};
+
+	/*! Makes SimpleBitmapTemplate take buffers from the pool. */
+	static void Install(void);
+	/*! Makes SimpleBitmapTemplate use the default allocator again.  The buffers from the pool
+	    that are still in use go back to the pool when freed. */
+	static void Uninstall(void);
+
+	static void *Allocate(size_t nByte);
+	static void Free(void *ptr);
+
+	/*! Returns the buffers kept in the shared pool and in the calling thread's cache to the system. */
+	static void Trim(void);
+
+	/*! Sets the limit of the bytes kept in the shared pool.  A freed buffer that would exceed
+	    the limit is returned to the system.  The default is 256MB. */
+	static void SetSharedPoolLimit(size_t nByte);
+
+	static Statistics GetStatistics(void);
+	static void ResetStatistics(void);
+};
+
+/* } */
+#endif
@@ -0,0 +1,250 @@
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include "simplebitmaprawfile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char SimpleBitmapRawFile_Magic[8]={'Y','S','R','A','W','B','M','P'};
+static const unsigned int SimpleBitmapRawFile_ByteOrderMark=0x01020304;
+
+static void SimpleBitmapRawFile_PutUInt(unsigned char *ptr,unsigned int value)
+{
+	memcpy(ptr,&value,4);
+}
+static unsigned int SimpleBitmapRawFile_GetUInt(const unsigned char *ptr)
+{
+	unsigned int value;
+	memcpy(&value,ptr,4);
+	return value;
+}
+
+SimpleBitmapRawFile::Format::Format()
+{
+	wid=0;
+	hei=0;
+	componentKind=COMPONENT_UNSIGNED;
+	componentSize=1;
+	numComponentPerPixel=4;
+	pitchInBytes=0;
+	checksum=0;
+}
+
+/* static */ unsigned long long SimpleBitmapRawFile::Checksum(const void *ptr,size_t nByte)
+{
+	auto wordPtr=(const unsigned char *)ptr;
+	unsigned long long sum0=0,sum1=0;
+	for(size_t i=0; i+4<=nByte; i+=4)
+	{
+		uint32_t word;
+		memcpy(&word,wordPtr+i,4);
+		sum0+=word;
+		sum1+=sum0;
+	}
+	return (sum1<<32)^sum0;
+}
+
+/* static */ bool SimpleBitmapRawFile::Write(FILE *fp,Format format,const void *pixelTop,size_t srcPitchInBytes)
+{
+	if(nullptr==fp)
+	{
+		return false;
+	}
+
+	const size_t lineBytes=(size_t)format.wid*format.componentSize*format.numComponentPerPixel;
+	format.pitchInBytes=(unsigned int)((lineBytes+PITCH_ALIGNMENT-1)/PITCH_ALIGNMENT*PITCH_ALIGNMENT);
+
+	// The checksum is the running sums over the whole data, and the padding is zero.
+	// Therefore, it can be calculated line by line as the lines are written.
+	std::vector <unsigned char> line(format.pitchInBytes,0);
+	unsigned long long sum0=0,sum1=0;
+	for(unsigned int y=0; y<format.hei; ++y)
+	{
+		memcpy(line.data(),(const unsigned char *)pixelTop+srcPitchInBytes*y,lineBytes);
+		for(size_t i=0; i<line.size(); i+=4)
+		{
+			uint32_t word;
+			memcpy(&word,line.data()+i,4);
+			sum0+=word;
+			sum1+=sum0;
+		}
+	}
+	format.checksum=(sum1<<32)^sum0;
+
+	unsigned char header[HEADER_SIZE];
+	memset(header,0,sizeof(header));
+	memcpy(header,SimpleBitmapRawFile_Magic,8);
+	SimpleBitmapRawFile_PutUInt(header+8,SimpleBitmapRawFile_ByteOrderMark);
+	SimpleBitmapRawFile_PutUInt(header+12,VERSION);
+	SimpleBitmapRawFile_PutUInt(header+16,format.wid);
+	SimpleBitmapRawFile_PutUInt(header+20,format.hei);
+	SimpleBitmapRawFile_PutUInt(header+24,format.componentKind);
+	SimpleBitmapRawFile_PutUInt(header+28,format.componentSize);
+	SimpleBitmapRawFile_PutUInt(header+32,format.numComponentPerPixel);
+	SimpleBitmapRawFile_PutUInt(header+36,format.pitchInBytes);
+	memcpy(header+40,&format.checksum,8);
+	if(HEADER_SIZE!=fwrite(header,1,HEADER_SIZE,fp))
+	{
+		return false;
+	}
+
+	for(unsigned int y=0; y<format.hei; ++y)
+	{
+		memcpy(line.data(),(const unsigned char *)pixelTop+srcPitchInBytes*y,lineBytes);
+		if(line.size()!=fwrite(line.data(),1,line.size(),fp))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* static */ void SimpleBitmapRawFile::DeleteMapping(void *mapping)
+{
+	delete (Mapping *)mapping;
+}
+
+////////////////////////////////////////////////////////////
+
+SimpleBitmapRawFile::Mapping::Mapping()
+{
+	dataPtr=nullptr;
+	dataSize=0;
+	allocPtr=nullptr;
+	mapped=false;
+}
+
+SimpleBitmapRawFile::Mapping::~Mapping()
+{
+	Close();
+}
+
+bool SimpleBitmapRawFile::Mapping::Open(const char fileName[],bool verifyChecksum,bool writable)
+{
+	Close();
+
+#ifndef _WIN32
+	int fd=open(fileName,O_RDONLY);
+	if(0<=fd)
+	{
+		struct stat st;
+		if(0==fstat(fd,&st) && HEADER_SIZE<=st.st_size)
+		{
+			// MAP_PRIVATE with PROT_WRITE gives copy-on-write pages.  The file is opened read-only,
+			// and the edits never go back to the file.
+			void *ptr=mmap(nullptr,(size_t)st.st_size,PROT_READ|(true==writable ? PROT_WRITE : 0),MAP_PRIVATE,fd,0);
+			if(MAP_FAILED!=ptr)
+			{
+				// The pixels are about to be used.  Start reading them in.
+				madvise(ptr,(size_t)st.st_size,MADV_WILLNEED);
+				dataPtr=(unsigned char *)ptr;
+				dataSize=(size_t)st.st_size;
+				mapped=true;
+			}
+		}
+		close(fd);
+	}
+#endif
+
+	if(true!=mapped)
+	{
+		// Memory-mapping is not available.  Read the whole file into a buffer that is aligned
+		// in the same way as a mapped file.
+		FILE *fp=fopen(fileName,"rb");
+		if(nullptr==fp)
+		{
+			return false;
+		}
+		fseek(fp,0,SEEK_END);
+		long fileSize=ftell(fp);
+		fseek(fp,0,SEEK_SET);
+		if(fileSize<HEADER_SIZE)
+		{
+			fclose(fp);
+			return false;
+		}
+
+		auto buf=new unsigned char [fileSize+SimpleBitmapTemplate <unsigned char,1>::BUFFER_ALIGNMENT];
+		auto alignedAddr=((uintptr_t)buf+SimpleBitmapTemplate <unsigned char,1>::BUFFER_ALIGNMENT-1)&~(uintptr_t)(SimpleBitmapTemplate <unsigned char,1>::BUFFER_ALIGNMENT-1);
+		allocPtr=buf;
+		dataPtr=(unsigned char *)alignedAddr;
+		dataSize=fread(dataPtr,1,(size_t)fileSize,fp);
+		fclose(fp);
+	}
+
+	Format fmt;
+	if(dataSize<HEADER_SIZE ||
+	   0!=memcmp(dataPtr,SimpleBitmapRawFile_Magic,8) ||
+	   SimpleBitmapRawFile_ByteOrderMark!=SimpleBitmapRawFile_GetUInt(dataPtr+8) ||
+	   VERSION!=SimpleBitmapRawFile_GetUInt(dataPtr+12))
+	{
+		fprintf(stderr,"Error! %s is not a raw bitmap file.\n",fileName);
+		Close();
+		return false;
+	}
+	fmt.wid=SimpleBitmapRawFile_GetUInt(dataPtr+16);
+	fmt.hei=SimpleBitmapRawFile_GetUInt(dataPtr+20);
+	fmt.componentKind=SimpleBitmapRawFile_GetUInt(dataPtr+24);
+	fmt.componentSize=SimpleBitmapRawFile_GetUInt(dataPtr+28);
+	fmt.numComponentPerPixel=SimpleBitmapRawFile_GetUInt(dataPtr+32);
+	fmt.pitchInBytes=SimpleBitmapRawFile_GetUInt(dataPtr+36);
+	memcpy(&fmt.checksum,dataPtr+40,8);
+
+	const unsigned long long lineBytes=(unsigned long long)fmt.wid*fmt.componentSize*fmt.numComponentPerPixel;
+	if(0x7fffffff<fmt.wid || 0x7fffffff<fmt.hei || fmt.pitchInBytes<lineBytes || 0!=fmt.pitchInBytes%PITCH_ALIGNMENT ||
+	   dataSize-HEADER_SIZE<(unsigned long long)fmt.pitchInBytes*fmt.hei)
+	{
+		fprintf(stderr,"Error! %s is broken.\n",fileName);
+		Close();
+		return false;
+	}
+	if(true==verifyChecksum && fmt.checksum!=Checksum(dataPtr+HEADER_SIZE,fmt.GetDataSize()))
+	{
+		fprintf(stderr,"Error! Checksum of %s does not match.\n",fileName);
+		Close();
+		return false;
+	}
+	format=fmt;
+	return true;
+}
+
+void SimpleBitmapRawFile::Mapping::Close(void)
+{
+#ifndef _WIN32
+	if(true==mapped && nullptr!=dataPtr)
+	{
+		munmap(dataPtr,dataSize);
+	}
+#endif
+	delete [] (unsigned char *)allocPtr;
+	dataPtr=nullptr;
+	dataSize=0;
+	allocPtr=nullptr;
+	mapped=false;
+	format=Format();
+}
+
+bool SimpleBitmapRawFile::Mapping::IsOpen(void) const
+{
+	return nullptr!=dataPtr;
+}
+
+const SimpleBitmapRawFile::Format &SimpleBitmapRawFile::Mapping::GetFormat(void) const
+{
+	return format;
+}
+
+const void *SimpleBitmapRawFile::Mapping::GetPixelData(void) const
+{
+	return (nullptr!=dataPtr ? dataPtr+HEADER_SIZE : nullptr);
+}
+
+void *SimpleBitmapRawFile::Mapping::GetEditablePixelData(void)
+{
+	return (nullptr!=dataPtr ? dataPtr+HEADER_SIZE : nullptr);
+}
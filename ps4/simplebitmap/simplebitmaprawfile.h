@@ -0,0 +1,180 @@
+#ifndef SIMPLEBITMAPRAWFILE_24783_IS_INCLUDED
+#define SIMPLEBITMAPRAWFILE_24783_IS_INCLUDED
+/* { */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <type_traits>
+#include "simplebitmaptemplate.h"
+
+/*! Uncompressed bitmap file, which can be mapped to memory and used without decoding.
+
+    Layout.  Numbers are in the byte order of the machine that wrote the file, and a file of the other
+    byte order is rejected.
+         0  char[8]  "YSRAWBMP"
+         8  uint32   0x01020304 (byte-order mark)
+        12  uint32   Version (1)
+        16  uint32   Width
+        20  uint32   Height
+        24  uint32   Component kind (COMPONENT_UNSIGNED, COMPONENT_SIGNED, or COMPONENT_FLOAT)
+        28  uint32   Bytes per component
+        32  uint32   Components per pixel
+        36  uint32   Pitch in bytes.  A multiple of PITCH_ALIGNMENT.
+        40  uint64   Checksum of the pixel data (see Checksum)
+        48  Zero up to HEADER_SIZE
+        64  Height lines of pitch bytes each.  The padding at the end of a line is zero.
+
+    Since both the header and the pitch are multiples of 64 bytes, every line of a mapped file is as
+    aligned as a line of a bitmap made by SimpleBitmapTemplate::Create with GetAlignedPitch.
+*/
+class SimpleBitmapRawFile
+{
+public:
+	enum
+	{
+		HEADER_SIZE=64,
+		PITCH_ALIGNMENT=64,
+		VERSION=1
+	};
+	enum
+	{
+		COMPONENT_UNSIGNED=0,
+		COMPONENT_SIGNED=1,
+		COMPONENT_FLOAT=2
+	};
+
+	class Format
+	{
+	public:
+		unsigned int wid,hei;
+		unsigned int componentKind,componentSize,numComponentPerPixel;
+		unsigned int pitchInBytes;
+		unsigned long long checksum;
+
+		Format();
+
+		/*! Returns true if the pixels can be used as SimpleBitmapTemplate <ComponentType,NumComponentPerPixel>. */
+		template <class ComponentType,int NumComponentPerPixel>
+		bool Matches(void) const
+		{
+			return componentKind==GetComponentKind <ComponentType>() &&
+			       componentSize==sizeof(ComponentType) &&
+			       numComponentPerPixel==(unsigned int)NumComponentPerPixel &&
+			       0==pitchInBytes%sizeof(ComponentType);
+		}
+		size_t GetDataSize(void) const
+		{
+			return (size_t)pitchInBytes*hei;
+		}
+	};
+
+	/*! Memory-mapped raw bitmap file.  The pixels are valid while the file is open.
+	    Where memory mapping is not available, the file is read into memory instead. */
+	class Mapping
+	{
+	private:
+		unsigned char *dataPtr;   // Top of the file.
+		size_t dataSize;
+		void *allocPtr;           // If the file is read instead of mapped.
+		bool mapped;
+		Format format;
+
+		Mapping(const Mapping &);
+		Mapping &operator=(const Mapping &);
+
+	public:
+		Mapping();
+		~Mapping();
+
+		/*! Opens and maps the file.  If writable is true, the pixels can be edited in memory, but the
+		    edits go only to private copies of the pages and do not go back to the file.
+		    Returns false if the file cannot be opened, is not a raw bitmap file, or the checksum
+		    does not match (if verifyChecksum is true). */
+		bool Open(const char fileName[],bool verifyChecksum=true,bool writable=false);
+		void Close(void);
+		bool IsOpen(void) const;
+
+		const Format &GetFormat(void) const;
+
+		/*! Returns the pointer to the top of the pixel data. */
+		const void *GetPixelData(void) const;
+		void *GetEditablePixelData(void);
+
+		/*! Makes view refer to the pixels in the mapped file without copying.
+		    Returns false if the file is not open or the format does not match. */
+		template <class ComponentType,int NumComponentPerPixel>
+		bool GetView(SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &view) const
+		{
+			if(true!=IsOpen() || true!=format.Matches <ComponentType,NumComponentPerPixel>())
+			{
+				return false;
+			}
+			view=SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel>(
+			    (const ComponentType *)GetPixelData(),format.wid,format.hei,format.pitchInBytes/sizeof(ComponentType));
+			return true;
+		}
+	};
+
+	template <class ComponentType>
+	static unsigned int GetComponentKind(void)
+	{
+		return (true==std::is_floating_point <ComponentType>::value ? COMPONENT_FLOAT :
+		       (true==std::is_signed <ComponentType>::value ? COMPONENT_SIGNED : COMPONENT_UNSIGNED));
+	}
+
+	/*! Checksum of the pixel data.  nByte must be a multiple of 4.
+	    Two running sums of the 32-bit words, as Fletcher's checksum, so that it runs at memory speed. */
+	static unsigned long long Checksum(const void *ptr,size_t nByte);
+
+	/*! Writes the header and the lines.  The lines are taken from pixelTop at every srcPitchInBytes.
+	    format.pitchInBytes and format.checksum are calculated in this function. */
+	static bool Write(FILE *fp,Format format,const void *pixelTop,size_t srcPitchInBytes);
+
+	template <class ComponentType,int NumComponentPerPixel>
+	static bool Save(FILE *fp,const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &view)
+	{
+		Format format;
+		format.wid=view.GetWidth();
+		format.hei=view.GetHeight();
+		format.componentKind=GetComponentKind <ComponentType>();
+		format.componentSize=sizeof(ComponentType);
+		format.numComponentPerPixel=NumComponentPerPixel;
+		return Write(fp,format,view.GetPixelPointer(0,0),view.GetPitchInBytes());
+	}
+	template <class ComponentType,int NumComponentPerPixel>
+	static bool Save(const char fileName[],const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &view)
+	{
+		FILE *fp=fopen(fileName,"wb");
+		if(nullptr==fp)
+		{
+			return false;
+		}
+		bool res=Save(fp,view);
+		return 0==fclose(fp) && true==res;
+	}
+
+	/*! Maps the file, and makes bmp use the mapped pixels without copying.  Copies of bmp share the
+	    mapping.  The mapping is private, therefore an edit does not go back to the file.
+	    Returns false if the file cannot be mapped or the format does not match, and then bmp is not changed. */
+	template <class ComponentType,int NumComponentPerPixel>
+	static bool Load(SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &bmp,const char fileName[],bool verifyChecksum=true)
+	{
+		auto mapping=new Mapping;
+		SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> view;
+		if(true!=mapping->Open(fileName,verifyChecksum,true) || true!=mapping->GetView(view))
+		{
+			delete mapping;
+			return false;
+		}
+		bmp.SetSharedBuffer(
+		    view.GetWidth(),view.GetHeight(),view.GetPitch(),
+		    (ComponentType *)mapping->GetEditablePixelData(),new SimpleBitmapSharedBuffer(mapping,DeleteMapping));
+		return true;
+	}
+
+private:
+	static void DeleteMapping(void *mapping);
+};
+
+/* } */
+#endif
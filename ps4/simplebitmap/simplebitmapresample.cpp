@@ -0,0 +1,276 @@
+#include <math.h>
+#include <string.h>
+#include <thread>
+#include "simplebitmapresample.h"
+
+#if defined(__SSE2__) || (defined(_MSC_VER) && defined(_M_X64))
+	#define SIMPLEBITMAPRESAMPLE_SSE2
+	#include <emmintrin.h>
+#endif
+
+
+static double SimpleBitmapResample_GetSupport(int filter)
+{
+	switch(filter)
+	{
+	case SimpleBitmapFilter::FILTER_BILINEAR:
+		return 1.0;
+	case SimpleBitmapFilter::FILTER_BOX:
+		return 0.5;
+	case SimpleBitmapFilter::FILTER_LANCZOS3:
+		return 3.0;
+	}
+	return 0.0;
+}
+
+static double SimpleBitmapResample_Evaluate(int filter,double x)
+{
+	const double pi=3.14159265358979323846;
+	switch(filter)
+	{
+	case SimpleBitmapFilter::FILTER_BILINEAR:
+		x=fabs(x);
+		return (x<1.0 ? 1.0-x : 0.0);
+	case SimpleBitmapFilter::FILTER_BOX:
+		return (-0.5<=x && x<0.5 ? 1.0 : 0.0);
+	case SimpleBitmapFilter::FILTER_LANCZOS3:
+		x=fabs(x);
+		if(x<1e-8)
+		{
+			return 1.0;
+		}
+		if(x<3.0)
+		{
+			return 3.0*sin(pi*x)*sin(pi*x/3.0)/(pi*pi*x*x);
+		}
+		return 0.0;
+	}
+	return 0.0;
+}
+
+SimpleBitmapResampleWeight::SimpleBitmapResampleWeight()
+{
+	dstSize=0;
+	maxTap=0;
+}
+
+void SimpleBitmapResampleWeight::Make(int srcSize,int dstSize,int filter)
+{
+	this->dstSize=dstSize;
+	first.resize(dstSize);
+	count.resize(dstSize);
+
+	const double scale=(double)srcSize/(double)dstSize;
+	const double filterScale=(1.0<scale ? scale : 1.0);
+	const double support=SimpleBitmapResample_GetSupport(filter)*filterScale;
+
+	if(SimpleBitmapFilter::FILTER_NEAREST==filter || 0.0>=support)
+	{
+		maxTap=1;
+		weight.assign(dstSize,1.0f);
+		fixedWeight.assign(dstSize,1<<FIXED_POINT_BITS);
+		for(int i=0; i<dstSize; ++i)
+		{
+			int src=(int)(((double)i+0.5)*scale);
+			first[i]=(src<srcSize ? src : srcSize-1);
+			count[i]=1;
+		}
+		return;
+	}
+
+	maxTap=(int)ceil(support)*2+1;
+	weight.assign((size_t)dstSize*maxTap,0.0f);
+	fixedWeight.assign((size_t)dstSize*maxTap,0);
+
+	std::vector <double> w(maxTap);
+	for(int i=0; i<dstSize; ++i)
+	{
+		// Taps that would fall outside of the source are dropped, and the rest are re-normalized.
+		const double center=((double)i+0.5)*scale;
+		int src0=(int)floor(center-support+0.5);
+		int src1=(int)floor(center+support+0.5);
+		if(src0<0)
+		{
+			src0=0;
+		}
+		if(srcSize<src1)
+		{
+			src1=srcSize;
+		}
+		if(maxTap<src1-src0)
+		{
+			src1=src0+maxTap;
+		}
+
+		double sum=0.0;
+		for(int s=src0; s<src1; ++s)
+		{
+			w[s-src0]=SimpleBitmapResample_Evaluate(filter,((double)s+0.5-center)/filterScale);
+			sum+=w[s-src0];
+		}
+		if(0.0==sum)
+		{
+			// Can happen only on a degenerate window.  Fall back to the nearest pixel.
+			int src=(int)center;
+			src0=(src<srcSize ? src : srcSize-1);
+			src1=src0+1;
+			w[0]=1.0;
+			sum=1.0;
+		}
+
+		first[i]=src0;
+		count[i]=src1-src0;
+
+		// Round each weight, and then give the rounding error to the largest, so that a flat
+		// input stays flat.
+		int fixedSum=0,largest=0;
+		for(int t=0; t<count[i]; ++t)
+		{
+			const double normalized=w[t]/sum;
+			const int fixed=(int)floor(normalized*(double)(1<<FIXED_POINT_BITS)+0.5);
+			weight[(size_t)i*maxTap+t]=(float)normalized;
+			fixedWeight[(size_t)i*maxTap+t]=fixed;
+			fixedSum+=fixed;
+			if(fixedWeight[(size_t)i*maxTap+largest]<fixed)
+			{
+				largest=t;
+			}
+		}
+		fixedWeight[(size_t)i*maxTap+largest]+=(1<<FIXED_POINT_BITS)-fixedSum;
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+static inline unsigned char SimpleBitmapResample_ToUnsignedChar(int acc)
+{
+	acc=(acc+(1<<(SimpleBitmapResampleWeight::FIXED_POINT_BITS-1)))>>SimpleBitmapResampleWeight::FIXED_POINT_BITS;
+	return (unsigned char)(acc<0 ? 0 : (255<acc ? 255 : acc));
+}
+
+void SimpleBitmapResample_HorizontalRGBA8(unsigned char *dstLine,const unsigned char *srcLine,const SimpleBitmapResampleWeight &weight)
+{
+	const int *fixedWeight=weight.fixedWeight.data();
+#ifdef SIMPLEBITMAPRESAMPLE_SSE2
+	// Two taps at a time.  The two pixels are interleaved as r0 r1 g0 g1 b0 b1 a0 a1 so that
+	// one _mm_madd_epi16 gives r0*w0+r1*w1, g0*w0+g1*w1, and so on.
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i round=_mm_set1_epi32(1<<(SimpleBitmapResampleWeight::FIXED_POINT_BITS-1));
+	for(int x=0; x<weight.dstSize; ++x)
+	{
+		const unsigned char *srcPtr=srcLine+weight.first[x]*4;
+		const int *w=fixedWeight+(size_t)x*weight.maxTap;
+		const int nTap=weight.count[x];
+		__m128i acc=round;
+		int t=0;
+		for(; t+1<nTap; t+=2)
+		{
+			__m128i pix=_mm_loadl_epi64((const __m128i *)(srcPtr+t*4));
+			pix=_mm_unpacklo_epi8(_mm_shuffle_epi32(pix,0x00),_mm_shuffle_epi32(pix,0x55));
+			pix=_mm_unpacklo_epi8(pix,zero);
+			const __m128i w01=_mm_set1_epi32((int)(((unsigned int)w[t+1]<<16)|((unsigned int)w[t]&0xffff)));
+			acc=_mm_add_epi32(acc,_mm_madd_epi16(pix,w01));
+		}
+		if(t<nTap)
+		{
+			int p;
+			memcpy(&p,srcPtr+t*4,4);
+			__m128i pix=_mm_unpacklo_epi8(_mm_cvtsi32_si128(p),zero);
+			pix=_mm_unpacklo_epi16(pix,zero);
+			acc=_mm_add_epi32(acc,_mm_madd_epi16(pix,_mm_set1_epi32(w[t]&0xffff)));
+		}
+		acc=_mm_srai_epi32(acc,SimpleBitmapResampleWeight::FIXED_POINT_BITS);
+		acc=_mm_packs_epi32(acc,acc);
+		acc=_mm_packus_epi16(acc,acc);
+		const int rgba=_mm_cvtsi128_si32(acc);
+		memcpy(dstLine+x*4,&rgba,4);
+	}
+#else
+	for(int x=0; x<weight.dstSize; ++x)
+	{
+		const unsigned char *srcPtr=srcLine+weight.first[x]*4;
+		const int *w=fixedWeight+(size_t)x*weight.maxTap;
+		int acc[4]={0,0,0,0};
+		for(int t=0; t<weight.count[x]; ++t)
+		{
+			for(int c=0; c<4; ++c)
+			{
+				acc[c]+=w[t]*srcPtr[t*4+c];
+			}
+		}
+		for(int c=0; c<4; ++c)
+		{
+			dstLine[x*4+c]=SimpleBitmapResample_ToUnsignedChar(acc[c]);
+		}
+	}
+#endif
+}
+
+void SimpleBitmapResample_VerticalRGBA8(unsigned char *dstLine,const unsigned char *const srcLine[],const int fixedWeight[],int nTap,int nByte)
+{
+	int i=0;
+#ifdef SIMPLEBITMAPRESAMPLE_SSE2
+	// Eight bytes from two lines at a time, interleaved as a0 b0 a1 b1 ... so that
+	// _mm_madd_epi16 gives a0*wa+b0*wb, a1*wa+b1*wb, and so on.
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i round=_mm_set1_epi32(1<<(SimpleBitmapResampleWeight::FIXED_POINT_BITS-1));
+	for(; i+8<=nByte; i+=8)
+	{
+		__m128i accLow=round,accHigh=round;
+		int t=0;
+		for(; t+1<nTap; t+=2)
+		{
+			const __m128i a=_mm_loadl_epi64((const __m128i *)(srcLine[t]+i));
+			const __m128i b=_mm_loadl_epi64((const __m128i *)(srcLine[t+1]+i));
+			const __m128i ab=_mm_unpacklo_epi8(a,b);
+			const __m128i wab=_mm_set1_epi32((int)(((unsigned int)fixedWeight[t+1]<<16)|((unsigned int)fixedWeight[t]&0xffff)));
+			accLow=_mm_add_epi32(accLow,_mm_madd_epi16(_mm_unpacklo_epi8(ab,zero),wab));
+			accHigh=_mm_add_epi32(accHigh,_mm_madd_epi16(_mm_unpackhi_epi8(ab,zero),wab));
+		}
+		if(t<nTap)
+		{
+			const __m128i a=_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(srcLine[t]+i)),zero);
+			const __m128i wa=_mm_set1_epi32(fixedWeight[t]&0xffff);
+			accLow=_mm_add_epi32(accLow,_mm_madd_epi16(_mm_unpacklo_epi16(a,zero),wa));
+			accHigh=_mm_add_epi32(accHigh,_mm_madd_epi16(_mm_unpackhi_epi16(a,zero),wa));
+		}
+		accLow=_mm_srai_epi32(accLow,SimpleBitmapResampleWeight::FIXED_POINT_BITS);
+		accHigh=_mm_srai_epi32(accHigh,SimpleBitmapResampleWeight::FIXED_POINT_BITS);
+		const __m128i packed=_mm_packs_epi32(accLow,accHigh);
+		_mm_storel_epi64((__m128i *)(dstLine+i),_mm_packus_epi16(packed,packed));
+	}
+#endif
+	for(; i<nByte; ++i)
+	{
+		int acc=0;
+		for(int t=0; t<nTap; ++t)
+		{
+			acc+=fixedWeight[t]*srcLine[t][i];
+		}
+		dstLine[i]=SimpleBitmapResample_ToUnsignedChar(acc);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+void SimpleBitmapResample_RunBands(int nBand,void (*func)(void *context,int band),void *context)
+{
+	std::vector <std::thread> threads;
+	for(int i=1; i<nBand; ++i)
+	{
+		threads.push_back(std::thread(func,context,i));
+	}
+	if(0<nBand)
+	{
+		func(context,0);
+	}
+	for(auto &t : threads)
+	{
+		t.join();
+	}
+}
+
+int SimpleBitmapResample_GetNumHardwareThread(void)
+{
+	return (int)std::thread::hardware_concurrency();
+}
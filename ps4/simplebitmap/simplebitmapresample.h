@@ -0,0 +1,250 @@
+#ifndef SIMPLEBITMAPRESAMPLE_24783_IS_INCLUDED
+#define SIMPLEBITMAPRESAMPLE_24783_IS_INCLUDED
+/* { */
+
+#include <stddef.h>
+#include <vector>
+#include <limits>
+#include <type_traits>
+
+/*! Filters for SimpleBitmapTemplate::Resize. */
+class SimpleBitmapFilter
+{
+public:
+	enum
+	{
+		FILTER_NEAREST,
+		FILTER_BILINEAR,
+		FILTER_BOX,       // Area average when shrinking.  Good for thumbnails.
+		FILTER_LANCZOS3   // Sharpest.  Can overshoot, and the values are clamped.
+	};
+};
+
+/*! Weights of the source pixels for each destination pixel in one direction.
+    The weights of a destination pixel are for source pixels first[i] to first[i]+count[i]-1,
+    and stored from weight[i*maxTap].  The fixed-point weights add up to exactly 1<<FIXED_POINT_BITS. */
+class SimpleBitmapResampleWeight
+{
+public:
+	enum
+	{
+		FIXED_POINT_BITS=14
+	};
+	int dstSize,maxTap;
+	std::vector <int> first,count;
+	std::vector <float> weight;
+	std::vector <int> fixedWeight;
+
+	SimpleBitmapResampleWeight();
+	void Make(int srcSize,int dstSize,int filter);
+};
+
+/* Kernels for 8-bit RGBA, the most common case.  SSE2 where available.  Defined in simplebitmapresample.cpp. */
+void SimpleBitmapResample_HorizontalRGBA8(unsigned char *dstLine,const unsigned char *srcLine,const SimpleBitmapResampleWeight &weight);
+void SimpleBitmapResample_VerticalRGBA8(unsigned char *dstLine,const unsigned char *const srcLine[],const int fixedWeight[],int nTap,int nByte);
+
+/* Calls func(context,band) for band=0,...,nBand-1, each in a thread, and waits for all of them.
+   The threads are made in simplebitmapresample.cpp, so that this header does not pull in <thread>,
+   which does not get along with the first/second macros of yshash.h.  SimpleBitmapFilterPipeline uses it, too. */
+void SimpleBitmapResample_RunBands(int nBand,void (*func)(void *context,int band),void *context);
+int SimpleBitmapResample_GetNumHardwareThread(void);
+
+/*! Resampling kernels for any component type and number of components per pixel.
+    Integer components use fixed-point weights and are rounded and clamped.
+    Floating-point components use floating-point weights and are not clamped. */
+template <class ComponentType,int NumComponentPerPixel>
+class SimpleBitmapResampleKernel
+{
+public:
+	typedef typename std::conditional <std::is_floating_point <ComponentType>::value,double,long long int>::type AccumulatorType;
+
+	static AccumulatorType GetWeight(const SimpleBitmapResampleWeight &weight,int i,int tap)
+	{
+		return GetWeight(weight,i*weight.maxTap+tap,std::is_floating_point <ComponentType>());
+	}
+	static AccumulatorType GetWeight(const SimpleBitmapResampleWeight &weight,int idx,std::true_type)
+	{
+		return (AccumulatorType)weight.weight[idx];
+	}
+	static AccumulatorType GetWeight(const SimpleBitmapResampleWeight &weight,int idx,std::false_type)
+	{
+		return (AccumulatorType)weight.fixedWeight[idx];
+	}
+	static ComponentType ToComponent(AccumulatorType acc)
+	{
+		return ToComponent(acc,std::is_floating_point <ComponentType>());
+	}
+	static ComponentType ToComponent(AccumulatorType acc,std::true_type)
+	{
+		return (ComponentType)acc;
+	}
+	static ComponentType ToComponent(AccumulatorType acc,std::false_type)
+	{
+		const AccumulatorType half=(AccumulatorType)1<<(SimpleBitmapResampleWeight::FIXED_POINT_BITS-1);
+		acc=(acc+half)>>SimpleBitmapResampleWeight::FIXED_POINT_BITS;
+		if(acc<(AccumulatorType)std::numeric_limits <ComponentType>::min())
+		{
+			return std::numeric_limits <ComponentType>::min();
+		}
+		if((AccumulatorType)std::numeric_limits <ComponentType>::max()<acc)
+		{
+			return std::numeric_limits <ComponentType>::max();
+		}
+		return (ComponentType)acc;
+	}
+
+	static void Horizontal(ComponentType *dstLine,const ComponentType *srcLine,const SimpleBitmapResampleWeight &weight)
+	{
+		for(int x=0; x<weight.dstSize; ++x)
+		{
+			AccumulatorType acc[NumComponentPerPixel];
+			for(auto &a : acc)
+			{
+				a=0;
+			}
+			auto srcPtr=srcLine+weight.first[x]*NumComponentPerPixel;
+			for(int t=0; t<weight.count[x]; ++t)
+			{
+				auto w=GetWeight(weight,x,t);
+				for(int c=0; c<NumComponentPerPixel; ++c)
+				{
+					acc[c]+=w*(AccumulatorType)srcPtr[t*NumComponentPerPixel+c];
+				}
+			}
+			for(int c=0; c<NumComponentPerPixel; ++c)
+			{
+				dstLine[x*NumComponentPerPixel+c]=ToComponent(acc[c]);
+			}
+		}
+	}
+	static void Vertical(ComponentType *dstLine,const ComponentType *const srcLine[],const SimpleBitmapResampleWeight &weight,int y,int nComponent,std::vector <AccumulatorType> &acc)
+	{
+		acc.assign(nComponent,0);
+		for(int t=0; t<weight.count[y]; ++t)
+		{
+			auto w=GetWeight(weight,y,t);
+			auto srcPtr=srcLine[t];
+			for(int i=0; i<nComponent; ++i)
+			{
+				acc[i]+=w*(AccumulatorType)srcPtr[i];
+			}
+		}
+		for(int i=0; i<nComponent; ++i)
+		{
+			dstLine[i]=ToComponent(acc[i]);
+		}
+	}
+};
+
+template <>
+class SimpleBitmapResampleKernel <unsigned char,4>
+{
+public:
+	typedef int AccumulatorType;
+
+	static void Horizontal(unsigned char *dstLine,const unsigned char *srcLine,const SimpleBitmapResampleWeight &weight)
+	{
+		SimpleBitmapResample_HorizontalRGBA8(dstLine,srcLine,weight);
+	}
+	static void Vertical(unsigned char *dstLine,const unsigned char *const srcLine[],const SimpleBitmapResampleWeight &weight,int y,int nComponent,std::vector <AccumulatorType> &)
+	{
+		SimpleBitmapResample_VerticalRGBA8(dstLine,srcLine,weight.fixedWeight.data()+y*weight.maxTap,weight.count[y],nComponent);
+	}
+};
+
+/*! Separable two-pass resampling.  The destination lines are split into bands, and each band is
+    processed in a thread.  A band first resamples horizontally only the source lines it needs,
+    and then resamples vertically.  The bands do not share anything but the source. */
+template <class ComponentType,int NumComponentPerPixel>
+class SimpleBitmapResampler
+{
+public:
+	typedef SimpleBitmapResampleKernel <ComponentType,NumComponentPerPixel> KERNEL;
+
+	static void Resample(
+	    ComponentType *dst,int dstWid,int dstHei,int dstPitch,
+	    const ComponentType *src,int srcWid,int srcHei,int srcPitch,
+	    int filter,int nThread)
+	{
+		SimpleBitmapResampleWeight xWeight,yWeight;
+		xWeight.Make(srcWid,dstWid,filter);
+		yWeight.Make(srcHei,dstHei,filter);
+
+		if(nThread<=0)
+		{
+			nThread=SimpleBitmapResample_GetNumHardwareThread();
+		}
+		// Not worth a thread for less than about 64 lines or 64K pixels per thread.
+		while(1<nThread && ((long long int)dstWid*dstHei<65536LL*nThread || dstHei<64*nThread))
+		{
+			--nThread;
+		}
+		if(nThread<=1)
+		{
+			ResampleBand(dst,dstPitch,src,srcPitch,xWeight,yWeight,0,dstHei);
+			return;
+		}
+
+		Band band;
+		band.dst=dst;
+		band.dstHei=dstHei;
+		band.dstPitch=dstPitch;
+		band.src=src;
+		band.srcPitch=srcPitch;
+		band.xWeight=&xWeight;
+		band.yWeight=&yWeight;
+		band.nBand=nThread;
+		SimpleBitmapResample_RunBands(nThread,RunBand,&band);
+	}
+
+private:
+	class Band
+	{
+	public:
+		ComponentType *dst;
+		int dstHei,dstPitch;
+		const ComponentType *src;
+		int srcPitch;
+		const SimpleBitmapResampleWeight *xWeight,*yWeight;
+		int nBand;
+	};
+	static void RunBand(void *context,int i)
+	{
+		auto &band=*(const Band *)context;
+		const int y0=band.dstHei*i/band.nBand,y1=band.dstHei*(i+1)/band.nBand;
+		ResampleBand(band.dst,band.dstPitch,band.src,band.srcPitch,*band.xWeight,*band.yWeight,y0,y1);
+	}
+
+	static void ResampleBand(
+	    ComponentType *dst,int dstPitch,const ComponentType *src,int srcPitch,
+	    const SimpleBitmapResampleWeight &xWeight,const SimpleBitmapResampleWeight &yWeight,int y0,int y1)
+	{
+		if(y1<=y0)
+		{
+			return;
+		}
+		const int srcY0=yWeight.first[y0];
+		const int srcY1=yWeight.first[y1-1]+yWeight.count[y1-1];
+		const int tmpPitch=xWeight.dstSize*NumComponentPerPixel;
+
+		std::vector <ComponentType> tmp((size_t)tmpPitch*(srcY1-srcY0));
+		for(int y=srcY0; y<srcY1; ++y)
+		{
+			KERNEL::Horizontal(tmp.data()+(size_t)(y-srcY0)*tmpPitch,src+(size_t)y*srcPitch,xWeight);
+		}
+
+		std::vector <const ComponentType *> srcLine(yWeight.maxTap);
+		std::vector <typename KERNEL::AccumulatorType> acc;
+		for(int y=y0; y<y1; ++y)
+		{
+			for(int t=0; t<yWeight.count[y]; ++t)
+			{
+				srcLine[t]=tmp.data()+(size_t)(yWeight.first[y]+t-srcY0)*tmpPitch;
+			}
+			KERNEL::Vertical(dst+(size_t)y*dstPitch,srcLine.data(),yWeight,y,tmpPitch,acc);
+		}
+	}
+};
+
+/* } */
+#endif
@@ -0,0 +1,246 @@
+#include <string.h>
+#include <atomic>
+#include "simplebitmapsimd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SIMPLEBITMAPSIMD_X86_GCC
+	#include <immintrin.h>
+	#define SIMPLEBITMAPSIMD_TARGET_SSE2 __attribute__((target("sse2")))
+	#define SIMPLEBITMAPSIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+	// SSE2 is always there on x64.  AVX2 is used only with the GNU-compatible compilers.
+	#define SIMPLEBITMAPSIMD_X86_MSC
+	#include <emmintrin.h>
+	#define SIMPLEBITMAPSIMD_TARGET_SSE2
+#endif
+
+
+static int SimpleBitmapSIMD_DetectBestInstructionSet(void)
+{
+#if defined(SIMPLEBITMAPSIMD_X86_GCC)
+	__builtin_cpu_init();
+	if(0!=__builtin_cpu_supports("avx2"))
+	{
+		return SimpleBitmapSIMD::INSTRUCTION_AVX2;
+	}
+	if(0!=__builtin_cpu_supports("sse2"))
+	{
+		return SimpleBitmapSIMD::INSTRUCTION_SSE2;
+	}
+#elif defined(SIMPLEBITMAPSIMD_X86_MSC)
+	return SimpleBitmapSIMD::INSTRUCTION_SSE2;
+#endif
+	return SimpleBitmapSIMD::INSTRUCTION_SCALAR;
+}
+
+static std::atomic <int> &SimpleBitmapSIMD_CurrentInstructionSet(void)
+{
+	static std::atomic <int> instructionSet(SimpleBitmapSIMD_DetectBestInstructionSet());
+	return instructionSet;
+}
+
+/* static */ int SimpleBitmapSIMD::GetInstructionSet(void)
+{
+	return SimpleBitmapSIMD_CurrentInstructionSet().load(std::memory_order_relaxed);
+}
+
+/* static */ int SimpleBitmapSIMD::GetBestInstructionSet(void)
+{
+	static const int best=SimpleBitmapSIMD_DetectBestInstructionSet();
+	return best;
+}
+
+/* static */ void SimpleBitmapSIMD::SetInstructionSet(int instructionSet)
+{
+	if(instructionSet<INSTRUCTION_SCALAR || GetBestInstructionSet()<instructionSet)
+	{
+		instructionSet=GetBestInstructionSet();
+	}
+	SimpleBitmapSIMD_CurrentInstructionSet().store(instructionSet);
+}
+
+/* static */ const char *SimpleBitmapSIMD::GetInstructionSetName(int instructionSet)
+{
+	switch(instructionSet)
+	{
+	case INSTRUCTION_SSE2:
+		return "SSE2";
+	case INSTRUCTION_AVX2:
+		return "AVX2";
+	}
+	return "Scalar";
+}
+
+////////////////////////////////////////////////////////////
+
+static bool SimpleBitmapSIMD_IsEqualScalar(const unsigned char *a,const unsigned char *b,size_t nByte)
+{
+	for(size_t i=0; i<nByte; ++i)
+	{
+		if(a[i]!=b[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Repeats the pattern to 16 bytes.  patternByte must be 1, 2, 4, 8, or 16. */
+static void SimpleBitmapSIMD_MakePattern16(unsigned char pattern16[16],const unsigned char *pattern,size_t patternByte)
+{
+	for(size_t i=0; i<16; i+=patternByte)
+	{
+		memcpy(pattern16+i,pattern,patternByte);
+	}
+}
+
+static void SimpleBitmapSIMD_FillScalar(unsigned char *dst,size_t nByte,const unsigned char *pattern,size_t patternByte)
+{
+	size_t i=0;
+	for(; i+patternByte<=nByte; i+=patternByte)
+	{
+		memcpy(dst+i,pattern,patternByte);
+	}
+	memcpy(dst+i,pattern,nByte-i);
+}
+
+#if defined(SIMPLEBITMAPSIMD_X86_GCC) || defined(SIMPLEBITMAPSIMD_X86_MSC)
+SIMPLEBITMAPSIMD_TARGET_SSE2 static bool SimpleBitmapSIMD_IsEqualSSE2(const unsigned char *a,const unsigned char *b,size_t nByte)
+{
+	size_t i=0;
+	for(; i+16<=nByte; i+=16)
+	{
+		__m128i va=_mm_loadu_si128((const __m128i *)(a+i));
+		__m128i vb=_mm_loadu_si128((const __m128i *)(b+i));
+		if(0xffff!=_mm_movemask_epi8(_mm_cmpeq_epi8(va,vb)))
+		{
+			return false;
+		}
+	}
+	return SimpleBitmapSIMD_IsEqualScalar(a+i,b+i,nByte-i);
+}
+
+SIMPLEBITMAPSIMD_TARGET_SSE2 static void SimpleBitmapSIMD_FillSSE2(unsigned char *dst,size_t nByte,const unsigned char pattern16[16])
+{
+	__m128i v=_mm_loadu_si128((const __m128i *)pattern16);
+	size_t i=0;
+	for(; i+16<=nByte; i+=16)
+	{
+		_mm_storeu_si128((__m128i *)(dst+i),v);
+	}
+	memcpy(dst+i,pattern16,nByte-i);
+}
+#endif
+
+#if defined(SIMPLEBITMAPSIMD_X86_GCC)
+SIMPLEBITMAPSIMD_TARGET_AVX2 static bool SimpleBitmapSIMD_IsEqualAVX2(const unsigned char *a,const unsigned char *b,size_t nByte)
+{
+	size_t i=0;
+	for(; i+64<=nByte; i+=64)
+	{
+		__m256i eq0=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i)),_mm256_loadu_si256((const __m256i *)(b+i)));
+		__m256i eq1=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i+32)),_mm256_loadu_si256((const __m256i *)(b+i+32)));
+		if(-1!=_mm256_movemask_epi8(_mm256_and_si256(eq0,eq1)))
+		{
+			return false;
+		}
+	}
+	for(; i+32<=nByte; i+=32)
+	{
+		__m256i eq=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i)),_mm256_loadu_si256((const __m256i *)(b+i)));
+		if(-1!=_mm256_movemask_epi8(eq))
+		{
+			return false;
+		}
+	}
+	return SimpleBitmapSIMD_IsEqualSSE2(a+i,b+i,nByte-i);
+}
+
+SIMPLEBITMAPSIMD_TARGET_AVX2 static void SimpleBitmapSIMD_FillAVX2(unsigned char *dst,size_t nByte,const unsigned char pattern16[16])
+{
+	__m128i v128=_mm_loadu_si128((const __m128i *)pattern16);
+	__m256i v=_mm256_broadcastsi128_si256(v128);
+	size_t i=0;
+	for(; i+32<=nByte; i+=32)
+	{
+		_mm256_storeu_si256((__m256i *)(dst+i),v);
+	}
+	if(i+16<=nByte)
+	{
+		_mm_storeu_si128((__m128i *)(dst+i),v128);
+		i+=16;
+	}
+	memcpy(dst+i,pattern16,nByte-i);
+}
+#endif
+
+/* static */ bool SimpleBitmapSIMD::IsEqual(const void *a,const void *b,size_t nByte)
+{
+	auto aPtr=(const unsigned char *)a;
+	auto bPtr=(const unsigned char *)b;
+	switch(GetInstructionSet())
+	{
+#if defined(SIMPLEBITMAPSIMD_X86_GCC)
+	case INSTRUCTION_AVX2:
+		return SimpleBitmapSIMD_IsEqualAVX2(aPtr,bPtr,nByte);
+#endif
+#if defined(SIMPLEBITMAPSIMD_X86_GCC) || defined(SIMPLEBITMAPSIMD_X86_MSC)
+	case INSTRUCTION_SSE2:
+		return SimpleBitmapSIMD_IsEqualSSE2(aPtr,bPtr,nByte);
+#endif
+	default:
+		break;
+	}
+	return SimpleBitmapSIMD_IsEqualScalar(aPtr,bPtr,nByte);
+}
+
+/* static */ void SimpleBitmapSIMD::Fill(void *dst,size_t nByte,const void *pattern,size_t patternByte)
+{
+	auto dstPtr=(unsigned char *)dst;
+	auto patternPtr=(const unsigned char *)pattern;
+	if(0==patternByte)
+	{
+		return;
+	}
+	if(0!=16%patternByte)
+	{
+		SimpleBitmapSIMD_FillScalar(dstPtr,nByte,patternPtr,patternByte);
+		return;
+	}
+
+	unsigned char pattern16[16];
+	SimpleBitmapSIMD_MakePattern16(pattern16,patternPtr,patternByte);
+	switch(GetInstructionSet())
+	{
+#if defined(SIMPLEBITMAPSIMD_X86_GCC)
+	case INSTRUCTION_AVX2:
+		SimpleBitmapSIMD_FillAVX2(dstPtr,nByte,pattern16);
+		return;
+#endif
+#if defined(SIMPLEBITMAPSIMD_X86_GCC) || defined(SIMPLEBITMAPSIMD_X86_MSC)
+	case INSTRUCTION_SSE2:
+		SimpleBitmapSIMD_FillSSE2(dstPtr,nByte,pattern16);
+		return;
+#endif
+	default:
+		break;
+	}
+	SimpleBitmapSIMD_FillScalar(dstPtr,nByte,pattern16,16);
+}
+
+/* static */ void SimpleBitmapSIMD::Swap(void *a,void *b,size_t nByte)
+{
+	// memcpy is already vectorized by the C library for every CPU.  Swap through a bounce buffer
+	// on the stack small enough to stay in L1 cache.
+	const size_t bounceSize=4096;
+	unsigned char bounce[bounceSize];
+	auto aPtr=(unsigned char *)a;
+	auto bPtr=(unsigned char *)b;
+	for(size_t i=0; i<nByte; i+=bounceSize)
+	{
+		size_t n=(bounceSize<nByte-i ? bounceSize : nByte-i);
+		memcpy(bounce,aPtr+i,n);
+		memcpy(aPtr+i,bPtr+i,n);
+		memcpy(bPtr+i,bounce,n);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef SIMPLEBITMAPSIMD_24783_IS_INCLUDED
+#define SIMPLEBITMAPSIMD_24783_IS_INCLUDED
+/* { */
+
+#include <stddef.h>
+
+/*! Byte-level kernels used by SimpleBitmapTemplate for comparing, filling, and flipping.
+    The fastest instruction set supported by the CPU is selected at run time.  The same binary runs on
+    a CPU without AVX2, and the scalar versions are used on non-x86 CPUs. */
+class SimpleBitmapSIMD
+{
+public:
+	enum
+	{
+		INSTRUCTION_SCALAR,
+		INSTRUCTION_SSE2,
+		INSTRUCTION_AVX2
+	};
+
+	/*! Returns the instruction set currently used. */
+	static int GetInstructionSet(void);
+
+	/*! Returns the fastest instruction set supported by the CPU. */
+	static int GetBestInstructionSet(void);
+
+	/*! Uses the given instruction set, or the fastest supported one if it is not supported.
+	    Mainly for benchmarking.  Must not be called while other threads are using the kernels. */
+	static void SetInstructionSet(int instructionSet);
+
+	/*! Returns a printable name of the instruction set. */
+	static const char *GetInstructionSetName(int instructionSet);
+
+	/*! Returns true if nByte bytes from a and b are the same.  Returns as soon as a difference is found. */
+	static bool IsEqual(const void *a,const void *b,size_t nByte);
+
+	/*! Fills nByte bytes from dst by repeating the pattern of patternByte bytes.
+	    nByte should be a multiple of patternByte.  The fast path is for a pattern of 1, 2, 4, 8, or 16 bytes.
+	    Does nothing if patternByte is zero. */
+	static void Fill(void *dst,size_t nByte,const void *pattern,size_t patternByte);
+
+	/*! Swaps nByte bytes of a and b, which must not overlap. */
+	static void Swap(void *a,void *b,size_t nByte);
+};
+
+/* } */
+#endif
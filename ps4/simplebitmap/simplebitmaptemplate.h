@@ -1,31 +1,273 @@
 #ifndef SIMPLEBITMAP_TEMPLATE_24783_IS_INCLUDED
 #define SIMPLEBITMAP_TEMPLATE_24783_IS_INCLUDED
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <atomic>
+#include "simplebitmapsimd.h"
+#include "simplebitmapresample.h"
+#include "simplebitmaporient.h"
+#include "simplebitmappool.h"
+
+/*! Non-owning reference to a rectangle of pixels, such as a tile of a SimpleBitmapTemplate.
+    The pixels are not copied, therefore the bitmap must outlive the view, and must not be
+    re-created while the view is used. */
+template <class ComponentType,int NumComponentPerPixel>
+class SimpleBitmapViewTemplate
+{
+private:
+	typedef SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> THISCLASS;
+
+protected:
+	const ComponentType *bmpPtr;
+	int nx,ny;
+	int pitch;  // Number of components from the top of one line to the top of the next line.
+
+public:
+	SimpleBitmapViewTemplate() : bmpPtr(nullptr),nx(0),ny(0),pitch(0)
+	{
+	}
+	SimpleBitmapViewTemplate(const ComponentType *bmpPtr,int wid,int hei,int pitch) : bmpPtr(bmpPtr),nx(wid),ny(hei),pitch(pitch)
+	{
+	}
+
+	/*! Returns the width in the number of pixels. */
+	int GetWidth(void) const
+	{
+		return nx;
+	}
+
+	/*! Returns the height in the number of pixels. */
+	int GetHeight(void) const
+	{
+		return ny;
+	}
+
+	/*! Returns the number of components from the top of one line to the top of the next line. */
+	int GetPitch(void) const
+	{
+		return pitch;
+	}
+
+	/*! Returns the pitch in bytes. */
+	int GetPitchInBytes(void) const
+	{
+		return pitch*(int)sizeof(ComponentType);
+	}
+
+	/*! Returns the total number of components in one single line. */
+	int GetNumComponentPerLine(void) const
+	{
+		return NumComponentPerPixel*nx;
+	}
+
+	/*! Returns true if there is no gap between the lines. */
+	bool IsTightlyPacked(void) const
+	{
+		return pitch==GetNumComponentPerLine();
+	}
+
+	/*! Returns true if (x,y) is inside the view. */
+	bool IsInRange(int x,int y) const
+	{
+		return (0<=x && x<nx && 0<=y && y<ny);
+	}
+
+	/*! Returns pointer to top of the horizontal line. */
+	const ComponentType *LineTop(int y) const
+	{
+		return bmpPtr+(size_t)y*pitch;
+	}
+
+	/*! Returns the pointer to the pixel. */
+	const ComponentType *GetPixelPointer(int x,int y) const
+	{
+		return LineTop(y)+NumComponentPerPixel*x;
+	}
+
+	/*! Returns a view of (x0,y0)-(x0+wid-1,y0+hei-1) of this view.  The part outside of this view is
+	    cut off, therefore the returned view can be smaller than wid x hei. */
+	THISCLASS GetView(int x0,int y0,int wid,int hei) const
+	{
+		int x1=x0+wid,y1=y0+hei;
+		x0=(x0<0 ? 0 : x0);
+		y0=(y0<0 ? 0 : y0);
+		x1=(nx<x1 ? nx : x1);
+		y1=(ny<y1 ? ny : y1);
+		if(x1<=x0 || y1<=y0)
+		{
+			return THISCLASS();
+		}
+		return THISCLASS(GetPixelPointer(x0,y0),x1-x0,y1-y0,pitch);
+	}
+
+	/*! Returns true if the two views have the same size and the same pixels. */
+	bool operator==(const THISCLASS &incoming) const
+	{
+		if(nx!=incoming.nx || ny!=incoming.ny)
+		{
+			return false;
+		}
+		if(true==std::is_integral <ComponentType>::value && bmpPtr==incoming.bmpPtr && pitch==incoming.pitch)
+		{
+			// Same pixels, for example, two copies sharing one buffer.
+			return true;
+		}
+		const int nComponent=GetNumComponentPerLine();
+		if(true==std::is_integral <ComponentType>::value && true==IsTightlyPacked() && true==incoming.IsTightlyPacked())
+		{
+			return SimpleBitmapSIMD::IsEqual(bmpPtr,incoming.bmpPtr,sizeof(ComponentType)*nComponent*ny);
+		}
+		for(int y=0; y<ny; ++y)
+		{
+			auto line0=LineTop(y),line1=incoming.LineTop(y);
+			if(true==std::is_integral <ComponentType>::value)
+			{
+				if(true!=SimpleBitmapSIMD::IsEqual(line0,line1,sizeof(ComponentType)*nComponent))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				for(int i=0; i<nComponent; ++i)
+				{
+					if(line0[i]!=line1[i])
+					{
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+	bool operator!=(const THISCLASS &incoming) const
+	{
+		return !(*this==incoming);
+	}
+};
+
+/*! Owner of a pixel buffer that is shared by the copies of a bitmap.  A copy shares the buffer until
+    either of them is edited, and then the edited one makes its own copy (copy-on-write).
+    The buffer is released by the deleter when the last bitmap lets go of it.  The owner does not
+    depend on the pixel format so that a buffer can be handed from one format to another. */
+class SimpleBitmapSharedBuffer
+{
+public:
+	std::atomic <int> refCount;
+	void *ptr;                    // Given to the deleter.
+	void (*deleter)(void *ptr);
+
+	SimpleBitmapSharedBuffer(void *ptr,void (*deleter)(void *ptr)) : refCount(1),ptr(ptr),deleter(deleter)
+	{
+	}
+	~SimpleBitmapSharedBuffer()
+	{
+		if(nullptr!=deleter)
+		{
+			(*deleter)(ptr);
+		}
+	}
+	void AddRef(void)
+	{
+		refCount.fetch_add(1,std::memory_order_relaxed);
+	}
+	/*! Decrements the reference count, and deletes itself if nobody refers to it any more. */
+	void Release(void)
+	{
+		if(1==refCount.fetch_sub(1,std::memory_order_acq_rel))
+		{
+			delete this;
+		}
+	}
+	bool IsShared(void) const
+	{
+		return 1<refCount.load(std::memory_order_acquire);
+	}
+};
+
 template <class ComponentType,int NumComponentPerPixel>
 class SimpleBitmapTemplate
 {
+	template <class OtherComponentType,int OtherNumComponentPerPixel>
+	friend class SimpleBitmapTemplate;
+
 private:
 	typedef SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> THISCLASS;
+	typedef SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> VIEWCLASS;
 
 	SimpleBitmapTemplate(const THISCLASS &incoming);
 	THISCLASS &operator=(const THISCLASS &incoming);
 
+public:
+	/*! Alignment of the bitmap buffer in bytes.  Good for the widest SIMD registers and a cache line. */
+	enum
+	{
+		BUFFER_ALIGNMENT=64
+	};
+
 private:
 	int nx,ny;
+	int pitch;  // Number of components from the top of one line to the top of the next line.
 	ComponentType *bmpPtr;
+	SimpleBitmapSharedBuffer *sharedBuffer;  // Owner of bmpPtr.  nullptr if bmpPtr is nullptr.
+
+	/* Allocates a buffer aligned to BUFFER_ALIGNMENT from SimpleBitmapAllocator, and makes its owner.
+	   The owner remembers the free function, so that the buffer goes back to where it came from. */
+	static ComponentType *AllocAligned(size_t numComponent,SimpleBitmapSharedBuffer *&owner)
+	{
+		static_assert(std::is_trivially_copyable <ComponentType>::value,"ComponentType must be trivially copyable.");
+		static_assert(0==SimpleBitmapAllocator::ALIGNMENT%BUFFER_ALIGNMENT,"The allocator must align at least as much as the bitmap.");
+		auto freeFunc=SimpleBitmapAllocator::GetFreeFunc();
+		auto ptr=(*SimpleBitmapAllocator::GetAllocateFunc())(numComponent*sizeof(ComponentType));
+		owner=new SimpleBitmapSharedBuffer(ptr,freeFunc);
+		return (ComponentType *)ptr;
+	}
+	static void DeleteDirect(void *directPtr)
+	{
+		delete [] (ComponentType *)directPtr;
+	}
+	void FreeBuffer(void)
+	{
+		if(nullptr!=sharedBuffer)
+		{
+			sharedBuffer->Release();
+		}
+		sharedBuffer=nullptr;
+		bmpPtr=nullptr;
+	}
+
+	/* Makes a private copy of the buffer if it is shared with another bitmap.
+	   Called before the pixels are edited. */
+	void Unshare(void)
+	{
+		if(nullptr!=sharedBuffer && true==sharedBuffer->IsShared())
+		{
+			const size_t nComponent=(size_t)pitch*ny;
+			SimpleBitmapSharedBuffer *newOwner;
+			auto newBmpPtr=AllocAligned(nComponent,newOwner);
+			memcpy(newBmpPtr,bmpPtr,sizeof(ComponentType)*nComponent);
+			FreeBuffer();
+			bmpPtr=newBmpPtr;
+			sharedBuffer=newOwner;
+		}
+	}
 
 protected:
-	/*! Returns pointer to top of the horizontal line. */
+	/*! Returns pointer to top of the horizontal line.  The buffer is un-shared first. */
 	ComponentType *LineTop(int y)
 	{
-		// &bmpPtr[0]                          ->First line
-		// &bmpPtr[nx*NumComponentPerPixel]    ->3nd line
-		// &bmpPtr[2*nx*NumComponentPerPixel]  ->2nd line
-		return bmpPtr+y*nx*NumComponentPerPixel;
+		Unshare();
+		// &bmpPtr[0]          ->First line
+		// &bmpPtr[pitch]      ->2nd line
+		// &bmpPtr[2*pitch]    ->3rd line
+		return bmpPtr+(size_t)y*pitch;
 	}
 	const ComponentType *LineTop(int y) const
 	{
-		return bmpPtr+y*nx*NumComponentPerPixel;
+		return bmpPtr+(size_t)y*pitch;
 	}
 
 public:
@@ -33,7 +275,9 @@ public:
 	{
 		nx=0;
 		ny=0;
+		pitch=0;
 		bmpPtr=nullptr;
+		sharedBuffer=nullptr;
 	}
 	~SimpleBitmapTemplate()
 	{
@@ -43,11 +287,8 @@ public:
 	{
 		nx=0;
 		ny=0;
-		if(nullptr!=bmpPtr)
-		{
-			delete [] bmpPtr;
-			bmpPtr=nullptr;
-		}
+		pitch=0;
+		FreeBuffer();
 	}
 
 	/*! This function, you will populate in the assignment. 
@@ -59,42 +300,140 @@ public:
 	void CutOut(SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &destination,int thisX0,int thisY0,int wid,int hei,ComponentType clearColor) const
 	{
 		// You don't have to deal with self-copy for full credit (destination==*this situation).
+		destination.CutOutFrom(GetView(),thisX0,thisY0,wid,hei,clearColor);
+	}
 
-		// You can leave the following part and fill the rest of this function, or you can delete the
-		// following part and write entire function yourself.
+	/*! Makes this bitmap a wid x hei copy of (srcX0,srcY0)-(srcX0+wid-1,srcY0+hei-1) of src.
+	    Pixels outside of src are clearColor.  src must not be a view of this bitmap. */
+	void CutOutFrom(const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &src,int srcX0,int srcY0,int wid,int hei,ComponentType clearColor)
+	{
+		Create(wid,hei);
 
-		// Make a bitmap of wid x hei and fill with the clear color. >>
-		destination.Create(wid,hei);
-		for(unsigned int i=0; i<destination.GetTotalNumComponent(); ++i)
+		// (inX0,inY0)-(inX1-1,inY1-1) of this bitmap comes from inside of src.
+		int inX0=0,inY0=0,inX1=wid,inY1=hei;
+		if(inX0<-srcX0)
 		{
-			destination.bmpPtr[i]=clearColor;
+			inX0=-srcX0;
 		}
-		// Make a bitmap of wid x hei and fill with the clear color. <<
+		if(inY0<-srcY0)
+		{
+			inY0=-srcY0;
+		}
+		if(src.GetWidth()-srcX0<inX1)
+		{
+			inX1=src.GetWidth()-srcX0;
+		}
+		if(src.GetHeight()-srcY0<inY1)
+		{
+			inY1=src.GetHeight()-srcY0;
+		}
+		if(inX1<=inX0 || inY1<=inY0)
+		{
+			Fill(0,0,wid,hei,clearColor);
+			return;
+		}
+
+		// Fill only the border that is outside of src.
+		Fill(0,0,wid,inY0,clearColor);
+		Fill(0,inY1,wid,hei-inY1,clearColor);
+		Fill(0,inY0,inX0,inY1-inY0,clearColor);
+		Fill(inX1,inY0,wid-inX1,inY1-inY0,clearColor);
 
-		// Write your code here.
-		int i = 0;
+		Blit(src,srcX0+inX0,srcY0+inY0,inX1-inX0,inY1-inY0,inX0,inY0);
+	}
+
+	/*! Copies (srcX0,srcY0)-(srcX0+wid-1,srcY0+hei-1) of src to this bitmap at (dstX0,dstY0).
+	    Pixels that fall outside of src or this bitmap are skipped.  The rectangle is clipped once,
+	    and then each line is copied by one memcpy.  src must not be this bitmap. */
+	void Blit(const SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &src,int srcX0,int srcY0,int wid,int hei,int dstX0,int dstY0)
+	{
+		Blit(src.GetView(),srcX0,srcY0,wid,hei,dstX0,dstY0);
+	}
 
-		for (int y = thisY0; y < (thisY0 + hei); y++)
+	/*! Same as Blit from a bitmap, but from a view.  src must not overlap with this bitmap. */
+	void Blit(const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &src,int srcX0,int srcY0,int wid,int hei,int dstX0,int dstY0)
+	{
+		if(true!=ClipBlitRect(srcX0,srcY0,wid,hei,dstX0,dstY0,src.GetWidth(),src.GetHeight()) ||
+		   true!=ClipBlitRect(dstX0,dstY0,wid,hei,srcX0,srcY0,nx,ny))
 		{
-			for (int x = thisX0; x < (thisX0 + wid); x++)
-			{
-				if (this->IsInRange(x, y))
-				{
-					auto val = bmpPtr + NumComponentPerPixel * (y * this->nx + x);
-					auto dp = destination.GetEditablePixelPointer(x - thisX0, y - thisY0);
-					for (int q = 0; q < 4; q++)
-					{
-						dp[q] = val[q];
-					}
+			return;
+		}
+		const size_t lineBytes=sizeof(ComponentType)*GetNumComponentPerLine(wid);
+		for(int y=0; y<hei; ++y)
+		{
+			memcpy(GetEditablePixelPointer(dstX0,dstY0+y),src.GetPixelPointer(srcX0,srcY0+y),lineBytes);
+		}
+	}
 
-				}
-				i++;
-			}
+	/*! Sets all components of the pixels in (x0,y0)-(x0+wid-1,y0+hei-1) to value.
+	    The part outside of the bitmap is skipped. */
+	void Fill(int x0,int y0,int wid,int hei,ComponentType value)
+	{
+		int unused0=0,unused1=0;
+		if(true!=ClipBlitRect(x0,y0,wid,hei,unused0,unused1,nx,ny))
+		{
+			return;
+		}
+		const size_t lineBytes=sizeof(ComponentType)*GetNumComponentPerLine(wid);
+		for(int y=y0; y<y0+hei; ++y)
+		{
+			SimpleBitmapSIMD::Fill(GetEditablePixelPointer(x0,y),lineBytes,&value,sizeof(ComponentType));
+		}
+	}
+
+	/*! Sets all pixels in (x0,y0)-(x0+wid-1,y0+hei-1) to the given pixel, which has NumComponentPerPixel components.
+	    The part outside of the bitmap is skipped. */
+	void FillPixel(int x0,int y0,int wid,int hei,const ComponentType pixel[])
+	{
+		int unused0=0,unused1=0;
+		if(true!=ClipBlitRect(x0,y0,wid,hei,unused0,unused1,nx,ny))
+		{
+			return;
+		}
+		const size_t lineBytes=sizeof(ComponentType)*GetNumComponentPerLine(wid);
+		if(0==x0 && wid==nx && true==IsTightlyPacked())
+		{
+			SimpleBitmapSIMD::Fill(LineTop(y0),lineBytes*hei,pixel,sizeof(ComponentType)*NumComponentPerPixel);
+			return;
+		}
+		for(int y=y0; y<y0+hei; ++y)
+		{
+			SimpleBitmapSIMD::Fill(GetEditablePixelPointer(x0,y),lineBytes,pixel,sizeof(ComponentType)*NumComponentPerPixel);
+		}
+	}
+
+private:
+	/* Clips (x0,y0)-(x0+wid-1,y0+hei-1) by a bitmap of bmpWid x bmpHei.  (otherX0,otherY0) is the
+	   corresponding corner on the other bitmap, and moves together.  Returns false if nothing is left. */
+	static bool ClipBlitRect(int &x0,int &y0,int &wid,int &hei,int &otherX0,int &otherY0,int bmpWid,int bmpHei)
+	{
+		if(x0<0)
+		{
+			wid+=x0;
+			otherX0-=x0;
+			x0=0;
+		}
+		if(y0<0)
+		{
+			hei+=y0;
+			otherY0-=y0;
+			y0=0;
+		}
+		if(bmpWid<x0+wid)
+		{
+			wid=bmpWid-x0;
+		}
+		if(bmpHei<y0+hei)
+		{
+			hei=bmpHei-y0;
 		}
+		return (0<wid && 0<hei);
 	}
 
+public:
 	/*! Returns the total number of components in the bitmap of given width and height.
-	    If, the number of components per pixel is 4, (100x100) bitmap has 4x100x100 total number of components. */
+	    If, the number of components per pixel is 4, (100x100) bitmap has 4x100x100 total number of components.
+	    The padding at the end of the lines is not included.  See GetPitch. */
 	static int GetTotalNumComponent(int wid,int hei)
 	{
 		return NumComponentPerPixel*wid*hei;
@@ -120,23 +459,41 @@ public:
 		return GetNumComponentPerLine(nx);
 	}
 
-	/*! Make a copy of the incoming bitmap. */
+	/*! Make a copy of the incoming bitmap.  The copy has the same pitch as the incoming bitmap.
+	    The pixels are not copied here.  The two bitmaps share the buffer until either of them is edited. */
 	SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &CopyFrom(const SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &incoming)
 	{
-		if(&incoming!=this)
+		if(&incoming!=this && (sharedBuffer!=incoming.sharedBuffer || nullptr==sharedBuffer))
 		{
 			CleanUp();
-			this->nx=incoming.nx;
-			this->ny=incoming.ny;
-			this->bmpPtr=new ComponentType [GetTotalNumComponent(incoming.nx,incoming.ny)];
-			for(int i=0; i<GetTotalNumComponent(incoming.nx,incoming.ny); ++i)
+			if(nullptr!=incoming.sharedBuffer)
 			{
-				this->bmpPtr[i]=incoming.bmpPtr[i];
+				incoming.sharedBuffer->AddRef();
 			}
+			this->nx=incoming.nx;
+			this->ny=incoming.ny;
+			this->pitch=incoming.pitch;
+			this->bmpPtr=incoming.bmpPtr;
+			this->sharedBuffer=incoming.sharedBuffer;
 		}
 		return *this;
 	}
 
+	/*! Returns true if the buffer is shared with another bitmap. */
+	bool IsShared(void) const
+	{
+		return nullptr!=sharedBuffer && true==sharedBuffer->IsShared();
+	}
+
+	/*! Make a tightly-packed copy of the pixels referenced by the view.
+	    The view must not refer to this bitmap. */
+	SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &CopyFrom(const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &incoming)
+	{
+		Create(incoming.GetWidth(),incoming.GetHeight());
+		Blit(incoming,0,0,incoming.GetWidth(),incoming.GetHeight(),0,0);
+		return *this;
+	}
+
 	/*! Moves the incoming bitmap to this bitmap. */
 	SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &MoveFrom(SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &incoming)
 	{
@@ -145,21 +502,135 @@ public:
 			CleanUp();
 			this->nx=incoming.nx;
 			this->ny=incoming.ny;
+			this->pitch=incoming.pitch;
 			this->bmpPtr=incoming.bmpPtr;
+			this->sharedBuffer=incoming.sharedBuffer;
 			incoming.nx=0;
 			incoming.ny=0;
+			incoming.pitch=0;
 			incoming.bmpPtr=nullptr;
+			incoming.sharedBuffer=nullptr;
 		}
 		return *this;
 	}
 
-	/*! Creates a bitmap. */
+	/*! Takes the buffer of incoming, which becomes empty, and uses it as a wid x hei bitmap of this format.
+	    pitch is in the number of components of this format.  The pixels are not touched, therefore they
+	    need to be converted before or after.  Used by the in-place pixel-format conversions.
+	    Returns false, and leaves both bitmaps as they are, if the lines do not fit in the buffer. */
+	template <class IncomingComponentType,int IncomingNumComponentPerPixel>
+	bool TakeBufferFrom(SimpleBitmapTemplate <IncomingComponentType,IncomingNumComponentPerPixel> &incoming,int wid,int hei,int pitch)
+	{
+		const size_t bufferBytes=sizeof(IncomingComponentType)*(size_t)incoming.pitch*incoming.ny;
+		if((void *)&incoming==(void *)this || wid<0 || hei<0 || pitch<GetNumComponentPerLine(wid) ||
+		   bufferBytes<sizeof(ComponentType)*(size_t)pitch*hei ||
+		   0!=(uintptr_t)incoming.bmpPtr%alignof(ComponentType))
+		{
+			return false;
+		}
+		incoming.Unshare();
+		CleanUp();
+		nx=wid;
+		ny=hei;
+		this->pitch=pitch;
+		bmpPtr=(ComponentType *)incoming.bmpPtr;
+		sharedBuffer=incoming.sharedBuffer;
+		incoming.nx=0;
+		incoming.ny=0;
+		incoming.pitch=0;
+		incoming.bmpPtr=nullptr;
+		incoming.sharedBuffer=nullptr;
+		return true;
+	}
+
+	/*! Creates a tightly-packed bitmap.  The buffer is aligned to BUFFER_ALIGNMENT bytes. */
 	bool Create(int wid,int hei)
+	{
+		return Create(wid,hei,GetNumComponentPerLine(wid));
+	}
+
+	/*! Creates a bitmap with the given pitch, which is the number of components from the top of one line
+	    to the top of the next line.  The buffer is aligned to BUFFER_ALIGNMENT bytes.  With the pitch
+	    from GetAlignedPitch, every line is aligned.  Returns false if the pitch is shorter than a line. */
+	bool Create(int wid,int hei,int pitch)
 	{
 		CleanUp();
+		if(wid<0 || hei<0 || pitch<GetNumComponentPerLine(wid))
+		{
+			return false;
+		}
 		this->nx=wid;
 		this->ny=hei;
-		this->bmpPtr=new ComponentType [GetTotalNumComponent(wid,hei)];
+		this->pitch=pitch;
+		this->bmpPtr=AllocAligned((size_t)pitch*hei,this->sharedBuffer);
+		return true;
+	}
+
+	/*! Returns the smallest pitch in the number of components for the given width,
+	    with which every line starts at a BUFFER_ALIGNMENT-byte boundary. */
+	static int GetAlignedPitch(int wid)
+	{
+		const int lineBytes=(int)sizeof(ComponentType)*GetNumComponentPerLine(wid);
+		if(0!=BUFFER_ALIGNMENT%sizeof(ComponentType))
+		{
+			return GetNumComponentPerLine(wid);
+		}
+		return ((lineBytes+BUFFER_ALIGNMENT-1)/BUFFER_ALIGNMENT*BUFFER_ALIGNMENT)/(int)sizeof(ComponentType);
+	}
+
+	/*! Returns the number of components from the top of one line to the top of the next line. */
+	int GetPitch(void) const
+	{
+		return pitch;
+	}
+
+	/*! Returns the pitch in bytes.  For example, the PNG encoder and glPixelStorei(GL_UNPACK_ROW_LENGTH,...)
+	    need to know it if the bitmap is not tightly packed. */
+	int GetPitchInBytes(void) const
+	{
+		return pitch*(int)sizeof(ComponentType);
+	}
+
+	/*! Returns true if there is no padding at the end of the lines.  The whole bitmap then can be
+	    processed as one array of GetTotalNumComponent() components. */
+	bool IsTightlyPacked(void) const
+	{
+		return pitch==GetNumComponentPerLine();
+	}
+
+	/*! Returns true if the buffer starts at a BUFFER_ALIGNMENT-byte boundary, or the bitmap is empty.
+	    A bitmap made by Create or loaded by LoadPng is aligned.  One given by SetDirect, for example, by
+	    MoveFrom(YsRawPngDecoder &), may not be.  Every line is aligned if the pitch is from GetAlignedPitch, too. */
+	bool IsAligned(void) const
+	{
+		return 0==(uintptr_t)bmpPtr%BUFFER_ALIGNMENT;
+	}
+
+	/*! Makes dst a wid x hei bitmap resampled from this bitmap.
+	    filter is one of SimpleBitmapFilter::FILTER_NEAREST, FILTER_BILINEAR, FILTER_BOX, and FILTER_LANCZOS3.
+	    The work is split into bands of lines over nThread threads.  If nThread is zero or negative,
+	    the number of hardware threads is used.  Returns false if the size is not positive or dst is this bitmap. */
+	bool Resize(SimpleBitmapTemplate <ComponentType,NumComponentPerPixel> &dst,int wid,int hei,int filter,int nThread=0) const
+	{
+		if(&dst==this)
+		{
+			return false;
+		}
+		return dst.ResizeFrom(GetView(),wid,hei,filter,nThread);
+	}
+
+	/*! Makes this bitmap a wid x hei bitmap resampled from src.  src must not be a view of this bitmap. */
+	bool ResizeFrom(const SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> &src,int wid,int hei,int filter,int nThread=0)
+	{
+		if(wid<=0 || hei<=0 || src.GetWidth()<=0 || src.GetHeight()<=0)
+		{
+			return false;
+		}
+		Create(wid,hei);
+		SimpleBitmapResampler <ComponentType,NumComponentPerPixel>::Resample(
+		    bmpPtr,nx,ny,pitch,
+		    src.GetPixelPointer(0,0),src.GetWidth(),src.GetHeight(),src.GetPitch(),
+		    filter,nThread);
 		return true;
 	}
 
@@ -175,7 +646,20 @@ public:
 		return ny;
 	}
 
-	/*! Returns the pointer to the bitmap. */
+	/*! Returns a view of the whole bitmap. */
+	SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> GetView(void) const
+	{
+		return VIEWCLASS(bmpPtr,nx,ny,pitch);
+	}
+
+	/*! Returns a view of (x0,y0)-(x0+wid-1,y0+hei-1) without copying the pixels.
+	    The part outside of the bitmap is cut off, therefore the view can be smaller than wid x hei. */
+	SimpleBitmapViewTemplate <ComponentType,NumComponentPerPixel> GetView(int x0,int y0,int wid,int hei) const
+	{
+		return GetView().GetView(x0,y0,wid,hei);
+	}
+
+	/*! Returns the pointer to the bitmap.  Use GetPitch to find the next line. */
 	const ComponentType *GetBitmapPointer(void) const
 	{
 		return bmpPtr;
@@ -184,45 +668,152 @@ public:
 	/*! Returns the pointer to the pixel. */
 	const ComponentType *GetPixelPointer(int x,int y) const
 	{
-		return bmpPtr+NumComponentPerPixel*(y*nx+x);
+		return LineTop(y)+NumComponentPerPixel*x;
 	}
 
-	/*! Returns the mutable pointer to the bitmap. */
+	/*! Returns the mutable pointer to the bitmap.
+	    If the buffer is shared with a copy, this bitmap gets its own buffer first.  Therefore, the pointer
+	    must be taken again after this bitmap is copied, otherwise the edits will show in the copy. */
 	ComponentType *GetEditableBitmapPointer(void)
 	{
+		Unshare();
 		return bmpPtr;
 	}
 
-	/*! Returns the mutable pointer to the pixel. */
+	/*! Returns the mutable pointer to the pixel.  Same rule as GetEditableBitmapPointer. */
 	ComponentType *GetEditablePixelPointer(int x,int y)
 	{
-		return bmpPtr+NumComponentPerPixel*(y*nx+x);
+		return LineTop(y)+NumComponentPerPixel*x;
 	}
 
 	/*! Flips the image upside down. */
 	void Invert(void)
 	{
+		const size_t lineBytes=sizeof(ComponentType)*GetNumComponentPerLine();
 		for(int y=0; y<ny/2; ++y)
 		{
-			auto L0=LineTop(y);
-			auto L1=LineTop(ny-1-y);
-			for(int x=0; x<GetNumComponentPerLine(); ++x)
+			SimpleBitmapSIMD::Swap(LineTop(y),LineTop(ny-1-y),lineBytes);
+		}
+	}
+
+	/*! Transposes the image.  The pixel at (x,y) moves to (y,x), and the width and the height are swapped.
+	    Large images are split over nThread threads, or all hardware threads if nThread is zero or negative.
+	    See SimpleBitmapOrient for the kernels. */
+	void Transpose(int nThread=0)
+	{
+		TransposeToNewBuffer(false,false,nThread);
+	}
+
+	/*! Rotates the image 90 degrees clockwise.  The width and the height are swapped. */
+	void Rotate90(int nThread=0)
+	{
+		// Transpose of the image read bottom-up.
+		TransposeToNewBuffer(true,false,nThread);
+	}
+
+	/*! Rotates the image 180 degrees.  Done in place unless the buffer is shared with a copy. */
+	void Rotate180(int nThread=0)
+	{
+		if(true==IsShared())
+		{
+			// Writing to a new buffer saves copying the shared pixels first.
+			THISCLASS rotated;
+			rotated.Create(nx,ny);
+			const ptrdiff_t srcPitchInBytes=sizeof(ComponentType)*(ptrdiff_t)pitch;
+			SimpleBitmapOrient::ReverseLines(
+			    rotated.bmpPtr,sizeof(ComponentType)*(ptrdiff_t)rotated.pitch,
+			    (const unsigned char *)bmpPtr+srcPitchInBytes*(0<ny ? ny-1 : 0),-srcPitchInBytes,
+			    nx,ny,sizeof(ComponentType)*NumComponentPerPixel,nThread);
+			MoveFrom(rotated);
+		}
+		else if(nullptr!=bmpPtr)
+		{
+			SimpleBitmapOrient::Rotate180InPlace(bmpPtr,sizeof(ComponentType)*(ptrdiff_t)pitch,nx,ny,sizeof(ComponentType)*NumComponentPerPixel,nThread);
+		}
+	}
+
+	/*! Rotates the image 270 degrees clockwise, or 90 degrees counterclockwise. */
+	void Rotate270(int nThread=0)
+	{
+		// Transpose written bottom-up.
+		TransposeToNewBuffer(false,true,nThread);
+	}
+
+	/*! Flips the image left to right.  Done in place unless the buffer is shared with a copy. */
+	void FlipHorizontal(int nThread=0)
+	{
+		if(true==IsShared())
+		{
+			THISCLASS flipped;
+			flipped.Create(nx,ny);
+			SimpleBitmapOrient::ReverseLines(
+			    flipped.bmpPtr,sizeof(ComponentType)*(ptrdiff_t)flipped.pitch,
+			    bmpPtr,sizeof(ComponentType)*(ptrdiff_t)pitch,
+			    nx,ny,sizeof(ComponentType)*NumComponentPerPixel,nThread);
+			MoveFrom(flipped);
+		}
+		else if(nullptr!=bmpPtr)
+		{
+			const ptrdiff_t pitchInBytes=sizeof(ComponentType)*(ptrdiff_t)pitch;
+			SimpleBitmapOrient::ReverseLines(bmpPtr,pitchInBytes,bmpPtr,pitchInBytes,nx,ny,sizeof(ComponentType)*NumComponentPerPixel,nThread);
+		}
+	}
+
+private:
+	/* The destination has a new buffer, because the width and the height are swapped. */
+	void TransposeToNewBuffer(bool srcBottomUp,bool dstBottomUp,int nThread)
+	{
+		THISCLASS transposed;
+		transposed.Create(ny,nx);
+		if(nullptr!=bmpPtr && 0<nx && 0<ny)
+		{
+			auto srcTop=(const unsigned char *)bmpPtr;
+			auto dstTop=(unsigned char *)transposed.bmpPtr;
+			ptrdiff_t srcPitchInBytes=sizeof(ComponentType)*(ptrdiff_t)pitch;
+			ptrdiff_t dstPitchInBytes=sizeof(ComponentType)*(ptrdiff_t)transposed.pitch;
+			if(true==srcBottomUp)
 			{
-				auto a=L0[x];
-				L0[x]=L1[x];
-				L1[x]=a;
+				srcTop+=srcPitchInBytes*(ny-1);
+				srcPitchInBytes=-srcPitchInBytes;
 			}
+			if(true==dstBottomUp)
+			{
+				dstTop+=dstPitchInBytes*(transposed.ny-1);
+				dstPitchInBytes=-dstPitchInBytes;
+			}
+			SimpleBitmapOrient::Transpose(dstTop,dstPitchInBytes,srcTop,srcPitchInBytes,nx,ny,sizeof(ComponentType)*NumComponentPerPixel,nThread);
 		}
+		MoveFrom(transposed);
 	}
 
+public:
+
 	/*! Sets an array and width and height dirctory.
 	    After this function, this class takes an ownership of incomingBmpPtr.
-	    It must not be deleted outside of this class. */
+	    It must not be deleted outside of this class.
+	    incomingBmpPtr must be tightly packed and allocated by new [], and does not have to be aligned. */
 	void SetDirect(int wid,int hei,ComponentType *incomingBmpPtr)
 	{
+		CleanUp();
+		nx=wid;
+		ny=hei;
+		pitch=GetNumComponentPerLine(wid);
+		bmpPtr=incomingBmpPtr;
+		sharedBuffer=(nullptr!=incomingBmpPtr ? new SimpleBitmapSharedBuffer(incomingBmpPtr,DeleteDirect) : nullptr);
+	}
+
+	/*! Uses the pixels at incomingBmpPtr, which are kept alive by owner, for example, a memory-mapped file.
+	    This class takes the reference of owner, which must have been made by new with the reference count of one.
+	    pitch is in the number of components.  An edit first copies the pixels to its own buffer
+	    if owner is shared with another bitmap. */
+	void SetSharedBuffer(int wid,int hei,int pitch,ComponentType *incomingBmpPtr,SimpleBitmapSharedBuffer *owner)
+	{
+		CleanUp();
 		nx=wid;
 		ny=hei;
+		this->pitch=pitch;
 		bmpPtr=incomingBmpPtr;
+		sharedBuffer=owner;
 	}
 
 	/*! Returns true if (x,y) is inside the bitmap. */
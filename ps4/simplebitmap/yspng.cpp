@@ -28,9 +28,25 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //////////////////////////////////////////////////////////// */
 
 #include <stdio.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	// SSSE3 kernels are compiled for SSSE3 by the target attribute, and used only if the CPU has it.
+	#define YSPNG_X86_GCC
+	#include <tmmintrin.h>
+#endif
 
 #include "yspng.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 
 unsigned int YsGenericPngDecoder::verboseMode=YSFALSE;
@@ -144,6 +160,7 @@ YsPngPalette::YsPngPalette()
 {
 	nEntry=0;
 	entry=NULL;
+	nAlloc=0;
 }
 
 YsPngPalette::~YsPngPalette()
@@ -161,16 +178,16 @@ int YsPngPalette::Decode(unsigned length,unsigned char dat[])
 		return YSERR;
 	}
 
-	if(entry!=NULL)
+	nEntry=0;
+	if(nAlloc<length)
 	{
 		delete [] entry;
-		nEntry=0;
-		entry=NULL;
+		entry=new unsigned char [length];
+		nAlloc=length;
 	}
 
 	if(length>0)
 	{
-		entry=new unsigned char [length];
 		if(entry!=NULL)
 		{
 			unsigned int i;
@@ -269,6 +286,136 @@ size_t YsPngBinaryMemoryStream::Read(unsigned char buf[],size_t readSize)
 	return byteCopied;
 }
 
+const unsigned char *YsPngBinaryMemoryStream::ReadInPlace(size_t readSize,size_t &nRead)
+{
+	nRead=(dataSize-offset<readSize ? dataSize-offset : readSize);
+	const unsigned char *ptr=binaryData+offset;
+	offset+=nRead;
+	return ptr;
+}
+
+const unsigned char *YsPngGenericBinaryStream::ReadInPlace(size_t,size_t &nRead)
+{
+	nRead=0;
+	return nullptr;
+}
+
+YsPngBinaryMappedStream::YsPngBinaryMappedStream()
+{
+	offset=0;
+	dataSize=0;
+	dataPtr=nullptr;
+	allocPtr=nullptr;
+	mapped=false;
+}
+
+YsPngBinaryMappedStream::YsPngBinaryMappedStream(const char fn[])
+{
+	offset=0;
+	dataSize=0;
+	dataPtr=nullptr;
+	allocPtr=nullptr;
+	mapped=false;
+	Open(fn);
+}
+
+YsPngBinaryMappedStream::~YsPngBinaryMappedStream()
+{
+	Close();
+}
+
+int YsPngBinaryMappedStream::Open(const char fn[])
+{
+	Close();
+
+#ifndef _WIN32
+	int fd=open(fn,O_RDONLY);
+	if(0<=fd)
+	{
+		struct stat st;
+		if(0==fstat(fd,&st) && 0<st.st_size)
+		{
+			void *ptr=mmap(nullptr,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+			if(MAP_FAILED!=ptr)
+			{
+				// Read ahead aggressively.  The pages behind can be dropped, as they are not read again.
+				madvise(ptr,(size_t)st.st_size,MADV_SEQUENTIAL);
+				dataPtr=(const unsigned char *)ptr;
+				dataSize=(size_t)st.st_size;
+				mapped=true;
+			}
+		}
+		close(fd);
+		if(true==mapped)
+		{
+			return YSOK;
+		}
+	}
+#endif
+
+	FILE *fp=fopen(fn,"rb");
+	if(NULL==fp)
+	{
+		return YSERR;
+	}
+	fseek(fp,0,SEEK_END);
+	const long fileSize=ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	if(0<fileSize)
+	{
+		allocPtr=new unsigned char [fileSize];
+		dataSize=fread(allocPtr,1,(size_t)fileSize,fp);
+	}
+	dataPtr=allocPtr;
+	fclose(fp);
+	return YSOK;
+}
+
+void YsPngBinaryMappedStream::Close(void)
+{
+#ifndef _WIN32
+	if(true==mapped)
+	{
+		munmap((void *)dataPtr,dataSize);
+	}
+#endif
+	delete [] allocPtr;
+	offset=0;
+	dataSize=0;
+	dataPtr=nullptr;
+	allocPtr=nullptr;
+	mapped=false;
+}
+
+bool YsPngBinaryMappedStream::IsOpen(void) const
+{
+	return nullptr!=dataPtr;
+}
+
+size_t YsPngBinaryMappedStream::GetSize(void) const
+{
+	return dataSize;
+}
+
+size_t YsPngBinaryMappedStream::Read(unsigned char buf[],size_t readSize)
+{
+	size_t nRead;
+	const unsigned char *ptr=ReadInPlace(readSize,nRead);
+	if(0<nRead)
+	{
+		memcpy(buf,ptr,nRead);
+	}
+	return nRead;
+}
+
+const unsigned char *YsPngBinaryMappedStream::ReadInPlace(size_t readSize,size_t &nRead)
+{
+	nRead=(dataSize-offset<readSize ? dataSize-offset : readSize);
+	const unsigned char *ptr=dataPtr+offset;
+	offset+=nRead;
+	return ptr;
+}
+
 
 
 ////////////////////////////////////////////////////////////
@@ -276,6 +423,21 @@ size_t YsPngBinaryMemoryStream::Read(unsigned char buf[],size_t readSize)
 YsGenericPngDecoder::YsGenericPngDecoder()
 {
 	Initialize();
+	stopRequested=false;
+}
+
+void YsGenericPngDecoder::Reset(void)
+{
+	Initialize();
+	hdr.width=0;
+	hdr.height=0;
+	hdr.bitDepth=0;
+	hdr.colorType=0;
+	hdr.compressionMethod=0;
+	hdr.filterMethod=0;
+	hdr.interlaceMethod=0;
+	plt.nEntry=0;
+	stopRequested=false;
 }
 
 void YsGenericPngDecoder::Initialize(void)
@@ -341,6 +503,42 @@ int YsGenericPngDecoder::ReadChunk(unsigned &length,unsigned char *&buf,unsigned
 	return YSOK;
 }
 
+int YsGenericPngDecoder::ReadChunkInPlace(unsigned &length,const unsigned char *&buf,unsigned &chunkType,unsigned &crc,YsPngGenericBinaryStream &binStream)
+{
+	size_t nRead;
+	const unsigned char *head=binStream.ReadInPlace(8,nRead);
+	if(nullptr==head || nRead<8)
+	{
+		return YSERR;
+	}
+	length=PngGetUnsignedInt(head);
+	chunkType=PngGetUnsignedInt(head+4);
+
+	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	{
+		printf("Chunk name=%c%c%c%c\n",head[4],head[5],head[6],head[7]);
+	}
+
+	buf=binStream.ReadInPlace(length,nRead);
+	if(nRead<length)
+	{
+		return YSERR;
+	}
+	if(0==length)
+	{
+		buf=NULL;
+	}
+
+	const unsigned char *tail=binStream.ReadInPlace(4,nRead);
+	if(nRead<4)
+	{
+		return YSERR;
+	}
+	crc=PngGetUnsignedInt(tail);
+
+	return YSOK;
+}
+
 ////////////////////////////////////////////////////////////
 
 int YsPngHuffmanTree::leakTracker=0;
@@ -462,1561 +660,2049 @@ void YsPngUncompressor::MakeDynamicHuffmanCode(unsigned hLength[],unsigned hCode
 	}
 }
 
-int YsPngUncompressor::DecodeDynamicHuffmanCode
-	   (unsigned int &hLit,unsigned int &hDist,unsigned int &hCLen,
-	    unsigned int *&hLengthLiteral,unsigned int *&hCodeLiteral,
-	    unsigned int *&hLengthDist,unsigned int *&hCodeDist,
-	    unsigned int hLengthBuf[322],unsigned int hCodeBuf[322],
-	    const unsigned char dat[],unsigned int &bytePtr,unsigned int &bitPtr)
+void YsPngBitReader::Begin(const unsigned char dat[],unsigned int length,unsigned int bytePtr)
 {
-	unsigned int i;
-	hLit=0;
-	hDist=0;
-	hCLen=0;
+	this->dat=dat;
+	this->length=length;
+	this->bytePtr=bytePtr;
+	bitBuf=0;
+	nBitInBuf=0;
+	nPadByte=0;
+}
+
+void YsPngBitReader::RefillSlow(void)
+{
+	while(nBitInBuf<=56)
+	{
+		if(bytePtr<length)
+		{
+			bitBuf|=(unsigned long long int)dat[bytePtr++]<<nBitInBuf;
+		}
+		else
+		{
+			++nPadByte;
+		}
+		nBitInBuf+=8;
+	}
+}
 
-	hLit=GetNextMultiBit(dat,bytePtr,bitPtr,5);
-	hDist=GetNextMultiBit(dat,bytePtr,bitPtr,5);
-	hCLen=GetNextMultiBit(dat,bytePtr,bitPtr,4);
+unsigned int YsPngBitReader::Rewind(void)
+{
+	Consume(nBitInBuf&7);
+
+	// The whole bytes left in the buffer are not used yet.  The zero padding never came from dat.
+	const unsigned int nByteInBuf=nBitInBuf/8;
+	bytePtr-=(nPadByte<nByteInBuf ? nByteInBuf-nPadByte : 0);
+	bitBuf=0;
+	nBitInBuf=0;
+	nPadByte=0;
+	return bytePtr;
+}
 
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+void YsPngBitReader::SeekBit(unsigned long long int bitPos)
+{
+	Begin(dat,length,(unsigned int)(bitPos/8));
+	if(0!=(bitPos&7))
 	{
-		printf("hLit=%d hDist=%d hCLen=%d\n",hLit,hDist,hCLen);
+		Refill();
+		Consume((unsigned int)(bitPos&7));
 	}
+}
 
-	const unsigned int codeLengthLen=19;
-	unsigned codeLengthOrder[codeLengthLen]=
+////////////////////////////////////////////////////////////
+
+static const unsigned short YsPngLengthBase[29]=
+{
+	3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258
+};
+static const unsigned char YsPngLengthExtraBits[29]=
+{
+	0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
+};
+static const unsigned short YsPngDistanceBase[30]=
+{
+	1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577
+};
+static const unsigned char YsPngDistanceExtraBits[30]=
+{
+	0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13
+};
+
+YsPngHuffmanTable::Entry YsPngHuffmanTable::MakeEntry(unsigned int symbol,unsigned int nBit,int alphabet)
+{
+	Entry entry;
+	entry.value=0;
+	entry.nBit=(unsigned char)nBit;
+	entry.op=OP_INVALID;
+	switch(alphabet)
+	{
+	case ALPHABET_CODE_LENGTH:
+		entry.value=(unsigned short)symbol;
+		entry.op=OP_LITERAL;
+		break;
+	case ALPHABET_LITERAL_LENGTH:
+		if(symbol<256)
+		{
+			entry.value=(unsigned short)symbol;
+			entry.op=OP_LITERAL;
+		}
+		else if(256==symbol)
+		{
+			entry.op=OP_END;
+		}
+		else if(symbol<=285)
+		{
+			entry.value=YsPngLengthBase[symbol-257];
+			entry.op=(unsigned char)(OP_BASE|YsPngLengthExtraBits[symbol-257]);
+		}
+		break;
+	case ALPHABET_DISTANCE:
+		if(symbol<30)
+		{
+			entry.value=YsPngDistanceBase[symbol];
+			entry.op=(unsigned char)(OP_BASE|YsPngDistanceExtraBits[symbol]);
+		}
+		break;
+	}
+	return entry;
+}
+
+int YsPngHuffmanTable::Make(unsigned int nSymbol,const unsigned int codeLength[],unsigned int rootBits,int alphabet)
+{
+	const unsigned int maxBits=15,maxRootBits=10,maxSymbol=320;
+	if(maxSymbol<nSymbol)
 	{
-		16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15
-	};
-	unsigned codeLengthCode[codeLengthLen];
-	for(i=0; i<codeLengthLen; i++)
+		return YSERR;
+	}
+	rootBits=(maxRootBits<rootBits ? maxRootBits : rootBits);
+
+	unsigned int count[maxBits+1];
+	for(auto &c : count)
 	{
-		codeLengthCode[i]=0;
+		c=0;
 	}
-	for(i=0; i<hCLen+4; i++)
+	for(unsigned int s=0; s<nSymbol; ++s)
 	{
-		codeLengthCode[codeLengthOrder[i]]=GetNextMultiBit(dat,bytePtr,bitPtr,3);
-		// printf("Code length code[%d]=%d (for %d)\n",
-		//     codeLengthOrder[i],codeLengthCode[i],codeLengthOrder[i]);
+		if(maxBits<codeLength[s])
+		{
+			return YSERR;
+		}
+		++count[codeLength[s]];
 	}
+	count[0]=0;
 
-	unsigned hLengthCode[codeLengthLen],hCodeCode[codeLengthLen];
-	MakeDynamicHuffmanCode(hLengthCode,hCodeCode,codeLengthLen,codeLengthCode);
-
-	if(YSTRUE==YsGenericPngDecoder::verboseMode)
+	int left=1;
+	for(unsigned int len=1; len<=maxBits; ++len)
 	{
-		for(i=0; i<hCLen+4; i++)
+		left=left*2-(int)count[len];
+		if(left<0)
 		{
-			printf("CodeLengthLen[%3d]=%d  HuffmanCode=%08x\n",i,codeLengthCode[i],hCodeCode[i]);
+			return YSERR;  // Over-subscribed.
 		}
 	}
 
-	// for(i=0; i<codeLengthLen; i++)
-	// {
-	// 	printf("[%d] %08x %08xx\n",i,hLengthCode[i],hCodeCode[i]);
-	// }
-
-	hLengthLiteral=hLengthBuf;
-	hCodeLiteral=hCodeBuf;
-	hLengthDist=hLengthBuf+hLit+257;
-	hCodeDist=hCodeBuf+hLit+257;
-
-	YsPngHuffmanTree *lengthTree,*lengthTreePtr;
-	lengthTree=MakeHuffmanTree(codeLengthLen,hLengthCode,hCodeCode);
-
-	unsigned int nExtr;
-	nExtr=0;
-	lengthTreePtr=lengthTree;
-	while(nExtr<hLit+257+hDist+1)
+	// Canonical codes as in RFC1951, bit-reversed because the stream is read from the least-significant bit.
+	unsigned int nextCode[maxBits+1],reversedCode[maxSymbol];
+	unsigned int code=0;
+	nextCode[0]=0;
+	for(unsigned int len=1; len<=maxBits; ++len)
+	{
+		code=(code+count[len-1])<<1;
+		nextCode[len]=code;
+	}
+	for(unsigned int s=0; s<nSymbol; ++s)
 	{
-		lengthTreePtr=lengthTreePtr->Traverse(GetNextBit(dat,bytePtr,bitPtr));
-		if(lengthTreePtr->Zero()==NULL && lengthTreePtr->One()==NULL)
+		const unsigned int len=codeLength[s];
+		reversedCode[s]=0;
+		if(0<len)
 		{
-			unsigned value,copyLength;
-			value=lengthTreePtr->dat;
-
-			// printf("Value=%d\n",value);
-
-			if(value<=15)
-			{
-				hLengthBuf[nExtr++]=value;
-			}
-			else if(value==16)
-			{
-				copyLength=3+GetNextMultiBit(dat,bytePtr,bitPtr,2);
-				// printf("copyLength=%d\n",copyLength);
-				while(copyLength>0)
-				{
-					hLengthBuf[nExtr]=hLengthBuf[nExtr-1];
-					nExtr++;
-					copyLength--;
-				}
-			}
-			else if(value==17)
-			{
-				copyLength=3+GetNextMultiBit(dat,bytePtr,bitPtr,3);
-				// printf("copyLength=%d\n",copyLength);
-				while(copyLength>0)
-				{
-					hLengthBuf[nExtr++]=0;
-					copyLength--;
-				}
-			}
-			else if(value==18)
+			unsigned int c=nextCode[len]++,r=0;
+			for(unsigned int i=0; i<len; ++i)
 			{
-				copyLength=11+GetNextMultiBit(dat,bytePtr,bitPtr,7);
-				// printf("copyLength=%d\n",copyLength);
-				while(copyLength>0)
-				{
-					hLengthBuf[nExtr++]=0;
-					copyLength--;
-				}
+				r=(r<<1)|(c&1);
+				c>>=1;
 			}
+			reversedCode[s]=r;
+		}
+	}
 
-			lengthTreePtr=lengthTree;
-
-			// printf("nExtr=%d/%d\n",nExtr,hLit+257+hDist+1);
+	// A sub-table is as large as the longest code under the root index needs.
+	const unsigned int rootSize=1u<<rootBits,rootMask=rootSize-1;
+	unsigned char subBits[1<<maxRootBits];
+	unsigned short subOffset[1<<maxRootBits];
+	for(unsigned int i=0; i<rootSize; ++i)
+	{
+		subBits[i]=0;
+	}
+	for(unsigned int s=0; s<nSymbol; ++s)
+	{
+		if(rootBits<codeLength[s])
+		{
+			const unsigned int prefix=reversedCode[s]&rootMask;
+			const unsigned int need=codeLength[s]-rootBits;
+			subBits[prefix]=(unsigned char)(subBits[prefix]<need ? need : subBits[prefix]);
 		}
 	}
 
-	if(YSTRUE==YsGenericPngDecoder::verboseMode)
+	Entry invalid;
+	invalid.value=0;
+	invalid.nBit=0;
+	invalid.op=OP_INVALID;
+
+	unsigned int tableSize=rootSize;
+	for(unsigned int i=0; i<rootSize; ++i)
 	{
-		for(i=0; i<hLit+257; i++)
+		if(0<subBits[i])
 		{
-			printf("LiteralLength[%3d]=%d\n",i,hLengthLiteral[i]);
+			subOffset[i]=(unsigned short)tableSize;
+			tableSize+=(1u<<subBits[i]);
 		}
-		for(i=0; i<hDist+1; i++)
+	}
+	this->rootBits=rootBits;
+	table.assign(tableSize,invalid);
+	for(unsigned int i=0; i<rootSize; ++i)
+	{
+		if(0<subBits[i])
 		{
-			printf("Dist [%d] Length %d\n",i,hLengthDist[i]);
+			table[i].value=subOffset[i];
+			table[i].nBit=subBits[i];
+			table[i].op=OP_LINK;
 		}
 	}
 
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	for(unsigned int s=0; s<nSymbol; ++s)
 	{
-		printf("Making Huffman Code from Code Lengths\n");
+		const unsigned int len=codeLength[s];
+		if(0==len)
+		{
+			continue;
+		}
+		const Entry entry=MakeEntry(s,len,alphabet);
+		const unsigned int rev=reversedCode[s];
+		if(len<=rootBits)
+		{
+			for(unsigned int i=rev; i<rootSize; i+=(1u<<len))
+			{
+				table[i]=entry;
+			}
+		}
+		else
+		{
+			const unsigned int prefix=rev&rootMask;
+			const unsigned int subSize=1u<<subBits[prefix];
+			for(unsigned int i=(rev>>rootBits); i<subSize; i+=(1u<<(len-rootBits)))
+			{
+				table[subOffset[prefix]+i]=entry;
+			}
+		}
 	}
-	MakeDynamicHuffmanCode(hLengthLiteral,hCodeLiteral,hLit+257,hLengthLiteral);
-	MakeDynamicHuffmanCode(hLengthDist,hCodeDist,hDist+1,hLengthDist);
-
-	DeleteHuffmanTree(lengthTree);
-
 	return YSOK;
 }
 
-YsPngHuffmanTree *YsPngUncompressor::MakeHuffmanTree(unsigned n,unsigned hLength[],unsigned hCode[])
+static const YsPngHuffmanTable &YsPngFixedLiteralTable(void)
 {
-	unsigned i,j,mask;
-	YsPngHuffmanTree *root,*ptr;
-	root=new YsPngHuffmanTree;
-
-	for(i=0; i<n; i++)
+	class FixedLiteralTable : public YsPngHuffmanTable
 	{
-		if(hLength[i]>0)
+	public:
+		FixedLiteralTable()
 		{
-			ptr=root;
-			mask=(1<<(hLength[i]-1));
-			for(j=0; j<hLength[i]; j++)
+			unsigned int hLength[288];
+			for(unsigned int i=0; i<288; ++i)
 			{
-				if(hCode[i]&mask)
-				{
-					if(ptr->One()==NULL)
-					{
-						ptr->One()=new YsPngHuffmanTree;
-					}
-					ptr=ptr->One();
-				}
-				else
-				{
-					if(ptr->Zero()==NULL)
-					{
-						ptr->Zero()=new YsPngHuffmanTree;
-					}
-					ptr=ptr->Zero();
-				}
-				mask>>=1;
+				hLength[i]=(i<=143 ? 8 : (i<=255 ? 9 : (i<=279 ? 7 : 8)));
 			}
-			ptr->dat=i;
+			Make(288,hLength,9,ALPHABET_LITERAL_LENGTH);
 		}
-	}
-
-	return root;
+	};
+	static const FixedLiteralTable table;
+	return table;
 }
 
-void YsPngUncompressor::DeleteHuffmanTree(YsPngHuffmanTree *node)
+static const YsPngHuffmanTable &YsPngFixedDistanceTable(void)
 {
-	YsPngHuffmanTree::DeleteHuffmanTree(node);
+	class FixedDistanceTable : public YsPngHuffmanTable
+	{
+	public:
+		FixedDistanceTable()
+		{
+			// 5 bits fixed.  Codes 30 and 31 do not appear in a valid stream.
+			unsigned int hLength[32];
+			for(auto &l : hLength)
+			{
+				l=5;
+			}
+			Make(32,hLength,5,ALPHABET_DISTANCE);
+		}
+	};
+	static const FixedDistanceTable table;
+	return table;
 }
 
-unsigned YsPngUncompressor::GetCopyLength(unsigned value,unsigned char dat[],unsigned &bytePtr,unsigned &bitPtr)
+////////////////////////////////////////////////////////////
+
+int YsPngUncompressor::DecodeDynamicHuffmanCode(YsPngBitReader &reader,YsPngHuffmanTable &literalTable,YsPngHuffmanTable &distTable)
 {
-	unsigned copyLength;
+	unsigned int i;
 
-	if(value<=264)
-	{
-		copyLength=3+(value-257);
-	}
-	else if(value>=285)
+	reader.Refill();
+	const unsigned int hLit=reader.Get(5);
+	const unsigned int hDist=reader.Get(5);
+	const unsigned int hCLen=reader.Get(4);
+
+	if(YsGenericPngDecoder::verboseMode==YSTRUE)
 	{
-		copyLength=258;
+		printf("hLit=%d hDist=%d hCLen=%d\n",hLit,hDist,hCLen);
 	}
-	else
+	if(29<hLit || 29<hDist)
 	{
-		unsigned base,offset,extBits;
-		extBits=1+(value-265)/4;
-		base=(8<<((value-265)/4))+3;
-		offset=((value-265)&3)*(2<<((value-265)/4));
-
-		copyLength=GetNextMultiBit(dat,bytePtr,bitPtr,extBits);
-		copyLength+=base+offset;
+		printf("Too many literal/length or distance codes.\n");
+		return YSERR;
 	}
 
-	return copyLength;
-}
-
-unsigned YsPngUncompressor::GetBackwardDistance
-   (unsigned distCode,unsigned char dat[],unsigned &bytePtr,unsigned &bitPtr)
-{
-	unsigned backDist;
-
-	if(distCode<=3)
+	const unsigned int codeLengthLen=19;
+	const unsigned codeLengthOrder[codeLengthLen]=
 	{
-		backDist=distCode+1;
-	}
-	else
+		16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15
+	};
+	unsigned codeLengthCode[codeLengthLen];
+	for(i=0; i<codeLengthLen; i++)
 	{
-		unsigned base,offset,extBits;
-
-		base=(4<<((distCode-4)/2))+1;
-		offset=(distCode&1)*(2<<((distCode-4)/2));
-		extBits=(distCode-2)/2;
-
-		backDist=GetNextMultiBit(dat,bytePtr,bitPtr,extBits);
-		backDist+=base+offset;
+		codeLengthCode[i]=0;
 	}
-
-	return backDist;
-}
-
-int YsPngUncompressor::Uncompress(unsigned length,unsigned char dat[])
-{
-	unsigned windowUsed;
-	unsigned char *windowBuf;
-	unsigned nByteExtracted;
-
-	YsPngHuffmanTree *codeTree=NULL;
-	YsPngHuffmanTree *distTree=NULL;
-
-
-	windowBuf=NULL;
-
-	unsigned bytePtr,bitPtr;
-	bytePtr=0;
-	bitPtr=1;
-	nByteExtracted=0;
-
-
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	reader.Refill();
+	for(i=0; i<hCLen+4; i++)
 	{
-		printf("Begin zLib block length=%d bytePtr=%d bitPtr=0x%02x\n",length,bytePtr,bitPtr);
+		codeLengthCode[codeLengthOrder[i]]=reader.Get(3);
 	}
 
-	unsigned char cmf,flg;
-	cmf=dat[bytePtr++];
-	flg=dat[bytePtr++];
-
-	unsigned cm,cInfo,windowSize;
-	cm=cmf&0x0f;
-	if(cm!=8)
+	if(YSTRUE==YsGenericPngDecoder::verboseMode)
 	{
-		printf("Unsupported compression method! (%d)\n",cm);
-		goto ERREND;
+		for(i=0; i<codeLengthLen; i++)
+		{
+			printf("CodeLengthLen[%3d]=%d\n",i,codeLengthCode[i]);
+		}
 	}
 
-	cInfo=(cmf&0xf0)>>4;
-	windowSize=1<<(cInfo+8);
-
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	if(YSOK!=codeLengthTable.Make(codeLengthLen,codeLengthCode,7,YsPngHuffmanTable::ALPHABET_CODE_LENGTH))
 	{
-		printf("cInfo=%d, Window Size=%d\n",cInfo,windowSize);
+		printf("Broken code-length code.\n");
+		return YSERR;
 	}
 
-	windowBuf=new unsigned char [windowSize];
-	windowUsed=0;
-
-
-
-	unsigned fCheck,fDict,fLevel;
-	fCheck=(flg&15);
-	fDict=(flg&32)>>5;
-	fLevel=(flg&192)>>6;
-
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
-	{
-		printf("fCheck=%d fDict=%d fLevel=%d\n",fCheck,fDict,fLevel);
-	}
-
-
-	if(fDict!=0)
-	{
-		printf("PNG is not supposed to have a preset dictionary.\n");
-		goto ERREND;
-	}
-
-
-	YsPngHuffmanTree *codeTreePtr;
-	YsPngHuffmanTree *distTreePtr;
-
-	for(;;)
+	const unsigned int nTotal=hLit+257+hDist+1;
+	unsigned int hLength[286+30];
+	unsigned int nExtr=0;
+	while(nExtr<nTotal)
 	{
-		unsigned bFinal,bType;
-
-		bFinal=GetNextBit(dat,bytePtr,bitPtr);
-		bType=GetNextMultiBit(dat,bytePtr,bitPtr,2);
-
-		if(bytePtr>=length)
+		reader.Refill();
+		const YsPngHuffmanTable::Entry &entry=codeLengthTable.Lookup(reader.bitBuf);
+		if(YsPngHuffmanTable::OP_INVALID==entry.op)
 		{
-			printf("Buffer overflow\n");
-			goto ERREND;
+			printf("Invalid code-length code.\n");
+			return YSERR;
 		}
+		reader.Consume(entry.nBit);
 
-		if(YsGenericPngDecoder::verboseMode==YSTRUE)
+		const unsigned int value=entry.value;
+		if(value<=15)
 		{
-			printf("bFinal=%d bType=%d\n",bFinal,bType);
+			hLength[nExtr++]=value;
 		}
-
-		if(bType==0) // No Compression
+		else
 		{
-			unsigned len;
-			if(bitPtr!=1)
-			{
-				bitPtr=1;
-				bytePtr++;
-			}
-			if(bytePtr>=length)
-			{
-				printf("Buffer overflow\n");
-				goto ERREND;
-			}
-
-			len=dat[bytePtr]+dat[bytePtr+1]*256;
-			bytePtr+=4;
-
-			// Feed len bytes
-
-			for(int i=0; i<(int)len; i++)  // 2010/02/08
+			unsigned int fill=0,copyLength;
+			if(value==16)
 			{
-				output->Output(dat[bytePtr+i]);
-				windowBuf[windowUsed++]=dat[bytePtr+i];  // 2014/03/22
-				windowUsed&=(windowSize-1);              // 2014/03/22
+				if(0==nExtr)
+				{
+					printf("Nothing to repeat in the code lengths.\n");
+					return YSERR;
+				}
+				fill=hLength[nExtr-1];
+				copyLength=3+reader.Get(2);
 			}
-
-			bytePtr+=len;
-		}
-		else if(bType==1 || bType==2)
-		{
-			codeTree=NULL;
-
-			if(bType==1)
+			else if(value==17)
 			{
-				unsigned hLength[288],hCode[288];
-				MakeFixedHuffmanCode(hLength,hCode);
-				codeTree=MakeHuffmanTree(288,hLength,hCode);
-				distTree=NULL;
+				copyLength=3+reader.Get(3);
 			}
 			else
 			{
-				unsigned hLit,hDist,hCLen;
-				unsigned *hLengthLiteral,*hCodeLiteral;
-				unsigned *hLengthDist,*hCodeDist;
-				unsigned hLengthBuf[322],hCodeBuf[322];
-
-				DecodeDynamicHuffmanCode
-				   (hLit,hDist,hCLen,
-				    hLengthLiteral,hCodeLiteral,hLengthDist,hCodeDist,hLengthBuf,hCodeBuf,
-				    dat,bytePtr,bitPtr);
-
-				if(YsGenericPngDecoder::verboseMode==YSTRUE)
-				{
-					printf("Making Huffman Tree\n");
-				}
-				codeTree=MakeHuffmanTree(hLit+257,hLengthLiteral,hCodeLiteral);
-				distTree=MakeHuffmanTree(hDist+1,hLengthDist,hCodeDist);
+				copyLength=11+reader.Get(7);
 			}
-
-
-			if(YsGenericPngDecoder::verboseMode==YSTRUE)
+			if(nTotal<nExtr+copyLength)
 			{
-				printf("Huffman table paprared\n");
+				printf("Too many code lengths.\n");
+				return YSERR;
 			}
-
-
-			codeTreePtr=codeTree;
-			if(codeTree!=NULL)
+			while(copyLength>0)
 			{
-				for(;;)
-				{
-					codeTreePtr=codeTreePtr->Traverse(GetNextBit(dat,bytePtr,bitPtr));
-
-					if(codeTreePtr==NULL)
-					{
-						printf("Huffman Decompression: Reached NULL node.\n");
-						goto ERREND;
-					}
-
-					if(codeTreePtr->Zero()==NULL && codeTreePtr->One()==NULL)
-					{
-						// printf("[%d]\n",codeTreePtr->dat);
-
-						unsigned value;
-						value=codeTreePtr->dat;
-						if(value<256)
-						{
-							windowBuf[windowUsed++]=(unsigned char)value;
-							windowUsed&=(windowSize-1);
-							if(output->Output((unsigned char)value)!=YSOK)
-							{
-								goto ERREND;
-							}
-							nByteExtracted++;
-						}
-						else if(value==256)
-						{
-							break;
-						}
-						else if(value<=285)
-						{
-							unsigned copyLength,distCode,backDist;
-							copyLength=GetCopyLength(value,dat,bytePtr,bitPtr);
-							// printf("CopyLength %d\n",copyLength);
-
-							if(bType==1)
-							{
-								distCode=16*GetNextBit(dat,bytePtr,bitPtr);  // 5 bits fixed
-								distCode+=8*GetNextBit(dat,bytePtr,bitPtr);  // Reversed order
-								distCode+=4*GetNextBit(dat,bytePtr,bitPtr);
-								distCode+=2*GetNextBit(dat,bytePtr,bitPtr);
-								distCode+=  GetNextBit(dat,bytePtr,bitPtr);
-							}
-							else
-							{
-								distTreePtr=distTree;
-								while(distTreePtr->Zero()!=NULL || distTreePtr->One()!=NULL)
-								{
-									distTreePtr=distTreePtr->Traverse(GetNextBit(dat,bytePtr,bitPtr));
-								}
-								distCode=distTreePtr->dat;
-							}
-							backDist=GetBackwardDistance(distCode,dat,bytePtr,bitPtr);
-							// printf("DistCode %d BackDist %d\n",distCode,backDist);
-
-
-							unsigned i;
-							for(i=0; i<copyLength; i++)
-							{
-								unsigned char dat;
-								dat=windowBuf[(windowUsed-backDist)&(windowSize-1)];
-								if(output->Output(dat)!=YSOK)
-								{
-									goto ERREND;
-								}
-								nByteExtracted++;
-								windowBuf[windowUsed++]=dat;
-								windowUsed&=(windowSize-1);
-							}
-						}
-
-						codeTreePtr=codeTree;
-					}
-
-					if(length<=bytePtr)
-					{
-						goto ERREND;
-					}
-				}
+				hLength[nExtr++]=fill;
+				copyLength--;
 			}
-
-
-			DeleteHuffmanTree(codeTree);
-			DeleteHuffmanTree(distTree);
-			codeTree=NULL;
-			distTree=NULL;
-		}
-		else
-		{
-			printf("Unknown compression type (bType=3)\n");
-			goto ERREND;
 		}
 
-
-		if(bFinal!=0)
+		if(true==reader.IsOverrun())
 		{
-			break;
+			printf("Buffer overflow\n");
+			return YSERR;
 		}
 	}
 
-	delete [] windowBuf;
-	windowBuf=NULL;
-
-
-
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	if(YSTRUE==YsGenericPngDecoder::verboseMode)
 	{
-		printf("End zLib block length=%d bytePtr=%d bitPtr=0x%02x\n",length,bytePtr,bitPtr);
-		printf("Huffman Tree Leak Tracker = %d\n",YsPngHuffmanTree::leakTracker);
-		printf("Output %d bytes.\n",nByteExtracted);
+		for(i=0; i<hLit+257; i++)
+		{
+			printf("LiteralLength[%3d]=%d\n",i,hLength[i]);
+		}
+		for(i=0; i<hDist+1; i++)
+		{
+			printf("Dist [%d] Length %d\n",i,hLength[hLit+257+i]);
+		}
 	}
 
-	return YSOK;
-
-ERREND:
-	if(windowBuf!=NULL)
-	{
-		delete [] windowBuf;
-	}
-	if(codeTree!=NULL)
+	if(0==hLength[256])
 	{
-		DeleteHuffmanTree(codeTree);
+		printf("No end-of-block code.\n");
+		return YSERR;
 	}
-	if(distTree!=NULL)
+	if(YSOK!=literalTable.Make(hLit+257,hLength,LITERAL_ROOT_BITS,YsPngHuffmanTable::ALPHABET_LITERAL_LENGTH) ||
+	   YSOK!=distTable.Make(hDist+1,hLength+hLit+257,DISTANCE_ROOT_BITS,YsPngHuffmanTable::ALPHABET_DISTANCE))
 	{
-		DeleteHuffmanTree(distTree);
+		printf("Broken Huffman code lengths.\n");
+		return YSERR;
 	}
-	return YSERR;
+	return YSOK;
 }
 
-////////////////////////////////////////////////////////////
-
-int YsGenericPngDecoder::Decode(const char fn[])
+int YsPngUncompressor::FlushWindow(void)
 {
-	int res=YSERR;
-	FILE *fp=fopen(fn,"rb");
-	if(NULL!=fp)
+	int res=YSOK;
+	if(windowFlushed<windowUsed)
 	{
-		YsPngBinaryFileStream binStream(fp);
-		res=Decode(binStream);
-		fclose(fp);
+		res=output->OutputBytes(windowBuf.data()+windowFlushed,windowUsed-windowFlushed);
+		if(STATE_ERROR!=state && true==output->IsStopRequested())
+		{
+			state=STATE_END;
+		}
 	}
-	return res;
-}
-
-int YsGenericPngDecoder::Decode(FILE *fp)
-{
-	if(NULL!=fp)
+	if(WINDOW_BUFFER_SIZE<=windowUsed)
 	{
-		YsPngBinaryFileStream binStream(fp);
-		return Decode(binStream);
+		windowUsed=0;
 	}
-	return YSERR;
+	windowFlushed=windowUsed;
+	return res;
 }
 
-int YsGenericPngDecoder::Decode(YsPngGenericBinaryStream &binStream)
+int YsPngUncompressor::UncompressHuffmanBlock(YsPngBitReader &reader,const YsPngHuffmanTable &literalTable,const YsPngHuffmanTable &distTable)
 {
-	const size_t fileSize=binStream.GetSize();
-
-	if(CheckSignature(binStream)!=YSOK)
+	const unsigned int windowMask=WINDOW_BUFFER_SIZE-1;
+	unsigned char *const window=windowBuf.data();
+	unsigned int nBitUsed;
+	for(;;)
 	{
-		printf("The file does not have PNG signature.\n");
-		return YSERR;
-	}
-
-	unsigned datBufUsed;
-	unsigned char *datBuf;
+		// After Refill, the buffer has enough bits for a literal/length code, its extra bits,
+		// a distance code, and its extra bits.  A code is written to the window only after it is known
+		// to be complete, so that a code cut at the end of the data can be read again from the beginning.
+		reader.Refill();
+		const YsPngHuffmanTable::Entry &code=literalTable.Lookup(reader.bitBuf);
+		reader.Consume(code.nBit);
+		nBitUsed=code.nBit;
 
-
-	datBufUsed=0;
-	datBuf=new unsigned char [fileSize];
-
-
-	unsigned char *buf;
-	unsigned length,chunkType,crc;
-	while(ReadChunk(length,buf,chunkType,crc,binStream)==YSOK && chunkType!=IEND)
-	{
-		switch(chunkType)
+		if(YsPngHuffmanTable::OP_LITERAL==code.op)
 		{
-		default:
-			if(buf!=NULL)
+			if(true==reader.IsOverrun())
 			{
-				delete [] buf;
+				break;
 			}
-			break;
-		case IHDR:
-			if(buf!=NULL)
+			window[windowUsed++]=(unsigned char)code.value;
+			nByteExtracted++;
+			if(WINDOW_BUFFER_SIZE==windowUsed)
 			{
-				if(length>=13)
+				if(YSOK!=FlushWindow())
+				{
+					return YSERR;
+				}
+				if(STATE_END==state)  // The output stopped the decoding.
 				{
-					hdr.Decode(buf);
+					return YSOK;
 				}
-				delete [] buf;
 			}
-			break;
-		case PLTE:
-			if(buf!=NULL)
+		}
+		else if(0!=(code.op&YsPngHuffmanTable::OP_BASE))
+		{
+			unsigned int copyLength=code.value+reader.Peek(code.op&15);
+			reader.Consume(code.op&15);
+
+			const YsPngHuffmanTable::Entry &dist=distTable.Lookup(reader.bitBuf);
+			reader.Consume(dist.nBit);
+			const unsigned int backDist=dist.value+reader.Peek(dist.op&15);
+			reader.Consume(dist.op&15);
+			nBitUsed+=(code.op&15)+dist.nBit+(dist.op&15);
+
+			if(true==reader.IsOverrun())
 			{
-				if(plt.Decode(length,buf)!=YSOK)
-				{
-					delete [] buf;
-					return YSERR;
-				}
-				delete [] buf;
+				break;
 			}
-			break;
-		case tRNS:
-			if(buf!=NULL)
+			if(0==(dist.op&YsPngHuffmanTable::OP_BASE))
 			{
-				trns.Decode(length,buf,hdr.colorType);
-				delete [] buf;
+				printf("Huffman Decompression: Invalid distance code.\n");
+				return YSERR;
 			}
-			break;
-		case gAMA:
-			if(buf!=NULL && length>=4)
+			if(windowSize<backDist || nByteExtracted<backDist)
 			{
-				gamma=PngGetUnsignedInt(buf);
-				if(YsGenericPngDecoder::verboseMode==YSTRUE)
-				{
-					printf("Gamma %d (default=%d)\n",gamma,gamma_default);
-				}
-				delete [] buf;
+				printf("Huffman Decompression: Distance too far back.\n");
+				return YSERR;
 			}
-			break;
-		case IDAT:
-			if(buf!=NULL)
+			nByteExtracted+=copyLength;
+
+			unsigned int from=(windowUsed-backDist)&windowMask;
+			while(0<copyLength)
 			{
-				unsigned i;
-				for(i=0; i<length; i++)
+				// Copy up to where either end wraps around.  Byte by byte forward, because the source
+				// may overlap the destination for a repeated pattern.
+				unsigned int nCopy=copyLength;
+				nCopy=(WINDOW_BUFFER_SIZE-windowUsed<nCopy ? WINDOW_BUFFER_SIZE-windowUsed : nCopy);
+				nCopy=(WINDOW_BUFFER_SIZE-from<nCopy ? WINDOW_BUFFER_SIZE-from : nCopy);
+
+				unsigned char *dst=window+windowUsed;
+				const unsigned char *src=window+from;
+				if(nCopy<=backDist)
+				{
+					memcpy(dst,src,nCopy);
+				}
+				else
+				{
+					for(unsigned int i=0; i<nCopy; ++i)
+					{
+						dst[i]=src[i];
+					}
+				}
+
+				windowUsed+=nCopy;
+				from=(from+nCopy)&windowMask;
+				copyLength-=nCopy;
+				if(WINDOW_BUFFER_SIZE==windowUsed)
 				{
-					datBuf[datBufUsed+i]=buf[i];
+					if(YSOK!=FlushWindow())
+					{
+						return YSERR;
+					}
+					if(STATE_END==state)
+					{
+						return YSOK;
+					}
 				}
-				datBufUsed+=length;
-				delete [] buf;
 			}
+		}
+		else if(true==reader.IsOverrun())
+		{
 			break;
 		}
+		else if(YsPngHuffmanTable::OP_END==code.op)
+		{
+			state=(0!=bFinal ? STATE_END : STATE_BLOCK_HEADER);
+			return YSOK;
+		}
+		else
+		{
+			printf("Huffman Decompression: Invalid code.\n");
+			return YSERR;
+		}
 	}
 
-
-
-	if(PrepareOutput()==YSOK)
-	{
-		YsPngUncompressor uncompressor;
-		uncompressor.output=this;
-		uncompressor.Uncompress(datBufUsed,datBuf);
-
-		EndOutput();
-	}
-
-
-	delete [] datBuf;
+	// The data ran out in the middle of a code.
+	reader.SeekBit(reader.GetBitPosition()-nBitUsed);
 	return YSOK;
 }
 
-int YsGenericPngDecoder::PrepareOutput(void)
+YsPngUncompressor::YsPngUncompressor()
 {
-	return YSOK;
+	output=nullptr;
+	BeginStream();
 }
 
-int YsGenericPngDecoder::Output(unsigned char)
+void YsPngUncompressor::BeginStream(void)
 {
-	return YSOK;
+	state=STATE_ZLIB_HEADER;
+	bFinal=0;
+	storedLeft=0;
+	literalTable=nullptr;
+	distTable=nullptr;
+	pending.clear();
+	pendingBit=0;
+
+	windowSize=WINDOW_BUFFER_SIZE;
+	windowUsed=0;
+	windowFlushed=0;
+	nByteExtracted=0;
 }
 
-int YsGenericPngDecoder::EndOutput(void)
+bool YsPngUncompressor::IsFinished(void) const
 {
-	return YSOK;
+	return STATE_END==state;
 }
 
-
-
-////////////////////////////////////////////////////////////
-
-static inline unsigned char Paeth(unsigned int ua,unsigned int ub,unsigned int uc)
+int YsPngUncompressor::Push(const unsigned char dat[],unsigned int length)
 {
-	int a,b,c,p,pa,pb,pc;
-
-	a=(int)ua;
-	b=(int)ub;
-	c=(int)uc;
-
-	p=a+b-c;
-	pa=(p>a ? p-a : a-p);
-	pb=(p>b ? p-b : b-p);
-	pc=(p>c ? p-c : c-p);
-
-	if(pa<=pb && pa<=pc)
+	if(STATE_ERROR==state)
 	{
-		return (unsigned char)a;
+		return YSERR;
 	}
-	else if(pb<=pc)
+	if(STATE_END==state || 0==length)  // Adler-32 checksum, and whatever after the stream is not used.
 	{
-		return (unsigned char)b;
+		return YSOK;
 	}
-	else
+	if(windowBuf.size()<WINDOW_BUFFER_SIZE)
 	{
-		return (unsigned char)c;
+		windowBuf.resize(WINDOW_BUFFER_SIZE);
 	}
-}
 
-static inline void Filter8(unsigned char curLine[],unsigned char prvLine[],int x,int y,int unitLng,int filter)
-{
-	int i;
-	switch(filter)
+	unsigned int startByte=0,startBit=0;
+	if(0<pending.size())
 	{
-	case 1:
-		if(x>0)
+		// Finish the code cut at the end of the previous piece from the kept bytes and the head of this piece.
+		// Once the decoder is past the kept bytes, it can continue directly from dat.
+		// If the head is not enough, for example, for a dynamic-Huffman block header, try a longer head.
+		const unsigned int nKept=(unsigned int)pending.size();
+		unsigned int nHead=0;
+		for(;;)
 		{
-			for(i=0; i<unitLng; i++)
+			nHead=(nHead<256 ? 256 : nHead*2);
+			nHead=(length<nHead ? length : nHead);
+
+			pending.resize(nKept);
+			pending.insert(pending.end(),dat,dat+nHead);
+
+			YsPngBitReader reader;
+			reader.Begin(pending.data(),(unsigned int)pending.size(),0);
+			reader.SeekBit(pendingBit);
+			if(YSOK!=UncompressBlocks(reader,false))
 			{
-				curLine[x*unitLng+i]+=curLine[x*unitLng+i-unitLng];
+				state=STATE_ERROR;
+				return YSERR;
 			}
-		}
-		break;
-	case 2:
-		if(y>0)
-		{
-			for(i=0; i<unitLng; i++)
+
+			const unsigned long long int bitPos=reader.GetBitPosition();
+			if(STATE_END==state)
 			{
-				curLine[x*unitLng+i]+=prvLine[x*unitLng+i];
+				pending.clear();
+				return FlushWindow();
 			}
+			if((unsigned long long int)nKept*8<=bitPos)
+			{
+				startByte=(unsigned int)(bitPos/8)-nKept;
+				startBit=(unsigned int)(bitPos%8);
+				break;
+			}
+			if(nHead==length)
+			{
+				// Still in the kept bytes.  Keep the unused part with this whole piece for the next Push.
+				pending.erase(pending.begin(),pending.begin()+(size_t)(bitPos/8));
+				pendingBit=(unsigned int)(bitPos%8);
+				return FlushWindow();
+			}
+
+			// Drop what has been consumed, and try again with a longer head.
+			pending.resize(nKept);
+			pending.erase(pending.begin(),pending.begin()+(size_t)(bitPos/8));
+			pendingBit=(unsigned int)(bitPos%8);
 		}
-		break;
-	case 3:
-		for(i=0; i<unitLng; i++)
-		{
-			unsigned int a;
-			a=(x>0 ? curLine[x*unitLng+i-unitLng] : 0);
-			a+=(y>0 ? prvLine[x*unitLng+i] : 0);
-			curLine[x*unitLng+i]+=(unsigned char)(a/2);
-		}
-		break;
-	case 4:
-		for(i=0; i<unitLng; i++)
-		{
-			unsigned int a,b,c;
-			a=(x>0 ? curLine[x*unitLng+i-unitLng] : 0);
-			b=(y>0 ? prvLine[x*unitLng+i] : 0);
-			c=((x>0 && y>0) ? prvLine[x*unitLng-unitLng+i] : 0);
-			curLine[x*unitLng+i]+=Paeth(a,b,c);
-		}
-		break;
 	}
+
+	if(YSOK!=UncompressPiece(dat,length,startByte,startBit))
+	{
+		return YSERR;
+	}
+	return FlushWindow();
 }
 
-YsRawPngDecoder::YsRawPngDecoder()
+int YsPngUncompressor::UncompressPiece(const unsigned char dat[],unsigned int length,unsigned int startByte,unsigned int startBit)
 {
-	wid=0;
-	hei=0;
-	rgba=NULL;
-	twoLineBuf8=NULL;
-
-	curLine8=NULL;
-	prvLine8=NULL;
+	YsPngBitReader reader;
+	reader.Begin(dat,length,startByte);
+	reader.SeekBit((unsigned long long int)startByte*8+startBit);
+	if(YSOK!=UncompressBlocks(reader,false))
+	{
+		state=STATE_ERROR;
+		return YSERR;
+	}
 
-	autoDeleteRgbaBuffer=1;
+	pending.clear();
+	if(STATE_END!=state)
+	{
+		const unsigned long long int bitPos=reader.GetBitPosition();
+		pending.insert(pending.end(),dat+(size_t)(bitPos/8),dat+length);
+		pendingBit=(unsigned int)(bitPos%8);
+	}
+	return YSOK;
 }
 
-YsRawPngDecoder::~YsRawPngDecoder()
+int YsPngUncompressor::EndStream(void)
 {
-	if(autoDeleteRgbaBuffer==1 && rgba!=NULL)
+	if(STATE_END!=state && STATE_ERROR!=state && 0<pending.size())
 	{
-		delete [] rgba;
-	}
-	if(twoLineBuf8!=NULL)
-	{
-		delete [] twoLineBuf8;
-	}
-}
-
-void YsRawPngDecoder::ShiftTwoLineBuf(void)
-{
-	if(twoLineBuf8!=NULL)
-	{
-		unsigned char *swap;
-		swap=curLine8;
-		curLine8=prvLine8;
-		prvLine8=swap;
+		YsPngBitReader reader;
+		reader.Begin(pending.data(),(unsigned int)pending.size(),0);
+		reader.SeekBit(pendingBit);
+		if(YSOK!=UncompressBlocks(reader,true))
+		{
+			state=STATE_ERROR;
+		}
 	}
-}
-
-int YsRawPngDecoder::PrepareOutput(void)
-{
-	int supported;
+	pending.clear();
 
-	supported=0;
-	switch(hdr.colorType)
+	int res=YSOK;
+	if(STATE_END!=state)
 	{
-	case 0:   // Greyscale
-		switch(hdr.bitDepth)
-		{
-		case 8:
-		case 1:
-			supported=1;
-			break;
-		case 2:
-		case 4:
-		case 16:
-			break;
-		}
-		break;
-	case 2:   // Truecolor
-		switch(hdr.bitDepth)
-		{
-		case 8:
-		case 16:
-			supported=1;
-			break;
-		}
-		break;
-	case 3:   // Indexed-color
-		switch(hdr.bitDepth)
-		{
-		case 1:
-		case 2:
-		case 4:
-		case 8:
-			supported=1;
-			break;
-		}
-		break;
-	case 4:   // Greyscale with alpha
-		switch(hdr.bitDepth)
-		{
-		case 8:
-			supported=1;
-			break;
-		case 16:
-			break;
-		}
-		break;
-	case 6:   // Truecolor with alpha
-		switch(hdr.bitDepth)
+		if(STATE_ERROR!=state)
 		{
-		case 8:
-			supported=1;
-			break;
-		case 16:
-			break;
+			printf("Buffer overflow\n");
+			state=STATE_ERROR;
 		}
-		break;
+		res=YSERR;
 	}
 
-	if(supported==0)
+	// Give what has been decoded even after an error, so that a truncated image is decoded up to the broken part.
+	if(0<windowBuf.size() && YSOK!=FlushWindow())
 	{
-		printf("Unsupported colorType-bitDepth combination.\n");
-		printf("  Color type=%d\n",hdr.colorType);
-		printf("  Bit deptch=%d\n",hdr.bitDepth);
-		return YSERR;
+		res=YSERR;
 	}
 
-
-
-	wid=hdr.width;
-	hei=hdr.height;
-	if(autoDeleteRgbaBuffer==1 && rgba!=NULL)
+	if(YsGenericPngDecoder::verboseMode==YSTRUE)
 	{
-		delete [] rgba;
-		rgba=NULL;
+		printf("Output %llu bytes.\n",nByteExtracted);
 	}
-	rgba=new unsigned char [wid*hei*4];
-	x=-1;
-	y=0;
-	filter=0;
-	inLineCount=0;
-	inPixelCount=0;
-	firstByte=1;
-	index=0;
-	interlacePass=1;
+	return res;
+}
 
-	if(twoLineBuf8!=NULL)
+int YsPngUncompressor::Uncompress(unsigned length,unsigned char dat[])
+{
+	if(YsGenericPngDecoder::verboseMode==YSTRUE)
 	{
-		delete [] twoLineBuf8;
-		twoLineBuf8=NULL;
+		printf("Begin zLib block length=%d\n",length);
 	}
 
-
-	// See PNG Specification 11.2 for Allowed combinations of color type and bit depth
-	unsigned int twoLineBufLngPerLine=0;
-	switch(hdr.colorType)
+	BeginStream();
+	if(YSOK!=Push(dat,length))
 	{
-	default:
-		printf("Internal error!  Color type was supposed to be checked in the previous switch/case statement!\n");
+		EndStream();
 		return YSERR;
-	case 0:   // Greyscale
-		switch(hdr.bitDepth)
-		{
-		case 1:
-			twoLineBufLngPerLine=(hdr.width+7)/8;
-			break;
-		case 2:
-			twoLineBufLngPerLine=(hdr.width+3)/4;
-			break;
-		case 4:
-			twoLineBufLngPerLine=(hdr.width+1)/2;
-			break;
-		case 8:
-			twoLineBufLngPerLine=hdr.width;
-			break;
-		case 16:
-			twoLineBufLngPerLine=hdr.width*2;
-			break;
-		}
-		break;
-	case 2:   // Truecolor
-		switch(hdr.bitDepth)
-		{
-		case 8:
-			twoLineBufLngPerLine=hdr.width*3;
-			break;
-		case 16:
-			twoLineBufLngPerLine=hdr.width*6;
-			break;
-		}
-		break;
-	case 3:   // Indexed-color
-		switch(hdr.bitDepth)
-		{
-		case 1:
-			twoLineBufLngPerLine=(hdr.width+7)/8;
-			break;
-		case 2:
-			twoLineBufLngPerLine=(hdr.width+3)/4;
-			break;
-		case 4:
-			twoLineBufLngPerLine=(hdr.width+1)/2;
-			break;
-		case 8:
-			twoLineBufLngPerLine=hdr.width;
-			break;
-		}
-		break;
-	case 4:   // Greyscale with alpha
-		switch(hdr.bitDepth)
-		{
-		case 8:
-			twoLineBufLngPerLine=hdr.width*2;
-			break;
-		case 16:
-			twoLineBufLngPerLine=hdr.width*4;
-			break;
-		}
-		break;
-	case 6:   // Truecolor with alpha
-		switch(hdr.bitDepth)
-		{
-		case 8:
-			twoLineBufLngPerLine=hdr.width*4;
-			break;
-		case 16:
-			twoLineBufLngPerLine=hdr.width*8;
-			break;
-		}
-		break;
 	}
-
-	twoLineBuf8=new unsigned char [twoLineBufLngPerLine*2];
-	curLine8=twoLineBuf8;
-	prvLine8=twoLineBuf8+twoLineBufLngPerLine;
-
-	return YSOK;
+	return EndStream();
 }
 
-int YsRawPngDecoder::Output(unsigned char dat)
+int YsPngUncompressor::UncompressBlocks(YsPngBitReader &reader,bool lastInput)
 {
-	unsigned int i;
-	unsigned int colIdx;
-	unsigned int interlaceWid,interlaceHei,interlaceX,interlaceY;
-
-	if(y>=hei)
-	{
-		return YSERR;
-	}
-
-	if(x==-1)  // First byte is filter type for the line.  
-	{
-		filter=dat;   // See PNG Specification 4.5.4 Filtering, 9 Filtering
-		inLineCount=0;
-		inPixelCount=0;
-		x++;
-		// printf("y=%d filter=%d\n",y,filter);
-		return YSOK;
-	}
-	else 
+	const unsigned char *const dat=reader.dat;
+	const unsigned int length=reader.length;
+	for(;;)
 	{
-		switch(hdr.interlaceMethod)
+		switch(state)
 		{
-		// Non-Interlace
-		case 0:
-			switch(hdr.colorType)  // See PNG Specification 6.1 Colour types and values
+		case STATE_ZLIB_HEADER:
 			{
-			// Grayscale
-			case 0:
-				switch(hdr.bitDepth)
+				if(reader.GetNumAvailableByte()<2)
 				{
-				case 1:
-					curLine8[x/8]=dat;
-					Filter8(curLine8,prvLine8,x/8,y,1,filter);
-
-					for(i=0; i<8 && x<wid; i++)
-					{
-						colIdx=(curLine8[x/8]>>(7-i))&1;
-						colIdx=(colIdx<<1)+colIdx;
-						colIdx=(colIdx<<2)+colIdx;
-						colIdx=(colIdx<<4)+colIdx;
-
-						rgba[index  ]=(unsigned char)colIdx;
-						rgba[index+1]=(unsigned char)colIdx;
-						rgba[index+2]=(unsigned char)colIdx;
-						rgba[index+3]=0;
-						x++;
-						index+=4;
-					}
-					break;
+					return YSOK;
+				}
 
-				case 8:
-					curLine8[x]=dat;
-					Filter8(curLine8,prvLine8,x,y,1,filter);
-					colIdx=curLine8[x];
+				reader.Refill();
+				unsigned char cmf,flg;
+				cmf=(unsigned char)reader.Get(8);
+				flg=(unsigned char)reader.Get(8);
 
-					rgba[index  ]=curLine8[x];
-					rgba[index+1]=curLine8[x];
-					rgba[index+2]=curLine8[x];
-					if(curLine8[x]==trns.col[0] || curLine8[x]==trns.col[1] || curLine8[x]==trns.col[2])
-					{
-						rgba[index+3]=0;
-					}
-					else
-					{
-						rgba[index+3]=255;
-					}
+				unsigned cm,cInfo;
+				cm=cmf&0x0f;
+				if(cm!=8)
+				{
+					printf("Unsupported compression method! (%d)\n",cm);
+					return YSERR;
+				}
 
-					x++;
-					index+=4;
-					break;
+				cInfo=(cmf&0xf0)>>4;
+				if(7<cInfo)
+				{
+					printf("Window size too large! (%d)\n",cInfo);
+					return YSERR;
 				}
-				break;
+				windowSize=1<<(cInfo+8);
 
+				if(YsGenericPngDecoder::verboseMode==YSTRUE)
+				{
+					printf("cInfo=%d, Window Size=%d\n",cInfo,windowSize);
+				}
 
+				unsigned fCheck,fDict,fLevel;
+				fCheck=(flg&15);
+				fDict=(flg&32)>>5;
+				fLevel=(flg&192)>>6;
 
-			// True color
-			case 2:
-				switch(hdr.bitDepth)
+				if(YsGenericPngDecoder::verboseMode==YSTRUE)
 				{
-				case 8:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==3)
-					{
-						Filter8(curLine8,prvLine8,x,y,3,filter);
-						rgba[index  ]=curLine8[inLineCount];
-						rgba[index+1]=curLine8[inLineCount+1];
-						rgba[index+2]=curLine8[inLineCount+2];
-
-						if(curLine8[inLineCount  ]==trns.col[0] && 
-						   curLine8[inLineCount+1]==trns.col[1] && 
-						   curLine8[inLineCount+2]==trns.col[2])
-						{
-							rgba[index+3]=0;
-						}
-						else
-						{
-							rgba[index+3]=255;
-						}
+					printf("fCheck=%d fDict=%d fLevel=%d\n",fCheck,fDict,fLevel);
+				}
 
-						x++;
-						index+=4;
-						inLineCount+=3;
-						inPixelCount=0;
-					}
-					break;
-				case 16:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==6)
-					{
-						Filter8(curLine8,prvLine8,x,y,6,filter);
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount+2];
-						rgba[index+2]=curLine8[inLineCount+4];
-
-						r=curLine8[inLineCount  ]*256+curLine8[inLineCount+1];
-						g=curLine8[inLineCount+2]*256+curLine8[inLineCount+3];
-						b=curLine8[inLineCount+4]*256+curLine8[inLineCount+5];
-						if(r==trns.col[0] && g==trns.col[1] && b==trns.col[2])
-						{
-							rgba[index+3]=0;
-						}
-						else
-						{
-							rgba[index+3]=255;
-						}
-						x++;
-						index+=4;
-						inLineCount+=6;
-						inPixelCount=0;
-					}
-					break;
+				if(fDict!=0)
+				{
+					printf("PNG is not supposed to have a preset dictionary.\n");
+					return YSERR;
 				}
-				break;
+				state=STATE_BLOCK_HEADER;
+			}
+			break;
 
+		case STATE_BLOCK_HEADER:
+			{
+				const unsigned long long int blockTop=reader.GetBitPosition();
+				reader.Refill();
+				bFinal=reader.Get(1);
+				const unsigned int bType=reader.Get(2);
 
+				if(true==reader.IsOverrun())
+				{
+					reader.SeekBit(blockTop);
+					return YSOK;
+				}
 
-			// Indexed color
-			case 3:
-				switch(hdr.bitDepth)
+				if(YsGenericPngDecoder::verboseMode==YSTRUE)
 				{
-				case 1:
-					curLine8[x/8]=dat;
-					Filter8(curLine8,prvLine8,x/8,y,1,filter);
+					printf("bFinal=%d bType=%d\n",bFinal,bType);
+				}
 
-					for(i=0; i<8 && x<wid; i++)
+				if(bType==0) // No Compression
+				{
+					const unsigned int bytePtr=reader.Rewind();
+					if(length<bytePtr+4)
 					{
-						colIdx=(curLine8[x/8]>>(7-i))&1;
-						if(colIdx<plt.nEntry)
-						{
-							rgba[index  ]=plt.entry[colIdx*3  ];
-							rgba[index+1]=plt.entry[colIdx*3+1];
-							rgba[index+2]=plt.entry[colIdx*3+2];
-							if(colIdx==trns.col[0] || colIdx==trns.col[1] || colIdx==trns.col[2])
-							{
-								rgba[index+3]=0;
-							}
-							else
-							{
-								rgba[index+3]=255;
-							}
-						}
-						else
-						{
-							printf("Not enough palette entry! (%d)\n",plt.nEntry);
-						}
-						x++;
-						index+=4;
+						reader.SeekBit(blockTop);
+						return YSOK;
 					}
-					break;
-				case 2:
-					curLine8[x/4]=dat;
-					Filter8(curLine8,prvLine8,x/4,y,1,filter);
 
-					for(i=0; i<4 && x<wid; i++)
+					const unsigned int len=dat[bytePtr]+dat[bytePtr+1]*256;
+					const unsigned int nlen=dat[bytePtr+2]+dat[bytePtr+3]*256;
+					if(len!=(~nlen&0xffff))
 					{
-						colIdx=(curLine8[x/4]>>((3-i)*2))&0x03;
-
-						if(colIdx<plt.nEntry)
-						{
-							rgba[index  ]=plt.entry[colIdx*3  ];
-							rgba[index+1]=plt.entry[colIdx*3+1];
-							rgba[index+2]=plt.entry[colIdx*3+2];
-							if(colIdx==trns.col[0] || colIdx==trns.col[1] || colIdx==trns.col[2])
-							{
-								rgba[index+3]=0;
-							}
-							else
-							{
-								rgba[index+3]=255;
-							}
-						}
-						x++;
-						index+=4;
+						printf("Broken non-compressed block.\n");
+						return YSERR;
 					}
-					break;
 
-				case 4:
-					curLine8[x/2]=dat;
-					Filter8(curLine8,prvLine8,x/2,y,1,filter);
-
-					for(i=0; i<2 && x<wid; i++)
+					storedLeft=len;
+					reader.Begin(dat,length,bytePtr+4);
+					state=STATE_STORED;
+				}
+				else if(bType==1)
+				{
+					literalTable=&YsPngFixedLiteralTable();
+					distTable=&YsPngFixedDistanceTable();
+					state=STATE_HUFFMAN;
+				}
+				else if(bType==2)
+				{
+					if(true!=lastInput && reader.GetNumAvailableByte()<MAX_DYNAMIC_HEADER_SIZE)
 					{
-						colIdx=(curLine8[x/2]>>((1-i)*4))&0x0f;
-
-						if(colIdx<plt.nEntry)
-						{
-							rgba[index  ]=plt.entry[colIdx*3  ];
-							rgba[index+1]=plt.entry[colIdx*3+1];
-							rgba[index+2]=plt.entry[colIdx*3+2];
-							if(colIdx==trns.col[0] || colIdx==trns.col[1] || colIdx==trns.col[2])
-							{
-								rgba[index+3]=0;
-							}
-							else
-							{
-								rgba[index+3]=255;
-							}
-						}
-						x++;
-						index+=4;
+						reader.SeekBit(blockTop);
+						return YSOK;
 					}
-					break;
+					if(YSOK!=DecodeDynamicHuffmanCode(reader,dynamicLiteralTable,dynamicDistTable))
+					{
+						return YSERR;
+					}
+					literalTable=&dynamicLiteralTable;
+					distTable=&dynamicDistTable;
+					state=STATE_HUFFMAN;
 
-				case 8:
-					curLine8[x]=dat;
-					Filter8(curLine8,prvLine8,x,y,1,filter);
-					colIdx=curLine8[x];
+					if(YsGenericPngDecoder::verboseMode==YSTRUE)
+					{
+						printf("Huffman table paprared\n");
+					}
+				}
+				else
+				{
+					printf("Unknown compression type (bType=3)\n");
+					return YSERR;
+				}
+			}
+			break;
 
-					if(colIdx<plt.nEntry)
+		case STATE_STORED:
+			{
+				const unsigned int bytePtr=reader.Rewind();
+				const unsigned int nAvailable=length-bytePtr;
+				const unsigned int len=(storedLeft<nAvailable ? storedLeft : nAvailable);
+				for(unsigned int i=0; i<len; )
+				{
+					unsigned int nCopy=len-i;
+					nCopy=(WINDOW_BUFFER_SIZE-windowUsed<nCopy ? WINDOW_BUFFER_SIZE-windowUsed : nCopy);
+					memcpy(windowBuf.data()+windowUsed,dat+bytePtr+i,nCopy);
+					windowUsed+=nCopy;
+					i+=nCopy;
+					if(WINDOW_BUFFER_SIZE==windowUsed)
 					{
-						rgba[index  ]=plt.entry[colIdx*3  ];
-						rgba[index+1]=plt.entry[colIdx*3+1];
-						rgba[index+2]=plt.entry[colIdx*3+2];
-						if(colIdx==trns.col[0] || colIdx==trns.col[1] || colIdx==trns.col[2])
+						if(YSOK!=FlushWindow())
 						{
-							rgba[index+3]=0;
+							return YSERR;
 						}
-						else
+						if(STATE_END==state)  // The output stopped the decoding.
 						{
-							rgba[index+3]=255;
+							return YSOK;
 						}
 					}
-					x++;
-					index+=4;
-					break;
 				}
-				break;
-
+				nByteExtracted+=len;
+				storedLeft-=len;
+				reader.Begin(dat,length,bytePtr+len);
 
-
-			// Greyscale with alpha
-			case 4:
-				switch(hdr.bitDepth)
+				if(0<storedLeft)
 				{
-				case 8:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==2)
-					{
-						Filter8(curLine8,prvLine8,x,y,2,filter);
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount  ];
-						rgba[index+2]=curLine8[inLineCount  ];
-						rgba[index+3]=curLine8[inLineCount+1];
-						index+=4;
-						x++;
-						inLineCount+=2;
-						inPixelCount=0;
-					}
-					break;
-				}
-				break;
-
-
-
-			// Truecolor with alpha
-			case 6:
-				switch(hdr.bitDepth)
-				{
-				case 8:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==4)
-					{
-						Filter8(curLine8,prvLine8,x,y,4,filter);
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount+1];
-						rgba[index+2]=curLine8[inLineCount+2];
-						rgba[index+3]=curLine8[inLineCount+3];
-						index+=4;
-						x++;
-						inLineCount+=4;
-						inPixelCount=0;
-					}
-					break;
+					return YSOK;
 				}
-				break;
-			}  // switch(hdr.colorType)
+				state=(0!=bFinal ? STATE_END : STATE_BLOCK_HEADER);
+			}
+			break;
 
-			if(x>=wid)
+		case STATE_HUFFMAN:
+			if(YSOK!=UncompressHuffmanBlock(reader,*literalTable,*distTable))
+			{
+				return YSERR;
+			}
+			if(STATE_HUFFMAN==state)  // Needs more data.
 			{
-				y++;
-				x=-1;
-				ShiftTwoLineBuf();
+				return YSOK;
 			}
+			break;
 
+		case STATE_END:
 			return YSOK;
 
+		default:
+			return YSERR;
+		}
+	}
+}
 
-		// Interlace
-		case 1:
-			//   1 6 4 6 2 6 4 6
-			//   7 7 7 7 7 7 7 7
-			//   5 6 5 6 5 6 5 6
-			//   7 7 7 7 7 7 7 7
-			//   3 6 4 6 3 6 4 6
-			//   7 7 7 7 7 7 7 7
-			//   5 6 5 6 5 6 5 6
-			//   7 7 7 7 7 7 7 7
-			switch(interlacePass)
-			{
-			case 1:
-				interlaceWid=(wid+7)/8;
-				interlaceHei=(hei+7)/8;
-				interlaceX=x*8;
-				interlaceY=y*8;
-				break;
-			case 2:
-				interlaceWid=(wid+3)/8;
-				interlaceHei=(hei+7)/8;
-				interlaceX=4+x*8;
-				interlaceY=y*8;
-				break;
-			case 3:
-				interlaceWid=(wid+3)/4;
-				interlaceHei=(hei+3)/8;
-				interlaceX=x*4;
-				interlaceY=4+y*8;
-				break;
-			case 4:
-				interlaceWid=(wid+1)/4;
-				interlaceHei=(hei+3)/4;
-				interlaceX=2+x*4;
-				interlaceY=y*4;
-				break;
-			case 5:
-				interlaceWid=(wid+1)/2;
-				interlaceHei=(hei+1)/4;
-				interlaceX=x*2;
-				interlaceY=2+y*4;
-				break;
-			case 6:
-				interlaceWid=(wid  )/2;
-				interlaceHei=(hei+1)/2;
-				interlaceX=1+x*2;
-				interlaceY=y*2;
-				break;
-			case 7:
-				interlaceWid=wid;
-				interlaceHei=hei/2;
-				interlaceX=x;
-				interlaceY=1+y*2;
-				break;
-			default:
-				return YSERR;
-			} // switch(interlacePass)
-
-			switch(hdr.colorType)  // See PNG Specification 6.1 Colour types and values
-			{
-			// Grayscale
-			case 0:
-				switch(hdr.bitDepth)
-				{
-				case 8:
-					curLine8[inLineCount]=dat;
-					Filter8(curLine8,prvLine8,x,y,1,filter);
-
-					index=interlaceX*4+interlaceY*wid*4;
-					rgba[index  ]=curLine8[inLineCount];
-					rgba[index+1]=curLine8[inLineCount];
-					rgba[index+2]=curLine8[inLineCount];
-
-					if(curLine8[inLineCount]==trns.col[0] || 
-					   curLine8[inLineCount]==trns.col[1] || 
-					   curLine8[inLineCount]==trns.col[2])
-					{
-						rgba[index+3]=0;
-					}
-					else
-					{
-						rgba[index+3]=255;
-					}
+////////////////////////////////////////////////////////////
 
-					x++;
-					inLineCount++;
-					break;
-				}
-				break;
+int YsGenericPngDecoder::Decode(const char fn[])
+{
+	YsPngBinaryMappedStream binStream;
+	if(YSOK==binStream.Open(fn))
+	{
+		return Decode(binStream);
+	}
+	return YSERR;
+}
 
+int YsGenericPngDecoder::Decode(FILE *fp)
+{
+	if(NULL!=fp)
+	{
+		YsPngBinaryFileStream binStream(fp);
+		return Decode(binStream);
+	}
+	return YSERR;
+}
 
-			// True color
-			case 2:
-				switch(hdr.bitDepth)
-				{
-				case 8:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==3)
-					{
-						Filter8(curLine8,prvLine8,x,y,3,filter);
+int YsGenericPngDecoder::Decode(YsPngGenericBinaryStream &binStream)
+{
+	// If the stream already has the data in memory, the IDAT data goes to the inflater straight from there.
+	size_t nInPlace;
+	const unsigned char *inPlace=binStream.ReadInPlace(binStream.GetSize(),nInPlace);
+	if(nullptr!=inPlace)
+	{
+		BeginPush();
+		Push(inPlace,nInPlace);
+		return EndPush();
+	}
 
-						index=interlaceX*4+interlaceY*wid*4;
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount+1];
-						rgba[index+2]=curLine8[inLineCount+2];
+	// Otherwise, read in pieces and push, so that neither the file nor the compressed data is kept in memory as a whole.
+	const size_t readBufSize=65536;
+	if(readBuf.size()<readBufSize)
+	{
+		readBuf.resize(readBufSize);
+	}
 
-						if(curLine8[inLineCount  ]==trns.col[0] && 
-						   curLine8[inLineCount+1]==trns.col[1] && 
-						   curLine8[inLineCount+2]==trns.col[2])
-						{
-							rgba[index+3]=0;
-						}
-						else
-						{
-							rgba[index+3]=255;
-						}
+	BeginPush();
+	for(;;)
+	{
+		const size_t nRead=binStream.Read(readBuf.data(),readBufSize);
+		if(0==nRead || YSOK!=Push(readBuf.data(),nRead) || true==IsPushFinished())
+		{
+			break;
+		}
+	}
+	return EndPush();
+}
 
-						x++;
-						inLineCount+=3;
-						inPixelCount=0;
-					}
-					break;
+void YsGenericPngDecoder::BeginPush(void)
+{
+	// Not the override, which would clear the settings of the output for this image.
+	YsGenericPngDecoder::Reset();
+
+	pushState=PUSH_SIGNATURE;
+	pushFieldUsed=0;
+	chunkType=0;
+	chunkLeft=0;
+	chunkBuf.clear();
+	outputPrepared=false;
+	uncompressor.output=this;
+	uncompressor.BeginStream();
+}
 
-				case 16:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==6)
-					{
-						Filter8(curLine8,prvLine8,x,y,6,filter);
-						index=interlaceX*4+interlaceY*wid*4;
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount+2];
-						rgba[index+2]=curLine8[inLineCount+4];
-
-						r=curLine8[inLineCount  ]*256+curLine8[inLineCount+1];
-						g=curLine8[inLineCount+2]*256+curLine8[inLineCount+3];
-						b=curLine8[inLineCount+4]*256+curLine8[inLineCount+5];
-
-						if(r==trns.col[0] && g==trns.col[1] && b==trns.col[2])
-						// Fixed based on a bug report from a viewer.  Thanks for the good catch!
-						//   Report received 09/10/2010
-						//   Fixed           09/18/2010
-						{
-							rgba[index+3]=0;
-						}
-						else
-						{
-							rgba[index+3]=255;
-						}
+bool YsGenericPngDecoder::IsPushFinished(void) const
+{
+	return PUSH_END==pushState;
+}
 
-						x++;
-						inLineCount+=6;
-						inPixelCount=0;
-					}
-					break;
-				}
-				break;
+void YsGenericPngDecoder::RequestStop(void)
+{
+	stopRequested=true;
+}
 
+bool YsGenericPngDecoder::IsStopRequested(void) const
+{
+	return stopRequested;
+}
 
+int YsGenericPngDecoder::Push(const unsigned char dat[],size_t length)
+{
+	while(0<length)
+	{
+		if(true==stopRequested)
+		{
+			pushState=PUSH_END;
+			return YSOK;
+		}
 
-			// Indexed color
-			case 3:
-				switch(hdr.bitDepth)
+		switch(pushState)
+		{
+		case PUSH_SIGNATURE:
+		case PUSH_CHUNK_HEADER:
+			pushField[pushFieldUsed++]=*dat;
+			++dat;
+			--length;
+			if(8==pushFieldUsed)
+			{
+				pushFieldUsed=0;
+				if(PUSH_SIGNATURE==pushState)
 				{
-				case 8:
-					curLine8[inLineCount]=dat;
-					Filter8(curLine8,prvLine8,x,y,1,filter);
-
-					index=interlaceX*4+interlaceY*wid*4;
-					colIdx=curLine8[inLineCount  ];
-					if(colIdx<plt.nEntry)
+					if(pushField[0]!=0x89 || pushField[1]!=0x50 || pushField[2]!=0x4e || pushField[3]!=0x47 ||
+					   pushField[4]!=0x0d || pushField[5]!=0x0a || pushField[6]!=0x1a || pushField[7]!=0x0a)
 					{
-						rgba[index  ]=plt.entry[colIdx*3  ];
-						rgba[index+1]=plt.entry[colIdx*3+1];
-						rgba[index+2]=plt.entry[colIdx*3+2];
-						if(colIdx==trns.col[0] || colIdx==trns.col[1] || colIdx==trns.col[2])
-						{
-							rgba[index+3]=0;
-						}
-						else
-						{
-							rgba[index+3]=255;
-						}
+						printf("The file does not have PNG signature.\n");
+						pushState=PUSH_ERROR;
+						return YSERR;
 					}
-
-					x++;
-					inLineCount++;
+					pushState=PUSH_CHUNK_HEADER;
 					break;
 				}
-				break;
-
 
+				chunkLeft=PngGetUnsignedInt(pushField);
+				chunkType=PngGetUnsignedInt(pushField+4);
+				chunkBuf.clear();
+				if(YsGenericPngDecoder::verboseMode==YSTRUE)
+				{
+					printf("Chunk name=%c%c%c%c\n",pushField[4],pushField[5],pushField[6],pushField[7]);
+				}
 
-			// Greyscale with alpha
-			case 4:
-				switch(hdr.bitDepth)
+				if(IDAT==chunkType && true!=outputPrepared)
 				{
-				case 8:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==2)
+					// IHDR, PLTE, and tRNS come before IDAT.
+					if(YSOK!=PrepareOutput())
 					{
-						Filter8(curLine8,prvLine8,x,y,2,filter);
-
-						index=interlaceX*4+interlaceY*wid*4;
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount  ];
-						rgba[index+2]=curLine8[inLineCount  ];
-						rgba[index+3]=curLine8[inLineCount+1];
-
-						x++;
-						inLineCount+=2;
-						inPixelCount=0;
+						pushState=PUSH_ERROR;
+						return YSERR;
 					}
-					break;
+					outputPrepared=true;
 				}
-				break;
-
-
+				pushState=PUSH_CHUNK_DATA;
+				if(0==chunkLeft && YSOK!=EndChunk())
+				{
+					return YSERR;
+				}
+			}
+			break;
 
-			// Truecolor with alpha
-			case 6:
-				switch(hdr.bitDepth)
+		case PUSH_CHUNK_DATA:
+			{
+				const unsigned int nUse=(length<chunkLeft ? (unsigned int)length : chunkLeft);
+				if(IDAT==chunkType)
 				{
-				case 8:
-					curLine8[inLineCount+inPixelCount]=dat;
-					inPixelCount++;
-					if(inPixelCount==4)
+					// Straight to the uncompressor.  What was decoded before a broken part is still
+					// given to the output by EndPush.
+					if(YSOK!=uncompressor.Push(dat,nUse))
 					{
-						Filter8(curLine8,prvLine8,x,y,4,filter);
-
-						index=interlaceX*4+interlaceY*wid*4;
-						rgba[index  ]=curLine8[inLineCount  ];
-						rgba[index+1]=curLine8[inLineCount+1];
-						rgba[index+2]=curLine8[inLineCount+2];
-						rgba[index+3]=curLine8[inLineCount+3];
-
-						x++;
-						inLineCount+=4;
-						inPixelCount=0;
+						pushState=PUSH_ERROR;
+						return YSERR;
 					}
-					break;
 				}
+				else if(IHDR==chunkType || PLTE==chunkType || tRNS==chunkType || gAMA==chunkType)
+				{
+					chunkBuf.insert(chunkBuf.end(),dat,dat+nUse);
+				}
+				dat+=nUse;
+				length-=nUse;
+				chunkLeft-=nUse;
+				if(0==chunkLeft && YSOK!=EndChunk())
+				{
+					return YSERR;
+				}
+			}
 			break;
-			} // switch(hdr.colorType)
 
-			if(x>=(int)interlaceWid)
+		case PUSH_CHUNK_CRC:
 			{
-				y++;
-				x=-1;
-				ShiftTwoLineBuf();
-				if(y>=(int)interlaceHei)
+				const unsigned int nUse=(length<chunkLeft ? (unsigned int)length : chunkLeft);
+				dat+=nUse;
+				length-=nUse;
+				chunkLeft-=nUse;
+				if(0==chunkLeft)
 				{
-					y=0;
-					interlacePass++;
-
-					if(YsGenericPngDecoder::verboseMode==YSTRUE)
-					{
-						printf("Interlace Pass %d\n",interlacePass);
-					}
+					pushState=(IEND==chunkType ? PUSH_END : PUSH_CHUNK_HEADER);
 				}
 			}
+			break;
 
+		case PUSH_END:
 			return YSOK;
+
 		default:
-			printf("Unsupported interlace method.\n");
 			return YSERR;
 		}
 	}
-	// return YSERR;
+	return YSOK;
 }
 
-int YsRawPngDecoder::EndOutput(void)
+int YsGenericPngDecoder::EndChunk(void)
 {
-	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	unsigned char *buf=chunkBuf.data();
+	const unsigned int length=(unsigned int)chunkBuf.size();
+	switch(chunkType)
 	{
-		printf("Final Position (%d,%d)\n",x,y);
+	case IHDR:
+		if(length>=13)
+		{
+			hdr.Decode(buf);
+		}
+		break;
+	case PLTE:
+		if(plt.Decode(length,buf)!=YSOK)
+		{
+			pushState=PUSH_ERROR;
+			return YSERR;
+		}
+		break;
+	case tRNS:
+		trns.Decode(length,buf,hdr.colorType);
+		break;
+	case gAMA:
+		if(length>=4)
+		{
+			gamma=PngGetUnsignedInt(buf);
+			if(YsGenericPngDecoder::verboseMode==YSTRUE)
+			{
+				printf("Gamma %d (default=%d)\n",gamma,gamma_default);
+			}
+		}
+		break;
 	}
+	chunkBuf.clear();
+	pushState=PUSH_CHUNK_CRC;
+	chunkLeft=4;
 	return YSOK;
 }
 
-void YsRawPngDecoder::Flip(void)  // For drawing in OpenGL
+int YsGenericPngDecoder::EndPush(void)
 {
-	int x,y,bytePerLine;
-	unsigned int swp;
+	if(PUSH_ERROR==pushState || PUSH_SIGNATURE==pushState)
+	{
+		if(true==outputPrepared)
+		{
+			// Give the part decoded before the error, so that a broken image is decoded up to the broken part.
+			uncompressor.EndStream();
+			EndOutput();
+		}
+		return YSERR;
+	}
+	if(true!=outputPrepared)
+	{
+		// No IDAT.  Let the output know the image anyway, as the image is empty.
+		if(YSOK!=PrepareOutput())
+		{
+			return YSERR;
+		}
+		outputPrepared=true;
+	}
+
+	// If the output stopped the decoding, the rest of the stream is not needed, and it is not an error.
+	const int res=(true==stopRequested ? YSOK : uncompressor.EndStream());
+	EndOutput();
+	return res;
+}
+
+int YsGenericPngDecoder::PrepareOutput(void)
+{
+	return YSOK;
+}
+
+int YsGenericPngDecoder::Output(unsigned char)
+{
+	return YSOK;
+}
+
+int YsGenericPngDecoder::OutputBytes(const unsigned char dat[],unsigned int nByte)
+{
+	for(unsigned int i=0; i<nByte; ++i)
+	{
+		if(YSOK!=Output(dat[i]))
+		{
+			return YSERR;
+		}
+	}
+	return YSOK;
+}
+
+int YsGenericPngDecoder::EndOutput(void)
+{
+	return YSOK;
+}
+
+
+
+////////////////////////////////////////////////////////////
+
+static inline unsigned char Paeth(unsigned int ua,unsigned int ub,unsigned int uc)
+{
+	int a,b,c,p,pa,pb,pc;
+
+	a=(int)ua;
+	b=(int)ub;
+	c=(int)uc;
+
+	p=a+b-c;
+	pa=(p>a ? p-a : a-p);
+	pb=(p>b ? p-b : b-p);
+	pc=(p>c ? p-c : c-p);
+
+	if(pa<=pb && pa<=pc)
+	{
+		return (unsigned char)a;
+	}
+	else if(pb<=pc)
+	{
+		return (unsigned char)b;
+	}
+	else
+	{
+		return (unsigned char)c;
+	}
+}
+
+// The unfilter functions take a whole line.  bpp bytes before cur and prv must be zero, and prv must be
+// all zero for the first line of a pass, so that the left edge and the top line need no special case.
+// See PNG Specification 9 Filtering.
+
+static void YsPngUnfilterUp(unsigned char cur[],const unsigned char prv[],unsigned int lng)
+{
+	unsigned int i=0;
+#ifdef __SSE2__
+	for(; i+16<=lng; i+=16)
+	{
+		const __m128i x=_mm_loadu_si128((const __m128i *)(cur+i));
+		const __m128i b=_mm_loadu_si128((const __m128i *)(prv+i));
+		_mm_storeu_si128((__m128i *)(cur+i),_mm_add_epi8(x,b));
+	}
+#endif
+	for(; i<lng; i++)
+	{
+		cur[i]+=prv[i];
+	}
+}
+
+static void YsPngUnfilterScalar(unsigned char cur[],const unsigned char prv[],unsigned int lng,unsigned int bpp,int filter)
+{
+	unsigned int i;
+	const unsigned char *left=cur-bpp,*upperLeft=prv-bpp;
+	switch(filter)
+	{
+	case 1:
+		for(i=0; i<lng; i++)
+		{
+			cur[i]+=left[i];
+		}
+		break;
+	case 2:
+		YsPngUnfilterUp(cur,prv,lng);
+		break;
+	case 3:
+		for(i=0; i<lng; i++)
+		{
+			cur[i]+=(unsigned char)(((unsigned int)left[i]+(unsigned int)prv[i])/2);
+		}
+		break;
+	case 4:
+		for(i=0; i<lng; i++)
+		{
+			cur[i]+=Paeth(left[i],prv[i],upperLeft[i]);
+		}
+		break;
+	}
+}
+
+#ifdef __SSE2__
+// Sub, Average, and Paeth depend on the pixel on the left, therefore a line is unfiltered pixel by pixel.
+// All bytes of a pixel are done together in one register.
+template <unsigned int bpp>
+static inline __m128i YsPngLoadPixel(const unsigned char ptr[])
+{
+	unsigned char buf[8]={0,0,0,0,0,0,0,0};
+	memcpy(buf,ptr,bpp);
+	return _mm_loadl_epi64((const __m128i *)buf);
+}
+
+template <unsigned int bpp>
+static inline void YsPngStorePixel(unsigned char ptr[],__m128i value)
+{
+	unsigned char buf[8];
+	_mm_storel_epi64((__m128i *)buf,value);
+	memcpy(ptr,buf,bpp);
+}
+
+template <unsigned int bpp>
+static void YsPngUnfilterSubSSE2(unsigned char cur[],unsigned int lng)
+{
+	__m128i a=_mm_setzero_si128();
+	for(unsigned int i=0; i+bpp<=lng; i+=bpp)
+	{
+		a=_mm_add_epi8(a,YsPngLoadPixel<bpp>(cur+i));
+		YsPngStorePixel<bpp>(cur+i,a);
+	}
+}
+
+template <unsigned int bpp>
+static void YsPngUnfilterAverageSSE2(unsigned char cur[],const unsigned char prv[],unsigned int lng)
+{
+	const __m128i one=_mm_set1_epi8(1);
+	__m128i a=_mm_setzero_si128();
+	for(unsigned int i=0; i+bpp<=lng; i+=bpp)
+	{
+		const __m128i b=YsPngLoadPixel<bpp>(prv+i);
+		// _mm_avg_epu8 rounds up.  Take 1 off where a+b is odd.
+		__m128i avg=_mm_avg_epu8(a,b);
+		avg=_mm_sub_epi8(avg,_mm_and_si128(_mm_xor_si128(a,b),one));
+		a=_mm_add_epi8(YsPngLoadPixel<bpp>(cur+i),avg);
+		YsPngStorePixel<bpp>(cur+i,a);
+	}
+}
+
+template <unsigned int bpp>
+static void YsPngUnfilterPaethSSE2(unsigned char cur[],const unsigned char prv[],unsigned int lng)
+{
+	// a, b, and c are in 16-bit lanes so that the differences do not overflow.
+	const __m128i zero=_mm_setzero_si128();
+	__m128i a=zero,c=zero;
+	for(unsigned int i=0; i+bpp<=lng; i+=bpp)
+	{
+		const __m128i b=_mm_unpacklo_epi8(YsPngLoadPixel<bpp>(prv+i),zero);
+
+		// p=a+b-c, therefore p-a=b-c, p-b=a-c, and p-c=(b-c)+(a-c).
+		__m128i pa=_mm_sub_epi16(b,c);
+		__m128i pb=_mm_sub_epi16(a,c);
+		__m128i pc=_mm_add_epi16(pa,pb);
+		pa=_mm_max_epi16(pa,_mm_sub_epi16(zero,pa));
+		pb=_mm_max_epi16(pb,_mm_sub_epi16(zero,pb));
+		pc=_mm_max_epi16(pc,_mm_sub_epi16(zero,pc));
+
+		// Same tie-breaking as Paeth(): a, then b, then c.
+		const __m128i smallest=_mm_min_epi16(pc,_mm_min_epi16(pa,pb));
+		const __m128i useA=_mm_cmpeq_epi16(smallest,pa);
+		const __m128i useB=_mm_cmpeq_epi16(smallest,pb);
+		const __m128i bOrC=_mm_or_si128(_mm_and_si128(useB,b),_mm_andnot_si128(useB,c));
+		const __m128i nearest=_mm_or_si128(_mm_and_si128(useA,a),_mm_andnot_si128(useA,bOrC));
+
+		// The high byte of each lane stays zero because the bytes are added without carry.
+		a=_mm_add_epi8(_mm_unpacklo_epi8(YsPngLoadPixel<bpp>(cur+i),zero),nearest);
+		YsPngStorePixel<bpp>(cur+i,_mm_packus_epi16(a,a));
+		c=b;
+	}
+}
+
+template <unsigned int bpp>
+static void YsPngUnfilterSSE2(unsigned char cur[],const unsigned char prv[],unsigned int lng,int filter)
+{
+	switch(filter)
+	{
+	case 1:
+		YsPngUnfilterSubSSE2<bpp>(cur,lng);
+		break;
+	case 2:
+		YsPngUnfilterUp(cur,prv,lng);
+		break;
+	case 3:
+		YsPngUnfilterAverageSSE2<bpp>(cur,prv,lng);
+		break;
+	case 4:
+		YsPngUnfilterPaethSSE2<bpp>(cur,prv,lng);
+		break;
+	}
+}
+#endif
+
+static void YsPngUnfilterLine(unsigned char cur[],const unsigned char prv[],unsigned int lng,unsigned int bpp,int filter)
+{
+#ifdef __SSE2__
+	switch(bpp)
+	{
+	case 2:
+		YsPngUnfilterSSE2<2>(cur,prv,lng,filter);
+		return;
+	case 3:
+		YsPngUnfilterSSE2<3>(cur,prv,lng,filter);
+		return;
+	case 4:
+		YsPngUnfilterSSE2<4>(cur,prv,lng,filter);
+		return;
+	case 6:
+		YsPngUnfilterSSE2<6>(cur,prv,lng,filter);
+		return;
+	case 8:
+		YsPngUnfilterSSE2<8>(cur,prv,lng,filter);
+		return;
+	}
+#endif
+	YsPngUnfilterScalar(cur,prv,lng,bpp,filter);
+}
+
+////////////////////////////////////////////////////////////
+
+// Color expansion.  One of them is selected for an image in YsRawPngDecoder::PrepareOutput.
+
+static void YsPngExpandLookUp8(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &decoder)
+{
+	for(unsigned int i=0; i<nPixel; i++)
+	{
+		memcpy(rgba+i*4,decoder.lookUp+line[i]*4,4);
+	}
+}
+
+template <unsigned int bitDepth>
+static void YsPngExpandLookUpPacked(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &decoder)
+{
+	const unsigned int pixelPerByte=8/bitDepth,mask=(1<<bitDepth)-1;
+	for(unsigned int i=0; i<nPixel; i++)
+	{
+		// The first pixel is in the most-significant bits.
+		const unsigned int shift=8-bitDepth*(1+i%pixelPerByte);
+		const unsigned int value=(line[i/pixelPerByte]>>shift)&mask;
+		memcpy(rgba+i*4,decoder.lookUp+value*4,4);
+	}
+}
+
+static void YsPngExpandTrueColor8(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &decoder)
+{
+	const unsigned int *col=decoder.trns.col;
+	for(unsigned int i=0; i<nPixel; i++)
+	{
+		const unsigned char r=line[i*3],g=line[i*3+1],b=line[i*3+2];
+		rgba[i*4  ]=r;
+		rgba[i*4+1]=g;
+		rgba[i*4+2]=b;
+		rgba[i*4+3]=((r==col[0] && g==col[1] && b==col[2]) ? 0 : 255);
+	}
+}
+
+static void YsPngExpandTrueColor8Opaque(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &)
+{
+	for(unsigned int i=0; i<nPixel; i++)
+	{
+		rgba[i*4  ]=line[i*3];
+		rgba[i*4+1]=line[i*3+1];
+		rgba[i*4+2]=line[i*3+2];
+		rgba[i*4+3]=255;
+	}
+}
+
+#ifdef YSPNG_X86_GCC
+static bool YsPngHasSSSE3(void)
+{
+	__builtin_cpu_init();
+	return 0!=__builtin_cpu_supports("ssse3");
+}
+
+__attribute__((target("ssse3")))
+static void YsPngExpandTrueColor8OpaqueSSSE3(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &decoder)
+{
+	// pshufb spreads 4 pixels of 3 bytes to 4 pixels of 4 bytes.  Alpha is OR-ed in.
+	const __m128i shuffle=_mm_setr_epi8(0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1);
+	const __m128i alpha=_mm_set1_epi32((int)0xff000000);
+	unsigned int i=0;
+
+	// 48 bytes in, 16 pixels out.  palignr moves the pixels that cross the 16-byte loads to the bottom.
+	for(; i+16<=nPixel; i+=16)
+	{
+		const unsigned char *src=line+i*3;
+		const __m128i a=_mm_loadu_si128((const __m128i *)src);
+		const __m128i b=_mm_loadu_si128((const __m128i *)(src+16));
+		const __m128i c=_mm_loadu_si128((const __m128i *)(src+32));
+		__m128i *dst=(__m128i *)(rgba+i*4);
+		_mm_storeu_si128(dst  ,_mm_or_si128(_mm_shuffle_epi8(a,shuffle),alpha));
+		_mm_storeu_si128(dst+1,_mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b,a,12),shuffle),alpha));
+		_mm_storeu_si128(dst+2,_mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c,b,8),shuffle),alpha));
+		_mm_storeu_si128(dst+3,_mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c,4),shuffle),alpha));
+	}
+
+	// 16 bytes in, 4 pixels out.  A load reads 4 bytes beyond the 4 pixels, therefore 6 pixels must be left.
+	for(; i+6<=nPixel; i+=4)
+	{
+		const __m128i x=_mm_loadu_si128((const __m128i *)(line+i*3));
+		_mm_storeu_si128((__m128i *)(rgba+i*4),_mm_or_si128(_mm_shuffle_epi8(x,shuffle),alpha));
+	}
+
+	YsPngExpandTrueColor8Opaque(rgba+i*4,line+i*3,nPixel-i,decoder);
+}
+#endif
+
+static void YsPngExpandTrueColor16(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &decoder)
+{
+	const unsigned int *col=decoder.trns.col;
+	for(unsigned int i=0; i<nPixel; i++)
+	{
+		const unsigned char *src=line+i*6;
+		const unsigned int r=src[0]*256+src[1];
+		const unsigned int g=src[2]*256+src[3];
+		const unsigned int b=src[4]*256+src[5];
+		rgba[i*4  ]=src[0];
+		rgba[i*4+1]=src[2];
+		rgba[i*4+2]=src[4];
+		rgba[i*4+3]=((r==col[0] && g==col[1] && b==col[2]) ? 0 : 255);
+	}
+}
+
+static void YsPngExpandGrayAlpha8(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &)
+{
+	for(unsigned int i=0; i<nPixel; i++)
+	{
+		rgba[i*4  ]=line[i*2];
+		rgba[i*4+1]=line[i*2];
+		rgba[i*4+2]=line[i*2];
+		rgba[i*4+3]=line[i*2+1];
+	}
+}
+
+static void YsPngExpandTrueColorAlpha8(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &)
+{
+	memcpy(rgba,line,nPixel*4);
+}
+
+////////////////////////////////////////////////////////////
+
+//   1 6 4 6 2 6 4 6
+//   7 7 7 7 7 7 7 7
+//   5 6 5 6 5 6 5 6
+//   7 7 7 7 7 7 7 7
+//   3 6 4 6 3 6 4 6
+//   7 7 7 7 7 7 7 7
+//   5 6 5 6 5 6 5 6
+//   7 7 7 7 7 7 7 7
+static const unsigned int YsPngInterlaceX0[7]={0,4,0,2,0,1,0};
+static const unsigned int YsPngInterlaceY0[7]={0,0,4,0,2,0,1};
+static const unsigned int YsPngInterlaceDX[7]={8,8,4,4,2,2,1};
+static const unsigned int YsPngInterlaceDY[7]={8,8,8,4,4,2,2};
+
+YsRawPngDecoder::YsRawPngDecoder()
+{
+	wid=0;
+	hei=0;
+	rgba=NULL;
+	twoLineBuf8=NULL;
+	twoLineBufSize=0;
+
+	curLine8=NULL;
+	prvLine8=NULL;
+
+	expandLine=NULL;
+	passLine=NULL;
+	passLineSize=0;
+
+	autoDeleteRgbaBuffer=1;
+
+	rowY0=0;
+	rowY1=-1;
+	bottomUp=false;
+	userBuf=NULL;
+	userBufWid=0;
+	userBufHei=0;
+	userBufPitch=0;
+
+	decodeY0=0;
+	decodeY1=0;
+	outputBuf=NULL;
+	outputPitch=0;
+}
+
+void YsRawPngDecoder::Reset(void)
+{
+	YsGenericPngDecoder::Reset();
+
+	if(autoDeleteRgbaBuffer==1 && rgba!=NULL)
+	{
+		delete [] rgba;
+	}
+	rgba=NULL;
+	wid=0;
+	hei=0;
+
+	rowY0=0;
+	rowY1=-1;
+	bottomUp=false;
+	userBuf=NULL;
+	userBufWid=0;
+	userBufHei=0;
+	userBufPitch=0;
+
+	decodeY0=0;
+	decodeY1=0;
+	outputBuf=NULL;
+	outputPitch=0;
+}
+
+void YsRawPngDecoder::SetRowRange(int y0,int y1)
+{
+	rowY0=y0;
+	rowY1=y1;
+}
+
+void YsRawPngDecoder::SetBottomUp(bool bottomUp)
+{
+	this->bottomUp=bottomUp;
+}
+
+void YsRawPngDecoder::SetOutputBuffer(unsigned char *buf,int bufWid,int bufHei,int pitchInBytes)
+{
+	userBuf=buf;
+	userBufWid=bufWid;
+	userBufHei=bufHei;
+	userBufPitch=pitchInBytes;
+}
+
+unsigned char *YsRawPngDecoder::GetRowPointer(int y) const
+{
+	const int row=(true==bottomUp ? decodeY1-1-y : y-decodeY0);
+	return outputBuf+(size_t)row*outputPitch;
+}
+
+YsRawPngDecoder::~YsRawPngDecoder()
+{
+	if(autoDeleteRgbaBuffer==1 && rgba!=NULL)
+	{
+		delete [] rgba;
+	}
+	if(twoLineBuf8!=NULL)
+	{
+		delete [] twoLineBuf8;
+	}
+	if(passLine!=NULL)
+	{
+		delete [] passLine;
+	}
+}
+
+void YsRawPngDecoder::ShiftTwoLineBuf(void)
+{
+	if(twoLineBuf8!=NULL)
+	{
+		unsigned char *swap;
+		swap=curLine8;
+		curLine8=prvLine8;
+		prvLine8=swap;
+	}
+}
+
+int YsRawPngDecoder::PrepareOutput(void)
+{
+	int supported;
+
+	supported=0;
+	switch(hdr.colorType)
+	{
+	case 0:   // Greyscale
+		switch(hdr.bitDepth)
+		{
+		case 8:
+		case 1:
+			supported=1;
+			break;
+		case 2:
+		case 4:
+		case 16:
+			break;
+		}
+		break;
+	case 2:   // Truecolor
+		switch(hdr.bitDepth)
+		{
+		case 8:
+		case 16:
+			supported=1;
+			break;
+		}
+		break;
+	case 3:   // Indexed-color
+		switch(hdr.bitDepth)
+		{
+		case 1:
+		case 2:
+		case 4:
+		case 8:
+			supported=1;
+			break;
+		}
+		break;
+	case 4:   // Greyscale with alpha
+		switch(hdr.bitDepth)
+		{
+		case 8:
+			supported=1;
+			break;
+		case 16:
+			break;
+		}
+		break;
+	case 6:   // Truecolor with alpha
+		switch(hdr.bitDepth)
+		{
+		case 8:
+			supported=1;
+			break;
+		case 16:
+			break;
+		}
+		break;
+	}
+
+	if(supported==0)
+	{
+		printf("Unsupported colorType-bitDepth combination.\n");
+		printf("  Color type=%d\n",hdr.colorType);
+		printf("  Bit deptch=%d\n",hdr.bitDepth);
+		return YSERR;
+	}
+
+
+
+	if(0<hdr.width && 0x7fffffff/4/hdr.width<hdr.height)
+	{
+		printf("Image too large.\n");
+		printf("  Width=%u Height=%u\n",hdr.width,hdr.height);
+		return YSERR;
+	}
+
+	decodeY0=(rowY0<0 ? 0 : rowY0);
+	decodeY1=(rowY1<0 || (int)hdr.height<rowY1 ? (int)hdr.height : rowY1);
+	decodeY0=(decodeY1<decodeY0 ? decodeY1 : decodeY0);
+
+	wid=hdr.width;
+	hei=decodeY1-decodeY0;
+	if(autoDeleteRgbaBuffer==1 && rgba!=NULL)
+	{
+		delete [] rgba;
+	}
+	rgba=NULL;
+	if(NULL!=userBuf)
+	{
+		if(userBufWid<wid || userBufHei<hei || userBufPitch<wid*4)
+		{
+			printf("Output buffer too small.\n");
+			printf("  Width=%d Rows=%d\n",wid,hei);
+			return YSERR;
+		}
+		outputBuf=userBuf;
+		outputPitch=userBufPitch;
+	}
+	else
+	{
+		rgba=new unsigned char [wid*hei*4];
+		outputBuf=rgba;
+		outputPitch=wid*4;
+	}
+
+
+	// Select the color expansion for the image once, instead of for every byte.
+	unsigned int nComponent=1;
+	switch(hdr.colorType)
+	{
+	default:
+		printf("Internal error!  Color type was supposed to be checked in the previous switch/case statement!\n");
+		return YSERR;
+	case 0:   // Greyscale
+	case 3:   // Indexed-color
+		{
+			const unsigned int nValue=(1u<<hdr.bitDepth);
+			for(unsigned int value=0; value<nValue; value++)
+			{
+				unsigned char *entry=lookUp+value*4;
+				if(0==hdr.colorType)
+				{
+					entry[0]=(unsigned char)(value*255/(nValue-1));
+					entry[1]=entry[0];
+					entry[2]=entry[0];
+				}
+				else if(value<plt.nEntry)
+				{
+					entry[0]=plt.entry[value*3  ];
+					entry[1]=plt.entry[value*3+1];
+					entry[2]=plt.entry[value*3+2];
+				}
+				else
+				{
+					entry[0]=0;
+					entry[1]=0;
+					entry[2]=0;
+					entry[3]=0;
+					continue;
+				}
+				entry[3]=((value==trns.col[0] || value==trns.col[1] || value==trns.col[2]) ? 0 : 255);
+			}
+			switch(hdr.bitDepth)
+			{
+			case 1:
+				expandLine=YsPngExpandLookUpPacked<1>;
+				break;
+			case 2:
+				expandLine=YsPngExpandLookUpPacked<2>;
+				break;
+			case 4:
+				expandLine=YsPngExpandLookUpPacked<4>;
+				break;
+			case 8:
+				expandLine=YsPngExpandLookUp8;
+				break;
+			}
+		}
+		break;
+	case 2:   // Truecolor
+		nComponent=3;
+		if(16==hdr.bitDepth)
+		{
+			expandLine=YsPngExpandTrueColor16;
+		}
+		else if(255<trns.col[0] || 255<trns.col[1] || 255<trns.col[2])
+		{
+			expandLine=YsPngExpandTrueColor8Opaque;
+#ifdef YSPNG_X86_GCC
+			static const bool hasSSSE3=YsPngHasSSSE3();
+			if(true==hasSSSE3)
+			{
+				expandLine=YsPngExpandTrueColor8OpaqueSSSE3;
+			}
+#endif
+		}
+		else
+		{
+			expandLine=YsPngExpandTrueColor8;
+		}
+		break;
+	case 4:   // Greyscale with alpha
+		nComponent=2;
+		expandLine=YsPngExpandGrayAlpha8;
+		break;
+	case 6:   // Truecolor with alpha
+		nComponent=4;
+		expandLine=YsPngExpandTrueColorAlpha8;
+		break;
+	}
+
+	// See PNG Specification 7.2 Scanlines.  Less than 8 bits per pixel are unfiltered as 1 byte per pixel.
+	bitPerPixel=nComponent*hdr.bitDepth;
+	bytePerPixel=(8<=bitPerPixel ? bitPerPixel/8 : 1);
+	const unsigned int twoLineBufLngPerLine=LINE_PADDING+(hdr.width*bitPerPixel+7)/8;
+
+	// The line buffers from the previous image are used if they are large enough.
+	if(twoLineBufSize<twoLineBufLngPerLine*2)
+	{
+		delete [] twoLineBuf8;
+		twoLineBuf8=new unsigned char [twoLineBufLngPerLine*2];
+		twoLineBufSize=twoLineBufLngPerLine*2;
+	}
+	memset(twoLineBuf8,0,twoLineBufLngPerLine*2);
+	curLine8=twoLineBuf8+LINE_PADDING;
+	prvLine8=twoLineBuf8+twoLineBufLngPerLine+LINE_PADDING;
+
+	if(0!=hdr.interlaceMethod && passLineSize<(unsigned int)wid*4)
+	{
+		delete [] passLine;
+		passLine=new unsigned char [wid*4];
+		passLineSize=wid*4;
+	}
+
+	filter=0;
+	interlacePass=1;
+	BeginPass();
+
+	if(decodeY0==decodeY1)  // Nothing to write.
+	{
+		interlacePass=8;
+		RequestStop();
+	}
+
+	return YSOK;
+}
+
+void YsRawPngDecoder::BeginPass(void)
+{
+	while(interlacePass<=7)
+	{
+		if(0==hdr.interlaceMethod)
+		{
+			passWid=wid;
+			passHei=hdr.height;
+		}
+		else
+		{
+			const unsigned int pass=interlacePass-1;
+			const unsigned int x0=YsPngInterlaceX0[pass],y0=YsPngInterlaceY0[pass];
+			const unsigned int dx=YsPngInterlaceDX[pass],dy=YsPngInterlaceDY[pass];
+			passWid=(x0<(unsigned int)wid ? (wid-x0+dx-1)/dx : 0);
+			passHei=(y0<hdr.height ? (hdr.height-y0+dy-1)/dy : 0);
+		}
+
+		// A pass without a pixel has no line, not even the filter-type byte.
+		if(0<passWid && 0<passHei)
+		{
+			lineLng=(passWid*bitPerPixel+7)/8;
+			memset(prvLine8,0,lineLng);
+			x=-1;
+			y=0;
+			inLineCount=0;
+			return;
+		}
+
+		interlacePass=(0==hdr.interlaceMethod ? 8 : interlacePass+1);
+	}
+}
+
+void YsRawPngDecoder::DecodeLine(void)
+{
+	YsPngUnfilterLine(curLine8,prvLine8,lineLng,bytePerPixel,filter);
+
+	// A line above the range is unfiltered, as the next line needs it, but not expanded.
+	if(0==hdr.interlaceMethod)
+	{
+		if(decodeY0<=y)
+		{
+			(*expandLine)(GetRowPointer(y),curLine8,passWid,*this);
+		}
+	}
+	else
+	{
+		const unsigned int pass=interlacePass-1;
+		const unsigned int dx=YsPngInterlaceDX[pass];
+		const int dstY=YsPngInterlaceY0[pass]+y*YsPngInterlaceDY[pass];
+		if(decodeY0<=dstY && dstY<decodeY1)
+		{
+			(*expandLine)(passLine,curLine8,passWid,*this);
+			unsigned char *dst=GetRowPointer(dstY)+YsPngInterlaceX0[pass]*4;
+			for(unsigned int i=0; i<passWid; i++)
+			{
+				memcpy(dst+i*dx*4,passLine+i*4,4);
+			}
+		}
+	}
+
+	ShiftTwoLineBuf();
+	x=-1;
+	inLineCount=0;
+	y++;
+	if(0==hdr.interlaceMethod)
+	{
+		if(decodeY0<y)
+		{
+			LineDecoded(y-1,1);
+		}
+		if(decodeY1<=y)
+		{
+			// Rows below the range are not needed.  Stop uncompressing unless it was the last row anyway.
+			interlacePass=8;
+			if(y<(int)hdr.height)
+			{
+				RequestStop();
+			}
+		}
+	}
+	else if(passHei<=(unsigned int)y)
+	{
+		interlacePass++;
+		if(YsGenericPngDecoder::verboseMode==YSTRUE)
+		{
+			printf("Interlace Pass %d\n",interlacePass);
+		}
+		BeginPass();
+		if(7<interlacePass && decodeY0<decodeY1)
+		{
+			LineDecoded(decodeY0,decodeY1-decodeY0);
+		}
+	}
+}
+
+void YsRawPngDecoder::LineDecoded(int,int)
+{
+}
+
+int YsRawPngDecoder::Output(unsigned char dat)
+{
+	return OutputBytes(&dat,1);
+}
+
+int YsRawPngDecoder::OutputBytes(const unsigned char dat[],unsigned int nByte)
+{
+	while(0<nByte)
+	{
+		if(7<interlacePass)  // Already have all the lines.  Extra data is not used.
+		{
+			return YSOK;
+		}
+
+		if(x==-1)  // First byte is filter type for the line.
+		{
+			filter=dat[0];   // See PNG Specification 4.5.4 Filtering, 9 Filtering
+			x=0;
+			dat++;
+			nByte--;
+			continue;
+		}
+
+		// Take as many bytes as the line needs, and decode the line when it is filled.
+		unsigned int nCopy=lineLng-inLineCount;
+		nCopy=(nByte<nCopy ? nByte : nCopy);
+		memcpy(curLine8+inLineCount,dat,nCopy);
+		inLineCount+=nCopy;
+		dat+=nCopy;
+		nByte-=nCopy;
+
+		if(lineLng==inLineCount)
+		{
+			DecodeLine();
+		}
+	}
+	return YSOK;
+}
+
+int YsRawPngDecoder::EndOutput(void)
+{
+	if(YsGenericPngDecoder::verboseMode==YSTRUE)
+	{
+		printf("Final Position (%d,%d)\n",x,y);
+	}
+	return YSOK;
+}
+
+void YsRawPngDecoder::Flip(void)  // For drawing in OpenGL
+{
+	int x,y,bytePerLine;
+	unsigned int swp;
+	if(NULL==rgba)  // Written to the buffer given by SetOutputBuffer.  Use SetBottomUp instead.
+	{
+		return;
+	}
 	bytePerLine=wid*4;
 	for(y=0; y<hei/2; y++)
 	{
@@ -32,6 +32,8 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* { */
 
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
 #ifndef YSRESULT_IS_DEFINED
 #define YSRESULT_IS_DEFINED
@@ -83,55 +85,237 @@ public:
 	}
 };
 
-class YsPngUncompressor
+/*! Reads the bits of a deflate stream, least-significant bit first, through a 64-bit buffer.
+    Refill tops up the buffer to at least 56 bits, which is enough for one length/distance pair
+    with the extra bits, so that the decoder does not check for the end of the data for every bit.
+    Past the end of the data, zeros are read, and IsOverrun becomes true when they are consumed. */
+class YsPngBitReader
 {
 public:
-	class YsGenericPngDecoder *output;
+	const unsigned char *dat;
+	unsigned int length;
+	unsigned int bytePtr;         // Next byte to be loaded to the buffer.
+	unsigned long long int bitBuf;
+	unsigned int nBitInBuf;
+	unsigned int nPadByte;        // Zero bytes loaded past the end.
 
-	inline unsigned int GetNextBit(const unsigned char dat[],unsigned &bytePtr,unsigned &bitPtr)
+	void Begin(const unsigned char dat[],unsigned int length,unsigned int bytePtr);
+
+	inline void Refill(void)
 	{
-		unsigned a;
-		a=dat[bytePtr]&bitPtr;
-		bitPtr<<=1;
-		if(bitPtr>=256)
+		if(nBitInBuf<=56)
 		{
-			bitPtr=1;
-			bytePtr++;
+			if(bytePtr+8<=length)
+			{
+				unsigned long long int next=
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__ || defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+				    LoadLittleEndian(dat+bytePtr);
+#else
+				    (unsigned long long int)dat[bytePtr]|
+				    ((unsigned long long int)dat[bytePtr+1]<<8)|
+				    ((unsigned long long int)dat[bytePtr+2]<<16)|
+				    ((unsigned long long int)dat[bytePtr+3]<<24)|
+				    ((unsigned long long int)dat[bytePtr+4]<<32)|
+				    ((unsigned long long int)dat[bytePtr+5]<<40)|
+				    ((unsigned long long int)dat[bytePtr+6]<<48)|
+				    ((unsigned long long int)dat[bytePtr+7]<<56);
+#endif
+				bitBuf|=next<<nBitInBuf;
+				const unsigned int nByte=(63-nBitInBuf)>>3;
+				bytePtr+=nByte;
+				nBitInBuf+=nByte*8;
+			}
+			else
+			{
+				RefillSlow();
+			}
 		}
-		return (a!=0 ? 1 : 0);
 	}
-	inline unsigned int GetNextMultiBit(const unsigned char dat[],unsigned &bytePtr,unsigned &bitPtr,unsigned n)
+	void RefillSlow(void);
+
+	/*! Returns the next n bits without consuming.  n must not be more than the bits in the buffer. */
+	inline unsigned int Peek(unsigned int n) const
+	{
+		return (unsigned int)(bitBuf&((1ULL<<n)-1));
+	}
+	inline void Consume(unsigned int n)
 	{
-		unsigned value,mask,i;
-		value=0;
-		mask=1;
-		for(i=0; i<n; i++)
+		bitBuf>>=n;
+		nBitInBuf-=n;
+	}
+	/*! Returns and consumes the next n bits (up to 32), refilling the buffer if needed. */
+	inline unsigned int Get(unsigned int n)
+	{
+		if(nBitInBuf<n)
 		{
-			if(GetNextBit(dat,bytePtr,bitPtr))
-			{
-				value|=mask;
-			}
-			mask<<=1;
+			Refill();
 		}
+		unsigned int value=Peek(n);
+		Consume(n);
 		return value;
 	}
 
+	/*! Drops the bits up to the next byte boundary, empties the buffer, and returns the offset
+	    of the next byte in dat.  Used for a stored (non-compressed) block. */
+	unsigned int Rewind(void);
+
+	/*! Returns true if more bits have been consumed than there are in the data. */
+	inline bool IsOverrun(void) const
+	{
+		return nBitInBuf<nPadByte*8;
+	}
+
+	/*! Returns the number of bits consumed from the beginning of dat. */
+	inline unsigned long long int GetBitPosition(void) const
+	{
+		return (unsigned long long int)(bytePtr+nPadByte)*8-nBitInBuf;
+	}
+	/*! Moves back (or forward) to the bit position, for example, to the beginning of a code that was cut
+	    at the end of the data. */
+	void SeekBit(unsigned long long int bitPos);
+	/*! Returns the number of whole bytes not consumed yet. */
+	inline unsigned int GetNumAvailableByte(void) const
+	{
+		const unsigned long long int bitPos=GetBitPosition();
+		return (bitPos<(unsigned long long int)length*8 ? length-(unsigned int)((bitPos+7)/8) : 0);
+	}
+
+private:
+	static inline unsigned long long int LoadLittleEndian(const unsigned char ptr[])
+	{
+		unsigned long long int value;
+		memcpy(&value,ptr,8);
+		return value;
+	}
+};
+
+/*! Flat lookup table of a canonical Huffman code, like zlib's inflate.
+    The low rootBits bits of the bit buffer index the root table.  A code longer than rootBits
+    is found in a sub-table linked from the root entry.  An entry also tells the meaning of the symbol,
+    so that a length or distance is base value plus the extra bits without another table. */
+class YsPngHuffmanTable
+{
+public:
+	enum
+	{
+		OP_LITERAL=0x00,  // value is the literal byte, or the symbol of a code-length code.
+		OP_BASE=0x10,     // value is the base of a length or distance.  The low 4 bits is the number of extra bits.
+		OP_END=0x20,      // End of block.
+		OP_LINK=0x40,     // value is the offset of the sub-table, and nBit is its index bits.
+		OP_INVALID=0x80   // Not a code, or a symbol that must not appear.
+	};
+	enum
+	{
+		ALPHABET_CODE_LENGTH,
+		ALPHABET_LITERAL_LENGTH,
+		ALPHABET_DISTANCE
+	};
+
+	class Entry
+	{
+	public:
+		unsigned short value;
+		unsigned char nBit;    // Length of the code.  Bits to consume.
+		unsigned char op;
+	};
+
+	unsigned int rootBits;
+	std::vector <Entry> table;
+
+	/*! Makes the table from the code lengths of the symbols.  Returns YSERR if the lengths are
+	    over-subscribed.  An incomplete code is allowed, and the missing codes are OP_INVALID. */
+	int Make(unsigned int nSymbol,const unsigned int codeLength[],unsigned int rootBits,int alphabet);
+
+	inline const Entry &Lookup(unsigned long long int bitBuf) const
+	{
+		const Entry &root=table[(unsigned int)bitBuf&((1u<<rootBits)-1)];
+		if(OP_LINK!=root.op)
+		{
+			return root;
+		}
+		return table[root.value+((unsigned int)(bitBuf>>rootBits)&((1u<<root.nBit)-1))];
+	}
+
+private:
+	static Entry MakeEntry(unsigned int symbol,unsigned int nBit,int alphabet);
+};
+
+/*! Inflater of the zlib stream of PNG.
+
+    The data can be given in pieces by BeginStream, Push, and EndStream.  Push uncompresses as much as
+    the piece allows, and keeps only the bytes of a code that is cut at the end of the piece, therefore
+    the memory used is the 32KB window regardless of the size of the stream.  Uncompress is the same
+    with the whole data in one piece. */
+class YsPngUncompressor
+{
+public:
+	enum
+	{
+		LITERAL_ROOT_BITS=10,
+		DISTANCE_ROOT_BITS=9,
+		WINDOW_BUFFER_SIZE=32768,
+		MAX_DYNAMIC_HEADER_SIZE=600   // Bytes that a dynamic-Huffman block header can take at most, rounded up.
+	};
+
+	class YsGenericPngDecoder *output;
+
 	void MakeFixedHuffmanCode(unsigned hLength[288],unsigned hCode[288]);
 	static void MakeDynamicHuffmanCode(unsigned hLength[288],unsigned hCode[288],unsigned nLng,unsigned lng[]);
-	int DecodeDynamicHuffmanCode
-	   (unsigned int &hLit,unsigned int &hDist,unsigned int &hCLen,
-	    unsigned int *&hLengthLiteral,unsigned int *&hCodeLiteral,
-	    unsigned int *&hLengthDist,unsigned int *&hCodeDist,
-	    unsigned int hLengthBuf[322],unsigned int hCodeBuf[322],
-	    const unsigned char dat[],unsigned int &bytePtr,unsigned int &bitPtr);
 
-	YsPngHuffmanTree *MakeHuffmanTree(unsigned n,unsigned hLength[],unsigned hCode[]);
-	void DeleteHuffmanTree(YsPngHuffmanTree *node);
+	/*! Reads the code lengths at the beginning of a dynamic-Huffman block, and makes the tables. */
+	int DecodeDynamicHuffmanCode(YsPngBitReader &reader,YsPngHuffmanTable &literalTable,YsPngHuffmanTable &distTable);
+
+	/*! Decodes symbols until the end of the block. */
+	int UncompressHuffmanBlock(YsPngBitReader &reader,const YsPngHuffmanTable &literalTable,const YsPngHuffmanTable &distTable);
 
-	unsigned GetCopyLength(unsigned value,unsigned char dat[],unsigned &bytePtr,unsigned &bitPtr);
-	unsigned GetBackwardDistance(unsigned distCode,unsigned char dat[],unsigned &bytePtr,unsigned &bitPtr);
+	YsPngUncompressor();
+
+	void BeginStream(void);
+	/*! Uncompresses the next piece of the stream.  dat does not have to stay after the function returns. */
+	int Push(const unsigned char dat[],unsigned int length);
+	/*! Uncompresses what is left, and gives everything to output.  Returns YSERR if the data was broken,
+	    or ended before the final block. */
+	int EndStream(void);
+	/*! Returns true after the final block. */
+	bool IsFinished(void) const;
 
 	int Uncompress(unsigned length,unsigned char dat[]);
+
+private:
+	enum
+	{
+		STATE_ZLIB_HEADER,
+		STATE_BLOCK_HEADER,
+		STATE_STORED,
+		STATE_HUFFMAN,
+		STATE_END,
+		STATE_ERROR
+	};
+	int state;
+	unsigned int bFinal;
+	unsigned int storedLeft;   // Bytes left in a non-compressed block.
+	const YsPngHuffmanTable *literalTable,*distTable;
+	YsPngHuffmanTable dynamicLiteralTable,dynamicDistTable,codeLengthTable;
+
+	// Bytes from where the previous Push stopped, and the bits of the first byte already consumed.
+	std::vector <unsigned char> pending;
+	unsigned int pendingBit;
+
+	// The uncompressed bytes are written to the window, and given to output in blocks
+	// when the window wraps around, and at the end of the stream.
+	std::vector <unsigned char> windowBuf;  // WINDOW_BUFFER_SIZE bytes.
+	unsigned int windowSize;                // Farthest distance allowed by CINFO.
+	unsigned int windowUsed;                // Next byte to write.
+	unsigned int windowFlushed;             // Bytes before this are given to output.
+	unsigned long long int nByteExtracted;
+
+	int FlushWindow(void);
+	/*! Uncompresses from the reader until the end of the stream, or until the data runs out.  In the latter case,
+	    the reader is left at the beginning of the block header or the code that could not be completed.
+	    Unless lastInput, a dynamic-Huffman block header is not read until MAX_DYNAMIC_HEADER_SIZE bytes are available. */
+	int UncompressBlocks(YsPngBitReader &reader,bool lastInput);
+	/*! Uncompresses from the byte and bit position of dat, and keeps the rest in pending. */
+	int UncompressPiece(const unsigned char dat[],unsigned int length,unsigned int startByte,unsigned int startBit);
 };
 
 ////////////////////////////////////////////////////////////
@@ -151,6 +335,7 @@ class YsPngPalette
 public:
 	unsigned int nEntry;
 	unsigned char *entry;
+	unsigned int nAlloc;   // Bytes allocated for entry.  Kept for the next palette.
 
 	YsPngPalette();
 	~YsPngPalette();
@@ -171,6 +356,12 @@ class YsPngGenericBinaryStream
 public:
 	virtual size_t GetSize(void) const=0;
 	virtual size_t Read(unsigned char buf[],size_t readSize)=0;
+
+	/*! For a stream that is in memory as a whole, returns the pointer to the next readSize bytes (or less at
+	    the end of the stream) and advances the stream, so that the data can be used without copying.
+	    The pointer stays valid while the stream is alive.  The default implementation returns nullptr
+	    without advancing, which means the stream must be read by Read. */
+	virtual const unsigned char *ReadInPlace(size_t readSize,size_t &nRead);
 };
 
 class YsPngBinaryFileStream : public YsPngGenericBinaryStream
@@ -193,6 +384,37 @@ public:
 	YsPngBinaryMemoryStream(size_t dataSize,const unsigned char binaryData[]);
 	virtual size_t GetSize(void) const;
 	virtual size_t Read(unsigned char buf[],size_t readSize);
+	virtual const unsigned char *ReadInPlace(size_t readSize,size_t &nRead);
+};
+
+/*! Stream of a memory-mapped file.  The decoder uses the chunks in place, and the IDAT data go from the
+    mapping to the uncompressor without a copy.  The mapping is advised for sequential access, since
+    a PNG is read once from the beginning to the end.
+    Where memory-mapping is not available, the file is read into memory when opened. */
+class YsPngBinaryMappedStream : public YsPngGenericBinaryStream
+{
+private:
+	size_t offset;
+	size_t dataSize;
+	const unsigned char *dataPtr;
+	unsigned char *allocPtr;   // Not nullptr if the file was read instead of mapped.
+	bool mapped;
+
+	YsPngBinaryMappedStream(const YsPngBinaryMappedStream &)=delete;
+	YsPngBinaryMappedStream &operator=(const YsPngBinaryMappedStream &)=delete;
+
+public:
+	YsPngBinaryMappedStream();
+	explicit YsPngBinaryMappedStream(const char fn[]);
+	~YsPngBinaryMappedStream();
+
+	int Open(const char fn[]);
+	void Close(void);
+	bool IsOpen(void) const;
+
+	virtual size_t GetSize(void) const;
+	virtual size_t Read(unsigned char buf[],size_t readSize);
+	virtual const unsigned char *ReadInPlace(size_t readSize,size_t &nRead);
 };
 
 class YsGenericPngDecoder
@@ -212,15 +434,65 @@ public:
 
 	YsGenericPngDecoder();
 	void Initialize(void);
+
+	/*! Forgets the previous image, so that the decoder can be used for the next image.  The buffers,
+	    such as the window of the uncompressor, the Huffman tables, and the read buffer, are kept, and they
+	    are allocated again only if the next image needs more.  BeginPush, and therefore Decode, does this
+	    by itself, but not the part added by a subclass. */
+	virtual void Reset(void);
+
 	int CheckSignature(YsPngGenericBinaryStream &binStream);
 	int ReadChunk(unsigned &length,unsigned char *&buf,unsigned &chunkType,unsigned &crc,YsPngGenericBinaryStream &binStream);
+	/*! Same as ReadChunk, but buf points into the stream, and must not be deleted.  Returns YSERR if the
+	    stream does not support ReadInPlace. */
+	int ReadChunkInPlace(unsigned &length,const unsigned char *&buf,unsigned &chunkType,unsigned &crc,YsPngGenericBinaryStream &binStream);
 	int Decode(const char fn[]);
 	int Decode(FILE *fp);
 	int Decode(YsPngGenericBinaryStream &binStream);
 
+	/*! Decodes a PNG given in pieces.  BeginPush, then Push the data in pieces of any size, then EndPush.
+	    IDAT data are uncompressed as they arrive, and only the chunks that the decoder uses are stored.
+	    Push returns YSERR once the data is found broken.  EndPush returns YSERR if the image was not
+	    decoded to the end, after giving the output what was decoded before the broken part. */
+	void BeginPush(void);
+	int Push(const unsigned char dat[],size_t length);
+	int EndPush(void);
+	/*! Returns true after the IEND chunk, or after the output stopped the decoding by RequestStop. */
+	bool IsPushFinished(void) const;
+
+	/*! Called by the output when it has all it needs.  The uncompressor stops at the next time it gives
+	    data to the output, and the rest of the stream is not read.  The decoding is not an error. */
+	void RequestStop(void);
+	bool IsStopRequested(void) const;
+
 	virtual int PrepareOutput(void);
 	virtual int Output(unsigned char dat);
+	/*! Receives nByte bytes of the uncompressed data.  The default implementation calls Output(dat[i])
+	    for each byte.  A decoder that can take a block of bytes at once should override this function. */
+	virtual int OutputBytes(const unsigned char dat[],unsigned int nByte);
 	virtual int EndOutput(void);
+
+private:
+	enum
+	{
+		PUSH_SIGNATURE,
+		PUSH_CHUNK_HEADER,
+		PUSH_CHUNK_DATA,
+		PUSH_CHUNK_CRC,
+		PUSH_END,
+		PUSH_ERROR
+	};
+	int pushState;
+	unsigned char pushField[8];         // Signature, or length and type of a chunk.
+	unsigned int pushFieldUsed;
+	unsigned int chunkType,chunkLeft;
+	std::vector <unsigned char> chunkBuf;  // Data of IHDR, PLTE, tRNS, or gAMA.
+	bool outputPrepared;
+	bool stopRequested;
+	YsPngUncompressor uncompressor;
+	std::vector <unsigned char> readBuf;   // For a stream that cannot be read in place.
+
+	int EndChunk(void);
 };
 
 
@@ -234,28 +506,87 @@ public:
 	~YsRawPngDecoder();
 
 
-	int wid,hei;
-	unsigned char *rgba;  // Raw data of R,G,B,A
+	int wid,hei;          // hei is the number of rows decoded, which is less than the image height if SetRowRange is used.
+	unsigned char *rgba;  // Raw data of R,G,B,A.  NULL if the pixels are written to the buffer given by SetOutputBuffer.
 	int autoDeleteRgbaBuffer;
 
+	/*! Decodes only rows y0 to y1-1 of the image.  y1<0 means the bottom of the image.  The range is cut off by
+	    the image.  A non-interlaced image is uncompressed only up to row y1-1.  An interlaced image has to be
+	    uncompressed to the end, but only the rows in the range are written.  Stays until it is set again. */
+	void SetRowRange(int y0,int y1);
+
+	/*! If true, the last row of the range is written first, so that the pixels are ready for OpenGL without Flip. */
+	void SetBottomUp(bool bottomUp);
 
-	int filter,x,y,firstByte;
-	int inLineCount;
-	int inPixelCount;
-	unsigned int r,g,b,msb;  // msb for reading 16 bit depth
-	unsigned int index;
+	/*! Makes the decoder write the pixels to buf instead of allocating rgba.  Rows are pitchInBytes apart.
+	    Decode fails if the image is wider than bufWid, or has more rows to decode than bufHei.
+	    The buffer is not deleted by the decoder.  Give buf=NULL to let the decoder allocate rgba again. */
+	void SetOutputBuffer(unsigned char *buf,int bufWid,int bufHei,int pitchInBytes);
 
-	unsigned int interlacePass;
+	/*! Returns the pointer where row y of the image is written.  Valid after the header is read,
+	    for example, in LineDecoded.  y must be in the range given by SetRowRange. */
+	unsigned char *GetRowPointer(int y) const;
 
-	// For filtering
+	// Output settings.  See SetRowRange, SetBottomUp, and SetOutputBuffer.
+	int rowY0,rowY1;
+	bool bottomUp;
+	unsigned char *userBuf;
+	int userBufWid,userBufHei,userBufPitch;
+
+	// Where the rows are written.  Set in PrepareOutput.
+	int decodeY0,decodeY1;        // Rows to decode, cut off by the image.
+	unsigned char *outputBuf;     // rgba or userBuf.
+	int outputPitch;              // In bytes.
+
+
+	/*! Makes RGBA of nPixel pixels from an unfiltered line. */
+	typedef void (*ExpandLineFunc)(unsigned char rgba[],const unsigned char line[],unsigned int nPixel,const YsRawPngDecoder &decoder);
+
+	int filter,x,y;          // x is -1 while waiting for the filter-type byte of a line.
+	unsigned int inLineCount;   // Bytes of the current line received.
+
+	unsigned int interlacePass;  // 1 to 7 for an interlaced image.  Always 1 for a non-interlaced image.  8 after the last line.
+	unsigned int passWid,passHei;
+
+	// For filtering.  A line is stored after LINE_PADDING zero bytes, so that the left of the first pixel reads zero.
+	enum
+	{
+		LINE_PADDING=8
+	};
+	unsigned int bytePerPixel;   // 1 if less than 8 bits per pixel.
+	unsigned int bitPerPixel;
+	unsigned int lineLng;        // Bytes of a line of the current pass without the filter-type byte.
 	unsigned char *twoLineBuf8,*curLine8,*prvLine8;
+	unsigned int twoLineBufSize;  // Bytes allocated for twoLineBuf8.  Kept for the next image.
+
+	// For color expansion.  Selected in PrepareOutput.
+	ExpandLineFunc expandLine;
+	unsigned char lookUp[256*4];  // RGBA of a grayscale value or a palette index.
+	unsigned char *passLine;      // RGBA of a line of an interlace pass.
+	unsigned int passLineSize;    // Bytes allocated for passLine.  Kept for the next image.
+
+	/*! In addition to YsGenericPngDecoder::Reset, deletes the pixels of the previous image (unless
+	    autoDeleteRgbaBuffer is 0), and clears SetRowRange, SetBottomUp, and SetOutputBuffer.
+	    The line buffers are kept.  Use it to decode many small images, such as tiles, by one decoder. */
+	virtual void Reset(void);
 
 	void ShiftTwoLineBuf(void);
 
 	virtual int PrepareOutput(void);
 	virtual int Output(unsigned char dat);
+	virtual int OutputBytes(const unsigned char dat[],unsigned int nByte);
 	virtual int EndOutput(void);
 
+	/*! Moves to the first interlace pass from interlacePass that has a pixel, or sets interlacePass to 8. */
+	void BeginPass(void);
+	/*! Unfilters curLine8, and writes the pixels to rgba. */
+	void DecodeLine(void);
+
+	/*! Called when rows y0 to y0+nLine-1 of the image are decoded, so that a subclass can use them before the
+	    whole image is decoded.  See GetRowPointer for where they are.  A row of a non-interlaced image comes
+	    as soon as it is decoded.  An interlaced image comes after the last pass in one call. */
+	virtual void LineDecoded(int y0,int nLine);
+
 	void Flip(void);  // For drawing in OpenGL
 };
 
@@ -1695,7 +1695,7 @@ int YsGenericPngEncoder::WritetEXtChunk(const char keyword[],const char text[])
 	return YSERR;
 }
 
-int YsGenericPngEncoder::WriteIDATChunk(unsigned int nLine,unsigned int bytePerLine,const unsigned char dat[])
+int YsGenericPngEncoder::WriteIDATChunk(unsigned int nLine,unsigned int bytePerLine,const unsigned char dat[],unsigned int datBytePerLine)
 {
 	YsPngCompressor compressor;
 	unsigned char *chunk;
@@ -1739,7 +1739,7 @@ int YsGenericPngEncoder::WriteIDATChunk(unsigned int nLine,unsigned int bytePerL
 		for(yInBlock=0; yInBlock<nLineInBlock; yInBlock++)
 		{
 			int headPtrDst,headPtrSrc;
-			headPtrSrc=(y+yInBlock)*bytePerLine;
+			headPtrSrc=(y+yInBlock)*datBytePerLine;
 			headPtrDst=yInBlock*(bytePerLine+1);
 
 			zLibBlock[headPtrDst]=0;  // No Filter.  See section 9 of PNG documentation.
@@ -1915,6 +1915,11 @@ unsigned int YsGenericPngEncoder::CalculateBytePerLine(int width,int bitDepth,in
 }
 
 int YsGenericPngEncoder::Encode(int width,int height,int bitDepth,int colorType,const unsigned char dat[])
+{
+	return Encode(width,height,bitDepth,colorType,dat,CalculateBytePerLine(width,bitDepth,colorType));
+}
+
+int YsGenericPngEncoder::Encode(int width,int height,int bitDepth,int colorType,const unsigned char dat[],unsigned int datBytePerLine)
 {
 	unsigned int totalByte,bytePerLine;
 	bytePerLine=CalculateBytePerLine(width,bitDepth,colorType);
@@ -1923,6 +1928,11 @@ int YsGenericPngEncoder::Encode(int width,int height,int bitDepth,int colorType,
 		printf("Unsupported color type and/or bitDepth\n");
 		return YSERR;
 	}
+	if(datBytePerLine<bytePerLine)
+	{
+		printf("Line pitch is shorter than a line\n");
+		return YSERR;
+	}
 	totalByte=bytePerLine*height;
 
 
@@ -1932,7 +1942,7 @@ int YsGenericPngEncoder::Encode(int width,int height,int bitDepth,int colorType,
 		return YSERR;
 	}
 
-	WriteIDATChunk(height,bytePerLine,dat);
+	WriteIDATChunk(height,bytePerLine,dat,datBytePerLine);
 
 	WritetEXtChunk("Comment","YS PNG Encoder (http://www.ysflight.com)");
 	WriteIENDChunk();
@@ -1967,12 +1977,18 @@ int YsRawPngEncoder::EncodeToFile(const char fn[],int width,int height,int bitDe
 }
 
 int YsRawPngEncoder::EncodeToFile(FILE *fp,int width,int height,int bitDepth,int colorType,const unsigned char dat[])
+{
+	return EncodeToFile(fp,width,height,bitDepth,colorType,dat,CalculateBytePerLine(width,bitDepth,colorType));
+}
+
+int YsRawPngEncoder::EncodeToFile(FILE *fp,int width,int height,int bitDepth,int colorType,const unsigned char dat[],unsigned int datBytePerLine)
 {
 	if(NULL!=fp)
 	{
 		this->fp=fp;
-		return Encode(width,height,bitDepth,colorType,dat);
+		return Encode(width,height,bitDepth,colorType,dat,datBytePerLine);
 	}
+	return YSERR;
 }
 
 ////////////////////////////////////////////////////////////
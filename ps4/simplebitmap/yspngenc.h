@@ -185,7 +185,7 @@ protected:
 
 	int WritetEXtChunk(const char keyword[],const char text[]);
 
-	int WriteIDATChunk(unsigned int nLine,unsigned int bytePerLine,const unsigned char dat[]);
+	int WriteIDATChunk(unsigned int nLine,unsigned int bytePerLine,const unsigned char dat[],unsigned int datBytePerLine);
 
 	unsigned int CalculateBytePerLine(int width,int bitDepth,int colorType);
 
@@ -194,6 +194,11 @@ public:
 	*/
 	int Encode(int width,int height,int bitDepth,int colorType,const unsigned char dat[]);
 
+	/*! Encode PNG from a bitmap that has padding at the end of each line.
+	    datBytePerLine is the number of bytes from the top of one line to the top of the next line in dat.
+	*/
+	int Encode(int width,int height,int bitDepth,int colorType,const unsigned char dat[],unsigned int datBytePerLine);
+
 	void SetDontCompress(int dontCompress);
 };
 
@@ -212,6 +217,11 @@ public:
 	/*! Encode PNG to file.  For 24bit RGBA bitmap (24-bit for RGB and 8-bit for A), use bitDepth=8, and colorType=6.
 	*/
 	int EncodeToFile(FILE *fp,int width,int height,int bitDepth,int colorType,const unsigned char dat[]);
+
+	/*! Encode PNG to file from a bitmap that has padding at the end of each line.
+	    datBytePerLine is the number of bytes from the top of one line to the top of the next line in dat.
+	*/
+	int EncodeToFile(FILE *fp,int width,int height,int bitDepth,int colorType,const unsigned char dat[],unsigned int datBytePerLine);
 };
 
 
@@ -0,0 +1,937 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <initializer_list>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "simplebitmap.h"
+#include "simplebitmapsimd.h"
+#include "simplebitmapfilterpipeline.h"
+#include "simplebitmapconvert.h"
+#include "simplebitmaprawfile.h"
+#include "simplebitmappool.h"
+#include "yspng.h"
+#include "yspngenc.h"
+
+static double Elapsed(std::chrono::high_resolution_clock::time_point t0)
+{
+	auto t1=std::chrono::high_resolution_clock::now();
+	return std::chrono::duration <double> (t1-t0).count();
+}
+
+/* Counts the bitmaps loaded by SimpleBitmap::LoadPngBatch that are same as the expected bitmap. */
+class BatchCheck
+{
+public:
+	const SimpleBitmap *expected;
+	int nMatch;
+
+	static void Callback(void *context,SimpleBitmapLoadResult &result)
+	{
+		BatchCheck *check=(BatchCheck *)context;
+		if(true==result.loaded && result.bmp==*check->expected)
+		{
+			++check->nMatch;
+		}
+	}
+};
+
+/* Per-component loops equivalent to the original implementations, for reference. */
+static bool CompareReference(const SimpleBitmap &a,const SimpleBitmap &b)
+{
+	auto nElements=a.GetWidth()*a.GetHeight()*4;
+	auto aPtr=a.GetBitmapPointer();
+	auto bPtr=b.GetBitmapPointer();
+	for(int i=0; i<nElements; ++i)
+	{
+		if(aPtr[i]!=bPtr[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+static void ClearReference(SimpleBitmap &bmp,unsigned char r,unsigned char g,unsigned char b,unsigned char a)
+{
+	auto rgba=bmp.GetEditableBitmapPointer();
+	auto numPix=bmp.GetWidth()*bmp.GetHeight();
+	for(int i=0; i<numPix; ++i)
+	{
+		rgba[i*4  ]=r;
+		rgba[i*4+1]=g;
+		rgba[i*4+2]=b;
+		rgba[i*4+3]=a;
+	}
+}
+static void InvertReference(SimpleBitmap &bmp)
+{
+	for(int y=0; y<bmp.GetHeight()/2; ++y)
+	{
+		auto L0=bmp.GetEditablePixelPointer(0,y);
+		auto L1=bmp.GetEditablePixelPointer(0,bmp.GetHeight()-1-y);
+		for(int x=0; x<bmp.GetNumComponentPerLine(); ++x)
+		{
+			auto a=L0[x];
+			L0[x]=L1[x];
+			L1[x]=a;
+		}
+	}
+}
+
+/* Copies a to b, and gives b its own buffer.  CopyFrom shares a's buffer, and operator== then returns true
+   without comparing a pixel. */
+static void CopyUnshared(SimpleBitmap &b,const SimpleBitmap &a)
+{
+	b.CopyFrom(a);
+	b.GetEditableBitmapPointer();
+}
+
+static void PrintResult(const char label[],double bytes,double t)
+{
+	printf("%-10s %12.2f\n",label,bytes/t/1e9);
+}
+
+/* PNG images for "simplebitmapbench pngcheck".  The scanlines are packed, filtered, interlaced, and cut into
+   chunks here, because YsMemoryPngEncoder writes only non-interlaced images without PLTE and tRNS. */
+class PngCheckCompressor : public YsPngCompressor
+{
+public:
+	PngCheckCompressor()
+	{
+		verboseMode=YSFALSE;
+	}
+};
+
+class PngCheckImage
+{
+public:
+	std::string label;
+	int wid,hei,bitDepth,colorType;
+	bool interlace;
+	std::vector <unsigned int> sample;     // Samples of the pixels, GetNumChannel() per pixel.
+	std::vector <unsigned char> plt,trns;  // Chunk data.  Not written if empty.
+	std::vector <unsigned char> expected;  // RGBA that the decoder should give.
+	std::vector <unsigned char> png;
+
+	int GetNumChannel(void) const
+	{
+		switch(colorType)
+		{
+		case 2:
+			return 3;
+		case 4:
+			return 2;
+		case 6:
+			return 4;
+		}
+		return 1;
+	}
+	void Make(const char label[],int wid,int hei,int bitDepth,int colorType,bool interlace,bool useTrns,unsigned int seed);
+	void Encode(bool compress);
+private:
+	void AddUInt32(unsigned int x);
+	void AddChunk(const char tag[],const std::vector <unsigned char> &dat);
+	void AddPass(std::vector <unsigned char> &raw,int x0,int y0,int dx,int dy) const;
+};
+
+void PngCheckImage::Make(const char label[],int wid,int hei,int bitDepth,int colorType,bool interlace,bool useTrns,unsigned int seed)
+{
+	this->label=label;
+	this->wid=wid;
+	this->hei=hei;
+	this->bitDepth=bitDepth;
+	this->colorType=colorType;
+	this->interlace=interlace;
+
+	// Runs of the same pixel so that the compressor finds something to copy.
+	std::mt19937 rnd(seed);
+	const unsigned int maxValue=(1u<<bitDepth)-1;
+	const int nChannel=GetNumChannel();
+	sample.resize(wid*hei*nChannel);
+	for(int i=0; i<wid*hei; ++i)
+	{
+		for(int c=0; c<nChannel; ++c)
+		{
+			sample[i*nChannel+c]=(0<i && 0==rnd()%2 ? sample[(i-1)*nChannel+c] : rnd()&maxValue);
+		}
+	}
+
+	plt.clear();
+	if(3==colorType)
+	{
+		for(unsigned int i=0; i<3*(maxValue+1); ++i)
+		{
+			plt.push_back((unsigned char)rnd());
+		}
+	}
+
+	// tRNS of the first pixel for gray and truecolor, so that some pixels are transparent.
+	// Of an indexed-color image, only the first entry is transparent.
+	trns.clear();
+	if(true==useTrns)
+	{
+		if(3==colorType)
+		{
+			trns.push_back(0);
+		}
+		else
+		{
+			for(int c=0; c<nChannel; ++c)
+			{
+				trns.push_back((unsigned char)(sample[c]>>8));
+				trns.push_back((unsigned char)sample[c]);
+			}
+		}
+	}
+
+	expected.resize(wid*hei*4);
+	for(int i=0; i<wid*hei; ++i)
+	{
+		const unsigned int *s=sample.data()+i*nChannel;
+		unsigned char *rgba=expected.data()+i*4;
+		bool transparent=(true==useTrns);
+		for(int c=0; c<nChannel; ++c)
+		{
+			transparent=(true==transparent && s[c]==(3==colorType ? 0 : sample[c]));
+		}
+		switch(colorType)
+		{
+		case 0:
+		case 4:
+			rgba[0]=(unsigned char)(s[0]*255/maxValue);
+			rgba[1]=rgba[0];
+			rgba[2]=rgba[0];
+			rgba[3]=(4==colorType ? (unsigned char)s[1] : 255);
+			break;
+		case 2:
+		case 6:
+			for(int c=0; c<nChannel; ++c)
+			{
+				rgba[c]=(unsigned char)(16==bitDepth ? s[c]>>8 : s[c]);
+			}
+			rgba[3]=(6==colorType ? rgba[3] : 255);
+			break;
+		case 3:
+			rgba[0]=plt[s[0]*3];
+			rgba[1]=plt[s[0]*3+1];
+			rgba[2]=plt[s[0]*3+2];
+			rgba[3]=255;
+			break;
+		}
+		if(true==transparent)
+		{
+			rgba[3]=0;
+		}
+	}
+}
+
+void PngCheckImage::AddPass(std::vector <unsigned char> &raw,int x0,int y0,int dx,int dy) const
+{
+	const int passWid=(x0<wid ? (wid-x0+dx-1)/dx : 0);
+	const int passHei=(y0<hei ? (hei-y0+dy-1)/dy : 0);
+	if(0==passWid || 0==passHei)
+	{
+		return;
+	}
+
+	const int nChannel=GetNumChannel();
+	const int bitPerPixel=nChannel*bitDepth;
+	const int bytePerPixel=(8<=bitPerPixel ? bitPerPixel/8 : 1);
+	const int lineLng=(passWid*bitPerPixel+7)/8;
+	std::vector <unsigned char> line,prv(lineLng,0);
+	for(int py=0; py<passHei; ++py)
+	{
+		line.assign(lineLng,0);
+		int bitPos=0;
+		for(int px=0; px<passWid; ++px)
+		{
+			const unsigned int *s=sample.data()+((y0+py*dy)*wid+x0+px*dx)*nChannel;
+			for(int c=0; c<nChannel; ++c)
+			{
+				if(16==bitDepth)
+				{
+					line[bitPos/8  ]=(unsigned char)(s[c]>>8);
+					line[bitPos/8+1]=(unsigned char)s[c];
+				}
+				else
+				{
+					// The first sample is in the most-significant bits.
+					line[bitPos/8]|=(unsigned char)(s[c]<<(8-bitDepth-bitPos%8));
+				}
+				bitPos+=bitDepth;
+			}
+		}
+
+		// All five filters, in turn.
+		const int filter=(py+x0+y0)%5;
+		raw.push_back((unsigned char)filter);
+		for(int i=0; i<lineLng; ++i)
+		{
+			const int a=(bytePerPixel<=i ? line[i-bytePerPixel] : 0);
+			const int b=prv[i];
+			const int c=(bytePerPixel<=i ? prv[i-bytePerPixel] : 0);
+			int predict=0;
+			switch(filter)
+			{
+			case 1:
+				predict=a;
+				break;
+			case 2:
+				predict=b;
+				break;
+			case 3:
+				predict=(a+b)/2;
+				break;
+			case 4:
+				{
+					const int p=a+b-c,pa=abs(p-a),pb=abs(p-b),pc=abs(p-c);
+					predict=(pa<=pb && pa<=pc ? a : (pb<=pc ? b : c));
+				}
+				break;
+			}
+			raw.push_back((unsigned char)(line[i]-predict));
+		}
+		prv.swap(line);
+	}
+}
+
+void PngCheckImage::AddUInt32(unsigned int x)
+{
+	png.push_back((unsigned char)(x>>24));
+	png.push_back((unsigned char)(x>>16));
+	png.push_back((unsigned char)(x>>8));
+	png.push_back((unsigned char)x);
+}
+
+void PngCheckImage::AddChunk(const char tag[],const std::vector <unsigned char> &dat)
+{
+	AddUInt32((unsigned int)dat.size());
+	const size_t tagPos=png.size();
+	png.insert(png.end(),tag,tag+4);
+	png.insert(png.end(),dat.begin(),dat.end());
+
+	unsigned int crc=0xffffffff;
+	for(size_t i=tagPos; i<png.size(); ++i)
+	{
+		crc^=png[i];
+		for(int b=0; b<8; ++b)
+		{
+			crc=((crc&1) ? 0xedb88320^(crc>>1) : crc>>1);
+		}
+	}
+	AddUInt32(~crc);
+}
+
+void PngCheckImage::Encode(bool compress)
+{
+	std::vector <unsigned char> raw;
+	if(true==interlace)
+	{
+		const int x0[7]={0,4,0,2,0,1,0},y0[7]={0,0,4,0,2,0,1};
+		const int dx[7]={8,8,4,4,2,2,1},dy[7]={8,8,8,4,4,2,2};
+		for(int pass=0; pass<7; ++pass)
+		{
+			AddPass(raw,x0[pass],y0[pass],dx[pass],dy[pass]);
+		}
+	}
+	else
+	{
+		AddPass(raw,0,0,1,1);
+	}
+
+	// Small blocks, so that the decoder goes across the block boundaries.
+	PngCheckCompressor compressor;
+	compressor.BeginCompression((unsigned int)raw.size());
+	const size_t blockSize=(true==compress ? (raw.size()+1)/2 : 29);
+	for(size_t i=0; i<raw.size(); i+=blockSize)
+	{
+		const unsigned int n=(unsigned int)std::min(blockSize,raw.size()-i);
+		const int bFinal=(raw.size()<=i+n ? 1 : 0);
+		if(true==compress)
+		{
+			compressor.AddCompressionBlock(n,raw.data()+i,bFinal);
+		}
+		else
+		{
+			compressor.AddNonCompressionBlock(n,raw.data()+i,bFinal);
+		}
+	}
+	compressor.EndCompression();
+
+	// 8-byte signature, 12 bytes per chunk, 13 bytes of IHDR, and the chunk data.
+	const unsigned char signature[8]={0x89,0x50,0x4e,0x47,0x0d,0x0a,0x1a,0x0a};
+	const size_t nIDAT=(compressor.GetCompressedLength()+36)/37;
+	png.clear();
+	png.reserve(8+12*(4+nIDAT)+13+plt.size()+trns.size()+compressor.GetCompressedLength());
+	png.resize(8);
+	memcpy(png.data(),signature,8);
+
+	std::vector <unsigned char> ihdr(13,0);
+	for(int i=0; i<4; ++i)
+	{
+		ihdr[i]=(unsigned char)(wid>>(24-i*8));
+		ihdr[4+i]=(unsigned char)(hei>>(24-i*8));
+	}
+	ihdr[8]=(unsigned char)bitDepth;
+	ihdr[9]=(unsigned char)colorType;
+	ihdr[12]=(true==interlace ? 1 : 0);
+	AddChunk("IHDR",ihdr);
+	if(0<plt.size())
+	{
+		AddChunk("PLTE",plt);
+	}
+	if(0<trns.size())
+	{
+		AddChunk("tRNS",trns);
+	}
+
+	// IDAT in several chunks.
+	const unsigned char *zlib=compressor.GetCompressedData();
+	const unsigned int zlibLength=compressor.GetCompressedLength();
+	for(unsigned int i=0; i<zlibLength; i+=37)
+	{
+		AddChunk("IDAT",std::vector <unsigned char> (zlib+i,zlib+std::min(i+37,zlibLength)));
+	}
+	AddChunk("IEND",std::vector <unsigned char> ());
+}
+
+static bool CheckPngRows(const PngCheckImage &img,const char what[],const unsigned char rgba[],int pitch,int y0,int y1,bool bottomUp)
+{
+	for(int y=y0; y<y1; ++y)
+	{
+		const int row=(true==bottomUp ? y1-1-y : y-y0);
+		if(0!=memcmp(rgba+row*pitch,img.expected.data()+y*img.wid*4,img.wid*4))
+		{
+			fprintf(stderr,"Error! %s: %s is wrong at row %d.\n",img.label.c_str(),what,y);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Decodes in one go, pushes in pieces, and decodes row ranges, top-down and bottom-up. */
+static bool CheckPng(const PngCheckImage &img)
+{
+	{
+		YsRawPngDecoder decoder;
+		YsPngBinaryMemoryStream stream(img.png.size(),img.png.data());
+		if(YSOK!=decoder.Decode(stream) || img.wid!=decoder.wid || img.hei!=decoder.hei ||
+		   true!=CheckPngRows(img,"Decode",decoder.rgba,img.wid*4,0,img.hei,false))
+		{
+			fprintf(stderr,"Error! %s: Decode failed.\n",img.label.c_str());
+			return false;
+		}
+	}
+
+	// Pieces of 1 byte, and of random sizes.
+	std::mt19937 rnd(img.png.size());
+	for(int random=0; random<2; ++random)
+	{
+		YsRawPngDecoder decoder;
+		decoder.BeginPush();
+		bool ok=true;
+		for(size_t i=0; i<img.png.size(); )
+		{
+			const size_t n=std::min<size_t>((0!=random ? 1+rnd()%97 : 1),img.png.size()-i);
+			ok=(true==ok && YSOK==decoder.Push(img.png.data()+i,n));
+			i+=n;
+		}
+		ok=(true==ok && YSOK==decoder.EndPush());
+		if(true!=ok || img.hei!=decoder.hei ||
+		   true!=CheckPngRows(img,"Push",decoder.rgba,img.wid*4,0,img.hei,false))
+		{
+			fprintf(stderr,"Error! %s: Push in %s pieces failed.\n",img.label.c_str(),(0!=random ? "random" : "1-byte"));
+			return false;
+		}
+	}
+
+	const int range[4][2]=
+	{
+		{0,-1},{1,img.hei-1},{img.hei/2,img.hei/2+1},{img.hei-1,img.hei+5}
+	};
+	for(auto r : range)
+	{
+		const int y0=r[0],y1=(r[1]<0 || img.hei<r[1] ? img.hei : r[1]);
+		if(y1<=y0)
+		{
+			continue;
+		}
+		for(int userBuf=0; userBuf<2; ++userBuf)
+		{
+			for(int bottomUp=0; bottomUp<2; ++bottomUp)
+			{
+				// Padded rows.  The padding must stay untouched.
+				const int pitch=(img.wid+3)*4;
+				std::vector <unsigned char> buf(pitch*(y1-y0),0xcd);
+
+				YsRawPngDecoder decoder;
+				decoder.SetRowRange(r[0],r[1]);
+				decoder.SetBottomUp(0!=bottomUp);
+				if(0!=userBuf)
+				{
+					decoder.SetOutputBuffer(buf.data(),img.wid,y1-y0,pitch);
+				}
+				YsPngBinaryMemoryStream stream(img.png.size(),img.png.data());
+				bool ok=(YSOK==decoder.Decode(stream) && y1-y0==decoder.hei);
+				if(true==ok && 0!=userBuf)
+				{
+					ok=(nullptr==decoder.rgba && true==CheckPngRows(img,"Row range",buf.data(),pitch,y0,y1,0!=bottomUp));
+					for(size_t i=0; i<buf.size(); ++i)
+					{
+						ok=(true==ok && (img.wid*4<=(int)(i%pitch) ? 0xcd==buf[i] : true));
+					}
+				}
+				else if(true==ok)
+				{
+					ok=CheckPngRows(img,"Row range",decoder.rgba,img.wid*4,y0,y1,0!=bottomUp);
+				}
+				if(true!=ok)
+				{
+					fprintf(stderr,"Error! %s: Rows %d to %d%s%s failed.\n",img.label.c_str(),r[0],r[1],
+					    (0!=bottomUp ? " bottom-up" : ""),(0!=userBuf ? " to the output buffer" : ""));
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static int RunPngCheck(void)
+{
+	struct PngCheckCase
+	{
+		const char *label;
+		int wid,hei,bitDepth,colorType;
+		bool interlace,useTrns;
+	};
+	const PngCheckCase cases[]=
+	{
+		{"Gray 1-bit interlaced",          13,11, 1,0,true, false},
+		{"Gray 1-bit tRNS",                 9, 7, 1,0,false,true},
+		{"Gray 1-bit tRNS interlaced",     10, 9, 1,0,true, true},
+		{"Gray 8-bit tRNS interlaced",     12,10, 8,0,true, true},
+		{"Palette 1-bit interlaced",        3, 2, 1,3,true, false},
+		{"Palette 2-bit interlaced",       11, 9, 2,3,true, false},
+		{"Palette 4-bit tRNS",              5, 5, 4,3,false,true},
+		{"Palette 4-bit tRNS interlaced",  17,13, 4,3,true, true},
+		{"Palette 8-bit tRNS",             23, 6, 8,3,false,true},
+		{"Palette 8-bit tRNS interlaced",   1, 1, 8,3,true, true},
+		{"Gray alpha 8-bit interlaced",     9, 9, 8,4,true, false},
+		{"RGB 8-bit",                      37, 9, 8,2,false,false},
+		{"RGB 8-bit interlaced",           45,23, 8,2,true, false},
+		{"RGB 8-bit tRNS",                 14, 5, 8,2,false,true},
+		{"RGB 16-bit tRNS interlaced",      7,12,16,2,true, true},
+		{"RGBA 8-bit interlaced",          16,16, 8,6,true, false},
+	};
+
+	int nFail=0;
+	unsigned int seed=1;
+	for(auto &c : cases)
+	{
+		for(int compress=0; compress<2; ++compress)
+		{
+			PngCheckImage img;
+			img.Make(c.label,c.wid,c.hei,c.bitDepth,c.colorType,c.interlace,c.useTrns,seed++);
+			img.label+=(0!=compress ? " compressed" : " stored");
+			img.Encode(0!=compress);
+			const bool ok=CheckPng(img);
+			printf("%-45s %s\n",img.label.c_str(),(true==ok ? "OK" : "FAILED"));
+			nFail+=(true==ok ? 0 : 1);
+		}
+	}
+
+	// What YsMemoryPngEncoder writes.
+	{
+		PngCheckImage img;
+		img.Make("YsMemoryPngEncoder RGBA 8-bit",31,17,8,6,false,false,seed++);
+		std::vector <unsigned char> rgba(img.sample.begin(),img.sample.end());
+		YsMemoryPngEncoder encoder;
+		encoder.verboseMode=YSFALSE;
+		encoder.Encode(img.wid,img.hei,8,6,rgba.data());
+		img.png.assign(encoder.GetByteData(),encoder.GetByteData()+encoder.GetLength());
+		const bool ok=CheckPng(img);
+		printf("%-45s %s\n",img.label.c_str(),(true==ok ? "OK" : "FAILED"));
+		nFail+=(true==ok ? 0 : 1);
+	}
+
+	return (0==nFail ? 0 : 1);
+}
+
+int main(int ac,char *av[])
+{
+	if(2<=ac && 0==strcmp(av[1],"pngcheck"))
+	{
+		return RunPngCheck();
+	}
+
+	int wid=(2<=ac ? atoi(av[1]) : 3840);
+	int hei=(3<=ac ? atoi(av[2]) : 2160);
+	int nRepeat=(4<=ac ? atoi(av[3]) : 20);
+
+	SimpleBitmap a,b;
+	a.Create(wid,hei);
+	b.Create(wid,hei);
+	for(int y=0; y<hei; ++y)
+	{
+		for(int x=0; x<wid; ++x)
+		{
+			auto pix=a.GetEditablePixelPointer(x,y);
+			pix[0]=(unsigned char)x;
+			pix[1]=(unsigned char)y;
+			pix[2]=(unsigned char)(x+y);
+			pix[3]=255;
+		}
+	}
+	CopyUnshared(b,a);
+	if(a.GetBitmapPointer()==b.GetBitmapPointer())
+	{
+		fprintf(stderr,"Error! The bitmaps to compare share one buffer.\n");
+		return 1;
+	}
+	const double bytes=(double)wid*hei*4*nRepeat;
+
+	printf("Bitmap %dx%d, %d times.  GB/s of bitmap processed.\n",wid,hei,nRepeat);
+
+	const int best=SimpleBitmapSIMD::GetBestInstructionSet();
+	for(const char *op : {"Compare","Clear","Invert"})
+	{
+		printf("%s\n",op);
+
+		bool ok=true;
+		auto t0=std::chrono::high_resolution_clock::now();
+		for(int i=0; i<nRepeat; ++i)
+		{
+			if(0==strcmp(op,"Compare"))
+			{
+				ok=(ok && CompareReference(a,b));
+			}
+			else if(0==strcmp(op,"Clear"))
+			{
+				ClearReference(b,1,2,3,4);
+			}
+			else
+			{
+				InvertReference(a);
+			}
+		}
+		PrintResult("Reference",bytes,Elapsed(t0));
+		CopyUnshared(b,a);
+
+		for(int instructionSet=SimpleBitmapSIMD::INSTRUCTION_SCALAR; instructionSet<=best; ++instructionSet)
+		{
+			SimpleBitmapSIMD::SetInstructionSet(instructionSet);
+			t0=std::chrono::high_resolution_clock::now();
+			for(int i=0; i<nRepeat; ++i)
+			{
+				if(0==strcmp(op,"Compare"))
+				{
+					ok=(ok && a==b);
+				}
+				else if(0==strcmp(op,"Clear"))
+				{
+					b.Clear(1,2,3,4);
+				}
+				else
+				{
+					a.Invert();
+				}
+			}
+			PrintResult(SimpleBitmapSIMD::GetInstructionSetName(instructionSet),bytes,Elapsed(t0));
+			CopyUnshared(b,a);
+
+			if(0==strcmp(op,"Compare") && 0<wid && 0<hei)
+			{
+				// The last byte differs.  Both must see it.
+				b.GetEditableBitmapPointer()[wid*hei*4-1]^=1;
+				if(true==(a==b) || true==CompareReference(a,b))
+				{
+					fprintf(stderr,"Error! Different bitmaps compared as equal.\n");
+					return 1;
+				}
+				CopyUnshared(b,a);
+			}
+		}
+		SimpleBitmapSIMD::SetInstructionSet(best);
+
+		if(true!=ok)
+		{
+			fprintf(stderr,"Error! Equal bitmaps compared as different.\n");
+			return 1;
+		}
+	}
+
+	printf("Resize to half and to x1.5.  ms per call with 1 thread and with all hardware threads.\n");
+	const char *const filterName[]={"Nearest","Bilinear","Box","Lanczos3"};
+	for(int filter=SimpleBitmapFilter::FILTER_NEAREST; filter<=SimpleBitmapFilter::FILTER_LANCZOS3; ++filter)
+	{
+		for(int scale : {2,-3})
+		{
+			const int dstWid=(0<scale ? wid/scale : wid*3/2),dstHei=(0<scale ? hei/scale : hei*3/2);
+			SimpleBitmap single,multi;
+			const int nResizeRepeat=(nRepeat+3)/4;
+
+			auto t0=std::chrono::high_resolution_clock::now();
+			for(int i=0; i<nResizeRepeat; ++i)
+			{
+				a.Resize(single,dstWid,dstHei,filter,1);
+			}
+			const double tSingle=Elapsed(t0)*1000.0/nResizeRepeat;
+
+			t0=std::chrono::high_resolution_clock::now();
+			for(int i=0; i<nResizeRepeat; ++i)
+			{
+				a.Resize(multi,dstWid,dstHei,filter);
+			}
+			const double tMulti=Elapsed(t0)*1000.0/nResizeRepeat;
+
+			printf("%-10s %5dx%-5d %10.2f %10.2f\n",filterName[filter],dstWid,dstHei,tSingle,tMulti);
+			if(single!=multi)
+			{
+				fprintf(stderr,"Error! Multi-threaded resize gave a different bitmap.\n");
+				return 1;
+			}
+		}
+	}
+
+	printf("Gaussian blur, sharpen, and Sobel.  ms per call.\n");
+	{
+		SimpleBitmapFilterPipeline <unsigned char,4> blur,sharpen,sobel,all;
+		blur.AddGaussianBlur(1.0f);
+		sharpen.AddSharpen(0.5f);
+		sobel.AddSobel();
+		all.AddGaussianBlur(1.0f);
+		all.AddSharpen(0.5f);
+		all.AddSobel();
+
+		const int nFilterRepeat=(nRepeat+3)/4;
+		SimpleBitmap tmp0,tmp1,out;
+		auto t0=std::chrono::high_resolution_clock::now();
+		for(int i=0; i<nFilterRepeat; ++i)
+		{
+			blur.Apply(tmp0,a.GetView());
+			sharpen.Apply(tmp1,tmp0.GetView());
+			sobel.Apply(out,tmp1.GetView());
+		}
+		printf("%-20s %10.2f\n","Stage by stage",Elapsed(t0)*1000.0/nFilterRepeat);
+
+		t0=std::chrono::high_resolution_clock::now();
+		for(int i=0; i<nFilterRepeat; ++i)
+		{
+			all.Apply(out,a.GetView());
+		}
+		printf("%-20s %10.2f\n","One tiled pass",Elapsed(t0)*1000.0/nFilterRepeat);
+	}
+
+	printf("Pixel-format conversion.  GB/s of RGBA8 processed.\n");
+	{
+		SimpleBitmapConvert::RGB8 rgb;
+		SimpleBitmapConvert::Gray8 gray;
+		SimpleBitmapConvert::RGBAF rgbaf;
+		SimpleBitmap rgba;
+		for(const char *op : {"ToRGB8","ToGray8","ToRGBAF","FromRGBAF","Premul"})
+		{
+			auto t0=std::chrono::high_resolution_clock::now();
+			for(int i=0; i<nRepeat; ++i)
+			{
+				if(0==strcmp(op,"ToRGB8"))
+				{
+					SimpleBitmapConvert::Convert(rgb,a.GetView());
+				}
+				else if(0==strcmp(op,"ToGray8"))
+				{
+					SimpleBitmapConvert::Convert(gray,a.GetView());
+				}
+				else if(0==strcmp(op,"ToRGBAF"))
+				{
+					SimpleBitmapConvert::Convert(rgbaf,a.GetView());
+				}
+				else if(0==strcmp(op,"FromRGBAF"))
+				{
+					SimpleBitmapConvert::Convert(rgba,rgbaf.GetView());
+				}
+				else
+				{
+					SimpleBitmapConvert::Premultiply(rgba,a.GetView());
+				}
+			}
+			PrintResult(op,bytes,Elapsed(t0));
+		}
+	}
+
+	printf("Transpose, rotate, and flip.  GB/s with 1 thread and with all hardware threads.\n");
+	{
+		SimpleBitmap work;
+		for(const char *op : {"Transpose","Rotate90","Rotate180","Rotate270","FlipH"})
+		{
+			double t[2];
+			for(int nThread=1; 0<=nThread; --nThread)
+			{
+				CopyUnshared(work,a);  // So that the first call is not a copy.
+				auto t0=std::chrono::high_resolution_clock::now();
+				for(int i=0; i<nRepeat; ++i)
+				{
+					if(0==strcmp(op,"Transpose"))
+					{
+						work.Transpose(nThread);
+					}
+					else if(0==strcmp(op,"Rotate90"))
+					{
+						work.Rotate90(nThread);
+					}
+					else if(0==strcmp(op,"Rotate180"))
+					{
+						work.Rotate180(nThread);
+					}
+					else if(0==strcmp(op,"Rotate270"))
+					{
+						work.Rotate270(nThread);
+					}
+					else
+					{
+						work.FlipHorizontal(nThread);
+					}
+				}
+				t[1-nThread]=Elapsed(t0);
+			}
+			printf("%-10s %12.2f %12.2f\n",op,bytes/t[0]/1e9,bytes/t[1]/1e9);
+		}
+	}
+
+	printf("Cut out tiles.  ns per tile with new [] and with the pool.\n");
+	for(int tileSize : {40,256})
+	{
+		double t[2];
+		for(int usePool=0; usePool<2; ++usePool)
+		{
+			if(0!=usePool)
+			{
+				SimpleBitmapPool::Install();
+				SimpleBitmapPool::ResetStatistics();
+			}
+			long long int nTile=0;
+			auto t0=std::chrono::high_resolution_clock::now();
+			for(int i=0; i<nRepeat; ++i)
+			{
+				for(int y=0; y+tileSize<=hei; y+=tileSize)
+				{
+					for(int x=0; x+tileSize<=wid; x+=tileSize)
+					{
+						SimpleBitmap tile=a.CutOut(x,y,tileSize,tileSize);
+						++nTile;
+					}
+				}
+			}
+			t[usePool]=Elapsed(t0)*1e9/(double)nTile;
+		}
+		printf("%3dx%-6d %12.2f %12.2f  Hit rate %.3f\n",tileSize,tileSize,t[0],t[1],SimpleBitmapPool::GetStatistics().GetHitRate());
+		SimpleBitmapPool::Uninstall();
+		SimpleBitmapPool::Trim();
+	}
+
+	printf("Load from file.  ms per load.\n");
+	{
+		const char pngFn[]="simplebitmapbench_tmp.png",rawFn[]="simplebitmapbench_tmp.raw";
+		FILE *fp=fopen(pngFn,"wb");
+		bool saved=(nullptr!=fp && true==a.SavePng(fp));
+		if(nullptr!=fp)
+		{
+			fclose(fp);
+		}
+		fp=fopen(rawFn,"wb");
+		saved=(true==saved && nullptr!=fp && true==a.SaveRaw(fp));
+		if(nullptr!=fp)
+		{
+			fclose(fp);
+		}
+		if(true!=saved)
+		{
+			fprintf(stderr,"Error! Cannot write the temporary files.\n");
+		}
+		else
+		{
+			const int nLoadRepeat=4;
+			SimpleBitmap loaded;
+			for(const char *op : {"PNG","Raw","Raw nocheck"})
+			{
+				auto t0=std::chrono::high_resolution_clock::now();
+				for(int i=0; i<nLoadRepeat; ++i)
+				{
+					if(0==strcmp(op,"PNG"))
+					{
+						loaded.LoadPng(pngFn);
+					}
+					else
+					{
+						SimpleBitmapRawFile::Load(loaded,rawFn,0==strcmp(op,"Raw"));
+					}
+				}
+				printf("%-20s %10.2f\n",op,Elapsed(t0)*1000.0/nLoadRepeat);
+				if(loaded!=a)
+				{
+					fprintf(stderr,"Error! Loaded bitmap is different.\n");
+				}
+			}
+
+			// Same file over and over, in one thread, and in all the hardware threads.  The bitmaps are checked
+			// and dropped as they come, so that the time is not about getting fresh pages for all of them.
+			const std::vector <std::string> batchFn(16,pngFn);
+			for(int nThread : {1,0})
+			{
+				auto t0=std::chrono::high_resolution_clock::now();
+				BatchCheck check;
+				check.expected=&a;
+				check.nMatch=0;
+				const int nLoaded=SimpleBitmap::LoadPngBatch(batchFn,BatchCheck::Callback,&check,nThread);
+				printf("%-20s %10.2f\n",(1==nThread ? "PNG batch 1 thread" : "PNG batch"),Elapsed(t0)*1000.0/batchFn.size());
+				if(nLoaded!=(int)batchFn.size() || check.nMatch!=nLoaded)
+				{
+					fprintf(stderr,"Error! Batch load failed.\n");
+				}
+			}
+		}
+		remove(pngFn);
+		remove(rawFn);
+	}
+
+	printf("Decode a small PNG from memory.  us per image.\n");
+	{
+		const int tileSize=40,nDecode=20000;
+		SimpleBitmap tile=a.CutOut(0,0,tileSize,tileSize);
+		YsMemoryPngEncoder encoder;
+		encoder.verboseMode=YSFALSE;
+		encoder.Encode(tileSize,tileSize,8,6,tile.GetBitmapPointer(),tile.GetPitchInBytes());
+
+		// A new decoder allocates the window and the line buffers for every image.  A reused one keeps them.
+		YsRawPngDecoder reused;
+		for(int reuse=0; reuse<2; ++reuse)
+		{
+			bool ok=true;
+			auto t0=std::chrono::high_resolution_clock::now();
+			for(int i=0; i<nDecode; ++i)
+			{
+				YsPngBinaryMemoryStream stream((size_t)encoder.GetLength(),encoder.GetByteData());
+				if(0!=reuse)
+				{
+					reused.Reset();
+					ok=(true==ok && YSOK==reused.Decode(stream));
+				}
+				else
+				{
+					YsRawPngDecoder decoder;
+					ok=(true==ok && YSOK==decoder.Decode(stream));
+				}
+			}
+			printf("%-20s %10.2f\n",(0!=reuse ? "Reused decoder" : "New decoder"),Elapsed(t0)*1e6/nDecode);
+			if(true!=ok || (0!=reuse && SimpleBitmapView(reused.rgba,tileSize,tileSize,tileSize*4)!=tile))
+			{
+				fprintf(stderr,"Error! Small PNG was not decoded correctly.\n");
+			}
+		}
+	}
+	return 0;
+}
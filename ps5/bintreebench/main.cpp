@@ -0,0 +1,1079 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <map>
+#include <algorithm>
+
+#include "bintree.h"
+#include "bintreeinterval.h"
+
+static double Elapsed(std::chrono::high_resolution_clock::time_point t0)
+{
+	auto t1=std::chrono::high_resolution_clock::now();
+	return std::chrono::duration <double> (t1-t0).count();
+}
+
+static void MakeRandomKeyValue(std::vector <std::pair <int,int> > &keyValue,long long int n)
+{
+	std::mt19937 rnd(24783);
+	keyValue.resize(n);
+	for(long long int i=0; i<n; ++i)
+	{
+		keyValue[i].first=(int)rnd();
+		keyValue[i].second=(int)i;
+	}
+}
+
+/* Parallel BuildFromUnsorted and ParallelForEach throughput from 1 thread to maxThread threads. */
+static int RunParallel(long long int n,int maxThread)
+{
+	printf("Parallel bulk operations  n=%lld\n",n);
+	printf("%8s %16s %16s\n","Threads","Build(Mkey/s)","ForEach(Mkey/s)");
+
+	std::vector <std::pair <int,int> > source,keyValue;
+	MakeRandomKeyValue(source,n);
+	for(int nThread=1; nThread<=maxThread; ++nThread)
+	{
+		BinaryTree <int,int> tree;
+
+		keyValue=source;
+		auto t0=std::chrono::high_resolution_clock::now();
+		tree.BuildFromUnsorted(keyValue,nThread);
+		double buildTime=Elapsed(t0);
+
+		t0=std::chrono::high_resolution_clock::now();
+		tree.ParallelForEach([](const int &,int &value){value+=1;},nThread);
+		double forEachTime=Elapsed(t0);
+
+		if(tree.GetN()!=n)
+		{
+			fprintf(stderr,"Error! Number of nodes does not match.\n");
+			return 1;
+		}
+		printf("%8d %16.2f %16.2f\n",nThread,(double)n/buildTime/1e6,(double)n/forEachTime/1e6);
+	}
+	return 0;
+}
+
+/* Rotation count and time of a mixed workload.  writePercent of the operations are insertions or deletions
+   (half and half), and the rest are look-ups. */
+template <class TreeClass>
+static void RunMixedWorkload(const char label[],long long int n,int writePercent)
+{
+	TreeClass tree;
+	tree.autoRebalancing=true;
+
+	std::mt19937 rnd(24783);
+	for(long long int i=0; i<n; ++i)
+	{
+		tree.Insert((int)(rnd()%(n*2)),0);
+	}
+	tree.ResetRotationCount();
+
+	long long int nFound=0;
+	auto t0=std::chrono::high_resolution_clock::now();
+	for(long long int i=0; i<n; ++i)
+	{
+		int key=(int)(rnd()%(n*2));
+		int op=(int)(rnd()%200);
+		if(op<writePercent)
+		{
+			tree.Insert(key,0);
+		}
+		else if(op<writePercent*2)
+		{
+			auto ndHd=tree.FindNode(key);
+			if(ndHd.IsNotNull())
+			{
+				tree.Delete(ndHd);
+			}
+		}
+		else if(tree.FindNode(key).IsNotNull())
+		{
+			++nFound;
+		}
+	}
+	double t=Elapsed(t0);
+
+	printf("%-10s %6d%% %14lld %10d %12.2f\n",label,writePercent,tree.GetRotationCount(),tree.GetHeight(tree.RootNode()),(double)n/t/1e6);
+}
+
+static int RunBalance(long long int n)
+{
+	printf("Balancing policies  n=%lld\n",n);
+	printf("%-10s %7s %14s %10s %12s\n","Policy","Write","Rotations","Height","Mop/s");
+	for(int writePercent : {5,50,95})
+	{
+		RunMixedWorkload <BinaryTree <int,int,BinaryTreeAVLPolicy> > ("AVL",n,writePercent);
+		RunMixedWorkload <BinaryTree <int,int,BinaryTreeRedBlackPolicy> > ("RedBlack",n,writePercent);
+	}
+	return 0;
+}
+
+/* Key-value pairs of the tree in the order of the keys. */
+template <class TreeClass>
+static void GetKeyValue(std::vector <std::pair <int,int> > &keyValue,const TreeClass &tree)
+{
+	keyValue.clear();
+	for(auto ndHd=tree.First(); ndHd.IsNotNull(); ndHd=tree.FindNext(ndHd))
+	{
+		keyValue.push_back(std::make_pair(tree.GetKey(ndHd),tree.GetValue(ndHd)));
+	}
+}
+
+/* Height and sub-tree size of every node in the order of the keys.  Two trees of the same pairs have the
+   same shape if and only if these are the same. */
+template <class TreeClass>
+static void GetShape(std::vector <std::pair <int,long long int> > &shape,const TreeClass &tree)
+{
+	shape.clear();
+	for(auto ndHd=tree.First(); ndHd.IsNotNull(); ndHd=tree.FindNext(ndHd))
+	{
+		shape.push_back(std::make_pair(tree.GetHeight(ndHd),tree.GetSubTreeSize(ndHd)));
+	}
+}
+
+static bool SaveTree(const char fileName[],const BinaryTree <int,int> &tree)
+{
+	FILE *fp=fopen(fileName,"wb");
+	bool saved=(nullptr!=fp && true==tree.Save(fp));
+	if(nullptr!=fp)
+	{
+		fclose(fp);
+	}
+	return saved;
+}
+
+static bool LoadTree(const char fileName[],BinaryTree <int,int> &tree)
+{
+	FILE *fp=fopen(fileName,"rb");
+	bool loaded=(nullptr!=fp && true==tree.Load(fp));
+	if(nullptr!=fp)
+	{
+		fclose(fp);
+	}
+	return loaded;
+}
+
+/* Checks that a tree loaded from a file has the pairs of the saved tree in the same order, the invariant,
+   and the perfectly-balanced shape, which BuildFromUnsorted also makes. */
+static bool IsSameAsSaved(const char label[],const BinaryTree <int,int> &loaded,
+    const std::vector <std::pair <int,int> > &savedKeyValue,const std::vector <std::pair <int,long long int> > &balancedShape)
+{
+	std::vector <std::pair <int,int> > keyValue;
+	std::vector <std::pair <int,long long int> > shape;
+	GetKeyValue(keyValue,loaded);
+	GetShape(shape,loaded);
+	if(true!=loaded.CheckInvariant())
+	{
+		fprintf(stderr,"Error! %s broke the invariant.\n",label);
+		return false;
+	}
+	if(keyValue!=savedKeyValue)
+	{
+		fprintf(stderr,"Error! %s gave different key-value pairs.\n",label);
+		return false;
+	}
+	if(shape!=balancedShape)
+	{
+		fprintf(stderr,"Error! %s did not make a perfectly-balanced tree.\n",label);
+		return false;
+	}
+	return true;
+}
+
+/* BuildFromUnsorted and ParallelForEach with various numbers of threads, from an empty tree to one large
+   enough to be built in separate threads.  Keys are drawn from a small range so that some are duplicates. */
+static int RunParallelCheck(long long int n)
+{
+	printf("Parallel bulk operations check  n=%lld\n",n);
+
+	std::mt19937 rnd(24783);
+	const int nThreadList[]={1,2,3,4,8,0};
+	for(long long int size : {0LL,1LL,2LL,7LL,100LL,1024LL,1025LL,3000LL,n})
+	{
+		std::vector <std::pair <int,int> > source((size_t)size);
+		for(long long int i=0; i<size; ++i)
+		{
+			source[i].first=(int)(rnd()%(size+1));
+			source[i].second=(int)i;
+		}
+		std::vector <std::pair <int,int> > sortedSource=source;
+		std::sort(sortedSource.begin(),sortedSource.end());
+
+		for(int nThread : nThreadList)
+		{
+			BinaryTree <int,int> tree;
+			std::vector <std::pair <int,int> > keyValue=source,treeKeyValue,permutation;
+			tree.BuildFromUnsorted(keyValue,nThread);
+
+			// The tree must be keyValue in order, and keyValue must be the input sorted by key.
+			GetKeyValue(treeKeyValue,tree);
+			permutation=keyValue;
+			std::sort(permutation.begin(),permutation.end());
+			bool ok=(true==tree.CheckInvariant() && tree.GetN()==size && treeKeyValue==keyValue && permutation==sortedSource);
+			for(size_t i=1; true==ok && i<keyValue.size(); ++i)
+			{
+				ok=(keyValue[i-1].first<=keyValue[i].first);
+			}
+			if(true!=ok)
+			{
+				fprintf(stderr,"Error! BuildFromUnsorted of %lld pairs in %d threads is wrong.\n",size,nThread);
+				return 1;
+			}
+
+			// Every node must be visited exactly once.
+			std::vector <std::atomic <int> > nVisit((size_t)size);
+			for(auto &v : nVisit)
+			{
+				v.store(0);
+			}
+			tree.ParallelForEach([&nVisit,size](const int &,int &value)
+			{
+				nVisit[value].fetch_add(1);
+				value+=(int)size;
+			},nThread);
+			for(long long int i=0; i<size; ++i)
+			{
+				ok=(true==ok && 1==nVisit[i].load());
+			}
+			GetKeyValue(treeKeyValue,tree);
+			for(size_t i=0; true==ok && i<treeKeyValue.size(); ++i)
+			{
+				ok=(treeKeyValue[i].first==keyValue[i].first && treeKeyValue[i].second==keyValue[i].second+(int)size);
+			}
+			if(true!=ok || true!=tree.CheckInvariant())
+			{
+				fprintf(stderr,"Error! ParallelForEach over %lld nodes in %d threads did not visit every node once.\n",size,nThread);
+				return 1;
+			}
+		}
+	}
+	printf("OK\n");
+	return 0;
+}
+
+/* Re-building a tree by Insert against Save followed by Load. */
+static int RunSaveLoad(long long int n)
+{
+	const char fileName[]="bintreebench_save.bin";
+	printf("Save and Load  n=%lld\n",n);
+
+	std::vector <std::pair <int,int> > keyValue;
+	MakeRandomKeyValue(keyValue,n);
+
+	BinaryTree <int,int> tree;
+	tree.autoRebalancing=true;
+	auto t0=std::chrono::high_resolution_clock::now();
+	for(auto &kv : keyValue)
+	{
+		tree.Insert(kv.first,kv.second);
+	}
+	printf("%-12s %10.3f sec\n","Insert",Elapsed(t0));
+
+	t0=std::chrono::high_resolution_clock::now();
+	if(true!=SaveTree(fileName,tree))
+	{
+		fprintf(stderr,"Error! Cannot save %s.\n",fileName);
+		return 1;
+	}
+	printf("%-12s %10.3f sec\n","Save",Elapsed(t0));
+
+	BinaryTree <int,int> loaded;
+	loaded.autoRebalancing=true;
+	t0=std::chrono::high_resolution_clock::now();
+	bool loadedOK=LoadTree(fileName,loaded);
+	printf("%-12s %10.3f sec\n","Load",Elapsed(t0));
+
+	BinaryTree <int,int> mapped;
+	mapped.autoRebalancing=true;
+	t0=std::chrono::high_resolution_clock::now();
+	bool mappedOK=mapped.LoadMapped(fileName);
+	printf("%-12s %10.3f sec\n","LoadMapped",Elapsed(t0));
+	remove(fileName);
+
+	if(true!=loadedOK || true!=mappedOK)
+	{
+		fprintf(stderr,"Error! Cannot load %s.\n",fileName);
+		return 1;
+	}
+
+	std::vector <std::pair <int,int> > savedKeyValue;
+	std::vector <std::pair <int,long long int> > balancedShape;
+	GetKeyValue(savedKeyValue,tree);
+	BinaryTree <int,int> balanced;
+	keyValue=savedKeyValue;
+	balanced.BuildFromUnsorted(keyValue);
+	GetShape(balancedShape,balanced);
+	if(true!=IsSameAsSaved("Load",loaded,savedKeyValue,balancedShape) ||
+	   true!=IsSameAsSaved("LoadMapped",mapped,savedKeyValue,balancedShape))
+	{
+		return 1;
+	}
+	return 0;
+}
+
+/* Truncated and corrupted files written by Save must be rejected by Load and LoadMapped, which leave the tree empty.
+   The records do not have a checksum, therefore only the header and the length are corrupted. */
+static int RunSaveLoadBroken(long long int n)
+{
+	const char fileName[]="bintreebench_broken.bin";
+	printf("Save and Load of broken files  n=%lld\n",n);
+
+	std::vector <std::pair <int,int> > keyValue;
+	MakeRandomKeyValue(keyValue,n);
+	BinaryTree <int,int> tree;
+	tree.BuildFromUnsorted(keyValue);
+	if(true!=SaveTree(fileName,tree))
+	{
+		fprintf(stderr,"Error! Cannot save %s.\n",fileName);
+		return 1;
+	}
+
+	std::vector <unsigned char> saved;
+	FILE *fp=fopen(fileName,"rb");
+	if(nullptr!=fp)
+	{
+		unsigned char buf[4096];
+		size_t nRead;
+		while(0<(nRead=fread(buf,1,sizeof(buf),fp)))
+		{
+			saved.insert(saved.end(),buf,buf+nRead);
+		}
+		fclose(fp);
+	}
+
+	const size_t headerSize=32,recordSize=sizeof(int)*2;
+	if(saved.size()!=headerSize+recordSize*(size_t)n)
+	{
+		fprintf(stderr,"Error! Unexpected file size.\n");
+		return 1;
+	}
+
+	class BrokenFile
+	{
+	public:
+		const char *label;
+		std::vector <unsigned char> dat;
+	};
+	std::vector <BrokenFile> broken;
+	auto AddBroken=[&](const char label[],const std::vector <unsigned char> &dat)
+	{
+		broken.push_back(BrokenFile());
+		broken.back().label=label;
+		broken.back().dat=dat;
+	};
+
+	AddBroken("Empty file",std::vector <unsigned char>());
+	AddBroken("Truncated header",std::vector <unsigned char>(saved.begin(),saved.begin()+headerSize/2));
+	if(0<n)
+	{
+		AddBroken("Header only",std::vector <unsigned char>(saved.begin(),saved.begin()+headerSize));
+		AddBroken("Last record cut",std::vector <unsigned char>(saved.begin(),saved.end()-1));
+		AddBroken("Last record missing",std::vector <unsigned char>(saved.begin(),saved.end()-recordSize));
+		AddBroken("Half of records",std::vector <unsigned char>(saved.begin(),saved.begin()+headerSize+recordSize*(size_t)(n/2)));
+	}
+
+	auto dat=saved;
+	dat[0]^=0xff;
+	AddBroken("Wrong magic",dat);
+	dat=saved;
+	std::swap(dat[8],dat[11]);
+	AddBroken("Wrong byte order",dat);
+	dat=saved;
+	dat[12]+=4;
+	AddBroken("Wrong key size",dat);
+	dat=saved;
+	dat[16]+=4;
+	AddBroken("Wrong value size",dat);
+	dat=saved;
+	dat[24]+=1;
+	AddBroken("Too many records",dat);
+	dat=saved;
+	dat[31]=0x80;
+	AddBroken("Negative number of records",dat);
+
+	int nFail=0;
+	for(auto &b : broken)
+	{
+		fp=fopen(fileName,"wb");
+		if(nullptr==fp || (0<b.dat.size() && b.dat.size()!=fwrite(b.dat.data(),1,b.dat.size(),fp)))
+		{
+			fprintf(stderr,"Error! Cannot write %s.\n",fileName);
+			if(nullptr!=fp)
+			{
+				fclose(fp);
+			}
+			remove(fileName);
+			return 1;
+		}
+		fclose(fp);
+
+		// Start from a non-empty tree so that the tree is known to be emptied.
+		BinaryTree <int,int> loaded,mapped;
+		loaded.Insert(0,0);
+		mapped.Insert(0,0);
+		bool loadedOK=LoadTree(fileName,loaded);
+		bool mappedOK=mapped.LoadMapped(fileName);
+		bool rejected=(true!=loadedOK && true!=mappedOK && 0==loaded.GetN() && 0==mapped.GetN() &&
+		               true==loaded.CheckInvariant() && true==mapped.CheckInvariant());
+		printf("%-28s %s\n",b.label,(true==rejected ? "Rejected" : "Accepted"));
+		if(true!=rejected)
+		{
+			++nFail;
+		}
+	}
+	remove(fileName);
+
+	if(0<nFail)
+	{
+		fprintf(stderr,"Error! %d broken files were accepted.\n",nFail);
+		return 1;
+	}
+	return 0;
+}
+
+/* Nearly-sorted keys, like time stamps, inserted by Insert and by an InsertCursor.
+   One in 16 keys arrives slightly late. */
+template <class TreeClass>
+static void RunHintedInsert(const char label[],long long int n)
+{
+	std::vector <int> keys(n);
+	std::mt19937 rnd(24783);
+	for(long long int i=0; i<n; ++i)
+	{
+		keys[i]=(int)(i*4);
+		if(0==rnd()%16)
+		{
+			keys[i]-=(int)(rnd()%64);
+		}
+	}
+
+	TreeClass plain,hinted;
+	plain.autoRebalancing=true;
+	hinted.autoRebalancing=true;
+
+	auto t0=std::chrono::high_resolution_clock::now();
+	for(auto key : keys)
+	{
+		plain.Insert(key,0);
+	}
+	double plainTime=Elapsed(t0);
+
+	typename TreeClass::InsertCursor cursor;
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto key : keys)
+	{
+		hinted.Insert(cursor,key,0);
+	}
+	double hintedTime=Elapsed(t0);
+
+	printf("%-10s %14.2f %14.2f\n",label,(double)n/plainTime/1e6,(double)n/hintedTime/1e6);
+}
+
+static int RunHint(long long int n)
+{
+	printf("Nearly-sorted insertion  n=%lld\n",n);
+	printf("%-10s %14s %14s\n","Policy","Insert(Mop/s)","Cursor(Mop/s)");
+	RunHintedInsert <BinaryTree <int,int,BinaryTreeAVLPolicy> > ("AVL",n);
+	RunHintedInsert <BinaryTree <int,int,BinaryTreeRedBlackPolicy> > ("RedBlack",n);
+	return 0;
+}
+
+enum
+{
+	ORDER_RANDOM,
+	ORDER_SORTED,
+	ORDER_REVERSE
+};
+
+static const char *OrderLabel(int order)
+{
+	switch(order)
+	{
+	case ORDER_SORTED:
+		return "sorted";
+	case ORDER_REVERSE:
+		return "reverse";
+	}
+	return "random";
+}
+
+/* Distinct keys in the given insertion order. */
+static void MakeKeys(std::vector <int> &keys,long long int n,int order)
+{
+	keys.resize(n);
+	for(long long int i=0; i<n; ++i)
+	{
+		keys[i]=(int)(i*2);
+	}
+	if(ORDER_RANDOM==order)
+	{
+		std::shuffle(keys.begin(),keys.end(),std::mt19937(24783));
+	}
+	else if(ORDER_REVERSE==order)
+	{
+		std::reverse(keys.begin(),keys.end());
+	}
+}
+
+class OpsResult
+{
+public:
+	double insertTime,findTime,traverseTime,deleteTime;
+};
+
+static void PrintOps(long long int n,int order,const char label[],const OpsResult &res)
+{
+	printf("%10lld %-8s %-14s %10.2f %10.2f %10.2f %10.2f\n",n,OrderLabel(order),label,
+	    (double)n/res.insertTime/1e6,(double)n/res.findTime/1e6,(double)n/res.traverseTime/1e6,(double)n/res.deleteTime/1e6);
+}
+
+/* Inserts the keys in the given order, looks up and deletes them in a random order, and traverses in-order. */
+static OpsResult RunTreeOps(const std::vector <int> &keys,const std::vector <int> &lookUp,bool autoRebalancing)
+{
+	OpsResult res;
+	BinaryTree <int,int> tree;
+	tree.autoRebalancing=autoRebalancing;
+
+	auto t0=std::chrono::high_resolution_clock::now();
+	for(auto key : keys)
+	{
+		tree.Insert(key,key);
+	}
+	res.insertTime=Elapsed(t0);
+
+	long long int sum=0;
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto key : lookUp)
+	{
+		sum+=tree.GetValue(tree.FindNode(key));
+	}
+	res.findTime=Elapsed(t0);
+
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto ndHd=tree.First(); ndHd.IsNotNull(); ndHd=tree.FindNext(ndHd))
+	{
+		sum-=tree.GetValue(ndHd);
+	}
+	res.traverseTime=Elapsed(t0);
+
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto key : lookUp)
+	{
+		tree.Delete(tree.FindNode(key));
+	}
+	res.deleteTime=Elapsed(t0);
+
+	if(0!=sum || 0!=tree.GetN())
+	{
+		fprintf(stderr,"Error! Tree operations gave a wrong result.\n");
+	}
+	return res;
+}
+
+static OpsResult RunMapOps(const std::vector <int> &keys,const std::vector <int> &lookUp)
+{
+	OpsResult res;
+	std::map <int,int> map;
+
+	auto t0=std::chrono::high_resolution_clock::now();
+	for(auto key : keys)
+	{
+		map.insert(std::make_pair(key,key));
+	}
+	res.insertTime=Elapsed(t0);
+
+	long long int sum=0;
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto key : lookUp)
+	{
+		sum+=map.find(key)->second;
+	}
+	res.findTime=Elapsed(t0);
+
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto &kv : map)
+	{
+		sum-=kv.second;
+	}
+	res.traverseTime=Elapsed(t0);
+
+	t0=std::chrono::high_resolution_clock::now();
+	for(auto key : lookUp)
+	{
+		map.erase(key);
+	}
+	res.deleteTime=Elapsed(t0);
+
+	if(0!=sum || 0!=map.size())
+	{
+		fprintf(stderr,"Error! std::map operations gave a wrong result.\n");
+	}
+	return res;
+}
+
+/* Basic operations from 1K keys up to maxN keys, in steps of x10.  Without rebalancing, sorted and
+   reverse-sorted insertion makes a list and takes O(n^2).  Therefore, it runs only up to unbalancedMaxN. */
+static int RunOps(long long int maxN)
+{
+	const long long int unbalancedMaxN=20000;
+	printf("Basic operations (Mop/s)\n");
+	printf("%10s %-8s %-14s %10s %10s %10s %10s\n","Keys","Order","Container","Insert","Find","Traverse","Delete");
+	for(long long int n=1000; n<=maxN; n*=10)
+	{
+		for(int order : {ORDER_RANDOM,ORDER_SORTED,ORDER_REVERSE})
+		{
+			std::vector <int> keys,lookUp;
+			MakeKeys(keys,n,order);
+			MakeKeys(lookUp,n,ORDER_RANDOM);
+
+			PrintOps(n,order,"AVL",RunTreeOps(keys,lookUp,true));
+			if(ORDER_RANDOM==order || n<=unbalancedMaxN)
+			{
+				PrintOps(n,order,"NoRebalancing",RunTreeOps(keys,lookUp,false));
+			}
+			PrintOps(n,order,"std::map",RunMapOps(keys,lookUp));
+		}
+	}
+	return 0;
+}
+
+/* Random insertions, hinted insertions, and deletions checked against std::multimap.
+   The invariant is checked after every operation. */
+template <class TreeClass>
+static bool RunFuzz(const char label[],long long int nOps,bool autoRebalancing,unsigned int seed)
+{
+	TreeClass tree;
+	tree.autoRebalancing=autoRebalancing;
+	typename TreeClass::InsertCursor cursor;
+	std::multimap <int,int> ref;
+	std::mt19937 rnd(seed);
+
+	const int keyRange=(int)std::max <long long int> (16,nOps/4);
+	for(long long int i=0; i<nOps; ++i)
+	{
+		int op=(int)(rnd()%8);
+		int key=(int)(rnd()%keyRange);
+		if(op<3)
+		{
+			tree.Insert(key,(int)i);
+			ref.insert(std::make_pair(key,(int)i));
+		}
+		else if(op<4)
+		{
+			tree.Insert(cursor,key,(int)i);
+			ref.insert(std::make_pair(key,(int)i));
+		}
+		else if(op<5)
+		{
+			tree.InsertHint(tree.FindNode(key+(int)(rnd()%5)-2),key,(int)i);
+			ref.insert(std::make_pair(key,(int)i));
+		}
+		else
+		{
+			auto ndHd=tree.FindNode(key);
+			auto found=ref.find(key);
+			if(ndHd.IsNotNull()!=(ref.end()!=found))
+			{
+				fprintf(stderr,"%s: FindNode disagrees with std::multimap.\n",label);
+				return false;
+			}
+			if(ndHd.IsNotNull())
+			{
+				// FindNode may find any of the nodes with the key.  Remove the same value from ref.
+				auto range=ref.equal_range(key);
+				while(range.first!=range.second && range.first->second!=tree.GetValue(ndHd))
+				{
+					++range.first;
+				}
+				if(range.first==range.second)
+				{
+					fprintf(stderr,"%s: Value does not match.\n",label);
+					return false;
+				}
+				ref.erase(range.first);
+				tree.Delete(ndHd);
+			}
+		}
+
+		if(true!=tree.CheckInvariant() || tree.GetN()!=(long long int)ref.size())
+		{
+			fprintf(stderr,"%s: Invariant broken after operation %lld.\n",label,i);
+			return false;
+		}
+	}
+
+	auto iter=ref.begin();
+	for(auto ndHd=tree.First(); ndHd.IsNotNull(); ndHd=tree.FindNext(ndHd))
+	{
+		if(ref.end()==iter || iter->first!=tree.GetKey(ndHd))
+		{
+			fprintf(stderr,"%s: Keys do not match.\n",label);
+			return false;
+		}
+		++iter;
+	}
+	printf("%-14s %lld operations OK\n",label,nOps);
+	return true;
+}
+
+/* True if the tree has the same key-value pairs as the range of ref.  Nodes with the same key may be
+   in any order, therefore the pairs are compared after sorting. */
+template <class TreeClass,class IteratorType>
+static bool IsSameKeyValue(const TreeClass &tree,IteratorType refBegin,IteratorType refEnd)
+{
+	std::vector <std::pair <int,int> > treeKeyValue,refKeyValue(refBegin,refEnd);
+	GetKeyValue(treeKeyValue,tree);
+	for(size_t i=1; i<treeKeyValue.size(); ++i)
+	{
+		if(treeKeyValue[i].first<treeKeyValue[i-1].first)
+		{
+			return false;
+		}
+	}
+	std::sort(treeKeyValue.begin(),treeKeyValue.end());
+	std::sort(refKeyValue.begin(),refKeyValue.end());
+	return treeKeyValue==refKeyValue;
+}
+
+template <class TreeClass>
+static bool CheckTree(const char label[],const char opLabel[],long long int i,const TreeClass &tree,const std::multimap <int,int> &ref)
+{
+	if(true!=tree.CheckInvariant() || tree.GetN()!=(long long int)ref.size())
+	{
+		fprintf(stderr,"%s: Invariant broken after %s, operation %lld.\n",label,opLabel,i);
+		return false;
+	}
+	if(true!=IsSameKeyValue(tree,ref.begin(),ref.end()))
+	{
+		fprintf(stderr,"%s: Key-value pairs do not match std::multimap after %s, operation %lld.\n",label,opLabel,i);
+		return false;
+	}
+	return true;
+}
+
+/* Split, Join, and Union mixed with insertions and deletions, checked against std::multimap.
+   The invariant of every tree involved is checked after every operation. */
+template <class TreeClass>
+static bool RunSplitJoinFuzz(const char label[],long long int nOps,bool autoRebalancing,unsigned int seed)
+{
+	TreeClass tree,leftTree,rightTree;
+	tree.autoRebalancing=autoRebalancing;
+	leftTree.autoRebalancing=autoRebalancing;
+	rightTree.autoRebalancing=autoRebalancing;
+	std::multimap <int,int> ref;
+	std::mt19937 rnd(seed);
+
+	// The trees are compared with ref after every operation.  Not adding keys above maxN keeps it from
+	// taking O(nOps^2).
+	const long long int maxN=512;
+	const int keyRange=(int)std::max <long long int> (16,nOps/4);
+	for(long long int i=0; i<nOps; ++i)
+	{
+		int op=(int)(rnd()%8);
+		int key=(int)(rnd()%keyRange);
+		const char *opLabel="";
+		if(op<3 && maxN<=(long long int)ref.size())
+		{
+			op=3;
+		}
+		if(op<3)
+		{
+			opLabel="Insert";
+			tree.Insert(key,(int)i);
+			ref.insert(std::make_pair(key,(int)i));
+		}
+		else if(op<4)
+		{
+			opLabel="Delete";
+			auto ndHd=tree.FindNode(key);
+			if(ndHd.IsNotNull())
+			{
+				auto range=ref.equal_range(key);
+				while(range.first!=range.second && range.first->second!=tree.GetValue(ndHd))
+				{
+					++range.first;
+				}
+				if(range.first==range.second)
+				{
+					fprintf(stderr,"%s: Value does not match.\n",label);
+					return false;
+				}
+				ref.erase(range.first);
+				tree.Delete(ndHd);
+			}
+		}
+		else if(op<6)
+		{
+			opLabel="Split";
+			tree.Split(key,leftTree,rightTree);
+			auto border=ref.lower_bound(key);
+			if(0!=tree.GetN() ||
+			   true!=leftTree.CheckInvariant() || true!=rightTree.CheckInvariant() ||
+			   true!=IsSameKeyValue(leftTree,ref.begin(),border) ||
+			   true!=IsSameKeyValue(rightTree,border,ref.end()))
+			{
+				fprintf(stderr,"%s: Split at %d gave wrong trees, operation %lld.\n",label,key,i);
+				return false;
+			}
+
+			// Put the pieces back in one of the three ways.
+			switch(rnd()%3)
+			{
+			case 0:
+				opLabel="Split and Join";
+				tree.Join(leftTree,rightTree);
+				break;
+			case 1:
+				// key is not less than the keys of leftTree, and not greater than the keys of rightTree.
+				opLabel="Split and Join with a pivot";
+				tree.Join(leftTree,key,(int)i,rightTree);
+				ref.insert(std::make_pair(key,(int)i));
+				break;
+			default:
+				opLabel="Split and Union";
+				rightTree.Union(leftTree);
+				tree.Union(rightTree);
+				break;
+			}
+			if(0!=leftTree.GetN() || 0!=rightTree.GetN())
+			{
+				fprintf(stderr,"%s: %s did not empty the pieces, operation %lld.\n",label,opLabel,i);
+				return false;
+			}
+		}
+		else if(op<7)
+		{
+			// Keys overlap the keys of the tree.
+			opLabel="Union";
+			const int nIncoming=(maxN<=(long long int)ref.size() ? 0 : (int)(rnd()%32));
+			for(int j=0; j<nIncoming; ++j)
+			{
+				int incomingKey=(int)(rnd()%keyRange);
+				rightTree.Insert(incomingKey,(int)i);
+				ref.insert(std::make_pair(incomingKey,(int)i));
+			}
+			tree.Union(rightTree);
+			if(0!=rightTree.GetN())
+			{
+				fprintf(stderr,"%s: Union did not empty the incoming tree, operation %lld.\n",label,i);
+				return false;
+			}
+		}
+		else
+		{
+			// Join to itself: append keys not less than the last key of the tree.
+			opLabel="Join to itself";
+			const int lastKey=(0<ref.size() ? ref.rbegin()->first : 0);
+			const int nIncoming=(maxN<=(long long int)ref.size() ? 0 : (int)(rnd()%32));
+			for(int j=0; j<nIncoming; ++j)
+			{
+				int incomingKey=lastKey+(int)(rnd()%(keyRange-lastKey));
+				rightTree.Insert(incomingKey,(int)i);
+				ref.insert(std::make_pair(incomingKey,(int)i));
+			}
+			tree.Join(tree,rightTree);
+		}
+
+		if(true!=CheckTree(label,opLabel,i,tree,ref))
+		{
+			return false;
+		}
+	}
+	printf("%-14s %lld Split/Join/Union operations OK\n",label,nOps);
+	return true;
+}
+
+/* Key-value pairs of the nodes found by an interval query.  The nodes must be in the order of the intervals. */
+template <class TreeClass>
+static bool GetFoundKeyValue(std::vector <std::pair <std::pair <int,int>,int> > &keyValue,const TreeClass &tree,const std::vector <typename TreeClass::NodeHandle> &found)
+{
+	keyValue.clear();
+	for(auto ndHd : found)
+	{
+		auto &interval=tree.GetKey(ndHd);
+		if(0<keyValue.size() && interval<BinaryTreeInterval <int>(keyValue.back().first.first,keyValue.back().first.second))
+		{
+			return false;
+		}
+		keyValue.push_back(std::make_pair(std::make_pair(interval.low,interval.high),tree.GetValue(ndHd)));
+	}
+	std::sort(keyValue.begin(),keyValue.end());
+	return true;
+}
+
+/* Random insertions and deletions of intervals, and FindOverlapping and FindContaining checked against
+   a brute-force scan of all the intervals.  The invariant, including the maximum high end of every
+   sub-tree, is checked after every operation. */
+template <class TreeClass>
+static bool RunIntervalFuzz(const char label[],long long int nOps,bool autoRebalancing,unsigned int seed)
+{
+	TreeClass tree;
+	tree.autoRebalancing=autoRebalancing;
+	std::vector <std::pair <std::pair <int,int>,int> > ref,refFound,treeFound;  // ((low,high),value)
+	std::vector <typename TreeClass::NodeHandle> found;
+	std::mt19937 rnd(seed);
+
+	const int coordRange=(int)std::max <long long int> (64,nOps/4);
+	for(long long int i=0; i<nOps; ++i)
+	{
+		int op=(int)(rnd()%8);
+		int low=(int)(rnd()%coordRange);
+		int high=low+(int)(rnd()%(1+rnd()%(coordRange/4)));  // Mostly short, sometimes long.
+		if(op<3)
+		{
+			tree.Insert(low,high,(int)i);
+			ref.push_back(std::make_pair(std::make_pair(low,high),(int)i));
+		}
+		else if(op<4 && 0<ref.size())
+		{
+			// Delete an interval that is in the tree.  FindNode may find any of the nodes with the same interval.
+			auto &victim=ref[rnd()%ref.size()].first;
+			auto ndHd=tree.FindNode(BinaryTreeInterval <int>(victim.first,victim.second));
+			if(ndHd.IsNull())
+			{
+				fprintf(stderr,"%s: FindNode did not find an interval.\n",label);
+				return false;
+			}
+			auto refIter=std::find(ref.begin(),ref.end(),std::make_pair(victim,tree.GetValue(ndHd)));
+			if(ref.end()==refIter)
+			{
+				fprintf(stderr,"%s: Value does not match.\n",label);
+				return false;
+			}
+			ref.erase(refIter);
+			tree.Delete(ndHd);
+		}
+		else
+		{
+			// Point queries are FindOverlapping with a zero-length range.  Test them separately anyway.
+			const bool point=(0==rnd()%2);
+			if(true==point)
+			{
+				high=low;
+			}
+
+			found.clear();
+			if(true==point)
+			{
+				tree.FindContaining(found,low);
+			}
+			else
+			{
+				tree.FindOverlapping(found,low,high);
+			}
+
+			refFound.clear();
+			for(auto &r : ref)
+			{
+				if(r.first.first<=high && low<=r.first.second)
+				{
+					refFound.push_back(r);
+				}
+			}
+			std::sort(refFound.begin(),refFound.end());
+			if(true!=GetFoundKeyValue(treeFound,tree,found) || treeFound!=refFound)
+			{
+				fprintf(stderr,"%s: %s [%d,%d] does not match the brute-force scan, operation %lld.\n",
+				    label,(true==point ? "FindContaining" : "FindOverlapping"),low,high,i);
+				return false;
+			}
+		}
+
+		if(true!=tree.CheckInvariant() || tree.GetN()!=(long long int)ref.size())
+		{
+			fprintf(stderr,"%s: Invariant broken after operation %lld.\n",label,i);
+			return false;
+		}
+	}
+	printf("%-14s %lld interval operations OK\n",label,nOps);
+	return true;
+}
+
+static int RunFuzz(long long int nOps)
+{
+	bool ok=true;
+	for(unsigned int seed : {24783u,1u,2u})
+	{
+		ok=(ok && RunFuzz <BinaryTree <int,int,BinaryTreeAVLPolicy> > ("AVL",nOps,true,seed));
+		ok=(ok && RunFuzz <BinaryTree <int,int,BinaryTreeRedBlackPolicy> > ("RedBlack",nOps,true,seed));
+		ok=(ok && RunFuzz <BinaryTree <int,int> > ("NoRebalancing",nOps,false,seed));
+	}
+
+	// Split, Join, and Union need a height-balanced policy, and are not available for RedBlack.
+	for(unsigned int seed : {24783u,1u,2u})
+	{
+		ok=(ok && RunSplitJoinFuzz <BinaryTree <int,int,BinaryTreeAVLPolicy> > ("AVL",nOps,true,seed));
+		ok=(ok && RunSplitJoinFuzz <BinaryTree <int,int,BinaryTreeNoBalancingPolicy> > ("NoBalancing",nOps,false,seed));
+		ok=(ok && RunSplitJoinFuzz <BinaryTree <int,int> > ("NoRebalancing",nOps,false,seed));
+	}
+
+	for(unsigned int seed : {24783u,1u,2u})
+	{
+		ok=(ok && RunIntervalFuzz <BinaryIntervalTree <int,int,BinaryTreeAVLPolicy> > ("AVL",nOps,true,seed));
+		ok=(ok && RunIntervalFuzz <BinaryIntervalTree <int,int,BinaryTreeRedBlackPolicy> > ("RedBlack",nOps,true,seed));
+		ok=(ok && RunIntervalFuzz <BinaryIntervalTree <int,int> > ("NoRebalancing",nOps,false,seed));
+	}
+	return (true==ok ? 0 : 1);
+}
+
+int main(int ac,char *av[])
+{
+	const char *mode=(2<=ac ? av[1] : "parallel");
+	long long int n=(3<=ac ? atoll(av[2]) : 1000000);
+	int maxThread=(4<=ac ? atoi(av[3]) : (int)std::thread::hardware_concurrency());
+	if(maxThread<1)
+	{
+		maxThread=1;
+	}
+
+	if(0==strcmp(mode,"parallel"))
+	{
+		return RunParallel(n,maxThread);
+	}
+	else if(0==strcmp(mode,"parallelcheck"))
+	{
+		return RunParallelCheck(n);
+	}
+	else if(0==strcmp(mode,"balance"))
+	{
+		return RunBalance(n);
+	}
+	else if(0==strcmp(mode,"saveload"))
+	{
+		return RunSaveLoad(n);
+	}
+	else if(0==strcmp(mode,"savebroken"))
+	{
+		return RunSaveLoadBroken(n);
+	}
+	else if(0==strcmp(mode,"hint"))
+	{
+		return RunHint(n);
+	}
+	else if(0==strcmp(mode,"ops"))
+	{
+		return RunOps(n);
+	}
+	else if(0==strcmp(mode,"fuzz"))
+	{
+		return RunFuzz(n);
+	}
+
+	printf("Usage: bintreebench parallel [numKeys] [maxThreads]\n");
+	printf("       bintreebench parallelcheck [numKeys]\n");
+	printf("       bintreebench balance [numKeys]\n");
+	printf("       bintreebench saveload [numKeys]\n");
+	printf("       bintreebench savebroken [numKeys]\n");
+	printf("       bintreebench hint [numKeys]\n");
+	printf("       bintreebench ops [maxNumKeys]\n");
+	printf("       bintreebench fuzz [numOperations]\n");
+	return 1;
+}
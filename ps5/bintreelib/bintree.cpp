@@ -1,4 +1,99 @@
 #include "bintree.h"
 
-// CMake add_library command requires at least one .c or .cpp file.
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
+BinaryTreeMappedFile::BinaryTreeMappedFile()
+{
+	dataPtr=nullptr;
+	dataSize=0;
+	mapped=false;
+}
+
+BinaryTreeMappedFile::~BinaryTreeMappedFile()
+{
+	Close();
+}
+
+bool BinaryTreeMappedFile::Open(const char fileName[])
+{
+	Close();
+
+#ifndef _WIN32
+	int fd=open(fileName,O_RDONLY);
+	if(0<=fd)
+	{
+		struct stat st;
+		if(0==fstat(fd,&st) && 0<st.st_size)
+		{
+			void *ptr=mmap(nullptr,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+			if(MAP_FAILED!=ptr)
+			{
+				// The tree is built by reading the file from the beginning to the end.
+				madvise(ptr,(size_t)st.st_size,MADV_SEQUENTIAL);
+				dataPtr=(const unsigned char *)ptr;
+				dataSize=(size_t)st.st_size;
+				mapped=true;
+				close(fd);
+				return true;
+			}
+		}
+		close(fd);
+	}
+#endif
+
+	// Memory-mapping is not available.  Read the whole file.
+	FILE *fp=fopen(fileName,"rb");
+	if(nullptr==fp)
+	{
+		return false;
+	}
+	fseek(fp,0,SEEK_END);
+	long fileSize=ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	if(fileSize<0)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	auto buf=new unsigned char [fileSize+1];
+	dataSize=fread(buf,1,(size_t)fileSize,fp);
+	dataPtr=buf;
+	fclose(fp);
+	return true;
+}
+
+void BinaryTreeMappedFile::Close(void)
+{
+	if(nullptr!=dataPtr)
+	{
+#ifndef _WIN32
+		if(true==mapped)
+		{
+			munmap((void *)dataPtr,dataSize);
+		}
+		else
+#endif
+		{
+			delete [] dataPtr;
+		}
+	}
+	dataPtr=nullptr;
+	dataSize=0;
+	mapped=false;
+}
+
+const unsigned char *BinaryTreeMappedFile::GetData(void) const
+{
+	return dataPtr;
+}
+
+size_t BinaryTreeMappedFile::GetSize(void) const
+{
+	return dataSize;
+}
@@ -1,10 +1,60 @@
+#ifndef BINTREE_IS_INCLUDED
+#define BINTREE_IS_INCLUDED
+/* { */
+
 #include <stdio.h>
+#include <string.h>
 #include <cstddef>
 #include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <type_traits>
+
+#include "bintreepolicy.h"
+
+/*! Read-only view of a whole file.  Memory-mapped where available, and read into memory otherwise.
+    Used by BinaryTree::LoadMapped. */
+class BinaryTreeMappedFile
+{
+private:
+	const unsigned char *dataPtr;
+	size_t dataSize;
+	bool mapped;
+
+	BinaryTreeMappedFile(const BinaryTreeMappedFile &);
+	BinaryTreeMappedFile &operator=(const BinaryTreeMappedFile &);
+public:
+	BinaryTreeMappedFile();
+	~BinaryTreeMappedFile();
+	bool Open(const char fileName[]);
+	void Close(void);
+	const unsigned char *GetData(void) const;
+	size_t GetSize(void) const;
+};
+
+/*! Extra data kept in every node for a sub-tree aggregate such as the maximum end point of an interval tree.
+    Update re-calculates the aggregate from the key of the node and the aggregates of the children (nullptr if no child),
+    and returns true if the aggregate changed.  The tree calls it whenever the sub-tree under a node changes,
+    including the rotations.  Specialize it for a key class that needs an aggregate.  See bintreeinterval.h. */
+template <class KeyClass>
+class BinaryTreeAugmentation
+{
+public:
+	bool Update(const KeyClass &,const BinaryTreeAugmentation <KeyClass> *,const BinaryTreeAugmentation <KeyClass> *)
+	{
+		return false;
+	}
+};
 
-template <class KeyClass,class ValueClass>
+/*! BalancingPolicy decides how the tree is rebalanced after insertion and deletion when autoRebalancing is true.
+    See bintreepolicy.h for the available policies. */
+template <class KeyClass,class ValueClass,class BalancingPolicy=BinaryTreeAVLPolicy>
 class BinaryTree
 {
+friend BalancingPolicy;
 protected:
 	class Node
 	{
@@ -13,7 +63,10 @@ protected:
 		ValueClass value;
 		Node *left,*right,*up;
 		int height;
-		Node() : left(nullptr),right(nullptr),up(nullptr),height(1)
+		typename BalancingPolicy::NodeAttribute balance;
+		BinaryTreeAugmentation <KeyClass> augment;
+		long long int size;  // Number of nodes in the sub-tree rooted at this node.
+		Node() : left(nullptr),right(nullptr),up(nullptr),height(1),size(1)
 		{
 		}
 	};
@@ -24,7 +77,7 @@ public:
 
 	class NodeHandle
 	{
-	friend BinaryTree <KeyClass,ValueClass>;
+	friend BinaryTree <KeyClass,ValueClass,BalancingPolicy>;
 	private:
 		Node *ptr;
 	public:
@@ -97,16 +150,29 @@ protected:
 		ndHd.ptr=nodePtr;
 		return ndHd;
 	}
-	bool UpdateHeight(Node *nodePtr)
+	static bool UpdateHeight(Node *nodePtr)
 	{
 		int leftHeight=1,rightHeight=1;
+		long long int newSize=1;
 		if(nullptr!=nodePtr->left)
 		{
 			leftHeight=nodePtr->left->height+1;
+			newSize+=nodePtr->left->size;
 		}
 		if(nullptr!=nodePtr->right)
 		{
 			rightHeight=nodePtr->right->height+1;
+			newSize+=nodePtr->right->size;
+		}
+		// Sub-tree size changes on every insertion and deletion, therefore the cascade always reaches the root.
+		bool aggregateChanged=(newSize!=nodePtr->size);
+		nodePtr->size=newSize;
+		if(true==nodePtr->augment.Update(
+		    nodePtr->key,
+		    (nullptr!=nodePtr->left ? &nodePtr->left->augment : nullptr),
+		    (nullptr!=nodePtr->right ? &nodePtr->right->augment : nullptr)))
+		{
+			aggregateChanged=true;
 		}
 		int newHeight=1;
 		if(leftHeight>rightHeight)
@@ -122,7 +188,7 @@ protected:
 			nodePtr->height=newHeight;
 			return true;
 		}
-		return false;
+		return aggregateChanged;
 	}
 	void UpdateHeightCascade(Node *nodePtr)
 	{
@@ -142,15 +208,19 @@ protected:
 private:
 	Node *root;
 	long long int nElem;
+	long long int nRotation;
+	long long int modificationCount;  // Incremented when a node is added or removed.  See InsertCursor.
 
 public:
 	BinaryTree()
 	{
 		root=nullptr;
 		nElem=0;
+		nRotation=0;
+		modificationCount=0;
 
 		/// <autoRebalancing implementation: Question 5.1>
-		autoRebalancing = false;
+		autoRebalancing = (0!=BalancingPolicy::defaultAutoRebalancing);
 	}
 	~BinaryTree()
 	{
@@ -159,6 +229,9 @@ public:
 	void CleanUp(void)
 	{
 		CleanUp(GetNode(RootNode()));
+		root=nullptr;
+		nElem=0;
+		++modificationCount;
 	}
 private:
 	void CleanUp(Node *nodePtr)
@@ -213,6 +286,105 @@ public:
 	{
 		return nElem;
 	}
+
+	/*! Returns the number of rotations since the tree was constructed or ResetRotationCount was called.
+	    Useful for comparing the balancing policies on the actual mix of insertions and deletions. */
+	long long int GetRotationCount(void) const
+	{
+		return nRotation;
+	}
+	void ResetRotationCount(void)
+	{
+		nRotation=0;
+	}
+
+	/*! Checks the up links, heights, sub-tree sizes, augmentations, and the order of the keys of all nodes,
+	    and the balance condition of BalancingPolicy if autoRebalancing is true.  The balance condition holds
+	    only if autoRebalancing has been on since the tree was empty.  Prints what is broken to stderr and
+	    returns false if something is wrong.  Takes O(n).  For testing. */
+	bool CheckInvariant(void) const
+	{
+		if(nullptr!=root && nullptr!=root->up)
+		{
+			fprintf(stderr,"Error! Root has a parent.\n");
+			return false;
+		}
+		const Node *prevPtr=nullptr;
+		if(true!=CheckInvariant(root,prevPtr))
+		{
+			return false;
+		}
+		if((nullptr!=root ? root->size : 0)!=nElem)
+		{
+			fprintf(stderr,"Error! Number of nodes does not match.\n");
+			return false;
+		}
+		if(true==autoRebalancing && true!=BalancingPolicy::IsBalanced(root))
+		{
+			fprintf(stderr,"Error! Tree is not balanced.\n");
+			return false;
+		}
+		return true;
+	}
+private:
+	bool CheckInvariant(const Node *nodePtr,const Node *&prevPtr) const
+	{
+		if(nullptr==nodePtr)
+		{
+			return true;
+		}
+		if(nullptr!=nodePtr->left && nodePtr!=nodePtr->left->up)
+		{
+			fprintf(stderr,"Error! Broken up link of a left child.\n");
+			return false;
+		}
+		if(nullptr!=nodePtr->right && nodePtr!=nodePtr->right->up)
+		{
+			fprintf(stderr,"Error! Broken up link of a right child.\n");
+			return false;
+		}
+		if(true!=CheckInvariant(nodePtr->left,prevPtr))
+		{
+			return false;
+		}
+		if(nullptr!=prevPtr && nodePtr->key<prevPtr->key)
+		{
+			fprintf(stderr,"Error! Keys are out of order.\n");
+			return false;
+		}
+		prevPtr=nodePtr;
+		if(true!=CheckInvariant(nodePtr->right,prevPtr))
+		{
+			return false;
+		}
+
+		int leftHeight=(nullptr!=nodePtr->left ? nodePtr->left->height : 0);
+		int rightHeight=(nullptr!=nodePtr->right ? nodePtr->right->height : 0);
+		long long int leftSize=(nullptr!=nodePtr->left ? nodePtr->left->size : 0);
+		long long int rightSize=(nullptr!=nodePtr->right ? nodePtr->right->size : 0);
+		if(nodePtr->height!=1+std::max(leftHeight,rightHeight))
+		{
+			fprintf(stderr,"Error! Wrong height.\n");
+			return false;
+		}
+		if(nodePtr->size!=1+leftSize+rightSize)
+		{
+			fprintf(stderr,"Error! Wrong sub-tree size.\n");
+			return false;
+		}
+		// Up to date if re-calculating does not change it.
+		auto augment=nodePtr->augment;
+		if(true==augment.Update(
+		    nodePtr->key,
+		    (nullptr!=nodePtr->left ? &nodePtr->left->augment : nullptr),
+		    (nullptr!=nodePtr->right ? &nodePtr->right->augment : nullptr)))
+		{
+			fprintf(stderr,"Error! Augmentation is not up to date.\n");
+			return false;
+		}
+		return true;
+	}
+public:
 	const KeyClass &GetKey(NodeHandle ndHd) const
 	{
 		// This will crash if ndHd==nullptr.  Therefore, ndHd must be non-null to use this function.
@@ -231,7 +403,7 @@ public:
 	NodeHandle FindNode(const KeyClass &key) const
 	{
 		auto ndHd=RootNode();
-		while(nullptr!=ndHd)
+		while(ndHd.IsNotNull())
 		{
 			if(key==GetKey(ndHd))
 			{
@@ -261,6 +433,15 @@ public:
 		}
 		return 0;
 	}
+	long long int GetSubTreeSize(NodeHandle ndHd) const
+	{
+		auto nodePtr=GetNode(ndHd);
+		if(nullptr!=nodePtr)
+		{
+			return nodePtr->size;
+		}
+		return 0;
+	}
 
 	NodeHandle Insert(const KeyClass &key,const ValueClass &value)
 	{
@@ -271,7 +452,7 @@ public:
 		auto ndHd=RootNode();
 		if(ndHd.IsNull())
 		{
-			root=newNode;
+			AttachNewNode(newNode,nullptr,true);
 		}
 		else
 		{
@@ -285,8 +466,7 @@ public:
 					}
 					else
 					{
-						GetNode(ndHd)->left=newNode;
-						newNode->up=GetNode(ndHd);
+						AttachNewNode(newNode,GetNode(ndHd),true);
 						break;
 					}
 				}
@@ -298,31 +478,170 @@ public:
 					}
 					else
 					{
-						GetNode(ndHd)->right=newNode;
-						newNode->up=GetNode(ndHd);
+						AttachNewNode(newNode,GetNode(ndHd),false);
 						break;
 					}
 				}
 			}
 		}
+		return MakeHandle(newNode);
+	}
+
+	/*! Inserts a key-value pair at the same position as Insert, but starts from hint instead of the root.
+	    If the key falls right after or right before hint in the order, the new node is attached next to hint
+	    without descending from the root.  Otherwise, same as Insert.  hint can be null. */
+	NodeHandle InsertHint(NodeHandle hint,const KeyClass &key,const ValueClass &value)
+	{
+		Node *upPtr=nullptr;
+		bool toLeft=false;
+		if(true==FindHintPosition(GetNode(hint),key,upPtr,toLeft))
+		{
+			auto newNode=new Node;
+			newNode->key=key;
+			newNode->value=value;
+			AttachNewNode(newNode,upPtr,toLeft);
+			return MakeHandle(newNode);
+		}
+		return Insert(key,value);
+	}
+
+	/*! Remembers the node inserted last and its next node for Insert(InsertCursor &,key,value).
+	    The cursor becomes stale once the tree is modified by anything other than the cursor,
+	    and then the next insertion through the cursor falls back to InsertHint. */
+	class InsertCursor
+	{
+	friend BinaryTree <KeyClass,ValueClass,BalancingPolicy>;
+	private:
+		NodeHandle last,next;
+		long long int modificationCount;
+	public:
+		InsertCursor()
+		{
+			last.Nullify();
+			next.Nullify();
+			modificationCount=-1;
+		}
+		NodeHandle GetLast(void) const
+		{
+			return last;
+		}
+	};
+
+	/*! Inserts a key-value pair, and moves the cursor to the new node.  If the key is not less than
+	    the previous key through the cursor and is less than the key after it, which is the case when the keys
+	    arrive in the ascending order, the new node is attached without comparing the keys in the tree. */
+	NodeHandle Insert(InsertCursor &cursor,const KeyClass &key,const ValueClass &value)
+	{
+		NodeHandle newHd;
+		Node *lastPtr=GetNode(cursor.last),*nextPtr=GetNode(cursor.next);
+		if(cursor.modificationCount==modificationCount &&
+		   nullptr!=lastPtr &&
+		   !(key<lastPtr->key) &&
+		   (nullptr==nextPtr || key<nextPtr->key))
+		{
+			// The new node goes between lastPtr and nextPtr.  If lastPtr has a right sub-tree, nextPtr is
+			// the left-most node of it, and therefore nextPtr->left is empty.
+			auto newNode=new Node;
+			newNode->key=key;
+			newNode->value=value;
+			if(nullptr==lastPtr->right)
+			{
+				AttachNewNode(newNode,lastPtr,false);
+			}
+			else
+			{
+				AttachNewNode(newNode,nextPtr,true);
+			}
+			newHd=MakeHandle(newNode);
+		}
+		else
+		{
+			newHd=InsertHint((cursor.modificationCount==modificationCount ? cursor.last : Null()),key,value);
+			cursor.next=FindNext(newHd);
+		}
+		cursor.last=newHd;
+		cursor.modificationCount=modificationCount;
+		return newHd;
+	}
+
+private:
+	/* Attaches a new leaf as the left or right child of upPtr, or as the root if upPtr is nullptr,
+	   and then updates the heights and rebalances. */
+	void AttachNewNode(Node *newNode,Node *upPtr,bool toLeft)
+	{
+		if(nullptr==upPtr)
+		{
+			root=newNode;
+		}
+		else if(true==toLeft)
+		{
+			upPtr->left=newNode;
+			newNode->up=upPtr;
+		}
+		else
+		{
+			upPtr->right=newNode;
+			newNode->up=upPtr;
+		}
 		UpdateHeightCascade(newNode);
 		nElem++;
+		++modificationCount;
 
 		/// <autoRebalancing implementation: Question 5.3>
-		Node* rebalancer = newNode->up;
-
 		if (autoRebalancing == true)
 		{
-			while (rebalancer != nullptr)
+			BalancingPolicy::AfterInsert(*this,newNode);
+		}
+	}
+	/* Finds where a new key goes if it is adjacent to hintPtr in the order.  Returns false if not adjacent. */
+	bool FindHintPosition(Node *hintPtr,const KeyClass &key,Node *&upPtr,bool &toLeft)
+	{
+		if(nullptr==hintPtr)
+		{
+			return false;
+		}
+		if(!(key<hintPtr->key))
+		{
+			// Goes right after hintPtr unless the next key is not greater.
+			auto nextPtr=GetNode(FindNext(MakeHandle(hintPtr)));
+			if(nullptr!=nextPtr && !(key<nextPtr->key))
 			{
-				Rebalance(rebalancer);
-				rebalancer = rebalancer->up;
+				return false;
+			}
+			if(nullptr==hintPtr->right)
+			{
+				upPtr=hintPtr;
+				toLeft=false;
+			}
+			else
+			{
+				upPtr=nextPtr;
+				toLeft=true;
 			}
+			return true;
+		}
+		else
+		{
+			// Goes right before hintPtr unless the previous key is greater.
+			auto prevPtr=GetNode(FindPrev(MakeHandle(hintPtr)));
+			if(nullptr!=prevPtr && key<prevPtr->key)
+			{
+				return false;
+			}
+			if(nullptr==hintPtr->left)
+			{
+				upPtr=hintPtr;
+				toLeft=true;
+			}
+			else
+			{
+				upPtr=prevPtr;
+				toLeft=false;
+			}
+			return true;
 		}
-
-
-		return MakeHandle(newNode);
 	}
+public:
 
 	NodeHandle First(void) const
 	{
@@ -526,18 +845,22 @@ private:
 public:
 	bool Delete(NodeHandle ndHd)
 	{
+		// If ndHd is simple-detachable, its only child (or nullptr) takes its position.
+		auto childPtr=(Left(ndHd).IsNotNull() ? GetNode(Left(ndHd)) : GetNode(Right(ndHd)));
 		if(true==SimpleDetach(ndHd))
 		{
 			Node * rebalance_up = GetNode(ndHd)->up;
+			auto removedBalance=GetNode(ndHd)->balance;
 			delete GetNode(ndHd);
-			--nElem; 
+			--nElem;
+			++modificationCount;
 
 			//////////////////////////////////////////////////////////////////////////////////>
 			/// <autoRebalancing implementation: Question 5.4>
 
 			if (autoRebalancing == true)
 			{
-				Rebalance(rebalance_up);
+				BalancingPolicy::AfterRemove(*this,removedBalance,childPtr,rebalance_up);
 			}
 			//////////////////////////////////////////////////////////////////////////////////<
 
@@ -548,6 +871,7 @@ public:
 			// Right most of left. Always Simple-Detachable.
 			// Also, since SimpleDetach of itself has failed, it must have a left sub-tree.
 			auto RMOL=RightMostOf(Left(ndHd));
+			auto childOfRMOLptr=GetNode(Left(RMOL));
 
 			if (true == SimpleDetach(RMOL))
 			{
@@ -563,8 +887,14 @@ public:
 				if(upOfRMOLptr==GetNode(ndHd))
 				{
 					upOfRMOLptr=RMOLptr;	// Now it is correct.
+					rebalancer=RMOLptr;		// ndHd is about to be deleted.
 				}
 
+				// RMOL takes over the balancing attribute of ndHd.  What is removed from the balancing
+				// point of view is RMOL at its original position.
+				auto removedBalance=RMOLptr->balance;
+				RMOLptr->balance=GetNode(ndHd)->balance;
+
 				if(nullptr==upPtr)
 				{
 					root=RMOLptr;
@@ -601,17 +931,14 @@ public:
 
 				delete GetNode(ndHd);
 				--nElem;
+				++modificationCount;
 
 				//////////////////////////////////////////////////////////////////////////////////>
 				/// <autoRebalancing implementation: Question 5.4>
 
 				if (autoRebalancing == true)
 				{
-					while (rebalancer != nullptr)
-					{
-						Rebalance(rebalancer);
-						rebalancer = rebalancer->up;
-					}
+					BalancingPolicy::AfterRemove(*this,removedBalance,childOfRMOLptr,rebalancer);
 				}
 				//////////////////////////////////////////////////////////////////////////////////<
 
@@ -657,6 +984,7 @@ public:
 			}
 			UpdateHeight(nodePtr);
 			UpdateHeightCascade(rightPtr);
+			++nRotation;
 			return true;
 		}
 		return false;
@@ -702,6 +1030,7 @@ public:
 			}
 			UpdateHeight(nodePtr);
 			UpdateHeightCascade(leftPtr);
+			++nRotation;
 			return true;
 		}
 		return false;
@@ -817,6 +1146,7 @@ public:
 			}
 			UpdateHeight(nodePtr);
 			UpdateHeightCascade(leftPtr);
+			++nRotation;
 			return true;
 		}
 		return false;
@@ -858,6 +1188,7 @@ public:
 			}
 			UpdateHeight(nodePtr);
 			UpdateHeightCascade(rightPtr);
+			++nRotation;
 			return true;
 		}
 		return false;
@@ -902,7 +1233,7 @@ public:
 					depth_r_r = selected_node->right->right->height;
 				}
 				// Rebalancing operation
-				if (depth_r_r > depth_r_l)
+				if (depth_r_r >= depth_r_l)
 				{
 					RotateLeft_PointerRebalanced(selected_node);
 					return;
@@ -930,7 +1261,7 @@ public:
 				}
 
 				// Rebalancing operation
-				if (depth_l_l > depth_l_r)
+				if (depth_l_l >= depth_l_r)
 				{
 					RotateRight_PointerRebalanced(selected_node);
 					return;
@@ -947,6 +1278,711 @@ public:
 	}
 	///////////////////////////////////////////////////////////////////////////////////////////<
 	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////<
-};
 
 
+	// Split, Join, and Union.
+	// These functions move nodes between trees without re-inserting them.  Split and Join take O(log n)
+	// as long as the input trees are height-balanced (autoRebalancing, or a tree made by VineToTree).
+	// They rebalance by heights, and therefore are not available for a policy that keeps its own balancing attribute.
+	// Duplicate keys are allowed as in Insert.  Keys equal to the pivot may go either side of the pivot.
+
+	/*! Moves all nodes whose key is less than the given key to leftTree, and the rest to rightTree.
+	    This tree becomes empty.  Existing contents of leftTree and rightTree are deleted. */
+	void Split(const KeyClass &key,BinaryTree <KeyClass,ValueClass,BalancingPolicy> &leftTree,BinaryTree <KeyClass,ValueClass,BalancingPolicy> &rightTree)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		auto nodePtr=DetachAll();
+		Node *leftPtr,*rightPtr;
+		SplitNode(nodePtr,key,leftPtr,rightPtr);
+		leftTree.CleanUp();
+		leftTree.AttachAll(leftPtr);
+		rightTree.CleanUp();
+		rightTree.AttachAll(rightPtr);
+	}
+
+	/*! Makes this tree by joining leftTree, a new node of (key,value), and rightTree.
+	    All keys in leftTree must be less than or equal to key, and all keys in rightTree must be greater than or equal to key.
+	    leftTree and rightTree become empty.  Existing contents of this tree are deleted unless this tree is leftTree or rightTree. */
+	NodeHandle Join(BinaryTree <KeyClass,ValueClass,BalancingPolicy> &leftTree,const KeyClass &key,const ValueClass &value,BinaryTree <KeyClass,ValueClass,BalancingPolicy> &rightTree)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		auto leftPtr=leftTree.DetachAll();
+		auto rightPtr=rightTree.DetachAll();
+		CleanUp();
+
+		auto newNode=new Node;
+		newNode->key=key;
+		newNode->value=value;
+		AttachAll(JoinNode(leftPtr,newNode,rightPtr));
+		return MakeHandle(newNode);
+	}
+
+	/*! Makes this tree by concatenating leftTree and rightTree.
+	    All keys in leftTree must be less than or equal to all keys in rightTree.
+	    leftTree and rightTree become empty.  Existing contents of this tree are deleted unless this tree is leftTree or rightTree. */
+	void Join(BinaryTree <KeyClass,ValueClass,BalancingPolicy> &leftTree,BinaryTree <KeyClass,ValueClass,BalancingPolicy> &rightTree)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		auto leftPtr=leftTree.DetachAll();
+		auto rightPtr=rightTree.DetachAll();
+		CleanUp();
+
+		if(nullptr==leftPtr)
+		{
+			AttachAll(rightPtr);
+		}
+		else
+		{
+			// The right-most node of the left tree becomes the pivot.
+			Node *pivot;
+			leftPtr=SplitLastNode(leftPtr,pivot);
+			AttachAll(JoinNode(leftPtr,pivot,rightPtr));
+		}
+	}
+
+	/*! Moves all nodes of incoming to this tree.  incoming becomes empty.
+	    Duplicate keys are kept as Insert does.
+	    It takes O(m log(n/m+1)) where m is the size of the smaller tree. */
+	void Union(BinaryTree <KeyClass,ValueClass,BalancingPolicy> &incoming)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		if(&incoming!=this)
+		{
+			auto thisPtr=DetachAll();
+			auto incomingPtr=incoming.DetachAll();
+			AttachAll(UnionNode(thisPtr,incomingPtr));
+		}
+	}
+
+
+
+	// Parallel bulk operations.
+	// nThread<=0 means the number of hardware threads.  The calling thread is one of the workers.
+
+	/*! Calls fn(key,value) for every node.  The tree is cut into disjoint sub-trees, and the worker threads
+	    take them one by one.  Each sub-tree is visited in order, but sub-trees are visited in parallel.
+	    fn must not change the tree structure, and must be safe to call from multiple threads. */
+	template <class FuncType>
+	void ParallelForEach(FuncType fn,int nThread=0)
+	{
+		nThread=GetNumThread(nThread);
+
+		// Make about 8 pieces per thread so that a thread that finished early can take another piece.
+		std::vector <ForEachPiece> pieces;
+		long long int pieceSize=(nElem+nThread*8-1)/(nThread*8);
+		MakeForEachPiece(pieces,root,(pieceSize<1 ? 1 : pieceSize));
+
+		std::atomic <size_t> nextPiece(0);
+		auto worker=[&]()
+		{
+			std::vector <Node *> stack;
+			for(;;)
+			{
+				auto pieceIdx=nextPiece.fetch_add(1);
+				if(pieces.size()<=pieceIdx)
+				{
+					break;
+				}
+				auto &piece=pieces[pieceIdx];
+				if(true!=piece.wholeSubTree)
+				{
+					fn(piece.nodePtr->key,piece.nodePtr->value);
+					continue;
+				}
+
+				// In-order traversal without recursion, since a sub-tree may be as deep as its size if not balanced.
+				auto nodePtr=piece.nodePtr;
+				while(nullptr!=nodePtr || 0<stack.size())
+				{
+					while(nullptr!=nodePtr)
+					{
+						stack.push_back(nodePtr);
+						nodePtr=nodePtr->left;
+					}
+					nodePtr=stack.back();
+					stack.pop_back();
+					fn(nodePtr->key,nodePtr->value);
+					nodePtr=nodePtr->right;
+				}
+			}
+		};
+		RunWorker(worker,nThread);
+	}
+
+	/*! Re-builds this tree from unsorted key-value pairs.  Existing contents are deleted.
+	    keyValue is sorted in parallel, and then the left and right halves of the tree are built concurrently.
+	    The resulting tree is perfectly balanced.  keyValue is left sorted by key when the function returns. */
+	void BuildFromUnsorted(std::vector <std::pair <KeyClass,ValueClass> > &keyValue,int nThread=0)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		nThread=GetNumThread(nThread);
+		CleanUp();
+
+		ParallelSort(keyValue,nThread);
+
+		int threadDepth=0;
+		while((1<<threadDepth)<nThread)
+		{
+			++threadDepth;
+		}
+		AttachAll(BuildBalanced(keyValue.data(),0,(long long int)keyValue.size(),threadDepth));
+	}
+
+	/*! Writes the key-value pairs in the order of the keys to fp, which must be opened in binary mode.
+	    The file starts with a 32-byte header (magic, byte order, key size, value size, number of pairs),
+	    followed by the raw bytes of the key and the value of each node.  Therefore, KeyClass and ValueClass
+	    must be trivially copyable.  Returns true if successful. */
+	bool Save(FILE *fp) const
+	{
+		static_assert(std::is_trivially_copyable <KeyClass>::value && std::is_trivially_copyable <ValueClass>::value,
+		              "Save and Load require trivially-copyable key and value classes.");
+
+		std::vector <unsigned char> buf;
+		buf.reserve(saveBufferSize+saveRecordSize);
+		MakeSaveHeader(buf,nElem);
+
+		// In-order traversal with an explicit stack.
+		std::vector <const Node *> stack;
+		const Node *nodePtr=root;
+		for(;;)
+		{
+			while(nullptr!=nodePtr)
+			{
+				stack.push_back(nodePtr);
+				nodePtr=nodePtr->left;
+			}
+			if(0==stack.size())
+			{
+				break;
+			}
+			nodePtr=stack.back();
+			stack.pop_back();
+
+			auto offset=buf.size();
+			buf.resize(offset+saveRecordSize);
+			memcpy(buf.data()+offset,&nodePtr->key,sizeof(KeyClass));
+			memcpy(buf.data()+offset+sizeof(KeyClass),&nodePtr->value,sizeof(ValueClass));
+			if(saveBufferSize<=buf.size())
+			{
+				if(buf.size()!=fwrite(buf.data(),1,buf.size(),fp))
+				{
+					return false;
+				}
+				buf.clear();
+			}
+
+			nodePtr=nodePtr->right;
+		}
+		return buf.size()==fwrite(buf.data(),1,buf.size(),fp);
+	}
+
+	/*! Re-builds this tree from a stream written by Save.  Existing contents are deleted.
+	    The pairs are already in order, therefore the tree is built perfectly balanced in one pass
+	    without comparing the keys or rotating.  Returns false and leaves the tree empty if the stream is broken,
+	    or if it was written for a different key size, value size, or byte order. */
+	bool Load(FILE *fp)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		static_assert(std::is_trivially_copyable <KeyClass>::value && std::is_trivially_copyable <ValueClass>::value,
+		              "Save and Load require trivially-copyable key and value classes.");
+		CleanUp();
+
+		unsigned char header[saveHeaderSize];
+		if(saveHeaderSize!=fread(header,1,saveHeaderSize,fp))
+		{
+			return false;
+		}
+		auto n=ReadSaveHeader(header);
+		if(n<0)
+		{
+			return false;
+		}
+
+		FileRecordReader reader(fp,n);
+		return LoadRecord(reader,n);
+	}
+
+	/*! Re-builds this tree from the bytes written by Save, for example, a memory-mapped file.
+	    The data does not have to be aligned. */
+	bool Load(const void *dataPtr,size_t dataSize)
+	{
+		static_assert(0!=BalancingPolicy::heightBalanced,"This function requires a height-based balancing policy.");
+		static_assert(std::is_trivially_copyable <KeyClass>::value && std::is_trivially_copyable <ValueClass>::value,
+		              "Save and Load require trivially-copyable key and value classes.");
+		CleanUp();
+
+		if(dataSize<saveHeaderSize)
+		{
+			return false;
+		}
+		auto bytePtr=(const unsigned char *)dataPtr;
+		auto n=ReadSaveHeader(bytePtr);
+		if(n<0 || (unsigned long long int)n>(dataSize-saveHeaderSize)/saveRecordSize)
+		{
+			return false;
+		}
+
+		MemoryRecordReader reader(bytePtr+saveHeaderSize);
+		return LoadRecord(reader,n);
+	}
+
+	/*! Maps the file written by Save into memory, and re-builds this tree from it.
+	    Reads the file normally where memory-mapping is not available. */
+	bool LoadMapped(const char fileName[])
+	{
+		BinaryTreeMappedFile mapped;
+		if(true!=mapped.Open(fileName))
+		{
+			CleanUp();
+			return false;
+		}
+		return Load(mapped.GetData(),mapped.GetSize());
+	}
+
+private:
+	enum
+	{
+		saveHeaderSize=32,
+		saveRecordSize=sizeof(KeyClass)+sizeof(ValueClass),
+		saveBufferSize=65536
+	};
+	static const char *SaveMagic(void)
+	{
+		return "YSBTREE";  // 7 letters and the terminator.
+	}
+	static unsigned int SaveByteOrderMark(void)
+	{
+		return 0x01020304;
+	}
+	static void MakeSaveHeader(std::vector <unsigned char> &buf,long long int n)
+	{
+		unsigned int byteOrder=SaveByteOrderMark();
+		unsigned int keySize=sizeof(KeyClass),valueSize=sizeof(ValueClass),reserved=0;
+		buf.resize(saveHeaderSize);
+		memcpy(buf.data(),SaveMagic(),8);
+		memcpy(buf.data()+8,&byteOrder,4);
+		memcpy(buf.data()+12,&keySize,4);
+		memcpy(buf.data()+16,&valueSize,4);
+		memcpy(buf.data()+20,&reserved,4);
+		memcpy(buf.data()+24,&n,8);
+	}
+	/* Returns the number of pairs, or -1 if the header does not match this tree. */
+	static long long int ReadSaveHeader(const unsigned char header[])
+	{
+		unsigned int byteOrder,keySize,valueSize;
+		long long int n;
+		memcpy(&byteOrder,header+8,4);
+		memcpy(&keySize,header+12,4);
+		memcpy(&valueSize,header+16,4);
+		memcpy(&n,header+24,8);
+		if(0!=memcmp(header,SaveMagic(),8) ||
+		   SaveByteOrderMark()!=byteOrder ||
+		   sizeof(KeyClass)!=keySize ||
+		   sizeof(ValueClass)!=valueSize ||
+		   n<0)
+		{
+			return -1;
+		}
+		return n;
+	}
+
+	/* Reads no more than nRemain records so that fp is left right after the saved tree. */
+	class FileRecordReader
+	{
+	private:
+		FILE *fp;
+		long long int nRemain;
+		std::vector <unsigned char> buf;
+		size_t bufUsed;
+	public:
+		FileRecordReader(FILE *fp,long long int nRemain) : fp(fp),nRemain(nRemain),bufUsed(0)
+		{
+		}
+		bool Read(Node *nodePtr)
+		{
+			if(buf.size()<=bufUsed)
+			{
+				long long int nRecord=std::min <long long int> (saveBufferSize/saveRecordSize+1,nRemain);
+				buf.resize((size_t)nRecord*saveRecordSize);
+				buf.resize(fread(buf.data(),1,buf.size(),fp)/saveRecordSize*saveRecordSize);
+				bufUsed=0;
+				nRemain-=buf.size()/saveRecordSize;
+				if(0==buf.size())
+				{
+					return false;
+				}
+			}
+			memcpy(&nodePtr->key,buf.data()+bufUsed,sizeof(KeyClass));
+			memcpy(&nodePtr->value,buf.data()+bufUsed+sizeof(KeyClass),sizeof(ValueClass));
+			bufUsed+=saveRecordSize;
+			return true;
+		}
+	};
+	class MemoryRecordReader
+	{
+	private:
+		const unsigned char *dataPtr;
+	public:
+		MemoryRecordReader(const unsigned char *dataPtr) : dataPtr(dataPtr)
+		{
+		}
+		bool Read(Node *nodePtr)
+		{
+			memcpy(&nodePtr->key,dataPtr,sizeof(KeyClass));
+			memcpy(&nodePtr->value,dataPtr+sizeof(KeyClass),sizeof(ValueClass));
+			dataPtr+=saveRecordSize;
+			return true;
+		}
+	};
+
+	template <class ReaderType>
+	bool LoadRecord(ReaderType &reader,long long int n)
+	{
+		bool error=false;
+		AttachAll(BuildFromRecord(reader,n,error));
+		if(true==error)
+		{
+			CleanUp();
+			return false;
+		}
+		return true;
+	}
+	/* Builds a perfectly-balanced sub-tree of n nodes by reading the pairs in order.
+	   Same shape as BuildBalanced.  If the reader runs out, the partial sub-tree is deleted and error is set. */
+	template <class ReaderType>
+	Node *BuildFromRecord(ReaderType &reader,long long int n,bool &error)
+	{
+		if(n<=0)
+		{
+			return nullptr;
+		}
+		auto leftPtr=BuildFromRecord(reader,n/2,error);
+		if(true==error)
+		{
+			CleanUp(leftPtr);
+			return nullptr;
+		}
+
+		auto nodePtr=new Node;
+		if(true!=reader.Read(nodePtr))
+		{
+			error=true;
+			CleanUp(leftPtr);
+			delete nodePtr;
+			return nullptr;
+		}
+
+		auto rightPtr=BuildFromRecord(reader,n-n/2-1,error);
+		if(true==error)
+		{
+			CleanUp(leftPtr);
+			delete nodePtr;
+			return nullptr;
+		}
+
+		SetChildren(nodePtr,leftPtr,rightPtr);
+		UpdateHeight(nodePtr);
+		return nodePtr;
+	}
+
+
+private:
+	class ForEachPiece
+	{
+	public:
+		Node *nodePtr;
+		bool wholeSubTree;
+	};
+	/* Cuts a sub-tree into pieces of at most pieceSize nodes in the in-order sequence. */
+	static void MakeForEachPiece(std::vector <ForEachPiece> &pieces,Node *nodePtr,long long int pieceSize)
+	{
+		while(nullptr!=nodePtr)
+		{
+			ForEachPiece piece;
+			piece.nodePtr=nodePtr;
+			piece.wholeSubTree=true;
+			if(nodePtr->size<=pieceSize)
+			{
+				pieces.push_back(piece);
+				return;
+			}
+			MakeForEachPiece(pieces,nodePtr->left,pieceSize);
+			piece.wholeSubTree=false;
+			pieces.push_back(piece);
+			nodePtr=nodePtr->right;
+		}
+	}
+
+	static int GetNumThread(int nThread)
+	{
+		if(nThread<=0)
+		{
+			nThread=(int)std::thread::hardware_concurrency();
+		}
+		return (nThread<1 ? 1 : nThread);
+	}
+	template <class WorkerType>
+	static void RunWorker(WorkerType &worker,int nThread)
+	{
+		std::vector <std::thread> threads;
+		for(int i=1; i<nThread; ++i)
+		{
+			threads.push_back(std::thread(std::ref(worker)));
+		}
+		worker();
+		for(auto &t : threads)
+		{
+			t.join();
+		}
+	}
+
+	static bool KeyValueLess(const std::pair <KeyClass,ValueClass> &a,const std::pair <KeyClass,ValueClass> &b)
+	{
+		return a.first<b.first;
+	}
+	/* Sorts nThread chunks concurrently, and then merges neighboring chunks concurrently until one chunk is left. */
+	static void ParallelSort(std::vector <std::pair <KeyClass,ValueClass> > &keyValue,int nThread)
+	{
+		const size_t n=keyValue.size();
+		if(nThread<=1 || n<(size_t)nThread*2)
+		{
+			std::sort(keyValue.begin(),keyValue.end(),KeyValueLess);
+			return;
+		}
+
+		std::vector <size_t> chunkTop;
+		for(int i=0; i<=nThread; ++i)
+		{
+			chunkTop.push_back(n*i/nThread);
+		}
+
+		std::vector <std::thread> threads;
+		for(int i=0; i<nThread; ++i)
+		{
+			threads.push_back(std::thread([&keyValue,&chunkTop,i]()
+			{
+				std::sort(keyValue.begin()+chunkTop[i],keyValue.begin()+chunkTop[i+1],KeyValueLess);
+			}));
+		}
+		for(auto &t : threads)
+		{
+			t.join();
+		}
+
+		for(size_t step=1; step<(size_t)nThread; step*=2)
+		{
+			threads.clear();
+			for(size_t i=0; i+step<(size_t)nThread; i+=step*2)
+			{
+				auto top=chunkTop[i];
+				auto mid=chunkTop[i+step];
+				auto end=chunkTop[std::min(i+step*2,(size_t)nThread)];
+				threads.push_back(std::thread([&keyValue,top,mid,end]()
+				{
+					std::inplace_merge(keyValue.begin()+top,keyValue.begin()+mid,keyValue.begin()+end,KeyValueLess);
+				}));
+			}
+			for(auto &t : threads)
+			{
+				t.join();
+			}
+		}
+	}
+	/* Builds a perfectly-balanced sub-tree from sorted keyValue[top] to keyValue[end-1].
+	   Until threadDepth reaches zero, the left half is built in a separate thread. */
+	static Node *BuildBalanced(const std::pair <KeyClass,ValueClass> keyValue[],long long int top,long long int end,int threadDepth)
+	{
+		if(end<=top)
+		{
+			return nullptr;
+		}
+		auto mid=top+(end-top)/2;
+		auto nodePtr=new Node;
+		nodePtr->key=keyValue[mid].first;
+		nodePtr->value=keyValue[mid].second;
+
+		Node *leftPtr=nullptr,*rightPtr=nullptr;
+		if(0<threadDepth && 1024<end-top)
+		{
+			std::thread leftThread([&leftPtr,keyValue,top,mid,threadDepth]()
+			{
+				leftPtr=BuildBalanced(keyValue,top,mid,threadDepth-1);
+			});
+			rightPtr=BuildBalanced(keyValue,mid+1,end,threadDepth-1);
+			leftThread.join();
+		}
+		else
+		{
+			leftPtr=BuildBalanced(keyValue,top,mid,0);
+			rightPtr=BuildBalanced(keyValue,mid+1,end,0);
+		}
+
+		SetChildren(nodePtr,leftPtr,rightPtr);
+		UpdateHeight(nodePtr);
+		return nodePtr;
+	}
+
+private:
+	Node *DetachAll(void)
+	{
+		auto nodePtr=root;
+		root=nullptr;
+		nElem=0;
+		++modificationCount;
+		return nodePtr;
+	}
+	void AttachAll(Node *nodePtr)
+	{
+		root=nodePtr;
+		nElem=0;
+		++modificationCount;
+		if(nullptr!=nodePtr)
+		{
+			nodePtr->up=nullptr;
+			nElem=nodePtr->size;
+		}
+	}
+
+	/* Joins two detached sub-trees with a pivot node, and returns the new sub-tree root.
+	   The rotation functions replace the root when they rotate at the top.  Therefore, the root
+	   pointer is borrowed while joining.  The tree must be detached (root==nullptr) when called. */
+	Node *JoinNode(Node *leftPtr,Node *pivot,Node *rightPtr)
+	{
+		int leftHeight=(nullptr!=leftPtr ? leftPtr->height : 0);
+		int rightHeight=(nullptr!=rightPtr ? rightPtr->height : 0);
+
+		pivot->up=nullptr;
+		if(leftHeight>rightHeight+1)
+		{
+			// Go down the right spine of the left tree until the sub-tree is short enough to be a sibling of the right tree.
+			auto upPtr=leftPtr;
+			while(nullptr!=upPtr->right && upPtr->right->height>rightHeight+1)
+			{
+				upPtr=upPtr->right;
+			}
+			SetChildren(pivot,upPtr->right,rightPtr);
+			upPtr->right=pivot;
+			pivot->up=upPtr;
+
+			root=leftPtr;
+			leftPtr->up=nullptr;
+			UpdateHeightCascade(pivot);
+			for(auto rebalancer=upPtr; nullptr!=rebalancer; rebalancer=rebalancer->up)
+			{
+				Rebalance(rebalancer);
+			}
+			return DetachAll();
+		}
+		else if(rightHeight>leftHeight+1)
+		{
+			auto upPtr=rightPtr;
+			while(nullptr!=upPtr->left && upPtr->left->height>leftHeight+1)
+			{
+				upPtr=upPtr->left;
+			}
+			SetChildren(pivot,leftPtr,upPtr->left);
+			upPtr->left=pivot;
+			pivot->up=upPtr;
+
+			root=rightPtr;
+			rightPtr->up=nullptr;
+			UpdateHeightCascade(pivot);
+			for(auto rebalancer=upPtr; nullptr!=rebalancer; rebalancer=rebalancer->up)
+			{
+				Rebalance(rebalancer);
+			}
+			return DetachAll();
+		}
+		else
+		{
+			SetChildren(pivot,leftPtr,rightPtr);
+			UpdateHeight(pivot);
+			return pivot;
+		}
+	}
+	static void SetChildren(Node *nodePtr,Node *leftPtr,Node *rightPtr)
+	{
+		nodePtr->left=leftPtr;
+		if(nullptr!=leftPtr)
+		{
+			leftPtr->up=nodePtr;
+		}
+		nodePtr->right=rightPtr;
+		if(nullptr!=rightPtr)
+		{
+			rightPtr->up=nodePtr;
+		}
+	}
+
+	/* Splits a detached sub-tree into keys less than the given key, and the rest. */
+	void SplitNode(Node *nodePtr,const KeyClass &key,Node *&leftPtr,Node *&rightPtr)
+	{
+		if(nullptr==nodePtr)
+		{
+			leftPtr=nullptr;
+			rightPtr=nullptr;
+			return;
+		}
+
+		auto leftOfNode=DetachChild(nodePtr->left);
+		auto rightOfNode=DetachChild(nodePtr->right);
+		if(nodePtr->key<key)
+		{
+			Node *leftOfRight;
+			SplitNode(rightOfNode,key,leftOfRight,rightPtr);
+			leftPtr=JoinNode(leftOfNode,nodePtr,leftOfRight);
+		}
+		else
+		{
+			Node *rightOfLeft;
+			SplitNode(leftOfNode,key,leftPtr,rightOfLeft);
+			rightPtr=JoinNode(rightOfLeft,nodePtr,rightOfNode);
+		}
+	}
+	/* Takes the right-most node out of a detached non-empty sub-tree, and returns the remaining sub-tree. */
+	Node *SplitLastNode(Node *nodePtr,Node *&lastPtr)
+	{
+		auto leftOfNode=DetachChild(nodePtr->left);
+		auto rightOfNode=DetachChild(nodePtr->right);
+		if(nullptr==rightOfNode)
+		{
+			lastPtr=nodePtr;
+			return leftOfNode;
+		}
+		rightOfNode=SplitLastNode(rightOfNode,lastPtr);
+		return JoinNode(leftOfNode,nodePtr,rightOfNode);
+	}
+	Node *UnionNode(Node *nodePtr,Node *incomingPtr)
+	{
+		if(nullptr==nodePtr)
+		{
+			return incomingPtr;
+		}
+		if(nullptr==incomingPtr)
+		{
+			return nodePtr;
+		}
+
+		auto leftOfNode=DetachChild(nodePtr->left);
+		auto rightOfNode=DetachChild(nodePtr->right);
+		Node *incomingLeft,*incomingRight;
+		SplitNode(incomingPtr,nodePtr->key,incomingLeft,incomingRight);
+
+		auto leftPtr=UnionNode(leftOfNode,incomingLeft);
+		auto rightPtr=UnionNode(rightOfNode,incomingRight);
+		return JoinNode(leftPtr,nodePtr,rightPtr);
+	}
+	static Node *DetachChild(Node *&childPtr)
+	{
+		auto nodePtr=childPtr;
+		childPtr=nullptr;
+		if(nullptr!=nodePtr)
+		{
+			nodePtr->up=nullptr;
+		}
+		return nodePtr;
+	}
+};
+
+/* } */
+#endif
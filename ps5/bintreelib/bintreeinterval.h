@@ -0,0 +1,143 @@
+#ifndef BINTREEINTERVAL_IS_INCLUDED
+#define BINTREEINTERVAL_IS_INCLUDED
+/* { */
+
+#include <vector>
+#include "bintree.h"
+
+/*! Closed interval [low,high] used as a key of BinaryIntervalTree.
+    Intervals are ordered by the low end, and then by the high end. */
+template <class CoordType>
+class BinaryTreeInterval
+{
+public:
+	CoordType low,high;
+
+	BinaryTreeInterval()
+	{
+	}
+	BinaryTreeInterval(CoordType low,CoordType high) : low(low),high(high)
+	{
+	}
+	bool operator<(const BinaryTreeInterval <CoordType> &incoming) const
+	{
+		return low<incoming.low || (!(incoming.low<low) && high<incoming.high);
+	}
+	bool operator==(const BinaryTreeInterval <CoordType> &incoming) const
+	{
+		return low==incoming.low && high==incoming.high;
+	}
+	bool Overlaps(CoordType qLow,CoordType qHigh) const
+	{
+		return !(high<qLow) && !(qHigh<low);
+	}
+};
+
+/*! Each node of an interval tree keeps the maximum high end in its sub-tree. */
+template <class CoordType>
+class BinaryTreeAugmentation <BinaryTreeInterval <CoordType> >
+{
+public:
+	CoordType maxHigh;
+
+	BinaryTreeAugmentation() : maxHigh(CoordType())
+	{
+	}
+	bool Update(
+	    const BinaryTreeInterval <CoordType> &key,
+	    const BinaryTreeAugmentation <BinaryTreeInterval <CoordType> > *left,
+	    const BinaryTreeAugmentation <BinaryTreeInterval <CoordType> > *right)
+	{
+		auto newMaxHigh=key.high;
+		if(nullptr!=left && newMaxHigh<left->maxHigh)
+		{
+			newMaxHigh=left->maxHigh;
+		}
+		if(nullptr!=right && newMaxHigh<right->maxHigh)
+		{
+			newMaxHigh=right->maxHigh;
+		}
+		if(newMaxHigh==maxHigh)
+		{
+			return false;
+		}
+		maxHigh=newMaxHigh;
+		return true;
+	}
+};
+
+/*! Interval tree.  Stores closed intervals, and answers which intervals contain a point, and which intervals
+    overlap a range.  A query visits only the sub-trees that may have an answer by using the maximum high end
+    of each sub-tree, and stops as soon as the low ends go beyond the query.
+    autoRebalancing is on by default since the bound of a query, given at FindOverlapping, holds only for a
+    balanced tree. */
+template <class CoordType,class ValueClass,class BalancingPolicy=BinaryTreeAVLPolicy>
+class BinaryIntervalTree : public BinaryTree <BinaryTreeInterval <CoordType>,ValueClass,BalancingPolicy>
+{
+public:
+	typedef BinaryTree <BinaryTreeInterval <CoordType>,ValueClass,BalancingPolicy> BASECLASS;
+	typedef typename BASECLASS::NodeHandle NodeHandle;
+	using BASECLASS::Insert;
+
+	BinaryIntervalTree()
+	{
+		this->autoRebalancing=true;
+	}
+
+	NodeHandle Insert(CoordType low,CoordType high,const ValueClass &value)
+	{
+		return Insert(BinaryTreeInterval <CoordType>(low,high),value);
+	}
+
+	/*! Returns the maximum high end of the sub-tree.  ndHd must not be null. */
+	CoordType GetMaxHigh(NodeHandle ndHd) const
+	{
+		return this->GetNode(ndHd)->augment.maxHigh;
+	}
+
+	/*! Adds the nodes whose interval contains point p to found, in the order of the intervals. */
+	void FindContaining(std::vector <NodeHandle> &found,CoordType p) const
+	{
+		FindOverlapping(found,p,p);
+	}
+
+	/*! Adds the nodes whose interval overlaps [qLow,qHigh] to found, in the order of the intervals.
+	    Every sub-tree the search enters has an interval that ends at or after qLow, and the search stops at
+	    the first interval that starts after qHigh.  Therefore, each visited node is an ancestor of an answer
+	    or on the path to the stopping point, and the search takes O(min(n,(k+1) log n)) for k answers in a
+	    balanced tree.  It is O(log n) if there are no answers, but it is not O(log n+k) when the answers are
+	    spread over the tree. */
+	void FindOverlapping(std::vector <NodeHandle> &found,CoordType qLow,CoordType qHigh) const
+	{
+		FindOverlapping(found,this->RootNode(),qLow,qHigh);
+	}
+
+private:
+	/* Returns false once an interval that starts after qHigh is found.  All the following intervals start after qHigh as well. */
+	bool FindOverlapping(std::vector <NodeHandle> &found,NodeHandle ndHd,CoordType qLow,CoordType qHigh) const
+	{
+		if(ndHd.IsNull() || GetMaxHigh(ndHd)<qLow)
+		{
+			// No interval of this sub-tree reaches qLow.
+			return true;
+		}
+		if(true!=FindOverlapping(found,this->Left(ndHd),qLow,qHigh))
+		{
+			return false;
+		}
+
+		auto &interval=this->GetKey(ndHd);
+		if(qHigh<interval.low)
+		{
+			return false;
+		}
+		if(true==interval.Overlaps(qLow,qHigh))
+		{
+			found.push_back(ndHd);
+		}
+		return FindOverlapping(found,this->Right(ndHd),qLow,qHigh);
+	}
+};
+
+/* } */
+#endif
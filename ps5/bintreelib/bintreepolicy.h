@@ -0,0 +1,297 @@
+#ifndef BINTREEPOLICY_IS_INCLUDED
+#define BINTREEPOLICY_IS_INCLUDED
+/* { */
+
+// Balancing policies for BinaryTree.
+//
+// A policy gives:
+//   NodeAttribute           Stored in every node.  Use an empty class if the policy does not need one.
+//   defaultAutoRebalancing  Initial value of BinaryTree::autoRebalancing.
+//   heightBalanced          Non-zero if the tree can be rebalanced by heights alone.  Split, Join, Union,
+//                           and BuildFromUnsorted are available only for such a policy.
+//   AfterInsert(tree,newNode)
+//                           Called after newNode is added as a leaf and the heights are updated.
+//   AfterRemove(tree,removedAttribute,childPtr,upPtr)
+//                           Called after a node is taken out of the tree.  childPtr is the node that took
+//                           the position of the removed node (may be nullptr), and upPtr is its parent.
+//   IsBalanced(rootPtr)     Returns true if the sub-tree satisfies the balance condition.  Used by
+//                           BinaryTree::CheckInvariant.
+//
+// The functions are called only when autoRebalancing is true.  Rotations are counted by the tree,
+// so that the policies can be compared by BinaryTree::GetRotationCount.
+
+/*! Does nothing.  Same as turning autoRebalancing off. */
+class BinaryTreeNoBalancingPolicy
+{
+public:
+	enum
+	{
+		defaultAutoRebalancing=0,
+		heightBalanced=1
+	};
+	class NodeAttribute
+	{
+	};
+
+	template <class TreeClass,class NodePtr>
+	static void AfterInsert(TreeClass &,NodePtr)
+	{
+	}
+	template <class TreeClass,class NodePtr>
+	static void AfterRemove(TreeClass &,const NodeAttribute &,NodePtr,NodePtr)
+	{
+	}
+	template <class NodePtr>
+	static bool IsBalanced(NodePtr)
+	{
+		return true;
+	}
+};
+
+/*! AVL tree.  Keeps the height difference of the two sub-trees of every node within one.
+    Shorter paths than red-black trees, and therefore good for read-heavy workloads.
+    autoRebalancing is off by default for compatibility, and can be turned on and off at any time. */
+class BinaryTreeAVLPolicy
+{
+public:
+	enum
+	{
+		defaultAutoRebalancing=0,
+		heightBalanced=1
+	};
+	class NodeAttribute
+	{
+	};
+
+	template <class TreeClass,class NodePtr>
+	static void AfterInsert(TreeClass &tree,NodePtr newNode)
+	{
+		for(auto rebalancer=newNode->up; nullptr!=rebalancer; rebalancer=rebalancer->up)
+		{
+			tree.Rebalance(rebalancer);
+		}
+	}
+	template <class TreeClass,class NodePtr>
+	static void AfterRemove(TreeClass &tree,const NodeAttribute &,NodePtr,NodePtr upPtr)
+	{
+		for(auto rebalancer=upPtr; nullptr!=rebalancer; rebalancer=rebalancer->up)
+		{
+			tree.Rebalance(rebalancer);
+		}
+	}
+	template <class NodePtr>
+	static bool IsBalanced(NodePtr nodePtr)
+	{
+		if(nullptr==nodePtr)
+		{
+			return true;
+		}
+		int leftHeight=(nullptr!=nodePtr->left ? nodePtr->left->height : 0);
+		int rightHeight=(nullptr!=nodePtr->right ? nodePtr->right->height : 0);
+		return leftHeight-1<=rightHeight && rightHeight-1<=leftHeight &&
+		       true==IsBalanced(nodePtr->left) && true==IsBalanced(nodePtr->right);
+	}
+};
+
+/*! Red-black tree.  At most two rotations per insertion and three per deletion, and therefore good for
+    write-heavy workloads.  The color of a node is meaningful only if autoRebalancing has been on since
+    the tree was empty.  Therefore, autoRebalancing is on by default, and must not be turned on for
+    a non-empty tree. */
+class BinaryTreeRedBlackPolicy
+{
+public:
+	enum
+	{
+		defaultAutoRebalancing=1,
+		heightBalanced=0
+	};
+	class NodeAttribute
+	{
+	public:
+		bool red;
+		NodeAttribute() : red(true)
+		{
+		}
+	};
+
+	template <class NodePtr>
+	static bool IsRed(NodePtr nodePtr)
+	{
+		return nullptr!=nodePtr && true==nodePtr->balance.red;
+	}
+
+	template <class TreeClass,class NodePtr>
+	static void AfterInsert(TreeClass &tree,NodePtr nodePtr)
+	{
+		// See Cormen et al., Introduction to Algorithms, RB-INSERT-FIXUP.
+		while(true==IsRed(nodePtr->up))
+		{
+			// The parent is red, therefore it is not the root, and the grand parent exists.
+			auto upPtr=nodePtr->up;
+			auto grandPtr=upPtr->up;
+			if(upPtr==grandPtr->left)
+			{
+				auto unclePtr=grandPtr->right;
+				if(true==IsRed(unclePtr))
+				{
+					upPtr->balance.red=false;
+					unclePtr->balance.red=false;
+					grandPtr->balance.red=true;
+					nodePtr=grandPtr;
+				}
+				else
+				{
+					if(nodePtr==upPtr->right)
+					{
+						tree.RotateLeft_PointerRebalanced(upPtr);
+						upPtr=nodePtr;
+					}
+					upPtr->balance.red=false;
+					grandPtr->balance.red=true;
+					tree.RotateRight_PointerRebalanced(grandPtr);
+					break;
+				}
+			}
+			else
+			{
+				auto unclePtr=grandPtr->left;
+				if(true==IsRed(unclePtr))
+				{
+					upPtr->balance.red=false;
+					unclePtr->balance.red=false;
+					grandPtr->balance.red=true;
+					nodePtr=grandPtr;
+				}
+				else
+				{
+					if(nodePtr==upPtr->left)
+					{
+						tree.RotateRight_PointerRebalanced(upPtr);
+						upPtr=nodePtr;
+					}
+					upPtr->balance.red=false;
+					grandPtr->balance.red=true;
+					tree.RotateLeft_PointerRebalanced(grandPtr);
+					break;
+				}
+			}
+		}
+		tree.root->balance.red=false;
+	}
+
+	template <class TreeClass,class NodePtr>
+	static void AfterRemove(TreeClass &tree,const NodeAttribute &removed,NodePtr childPtr,NodePtr upPtr)
+	{
+		if(true==removed.red)
+		{
+			return;
+		}
+
+		// See Cormen et al., Introduction to Algorithms, RB-DELETE-FIXUP.
+		// childPtr carries an extra black.  It can be nullptr, but then its sibling cannot be nullptr
+		// because the removed black node was counted in the black height of the sibling side.
+		while(nullptr!=upPtr && true!=IsRed(childPtr))
+		{
+			if(childPtr==upPtr->left)
+			{
+				auto siblingPtr=upPtr->right;
+				if(true==IsRed(siblingPtr))
+				{
+					siblingPtr->balance.red=false;
+					upPtr->balance.red=true;
+					tree.RotateLeft_PointerRebalanced(upPtr);
+					siblingPtr=upPtr->right;
+				}
+				if(true!=IsRed(siblingPtr->left) && true!=IsRed(siblingPtr->right))
+				{
+					siblingPtr->balance.red=true;
+					childPtr=upPtr;
+					upPtr=childPtr->up;
+				}
+				else
+				{
+					if(true!=IsRed(siblingPtr->right))
+					{
+						siblingPtr->left->balance.red=false;
+						siblingPtr->balance.red=true;
+						tree.RotateRight_PointerRebalanced(siblingPtr);
+						siblingPtr=upPtr->right;
+					}
+					siblingPtr->balance.red=upPtr->balance.red;
+					upPtr->balance.red=false;
+					siblingPtr->right->balance.red=false;
+					tree.RotateLeft_PointerRebalanced(upPtr);
+					childPtr=tree.root;
+					break;
+				}
+			}
+			else
+			{
+				auto siblingPtr=upPtr->left;
+				if(true==IsRed(siblingPtr))
+				{
+					siblingPtr->balance.red=false;
+					upPtr->balance.red=true;
+					tree.RotateRight_PointerRebalanced(upPtr);
+					siblingPtr=upPtr->left;
+				}
+				if(true!=IsRed(siblingPtr->left) && true!=IsRed(siblingPtr->right))
+				{
+					siblingPtr->balance.red=true;
+					childPtr=upPtr;
+					upPtr=childPtr->up;
+				}
+				else
+				{
+					if(true!=IsRed(siblingPtr->left))
+					{
+						siblingPtr->right->balance.red=false;
+						siblingPtr->balance.red=true;
+						tree.RotateLeft_PointerRebalanced(siblingPtr);
+						siblingPtr=upPtr->left;
+					}
+					siblingPtr->balance.red=upPtr->balance.red;
+					upPtr->balance.red=false;
+					siblingPtr->left->balance.red=false;
+					tree.RotateRight_PointerRebalanced(upPtr);
+					childPtr=tree.root;
+					break;
+				}
+			}
+		}
+		if(nullptr!=childPtr)
+		{
+			childPtr->balance.red=false;
+		}
+	}
+
+	template <class NodePtr>
+	static bool IsBalanced(NodePtr rootPtr)
+	{
+		return true!=IsRed(rootPtr) && 0<=GetBlackHeight(rootPtr);
+	}
+	/* Returns the black height of the sub-tree, or -1 if a red node has a red child or
+	   the black heights of the two sides do not match. */
+	template <class NodePtr>
+	static int GetBlackHeight(NodePtr nodePtr)
+	{
+		if(nullptr==nodePtr)
+		{
+			return 0;
+		}
+		if(true==IsRed(nodePtr) && (true==IsRed(nodePtr->left) || true==IsRed(nodePtr->right)))
+		{
+			return -1;
+		}
+		int leftBlackHeight=GetBlackHeight(nodePtr->left);
+		int rightBlackHeight=GetBlackHeight(nodePtr->right);
+		if(leftBlackHeight<0 || leftBlackHeight!=rightBlackHeight)
+		{
+			return -1;
+		}
+		return leftBlackHeight+(true==IsRed(nodePtr) ? 0 : 1);
+	}
+};
+
+/* } */
+#endif
@@ -5,11 +5,11 @@ int main(void)
 {
 	BinaryTree <int, int> tree;
 
-	auto first_val = tree->First();
-	auto findnext_first_val = tree->FindPrev(first_val);
+	auto first_val = tree.First();
+	auto findnext_first_val = tree.FindPrev(first_val);
 
-	auto last_val = tree->Last();
-	auto findnext_last_val = tree->FindNext(last_val);
+	auto last_val = tree.Last();
+	auto findnext_last_val = tree.FindNext(last_val);
 
 	if (findnext_first_val.IsNotNull())
 	{